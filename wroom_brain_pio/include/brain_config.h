@@ -23,6 +23,177 @@
 #define TELEGRAM_POLL_MS 3000
 #endif
 
+// getUpdates long-poll wait (seconds). Telegram holds the request open until an
+// update arrives or the timeout expires. 0 = legacy short polling every TELEGRAM_POLL_MS.
+#ifndef TELEGRAM_LONG_POLL_S
+#define TELEGRAM_LONG_POLL_S 25
+#endif
+// The poll read timeout, (TELEGRAM_LONG_POLL_S + 10) s in ms, must fit in
+// HTTPClient's uint16_t.
+static_assert(TELEGRAM_LONG_POLL_S >= 0 && TELEGRAM_LONG_POLL_S <= 55,
+              "TELEGRAM_LONG_POLL_S must be 0..55");
+
+// Max updates fetched per getUpdates call
+#ifndef TELEGRAM_POLL_BATCH_LIMIT
+#define TELEGRAM_POLL_BATCH_LIMIT 10
+#endif
+
+// Webhook mode: Telegram POSTs updates to http://<device>/tg/<secret> (via a
+// tunnel or reverse proxy). Empty secret = route disabled, polling only.
+// Allowed characters: A-Z a-z 0-9 _ -
+#ifndef TELEGRAM_WEBHOOK_SECRET
+#define TELEGRAM_WEBHOOK_SECRET ""
+#endif
+
+// Public base URL (e.g. "https://bot.example.com") to register with setWebhook
+// at boot. Empty = register the webhook yourself.
+#ifndef TELEGRAM_WEBHOOK_URL
+#define TELEGRAM_WEBHOOK_URL ""
+#endif
+
+#ifndef TELEGRAM_WEBHOOK_MAX_BODY
+#define TELEGRAM_WEBHOOK_MAX_BODY 16384
+#endif
+
+// Webhook updates waiting for the poller to dispatch them; when full, the
+// route answers an error and Telegram redelivers later.
+#ifndef TELEGRAM_WEBHOOK_QUEUE_DEPTH
+#define TELEGRAM_WEBHOOK_QUEUE_DEPTH 4
+#endif
+
+// While a webhook is set, getUpdates answers 409; the poller then only
+// checks back this often in case the webhook is removed.
+#ifndef TELEGRAM_WEBHOOK_POLL_BACKOFF_MS
+#define TELEGRAM_WEBHOOK_POLL_BACKOFF_MS 60000
+#endif
+
+// Keep-alive HTTPS connection pool (see http_pool.h), shared by Telegram
+// and the LLM providers. Each open TLS session costs ~40KB of heap, so two
+// slots hold at most ~80KB; idle slots are rebound to whichever host needs
+// one, and a request finding both busy uses a one-shot connection.
+#ifndef HTTP_POOL_SLOTS
+#define HTTP_POOL_SLOTS 2
+#endif
+
+// Close pooled connections idle longer than this (servers drop them anyway)
+#ifndef HTTP_POOL_IDLE_MS
+#define HTTP_POOL_IDLE_MS 45000
+#endif
+
+// Force a fresh connection after this age
+#ifndef HTTP_POOL_MAX_AGE_MS
+#define HTTP_POOL_MAX_AGE_MS 600000
+#endif
+
+// TLS session resumption cache (see tls_session_cache.h). Each entry holds a
+// session ticket plus the peer certificate, a few KB.
+#ifndef TLS_SESSION_CACHE_SIZE
+#define TLS_SESSION_CACHE_SIZE 4
+#endif
+
+// Discard cached sessions older than this; servers expire tickets anyway
+#ifndef TLS_SESSION_TTL_MS
+#define TLS_SESSION_TTL_MS 3600000
+#endif
+
+// Agent worker tasks. Each source (Telegram, web dashboard, scheduler) is
+// handled by one worker at a time; different sources run in parallel.
+#ifndef AGENT_WORKERS
+#define AGENT_WORKERS 2
+#endif
+
+// Pending messages per source
+#ifndef AGENT_QUEUE_DEPTH
+#define AGENT_QUEUE_DEPTH 10
+#endif
+
+// Preallocated slots for queued message text (bytes each, incl. 3 bytes of
+// header/NUL). Longer messages, or any once the arena is full, are copied
+// to the heap when AGENT_MSG_OVERFLOW_HEAP is 1 and dropped when it is 0.
+#ifndef AGENT_MSG_SLOTS
+#define AGENT_MSG_SLOTS 8
+#endif
+
+#ifndef AGENT_MSG_SLOT_BYTES
+#define AGENT_MSG_SLOT_BYTES 512
+#endif
+
+#ifndef AGENT_MSG_OVERFLOW_HEAP
+#define AGENT_MSG_OVERFLOW_HEAP 1
+#endif
+
+// Waiting this long promotes a queued job one priority class
+// (background -> reminder -> interactive), so nothing starves. 0 = never
+#ifndef AGENT_AGING_MS
+#define AGENT_AGING_MS 60000
+#endif
+
+// Time budget for one queued message, counted from when it was queued.
+// Network timeouts are capped to what is left; `cancel` stops it early.
+#ifndef AGENT_REQUEST_TIMEOUT_MS
+#define AGENT_REQUEST_TIMEOUT_MS 240000
+#endif
+
+// Chat messages and background jobs that waited longer than this in the
+// queue are dropped (chat with a short notice). 0 = never
+#ifndef AGENT_QUEUE_STALE_MS
+#define AGENT_QUEUE_STALE_MS 120000
+#endif
+
+// Outbound Telegram queue (messages/documents sent by a background task)
+#ifndef TELEGRAM_OUTBOX_DEPTH
+#define TELEGRAM_OUTBOX_DEPTH 16
+#endif
+
+// Per-chat limit: bursts of TELEGRAM_OUTBOX_CHAT_BURST, then one send per interval
+#ifndef TELEGRAM_OUTBOX_CHAT_INTERVAL_MS
+#define TELEGRAM_OUTBOX_CHAT_INTERVAL_MS 1000
+#endif
+
+#ifndef TELEGRAM_OUTBOX_CHAT_BURST
+#define TELEGRAM_OUTBOX_CHAT_BURST 3
+#endif
+
+// Bot-wide limit (Telegram allows ~30 messages/second)
+#ifndef TELEGRAM_OUTBOX_GLOBAL_PER_SEC
+#define TELEGRAM_OUTBOX_GLOBAL_PER_SEC 25
+#endif
+
+// Queued short messages to the same chat are merged up to this many bytes
+#ifndef TELEGRAM_OUTBOX_MERGE_MAX
+#define TELEGRAM_OUTBOX_MERGE_MAX 3800
+#endif
+
+// Failed sends (network errors, 5xx) are retried with exponential backoff
+#ifndef TELEGRAM_OUTBOX_MAX_ATTEMPTS
+#define TELEGRAM_OUTBOX_MAX_ATTEMPTS 4
+#endif
+
+#ifndef TELEGRAM_OUTBOX_BACKOFF_MS
+#define TELEGRAM_OUTBOX_BACKOFF_MS 500
+#endif
+
+// An item held back by 429 retry_after for longer than this in total is
+// dropped, so one throttled chat cannot stall the queue indefinitely.
+#ifndef TELEGRAM_OUTBOX_MAX_THROTTLE_MS
+#define TELEGRAM_OUTBOX_MAX_THROTTLE_MS 60000
+#endif
+
+// Show chat replies in Telegram while the LLM is still generating them
+// (one message, updated with editMessageText)
+#ifndef TELEGRAM_STREAM_REPLIES
+#define TELEGRAM_STREAM_REPLIES 1
+#endif
+
+// Minimum gap between live edits, and new characters needed before one
+#ifndef TELEGRAM_STREAM_EDIT_MS
+#define TELEGRAM_STREAM_EDIT_MS 1500
+#endif
+
+#ifndef TELEGRAM_STREAM_EDIT_CHARS
+#define TELEGRAM_STREAM_EDIT_CHARS 200
+#endif
+
 #ifndef AUTONOMOUS_STATUS_ENABLED
 #define AUTONOMOUS_STATUS_ENABLED 0
 #endif
@@ -72,6 +243,12 @@
 #define LLM_TIMEOUT_MS 180000
 #endif
 
+// Mark the stable head of system prompts as cacheable (Anthropic
+// cache_control). OpenAI, GLM and Gemini cache a repeated prefix on their own.
+#ifndef LLM_PROMPT_CACHE
+#define LLM_PROMPT_CACHE 1
+#endif
+
 // Image generation provider (separate from chat LLM)
 #ifndef IMAGE_PROVIDER
 #define IMAGE_PROVIDER "none"
@@ -135,6 +312,27 @@
 #define PROACTIVE_INTERVAL_MS 7200000  // 2 hours
 #endif
 
+// Auto-learn: personal facts for USER.md are extracted in batches when the
+// agent is idle, one LLM call per batch of up to AUTO_LEARN_BATCH_MAX
+// messages; a smaller batch is flushed after AUTO_LEARN_FLUSH_MS.
+#ifndef AUTO_LEARN_ENABLED
+#define AUTO_LEARN_ENABLED 1
+#endif
+
+#ifndef AUTO_LEARN_BATCH_MAX
+#define AUTO_LEARN_BATCH_MAX 5
+#endif
+
+#ifndef AUTO_LEARN_FLUSH_MS
+#define AUTO_LEARN_FLUSH_MS 600000
+#endif
+
+// Log which dispatch stages each tool command went through, and how long
+// it took.
+#ifndef TOOL_DISPATCH_TRACE
+#define TOOL_DISPATCH_TRACE 1
+#endif
+
 #ifndef TIMEZONE_TZ
 #define TIMEZONE_TZ "UTC0"
 #endif
@@ -233,6 +431,27 @@
 #define ENABLE_MEDIA_UNDERSTANDING 1
 #endif
 
+// Largest photo/document streamed to the vision model. Media is base64-encoded
+// on the fly, so this bounds upload time, not RAM. Telegram bots can't
+// download files over 20MB.
+#ifndef MEDIA_MAX_BYTES
+#define MEDIA_MAX_BYTES 10485760
+#endif
+
+// Downloaded media is kept on SPIFFS (LRU, keyed by Telegram file_unique_id)
+// so follow-up questions about the same file skip the download.
+#ifndef ENABLE_MEDIA_CACHE
+#define ENABLE_MEDIA_CACHE 1
+#endif
+
+#ifndef MEDIA_CACHE_MAX_BYTES
+#define MEDIA_CACHE_MAX_BYTES 262144
+#endif
+
+#ifndef MEDIA_CACHE_MAX_ENTRIES
+#define MEDIA_CACHE_MAX_ENTRIES 8
+#endif
+
 // Task management system
 #ifndef ENABLE_TASKS
 #define ENABLE_TASKS 1
@@ -52,6 +52,9 @@ if missing:
     Exit(1)
 
 poll_ms = parsed.get("TELEGRAM_POLL_MS", "3000")
+long_poll_s = parsed.get("TELEGRAM_LONG_POLL_S", "25")
+webhook_secret = parsed.get("TELEGRAM_WEBHOOK_SECRET", "")
+webhook_url = parsed.get("TELEGRAM_WEBHOOK_URL", "")
 status_enabled = parsed.get("AUTONOMOUS_STATUS_ENABLED", "0")
 status_ms = parsed.get("AUTONOMOUS_STATUS_MS", "30000")
 llm_timeout_ms = parsed.get("LLM_TIMEOUT_MS", "25000")
@@ -84,6 +87,7 @@ email_from = parsed.get("EMAIL_FROM", parsed.get("RESEND_FROM_EMAIL", "onboardin
 
 if (
     not poll_ms.isdigit()
+    or not long_poll_s.isdigit()
     or not status_enabled.isdigit()
     or not status_ms.isdigit()
     or not llm_timeout_ms.isdigit()
@@ -100,7 +104,7 @@ if (
     or not web_job_timeout_ms.isdigit()
 ):
     print(
-        "[env] TELEGRAM_POLL_MS, AUTONOMOUS_STATUS_ENABLED, AUTONOMOUS_STATUS_MS, "
+        "[env] TELEGRAM_POLL_MS, TELEGRAM_LONG_POLL_S, AUTONOMOUS_STATUS_ENABLED, AUTONOMOUS_STATUS_MS, "
         "LLM_TIMEOUT_MS, MEMORY_MAX_CHARS, HEARTBEAT_ENABLED, HEARTBEAT_INTERVAL_MS, "
         "SOUL_MAX_CHARS, HEARTBEAT_MAX_CHARS, REMINDER_MSG_MAX_CHARS, and "
         "REMINDER_GRACE_MINUTES, TASKS_MAX_CHARS, WEB_SEARCH_TIMEOUT_MS, "
@@ -108,6 +112,11 @@ if (
     )
     Exit(1)
 
+# Telegram only accepts these characters in secret_token; it is also a URL path segment.
+if webhook_secret and not all(c.isalnum() or c in "_-" for c in webhook_secret):
+    print("[env] TELEGRAM_WEBHOOK_SECRET may only contain A-Z, a-z, 0-9, _ and -.")
+    Exit(1)
+
 llm_provider = parsed.get("LLM_PROVIDER", "none")
 llm_api_key = parsed.get("LLM_API_KEY", "")
 llm_model = parsed.get("LLM_MODEL", "")
@@ -130,6 +139,9 @@ generated_header.write_text(
             f"#define TELEGRAM_BOT_TOKEN {cpp_quoted(parsed['TELEGRAM_BOT_TOKEN'])}",
             f"#define TELEGRAM_ALLOWED_CHAT_ID {cpp_quoted(parsed['TELEGRAM_ALLOWED_CHAT_ID'])}",
             f"#define TELEGRAM_POLL_MS {poll_ms}",
+            f"#define TELEGRAM_LONG_POLL_S {long_poll_s}",
+            f"#define TELEGRAM_WEBHOOK_SECRET {cpp_quoted(webhook_secret)}",
+            f"#define TELEGRAM_WEBHOOK_URL {cpp_quoted(webhook_url)}",
             f"#define AUTONOMOUS_STATUS_ENABLED {status_enabled}",
             f"#define AUTONOMOUS_STATUS_MS {status_ms}",
             f"#define LLM_PROVIDER {cpp_quoted(llm_provider)}",
@@ -1,26 +1,38 @@
 #include "agent_loop.h"
 
 #include <Arduino.h>
-#include <freertos/queue.h>
+#include <WiFi.h>
+#include <freertos/semphr.h>
 #include <freertos/task.h>
+#include <utility>
 
+#include "agent_queue.h"
+#include "auto_learn.h"
 #include "brain_config.h"
 #include "cron_store.h"
 #include "scheduler.h"
 #include "chat_history.h"
+#include "code_scan.h"
 #include "memory_store.h"
 #include "file_memory.h"
+#include "http_pool.h"
+#include "intent.h"
 #include "llm_client.h"
+#include "media_cache.h"
 #include "model_config.h"
 #include "persona_store.h"
 #include "event_log.h"
 #include "status_led.h"
 #include "task_store.h"
+#include "telegram_live_reply.h"
+#include "telegram_outbox.h"
+#include "tls_session_cache.h"
 #include "tool_registry.h"
 #include "transport_telegram.h"
 #include "usage_stats.h"
 #include "web_server.h"
 #include "react_agent.h"
+#include "request_ctx.h"
 #include "skill_registry.h"
 #include "minos/minos.h"
 
@@ -29,24 +41,41 @@ static String s_last_llm_response = "";
 // Store last generated code file for hosting/iteration
 static String s_last_generated_code = "";
 static String s_last_generated_filename = "";
-
-// Agent Task Logic
-struct AgentTaskMsg {
-  char *msg_ptr;
-  bool from_telegram;
+// Guards the three strings above; workers and tools read them concurrently.
+static SemaphoreHandle_t s_state_mutex = NULL;
+
+// Per-worker state. The chat reply being streamed into Telegram belongs to
+// the worker handling it.
+struct AgentWorker {
+  TaskHandle_t handle;
+  TelegramLiveReply live_reply;
+  bool stream_to_telegram;
 };
-static QueueHandle_t s_agent_queue = NULL;
+static AgentWorker s_workers[AGENT_WORKERS];
 
 static void send_reply_via_telegram(const String &outgoing);
-static bool send_document_with_retry(const String &filename, const String &content,
-                                     const String &mime_type, const String &caption) {
-  for (int attempt = 0; attempt < 3; attempt++) {
-    if (transport_telegram_send_document(filename, content, mime_type, caption)) {
-      return true;
+static void record_bot_msg(const String &outgoing);
+
+static void lock_state() {
+  if (s_state_mutex != NULL) {
+    xSemaphoreTake(s_state_mutex, portMAX_DELAY);
+  }
+}
+
+static void unlock_state() {
+  if (s_state_mutex != NULL) {
+    xSemaphoreGive(s_state_mutex);
+  }
+}
+
+static AgentWorker *current_worker() {
+  const TaskHandle_t self = xTaskGetCurrentTaskHandle();
+  for (int i = 0; i < AGENT_WORKERS; i++) {
+    if (s_workers[i].handle == self) {
+      return &s_workers[i];
     }
-    delay(180 + (attempt * 120));
   }
-  return false;
+  return NULL;
 }
 
 // MinOS Kernel Task
@@ -58,44 +87,100 @@ static void minos_task_code(void *pvParameters) {
   vTaskDelete(NULL);
 }
 
+// A chat message that sat in the queue this long is answered with a notice
+// instead; the user has likely moved on. Background jobs come round again
+// on the next scheduler tick. Reminders and cron commands always run.
+static bool job_is_stale(const AgentJob &job) {
+  return AGENT_QUEUE_STALE_MS > 0 && job.job_class != AGENT_CLASS_REMINDER &&
+         millis() - job.enqueued_ms > AGENT_QUEUE_STALE_MS;
+}
+
+static void drop_stale_job(const AgentJob &job) {
+  const unsigned long waited_s = (millis() - job.enqueued_ms) / 1000UL;
+  Serial.printf("[agent] dropping stale job after %lus: %s\n", waited_s, job.msg);
+  event_log_append("STALE: " + String(job.msg).substring(0, 60));
+  if (job.job_class != AGENT_CLASS_INTERACTIVE) {
+    return;
+  }
+  String preview = String(job.msg).substring(0, 40);
+  if (strlen(job.msg) > 40) {
+    preview += "...";
+  }
+  const String notice =
+      "⏳ Skipped \"" + preview + "\": it waited " + String(waited_s) + "s in the queue. Send it again if still needed.";
+  record_bot_msg(notice);
+  if (job.source == AGENT_SOURCE_TELEGRAM) {
+    transport_telegram_send(notice);
+  }
+}
+
 static void agent_task_code(void *param) {
-  AgentTaskMsg item;
+  AgentWorker &worker = *(AgentWorker *)param;
+  worker.handle = xTaskGetCurrentTaskHandle();
+  AgentJob job;
   while (true) {
-    if (xQueueReceive(s_agent_queue, &item, portMAX_DELAY)) {
-      if (item.msg_ptr) {
-        String msg = String(item.msg_ptr);
-        free(item.msg_ptr); // Free heap copy
-        
-        // Process message (blocking is fine in this task)
-        String reply = agent_loop_process_message(msg);
-        
-        if (item.from_telegram && reply.length() > 0) {
-           send_reply_via_telegram(reply);
-        }
+    agent_queue_take(job);
+    if (job.msg && job_is_stale(job)) {
+      drop_stale_job(job);
+    } else if (job.msg) {
+      const String msg = String(job.msg);
+
+      // Web chats read their reply from history; everything else answers in Telegram.
+      const bool reply_to_telegram = job.source != AGENT_SOURCE_WEB;
+      telegram_live_reply_begin(worker.live_reply);
+      worker.stream_to_telegram = job.source == AGENT_SOURCE_TELEGRAM && TELEGRAM_STREAM_REPLIES;
+      // The budget counts from when the message was queued.
+      request_ctx_begin(job.source, job.enqueued_ms + AGENT_REQUEST_TIMEOUT_MS);
+
+      // Process message (blocking is fine in this task)
+      String reply = agent_loop_process_message(msg);
+      worker.stream_to_telegram = false;
+
+      if (reply_to_telegram && reply.length() > 0) {
+         send_reply_via_telegram(reply);
+      }
+      // Nothing replaced the placeholder (empty reply).
+      if (telegram_live_reply_active(worker.live_reply)) {
+        telegram_live_reply_finish(worker.live_reply, "(no reply)");
       }
+      request_ctx_end();
     }
+    agent_queue_done(job);
   }
 }
 
 String agent_loop_get_last_response() {
-  return s_last_llm_response;
+  lock_state();
+  const String out = s_last_llm_response;
+  unlock_state();
+  return out;
 }
 
 void agent_loop_set_last_response(const String &response) {
+  lock_state();
   s_last_llm_response = response;
+  unlock_state();
 }
 
 String agent_loop_get_last_file_content() {
-  return s_last_generated_code;
+  lock_state();
+  const String out = s_last_generated_code;
+  unlock_state();
+  return out;
 }
 
 String agent_loop_get_last_file_name() {
-  return s_last_generated_filename;
+  lock_state();
+  const String out = s_last_generated_filename;
+  unlock_state();
+  return out;
 }
 
-void agent_loop_set_last_file(const String &name, const String &content) {
+void agent_loop_set_last_file(const String &name, String content) {
+  lock_state();
   s_last_generated_filename = name;
-  s_last_generated_code = content;
+  s_last_generated_code = std::move(content);
+  unlock_state();
 }
 
 static bool is_internal_dispatch_message(const String &msg) {
@@ -103,45 +188,7 @@ static bool is_internal_dispatch_message(const String &msg) {
   lc.trim();
   lc.toLowerCase();
   return lc == "heartbeat_run" || lc == "reminder_run" || lc == "proactive_check" ||
-         lc == "status";
-}
-
-static bool should_try_route(const String &msg) {
-  String lc = msg;
-  lc.trim();
-  lc.toLowerCase();
-  if (lc.length() == 0 || lc.startsWith("/")) {
-    return false;
-  }
-
-  const char *prefixes[] = {
-      "set ",       "show ",      "list ",      "add ",       "delete ",    "clear ",
-      "turn ",      "switch ",    "enable ",    "disable ",   "remind ",    "schedule ",
-      "search ",    "look up ",   "find ",      "google ",    "status",     "health",
-      "logs",       "time",       "timezone",   "task ",      "memory",     "remember ",
-      "forget",     "flash ",     "blink ",     "led ",       "sensor ",    "relay ",
-      "safe mode",  "email ",     "plan ",      "confirm",    "cancel",      "create ",
-      "build ",     "make ",      "generate ",  "update",     "upgrade",    "firmware",
-      "website",    "html",       "web ",       "saas",       "landing",    "portfolio",
-      "host ",      "serve ",     "deploy ",
-      "what ",      "who ",       "tell me",    "explain",    "define",
-  };
-
-  for (size_t i = 0; i < (sizeof(prefixes) / sizeof(prefixes[0])); i++) {
-    String p = String(prefixes[i]);
-    if (lc == p || lc.startsWith(p)) {
-      return true;
-    }
-  }
-
-  if (lc.indexOf("every day") >= 0 || lc.indexOf("everyday") >= 0 || lc.indexOf("daily") >= 0 ||
-      lc.indexOf("at ") >= 0 || lc.indexOf("reminder") >= 0 || lc.indexOf("web search") >= 0 ||
-      lc.indexOf("update") >= 0 || lc.indexOf("upgrade") >= 0 || lc.indexOf("firmware") >= 0 ||
-      lc.indexOf("new version") >= 0 || lc.indexOf("latest") >= 0) {
-    return true;
-  }
-
-  return false;
+         lc == "status" || lc == "auto_learn_run";
 }
 
 static void record_user_msg(const String &incoming) {
@@ -157,192 +204,33 @@ static void record_bot_msg(const String &outgoing) {
   chat_history_append('A', outgoing, err);
 }
 
-// Detect language from code content if not specified
-static String detect_language_from_content(const String &code) {
-  String lc = code;
-  lc.toLowerCase();
-
-  // HTML patterns
-  if (lc.indexOf("<!doctype html") >= 0 || lc.indexOf("<html") >= 0 || lc.indexOf("<div") >= 0 || lc.indexOf("<body") >= 0) {
-    // Check if it also has script/style tags (might be full HTML)
-    if (lc.indexOf("<style") >= 0 || lc.indexOf("<script") >= 0) {
-      return "html_full";
-    }
-    return "html";
-  }
-
-  // CSS patterns
-  if (lc.indexOf("{") >= 0 && lc.indexOf("}") >= 0 && lc.indexOf(":") >= 0 &&
-      (lc.indexOf("margin") >= 0 || lc.indexOf("padding") >= 0 ||
-       lc.indexOf("background") >= 0 || lc.indexOf("display:") >= 0 ||
-       lc.indexOf("color:") >= 0 || lc.indexOf("font-") >= 0 ||
-       lc.indexOf("border") >= 0 || lc.indexOf("flex") >= 0 ||
-       lc.indexOf("@media") >= 0 || lc.indexOf("@keyframes") >= 0)) {
-    return "css";
-  }
-
-  // JavaScript patterns
-  if (lc.indexOf("function ") >= 0 || lc.indexOf("const ") >= 0 || lc.indexOf("let ") >= 0 || lc.indexOf("=>") >= 0 || lc.indexOf("console.log") >= 0 || lc.indexOf("document.") >= 0) {
-    return "js";
-  }
-
-  // Python patterns
-  if (lc.indexOf("def ") >= 0 || lc.indexOf("import ") >= 0 || lc.indexOf("print(") >= 0 || lc.indexOf("self.") >= 0) {
-    return "py";
-  }
-
-  // C/C++ patterns
-  if (lc.indexOf("#include") >= 0 || (lc.indexOf("int main") >= 0 && lc.indexOf("{") >= 0)) {
-    if (lc.indexOf("class ") >= 0 || lc.indexOf("public:") >= 0 || lc.indexOf("namespace") >= 0) {
-      return "cpp";
-    }
-    return "c";
-  }
-
-  return "";
-}
-
-// Extract code blocks from LLM response and send as files
+// Sends each fenced code block found by code_scan() as a file.
 // Returns number of code files sent
-static int extract_and_send_code_blocks(const String &response) {
+static int send_code_files(const String &response, const CodeScan &scan) {
   int files_sent = 0;
-  int block_start = -1;
-  String code_lang;
-  String code_content;
-
-  Serial.println("[agent] Checking for code blocks...");
-
-  for (int i = 0; i < (int)response.length() - 2; i++) {
-    // Check for code block start ```
-    if (response[i] == '`' && response[i+1] == '`' && response[i+2] == '`') {
-      if (block_start < 0) {
-        // Found opening ```
-        block_start = i + 3;
-        // Extract language (e.g., ```cpp, ```python)
-        int lang_end = block_start;
-        while (lang_end < (int)response.length() && response[lang_end] != '\n' && response[lang_end] != ' ') {
-          lang_end++;
-        }
-        code_lang = response.substring(block_start, lang_end);
-        code_lang.toLowerCase();
-        code_lang.trim();
-
-        // Handle empty language tag
-        if (code_lang.length() == 0 || code_lang == "\r" || code_lang == "\n") {
-          code_lang = "";
-        }
-
-        Serial.printf("[agent] Found code block, language: '%s'\n", code_lang.c_str());
-
-        // Find actual code start
-        while (lang_end < (int)response.length() && (response[lang_end] == ' ' || response[lang_end] == '\r')) {
-          lang_end++;
-        }
-        if (lang_end < (int)response.length() && response[lang_end] == '\n') {
-          lang_end++;
-        }
-        block_start = lang_end;
-      } else {
-        // Found closing ```
-        code_content = response.substring(block_start, i);
-        code_content.trim();
-
-        // Skip empty code blocks
-        if (code_content.length() < 10) {
-          block_start = -1;
-          continue;
-        }
-
-        // If no language specified, detect from content
-        if (code_lang.length() == 0) {
-          code_lang = detect_language_from_content(code_content);
-          Serial.printf("[agent] Auto-detected language: '%s'\n", code_lang.c_str());
-        }
-
-        // Map language to file extension
-        String ext = "txt";
-        String mime = "text/plain";
-
-        if (code_lang == "cpp" || code_lang == "c++" || code_lang == "cxx") {
-          ext = "cpp";
-          mime = "text/x-c++src";
-        } else if (code_lang == "c") {
-          ext = "c";
-          mime = "text/x-csrc";
-        } else if (code_lang == "py" || code_lang == "python") {
-          ext = "py";
-          mime = "text/x-python";
-        } else if (code_lang == "js" || code_lang == "javascript") {
-          ext = "js";
-          mime = "application/javascript";
-        } else if (code_lang == "html") {
-          ext = "html";
-          mime = "text/html";
-        } else if (code_lang == "css") {
-          ext = "css";
-          mime = "text/css";
-        } else if (code_lang == "json") {
-          ext = "json";
-          mime = "application/json";
-        } else if (code_lang == "md" || code_lang == "markdown") {
-          ext = "md";
-          mime = "text/markdown";
-        } else if (code_lang == "ino" || code_lang == "arduino") {
-          ext = "ino";
-          mime = "text/x-c++src";
-        } else if (code_lang == "h" || code_lang == "hpp") {
-          ext = code_lang;
-          mime = "text/x-csrc";
-        } else if (code_lang == "sh" || code_lang == "bash" || code_lang == "shell") {
-          ext = "sh";
-          mime = "text/x-sh";
-        } else if (code_lang == "ts" || code_lang == "typescript") {
-          ext = "ts";
-          mime = "text/typescript";
-        } else if (code_lang == "tsx" || code_lang == "jsx") {
-          ext = code_lang;
-          mime = "text/javascript";
-        } else if (code_lang == "sql") {
-          ext = "sql";
-          mime = "text/sql";
-        } else if (code_lang == "java") {
-          ext = "java";
-          mime = "text/java";
-        } else if (code_lang == "rust" || code_lang == "rs") {
-          ext = "rs";
-          mime = "text/rust";
-        } else if (code_lang == "go" || code_lang == "golang") {
-          ext = "go";
-          mime = "text/go";
-        } else if (code_lang == "xml" || code_lang == "yaml" || code_lang == "yml") {
-          ext = code_lang;
-          mime = "text/plain";
-        } else if (code_lang == "html_full") {
-          ext = "html";
-          mime = "text/html";
-        }
-
-        // Generate filename with timestamp
-        String filename = "code_" + String((unsigned long)millis()) + "_" + String(files_sent) + "." + ext;
-
-        Serial.printf("[agent] Sending code file: %s (%d bytes)\n", filename.c_str(), code_content.length());
-
-        // Send as document
-        if (send_document_with_retry(filename, code_content, mime, "Here's the code file:")) {
-          files_sent++;
-          // Prefer HTML entrypoints for hosting. Fallback to first file.
-          if (ext == "html" || files_sent == 1) {
-            agent_loop_set_last_file(filename, code_content);
-          }
-          Serial.printf("[agent] Code file sent successfully!\n");
-        } else {
-          Serial.printf("[agent] Failed to send code file\n");
-        }
-
-        // Reset for next code block
-        block_start = -1;
-        code_content = "";
+  for (int i = 0; i < scan.span_count; i++) {
+    const CodeSpan &span = scan.spans[i];
+    String code = response.substring(span.start, span.end);
+    String filename = "code_" + String((unsigned long)millis()) + "_" + String(files_sent) + "." + span.ext;
+
+    Serial.printf("[agent] Sending code file: %s (%d bytes, language '%s')\n", filename.c_str(),
+                  code.length(), span.lang);
+
+    // Prefer HTML entrypoints for hosting. Fallback to first file. Only that
+    // span is kept for hosting; the others move straight into the outbox.
+    const bool keep = strcmp(span.ext, "html") == 0 || files_sent == 0;
+    String kept;
+    if (keep) {
+      kept = code;
+    }
+    if (transport_telegram_send_document(filename, std::move(code), span.mime,
+                                         "Here's the code file:")) {
+      files_sent++;
+      if (keep) {
+        agent_loop_set_last_file(filename, std::move(kept));
       }
+    } else {
+      Serial.printf("[agent] Failed to send code file\n");
     }
   }
 
@@ -351,45 +239,54 @@ static int extract_and_send_code_blocks(const String &response) {
 }
 
 // Send message directly (no streaming overhead)
+// End of the Telegram-sized chunk starting at `start`, preferring a line break.
+static int next_chunk_end(const String &outgoing, int start) {
+  const int kChunkMax = 3400;  // Telegram max is 4096 chars.
+  int end = start + kChunkMax;
+  if (end >= (int)outgoing.length()) {
+    return outgoing.length();
+  }
+  for (int i = end; i >= start + (kChunkMax / 2); i--) {
+    if (outgoing[i] == '\n') {
+      return i + 1;
+    }
+  }
+  return end;
+}
+
 static void send_streaming(const String &outgoing) {
   if (outgoing.length() == 0) {
     return;
   }
-  const int kChunkMax = 3400;  // Telegram max is 4096 chars.
   int start = 0;
+  // A reply that was streamed live: its message becomes the first chunk.
+  AgentWorker *worker = current_worker();
+  if (worker != NULL && telegram_live_reply_active(worker->live_reply)) {
+    const int split = next_chunk_end(outgoing, 0);
+    if (telegram_live_reply_finish(worker->live_reply, outgoing.substring(0, split))) {
+      start = split;
+    }
+  }
   while (start < (int)outgoing.length()) {
-    int end = start + kChunkMax;
-    if (end >= (int)outgoing.length()) {
-      transport_telegram_send(outgoing.substring(start));
+    if (request_ctx_canceled()) {
       break;
     }
-
-    int split = -1;
-    for (int i = end; i >= start + (kChunkMax / 2); i--) {
-      if (outgoing[i] == '\n') {
-        split = i + 1;
-        break;
-      }
-    }
-    if (split < 0) {
-      split = end;
-    }
-
+    const int split = next_chunk_end(outgoing, start);
+    // Chunks are queued; the outbox task paces them.
     transport_telegram_send(outgoing.substring(start, split));
     start = split;
-    delay(80);
   }
 }
 
-static bool response_contains_code(const String &text) {
-  if (text.indexOf("```") >= 0) {
-    return true;
+static bool on_reply_stream(LlmStreamEvent ev, const String &text, const LlmUsage &usage,
+                            void *ctx) {
+  TelegramLiveReply &live = *(TelegramLiveReply *)ctx;
+  if (ev == LLM_STREAM_BEGIN) {
+    telegram_live_reply_restart(live);
+  } else if (ev == LLM_STREAM_DELTA) {
+    telegram_live_reply_append(live, text);
   }
-  String lc = text;
-  lc.toLowerCase();
-  return (lc.indexOf("<html") >= 0) || (lc.indexOf("function ") >= 0) ||
-         (lc.indexOf("class ") >= 0) || (lc.indexOf("#include") >= 0) ||
-         (lc.indexOf("const ") >= 0 && lc.indexOf("=>") >= 0);
+  return true;
 }
 
 static bool looks_like_actionable_hint_command(const String &candidate_raw) {
@@ -423,6 +320,7 @@ static bool looks_like_actionable_hint_command(const String &candidate_raw) {
       "deploy",
       "list projects",
       "files_get ",
+      "files_send ",
       "files_list",
       "timezone_set ",
       "timezone_show",
@@ -546,85 +444,30 @@ static bool extract_embedded_tool_command(const String &text, String &cmd_out) {
   return false;
 }
 
-// Check if text looks like code (even without ``` blocks)
-static bool looks_like_code(const String &text) {
-  String lc = text;
-  lc.toLowerCase();
-
-  // Code-like patterns
-  const char *code_patterns[] = {
-    "function ", "def ", "class ", "import ", "#include",
-    "public void", "private int", "const ", "let ", "var ",
-    "return ", "if (", "for (", "while (", "print(", "console.log",
-    "{", "}", "//", "/*", "*/", "#!"
-  };
-
-  // Check for multiple code patterns
-  int pattern_count = 0;
-  for (size_t i = 0; i < sizeof(code_patterns) / sizeof(code_patterns[0]); i++) {
-    if (lc.indexOf(code_patterns[i]) >= 0) {
-      pattern_count++;
-      if (pattern_count >= 2) return true;
-    }
-  }
-
-  // Check for code-like line patterns (indentation)
-  int line_count = 0;
-  int indented_lines = 0;
-  for (int i = 0; i < (int)lc.length(); i++) {
-    if (lc[i] == '\n') {
-      line_count++;
-      // Check if next non-space character is indented (4+ spaces or tab)
-      int j = i + 1;
-      int spaces = 0;
-      while (j < (int)lc.length() && (lc[j] == ' ' || lc[j] == '\t')) {
-        if (lc[j] == ' ') spaces++;
-        j++;
-      }
-      if (spaces >= 4) indented_lines++;
-    }
-  }
-
-  // Many indented lines = likely code
-  if (indented_lines >= 3 && line_count > 5) {
-    return true;
-  }
-
-  return false;
-}
-
 static void send_reply_via_telegram(const String &outgoing) {
   event_log_append("OUT: " + outgoing);
 
-  // Check if response contains code blocks
-  int code_count = 0;
-  for (int i = 0; i < (int)outgoing.length() - 2; i++) {
-    if (outgoing[i] == '`' && outgoing[i+1] == '`' && outgoing[i+2] == '`') {
-      code_count++;
-    }
-  }
+  // One pass finds fenced blocks, their languages and unfenced code.
+  CodeScan scan;
+  code_scan(outgoing, scan);
 
   // If we have code blocks (even pairs of ```), send them as files
-  if (code_count >= 2) {
-    int sent = extract_and_send_code_blocks(outgoing);
+  if (scan.fence_count >= 2) {
+    int sent = send_code_files(outgoing, scan);
     if (sent > 0) {
-      String summary = "🦖 I've sent " + String(sent) + " code file(s)! Check above.";
+      // A live reply message sits above the files it is replaced by.
+      AgentWorker *worker = current_worker();
+      const bool live = worker != NULL && telegram_live_reply_active(worker->live_reply);
+      const char *where = live ? "below" : "above";
+      String summary = "🦖 I've sent " + String(sent) + " code file(s)! Check " + where + ".";
       send_streaming(summary);
     } else {
       send_streaming(outgoing);
     }
-  } else if (looks_like_code(outgoing) && outgoing.length() > 100) {
-    String detected = detect_language_from_content(outgoing);
-    String ext = "txt";
-    if (detected == "html" || detected == "html_full") ext = "html";
-    else if (detected == "css") ext = "css";
-    else if (detected == "js") ext = "js";
-    else if (detected == "py") ext = "py";
-    else if (detected == "c") ext = "c";
-    else if (detected == "cpp") ext = "cpp";
-    String filename = "code_" + String((unsigned long)millis()) + "." + ext;
+  } else if (scan.looks_like_code && outgoing.length() > 100) {
+    String filename = "code_" + String((unsigned long)millis()) + "." + scan.whole.ext;
     bool sent_code_file =
-        send_document_with_retry(filename, outgoing, "text/plain", "Here's your code:");
+        transport_telegram_send_document(filename, outgoing, scan.whole.mime, "Here's your code:");
     if (sent_code_file) {
       send_streaming("🦖 I've sent the code as a file!");
     } else {
@@ -640,6 +483,17 @@ static void send_reply_via_telegram(const String &outgoing) {
   }
 }
 
+// Sets a short notice and returns true once the request was canceled or ran
+// out of time, so the remaining stages are skipped.
+static bool request_stopped(String &response) {
+  String reason;
+  if (!request_ctx_should_stop(reason)) {
+    return false;
+  }
+  response = "🛑 " + reason;
+  return true;
+}
+
 String agent_loop_process_message(const String &msg) {
   if (msg.length() == 0) {
     return "";
@@ -653,9 +507,14 @@ String agent_loop_process_message(const String &msg) {
 
   String response;
   bool handled = false;
+  // Read once; every keyword-based decision below tests these bits.
+  const uint32_t intents = intent_classify(msg);
 
-  // 1. Direct Tool Execution
-  if (tool_registry_execute(msg, response)) {
+  // 1. Tool dispatch: commands, local parsing, then one LLM classifier
+  // (email, update or router, picked from the intent bits)
+  if (request_stopped(response)) {
+    handled = true;
+  } else if (tool_registry_execute(msg, response)) {
     handled = true;
   } 
   else {
@@ -668,33 +527,17 @@ String agent_loop_process_message(const String &msg) {
       handled = true;
     }
     
-    // 3. Router (if not handled)
-    if (!handled && should_try_route(trimmed)) {
-      String routed_command;
-      String route_err;
-      if (llm_route_tool_command(trimmed, routed_command, route_err)) {
-        routed_command.trim();
-        if (routed_command.length() > 0) {
-          String routed_response;
-          if (tool_registry_execute(routed_command, routed_response)) {
-            if (routed_response.length() > 3400 && !response_contains_code(routed_response)) {
-              routed_response = routed_response.substring(0, 3400) + "...";
-            }
-            event_log_append("ROUTE: " + routed_command);
-            response = routed_response;
-            handled = true;
-          }
-        }
-      }
+    if (!handled && request_stopped(response)) {
+      handled = true;
     }
 
-    // 4. ReAct Agent (if not handled)
-    if (!handled && react_agent_should_use(trimmed)) {
+    // 3. ReAct Agent (if not handled)
+    if (!handled && react_agent_should_use(trimmed, intents)) {
       String react_response, react_error;
       event_log_append("ReAct: Starting agent loop");
       if (react_agent_run(trimmed, react_response, react_error)) {
-        s_last_llm_response = react_response;
-        if (react_response.length() > 3400 && !response_contains_code(react_response)) {
+        agent_loop_set_last_response(react_response);
+        if (react_response.length() > 3400 && !code_scan_contains_code(react_response)) {
           react_response = react_response.substring(0, 3400) + "...";
         }
         response = react_response;
@@ -704,22 +547,35 @@ String agent_loop_process_message(const String &msg) {
       }
     }
 
-    // 5. Direct LLM Chat (if not handled)
+    if (!handled && request_stopped(response)) {
+      handled = true;
+    }
+
+    // 4. Direct LLM Chat (if not handled)
     if (!handled) {
       String err;
-      if (llm_generate_reply(trimmed, response, err)) {
+      AgentWorker *worker = current_worker();
+      const bool stream = worker != NULL && worker->stream_to_telegram;
+      if (stream) {
+        // Created up front: the stream callback must not block on Telegram.
+        telegram_live_reply_open(worker->live_reply);
+      }
+      const bool ok = stream ? llm_generate_reply_streaming(trimmed, on_reply_stream,
+                                                            &worker->live_reply, response, err)
+                             : llm_generate_reply(trimmed, response, err);
+      if (ok) {
         String hinted_cmd;
         if (extract_embedded_tool_command(response, hinted_cmd)) {
           String hinted_out;
-          if (tool_registry_execute(hinted_cmd, hinted_out)) {
+          if (tool_registry_execute(hinted_cmd, hinted_out, TOOL_COST_HEURISTIC)) {
             event_log_append("ROUTE: " + hinted_cmd + " (from model hint)");
             response = hinted_out;
           }
         }
 
-        s_last_llm_response = response;
+        agent_loop_set_last_response(response);
 
-        if (response.length() > 3400 && !response_contains_code(response)) {
+        if (response.length() > 3400 && !code_scan_contains_code(response)) {
           response = response.substring(0, 3400) + "...";
         }
         handled = true;
@@ -733,49 +589,58 @@ String agent_loop_process_message(const String &msg) {
 
   status_led_set_busy(false);
 
+  // A cancel wins over whatever was produced; a timeout only replaces the
+  // error it caused.
+  String stop_reason;
+  const bool stopped = request_ctx_should_stop(stop_reason);
+  if (stopped && (request_ctx_canceled() || response.startsWith("ERR:"))) {
+    response = "🛑 " + stop_reason;
+  }
+
   // Record history (Bot only, User recorded at ingress)
   record_bot_msg(response);
 
-  // Auto-learn: extract personal facts every 5th message OR if keywords found
-  static int s_msg_counter = 0;
-  s_msg_counter++;
-  
-  String msg_lc = msg;
-  msg_lc.toLowerCase();
-  bool force_learn = (msg_lc.indexOf("remember") >= 0 || 
-                      msg_lc.indexOf("favorit") >= 0 || 
-                      msg_lc.indexOf("name is") >= 0 ||
-                      msg_lc.indexOf("i am ") >= 0 ||
-                      msg_lc.indexOf("my ") >= 0); // "my car", "my mom", etc.
-
-  if ((s_msg_counter % 5 == 0 || force_learn) && msg.length() > 5) {
-    String existing_user, user_err;
-    file_memory_read_user(existing_user, user_err);
-
-    String facts, facts_err;
-    if (llm_extract_user_facts(msg, existing_user, facts, facts_err)) {
-      if (facts.length() > 0) {
-        String append_err;
-        if (file_memory_append_user(facts, append_err)) {
-          Serial.println("[auto-learn] Learned: " + facts);
-          event_log_append("AUTO_LEARN: " + facts);
-          
-          // Visual confirmation for user
-          response += "\n\n(📝 Learned: " + facts + ")";
-        }
-      }
-    }
+  // Facts are learned later, in a batch, once the queue is idle.
+  if (!stopped && !is_internal_dispatch_message(msg)) {
+    auto_learn_note(msg, intents);
   }
-  
+
   return response;
 }
 
 static void on_incoming_message(const String &msg) {
-  // Queue for processing (Telegram source = true)
-  agent_loop_queue_message(msg, true);
+  agent_loop_queue_from(msg, AGENT_SOURCE_TELEGRAM);
+}
+
+static void on_scheduled_message(const String &msg) {
+  agent_loop_queue_from(msg, AGENT_SOURCE_SCHEDULER);
+}
+
+static bool is_cancel_message(const String &msg) {
+  String lc = msg;
+  lc.trim();
+  lc.toLowerCase();
+  return lc == "cancel" || lc == "/cancel" || lc == "stop" || lc == "/stop";
+}
+
+// Scheduler jobs nobody is waiting on go behind reminders and cron commands,
+// which in turn yield to whatever a user just typed.
+static AgentJobClass classify_job(const String &msg, AgentSource source) {
+  if (source != AGENT_SOURCE_SCHEDULER) {
+    return AGENT_CLASS_INTERACTIVE;
+  }
+  if (msg == "heartbeat_run" || msg == "proactive_check" || msg == "status" ||
+      msg == "auto_learn_run") {
+    return AGENT_CLASS_BACKGROUND;
+  }
+  return AGENT_CLASS_REMINDER;
 }
 
 void agent_loop_queue_message(const String &msg, bool from_telegram) {
+  agent_loop_queue_from(msg, from_telegram ? AGENT_SOURCE_TELEGRAM : AGENT_SOURCE_WEB);
+}
+
+void agent_loop_queue_from(const String &msg, AgentSource source) {
   if (msg.length() == 0) return;
   
   // Record User Msg immediately so UI sees it
@@ -797,28 +662,51 @@ void agent_loop_queue_message(const String &msg, bool from_telegram) {
 
   record_user_msg(msg);
 
-  if (!s_agent_queue) return;
+  if (source < 0 || source >= AGENT_SOURCE_COUNT) return;
 
-  char *copy = strdup(msg.c_str());
-  if (copy) {
-    AgentTaskMsg item;
-    item.msg_ptr = copy;
-    item.from_telegram = from_telegram;
-    if (xQueueSend(s_agent_queue, &item, pdMS_TO_TICKS(100)) != pdTRUE) {
-      free(copy);
-      Serial.println("[agent] queue full");
-    }
+  // A cancel cannot wait behind the request it is meant to stop. With
+  // nothing running it is queued as usual (it also clears pending actions).
+  if (source != AGENT_SOURCE_SCHEDULER && is_cancel_message(msg) && request_ctx_cancel(source)) {
+    Serial.println("[agent] canceling in-flight request");
+    event_log_append("CANCEL: in-flight request");
+    return;
   }
+
+  agent_queue_push(msg, source, classify_job(msg, source));
 }
 
+#if TELEGRAM_LONG_POLL_S > 0
+// getUpdates blocks for up to TELEGRAM_LONG_POLL_S, so it gets its own task
+// instead of stalling loop() (OTA, scheduler, LED).
+static void telegram_poll_task_code(void *pvParameters) {
+  for (;;) {
+    transport_telegram_poll(on_incoming_message);
+    vTaskDelay(pdMS_TO_TICKS(50));
+  }
+}
+#endif
+
 void agent_loop_init() {
-  s_agent_queue = xQueueCreate(10, sizeof(AgentTaskMsg));
-  xTaskCreate(agent_task_code, "AgentTask", 16384, NULL, 1, NULL); 
+  s_state_mutex = xSemaphoreCreateMutex();
+  agent_queue_init();
+  for (int i = 0; i < AGENT_WORKERS; i++) {
+    s_workers[i].handle = NULL;
+    s_workers[i].stream_to_telegram = false;
+    char name[16];
+    snprintf(name, sizeof(name), "AgentTask%d", i);
+    xTaskCreate(agent_task_code, name, 16384, &s_workers[i], 1, NULL);
+  }
   
   event_log_init();
+  code_scan_init();
+  intent_init();
+  http_pool_init();
+  telegram_outbox_init();
   chat_history_init();
   memory_init();
   file_memory_init();  // Initialize SPIFFS-based file memory
+  media_cache_init();  // Telegram media kept on flash for follow-up questions
+  auto_learn_init();
   skill_init();        // Initialize lazy-loading skills
   model_config_init();
   persona_init();
@@ -836,6 +724,9 @@ void agent_loop_init() {
   xTaskCreate(minos_task_code, "MinOSTask", 8192, NULL, 1, NULL);
 
   transport_telegram_init();
+#if TELEGRAM_LONG_POLL_S > 0
+  xTaskCreate(telegram_poll_task_code, "TgPollTask", 8192, NULL, 1, NULL);
+#endif
   web_server_init();
   Serial.println("[agent] init complete");
 
@@ -848,10 +739,28 @@ void agent_loop_init() {
   #endif
 }
 
+// The WiFi stack also reconnects on its own, without ensure_wifi(); TLS
+// sessions cached on the old link are dropped either way.
+static void watch_wifi_reconnect() {
+  static bool s_was_connected = true;
+  const bool connected = WiFi.status() == WL_CONNECTED;
+  if (connected && !s_was_connected) {
+    Serial.println("[agent] WiFi reconnected, clearing TLS session cache");
+    tls_session_cache_clear();
+  }
+  s_was_connected = connected;
+}
+
 void agent_loop_tick() {
   status_led_tick();
+  watch_wifi_reconnect();
+#if TELEGRAM_LONG_POLL_S == 0
   transport_telegram_poll(on_incoming_message);
-  scheduler_tick(on_incoming_message);
+#endif
+  scheduler_tick(on_scheduled_message);
+  if (agent_queue_idle() && auto_learn_due()) {
+    on_scheduled_message(String("auto_learn_run"));
+  }
   
   // Web/Agent processing is now in AgentTask
 }
@@ -13,17 +13,27 @@ void agent_loop_set_last_response(const String &response);
 // Get/set the last generated code file (for hosting)
 String agent_loop_get_last_file_content();
 String agent_loop_get_last_file_name();
-void agent_loop_set_last_file(const String &name, const String &content);
+void agent_loop_set_last_file(const String &name, String content);
 
 // Get/set the last generated code file (for hosting)
 String agent_loop_get_last_file_content();
 String agent_loop_get_last_file_name();
-void agent_loop_set_last_file(const String &name, const String &content);
+void agent_loop_set_last_file(const String &name, String content);
 
 // Process a message from any source (Web/Telegram) and return the reply
 String agent_loop_process_message(const String &msg);
 
+// Where a queued message came from. Messages from one source are processed
+// in order; different sources are handled by separate workers in parallel.
+enum AgentSource {
+  AGENT_SOURCE_TELEGRAM,
+  AGENT_SOURCE_WEB,        // dashboard chat; reply is not sent to Telegram
+  AGENT_SOURCE_SCHEDULER,  // cron, reminders, heartbeat
+  AGENT_SOURCE_COUNT,
+};
+
 // Queue a message for async processing (Main Loop)
 void agent_loop_queue_message(const String &msg, bool from_telegram = false);
+void agent_loop_queue_from(const String &msg, AgentSource source);
 
 #endif
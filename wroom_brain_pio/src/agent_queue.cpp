@@ -0,0 +1,361 @@
+#include "agent_queue.h"
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+#include "brain_config.h"
+
+namespace {
+
+static const int kCapacity = AGENT_QUEUE_DEPTH * AGENT_SOURCE_COUNT;
+
+struct Slot {
+  AgentJob job;
+  uint32_t seq;  // arrival order
+  bool used;
+};
+
+struct ClassStats {
+  int depth;
+  uint32_t started;
+  uint32_t merged;
+  uint32_t dropped;
+  uint64_t wait_sum_ms;
+  unsigned long wait_max_ms;
+};
+
+Slot g_slots[kCapacity];
+bool g_busy[AGENT_SOURCE_COUNT];
+ClassStats g_stats[AGENT_CLASS_COUNT];
+uint32_t g_seq = 0;
+SemaphoreHandle_t g_mutex = NULL;
+SemaphoreHandle_t g_work = NULL;  // given on push and done; wakes idle workers
+
+const char *kClassNames[AGENT_CLASS_COUNT] = {"interactive", "reminder", "background"};
+
+// Message text lives in a fixed arena instead of per-message heap copies, so
+// days of chat traffic do not fragment the heap. A slot holds a 2-byte
+// length, the text and a NUL; the worker reads it in place and the slot is
+// reused once the job is done.
+static const size_t kSlotHeader = 2;
+static const size_t kSlotPayload = AGENT_MSG_SLOT_BYTES - kSlotHeader - 1;
+
+uint8_t g_arena[AGENT_MSG_SLOTS][AGENT_MSG_SLOT_BYTES];
+bool g_arena_used[AGENT_MSG_SLOTS];
+
+struct ArenaStats {
+  int in_use;
+  int high_water;
+  uint32_t allocs;
+  uint32_t overflow;  // too long or arena full, copied to the heap instead
+  uint32_t rejected;  // overflow with AGENT_MSG_OVERFLOW_HEAP off, or no heap
+};
+ArenaStats g_arena_stats;
+
+void lock() {
+  xSemaphoreTake(g_mutex, portMAX_DELAY);
+}
+
+void unlock() {
+  xSemaphoreGive(g_mutex);
+}
+
+int effective_rank(const Slot &slot, unsigned long now) {
+  int rank = (int)slot.job.job_class;
+  if (AGENT_AGING_MS > 0) {
+    rank -= (int)((now - slot.job.enqueued_ms) / AGENT_AGING_MS);
+  }
+  return rank < 0 ? 0 : rank;
+}
+
+// A job may only start once every older job of its source and class has.
+bool has_older_sibling(int idx) {
+  const Slot &s = g_slots[idx];
+  for (int i = 0; i < kCapacity; i++) {
+    const Slot &o = g_slots[i];
+    if (i != idx && o.used && o.job.source == s.job.source &&
+        o.job.job_class == s.job.job_class && o.seq < s.seq) {
+      return true;
+    }
+  }
+  return false;
+}
+
+int pick_next(unsigned long now) {
+  int best = -1;
+  int best_rank = 0;
+  for (int i = 0; i < kCapacity; i++) {
+    const Slot &s = g_slots[i];
+    if (!s.used || g_busy[s.job.source] || has_older_sibling(i)) {
+      continue;
+    }
+    const int rank = effective_rank(s, now);
+    if (best < 0 || rank < best_rank || (rank == best_rank && s.seq < g_slots[best].seq)) {
+      best = i;
+      best_rank = rank;
+    }
+  }
+  return best;
+}
+
+// Copies `text` into a free arena slot, or onto the heap if it does not fit
+// and the overflow policy allows. arena_slot_out is -1 for heap copies.
+char *payload_alloc(const String &text, int &arena_slot_out) {
+  arena_slot_out = -1;
+  const size_t len = text.length();
+  if (len <= kSlotPayload) {
+    for (int i = 0; i < AGENT_MSG_SLOTS; i++) {
+      if (g_arena_used[i]) {
+        continue;
+      }
+      uint8_t *slot = g_arena[i];
+      slot[0] = (uint8_t)(len & 0xFF);
+      slot[1] = (uint8_t)(len >> 8);
+      char *payload = (char *)slot + kSlotHeader;
+      memcpy(payload, text.c_str(), len + 1);
+      g_arena_used[i] = true;
+      arena_slot_out = i;
+      g_arena_stats.allocs++;
+      if (++g_arena_stats.in_use > g_arena_stats.high_water) {
+        g_arena_stats.high_water = g_arena_stats.in_use;
+      }
+      return payload;
+    }
+  }
+#if AGENT_MSG_OVERFLOW_HEAP
+  char *copy = (char *)malloc(len + 1);
+  if (copy != NULL) {
+    memcpy(copy, text.c_str(), len + 1);
+    g_arena_stats.overflow++;
+    return copy;
+  }
+#endif
+  g_arena_stats.rejected++;
+  return NULL;
+}
+
+void payload_free(AgentJob &job) {
+  if (job.msg == NULL) {
+    return;
+  }
+  if (job.arena_slot >= 0) {
+    g_arena_used[job.arena_slot] = false;
+    g_arena_stats.in_use--;
+  } else {
+    free(job.msg);
+  }
+  job.msg = NULL;
+}
+
+size_t payload_length(const AgentJob &job) {
+  if (job.arena_slot >= 0) {
+    const uint8_t *slot = g_arena[job.arena_slot];
+    return (size_t)slot[0] | ((size_t)slot[1] << 8);
+  }
+  return strlen(job.msg);
+}
+
+void release_slot(int idx) {
+  g_stats[g_slots[idx].job.job_class].depth--;
+  g_slots[idx].used = false;
+  g_slots[idx].job.msg = NULL;
+}
+
+int find_duplicate(const String &msg, AgentSource source, AgentJobClass job_class) {
+  for (int i = 0; i < kCapacity; i++) {
+    const Slot &s = g_slots[i];
+    if (s.used && s.job.source == source && s.job.job_class == job_class &&
+        payload_length(s.job) == msg.length() && strcmp(s.job.msg, msg.c_str()) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+int free_slot() {
+  for (int i = 0; i < kCapacity; i++) {
+    if (!g_slots[i].used) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// Newest waiting background job (of `only_source`, or any if -1): the
+// cheapest one to give up when a more urgent job needs room.
+int newest_background(int only_source) {
+  int idx = -1;
+  for (int i = 0; i < kCapacity; i++) {
+    const Slot &s = g_slots[i];
+    if (s.used && s.job.job_class == AGENT_CLASS_BACKGROUND &&
+        (only_source < 0 || s.job.source == only_source) &&
+        (idx < 0 || s.seq > g_slots[idx].seq)) {
+      idx = i;
+    }
+  }
+  return idx;
+}
+
+int source_depth(AgentSource source) {
+  int n = 0;
+  for (int i = 0; i < kCapacity; i++) {
+    if (g_slots[i].used && g_slots[i].job.source == source) {
+      n++;
+    }
+  }
+  return n;
+}
+
+}  // namespace
+
+void agent_queue_init() {
+  if (g_mutex != NULL) {
+    return;
+  }
+  g_mutex = xSemaphoreCreateMutex();
+  g_work = xSemaphoreCreateCounting(kCapacity + AGENT_SOURCE_COUNT, 0);
+  for (int i = 0; i < kCapacity; i++) {
+    g_slots[i].used = false;
+    g_slots[i].job.msg = NULL;
+  }
+  for (int i = 0; i < AGENT_SOURCE_COUNT; i++) {
+    g_busy[i] = false;
+  }
+  for (int i = 0; i < AGENT_MSG_SLOTS; i++) {
+    g_arena_used[i] = false;
+  }
+  memset(g_stats, 0, sizeof(g_stats));
+  memset(&g_arena_stats, 0, sizeof(g_arena_stats));
+}
+
+bool agent_queue_push(const String &msg, AgentSource source, AgentJobClass job_class) {
+  if (g_mutex == NULL || source < 0 || source >= AGENT_SOURCE_COUNT || msg.length() == 0) {
+    return false;
+  }
+
+  lock();
+  if (job_class == AGENT_CLASS_BACKGROUND && find_duplicate(msg, source, job_class) >= 0) {
+    // Same job already waiting; running it twice back to back buys nothing.
+    g_stats[job_class].merged++;
+    unlock();
+    return true;
+  }
+
+  const bool source_full = source_depth(source) >= AGENT_QUEUE_DEPTH;
+  int slot = source_full ? -1 : free_slot();
+  if (slot < 0 && job_class != AGENT_CLASS_BACKGROUND) {
+    const int victim = newest_background(source_full ? (int)source : -1);
+    if (victim >= 0) {
+      Serial.printf("[agent] queue full, dropping background job: %s\n", g_slots[victim].job.msg);
+      g_stats[AGENT_CLASS_BACKGROUND].dropped++;
+      payload_free(g_slots[victim].job);
+      release_slot(victim);
+      slot = victim;
+    }
+  }
+  if (slot < 0) {
+    g_stats[job_class].dropped++;
+    unlock();
+    Serial.println("[agent] queue full");
+    return false;
+  }
+
+  int arena_slot = -1;
+  char *payload = payload_alloc(msg, arena_slot);
+  if (payload == NULL) {
+    g_stats[job_class].dropped++;
+    unlock();
+    Serial.println("[agent] no room for message text");
+    return false;
+  }
+
+  Slot &s = g_slots[slot];
+  s.job.msg = payload;
+  s.job.arena_slot = arena_slot;
+  s.job.source = source;
+  s.job.job_class = job_class;
+  s.job.enqueued_ms = millis();
+  s.seq = g_seq++;
+  s.used = true;
+  g_stats[job_class].depth++;
+  unlock();
+
+  xSemaphoreGive(g_work);
+  return true;
+}
+
+void agent_queue_take(AgentJob &job_out) {
+  while (true) {
+    lock();
+    const unsigned long now = millis();
+    const int idx = pick_next(now);
+    if (idx >= 0) {
+      job_out = g_slots[idx].job;
+      g_busy[job_out.source] = true;
+
+      ClassStats &st = g_stats[job_out.job_class];
+      const unsigned long waited = now - job_out.enqueued_ms;
+      st.started++;
+      st.wait_sum_ms += waited;
+      if (waited > st.wait_max_ms) {
+        st.wait_max_ms = waited;
+      }
+      release_slot(idx);
+      unlock();
+      return;
+    }
+    unlock();
+    xSemaphoreTake(g_work, portMAX_DELAY);
+  }
+}
+
+void agent_queue_done(AgentJob &job) {
+  lock();
+  payload_free(job);
+  g_busy[job.source] = false;
+  unlock();
+  // The source may have more work that arrived while it was busy.
+  xSemaphoreGive(g_work);
+}
+
+bool agent_queue_idle() {
+  if (g_mutex == NULL) {
+    return false;
+  }
+  bool idle = true;
+  lock();
+  for (int i = 0; i < kCapacity && idle; i++) {
+    idle = !g_slots[i].used;
+  }
+  for (int i = 0; i < AGENT_SOURCE_COUNT && idle; i++) {
+    idle = !g_busy[i];
+  }
+  unlock();
+  return idle;
+}
+
+String agent_queue_health_line() {
+  if (g_mutex == NULL) {
+    return "off";
+  }
+  String out;
+  lock();
+  for (int c = 0; c < AGENT_CLASS_COUNT; c++) {
+    const ClassStats &st = g_stats[c];
+    const unsigned long avg = st.started > 0 ? (unsigned long)(st.wait_sum_ms / st.started) : 0;
+    if (out.length() > 0) {
+      out += " | ";
+    }
+    out += String(kClassNames[c]) + " depth=" + String(st.depth) + " wait_avg_ms=" + String(avg) +
+           " wait_max_ms=" + String(st.wait_max_ms) + " merged=" + String(st.merged) +
+           " dropped=" + String(st.dropped);
+  }
+  out += " | arena in_use=" + String(g_arena_stats.in_use) + "/" + String(AGENT_MSG_SLOTS) +
+         " high_water=" + String(g_arena_stats.high_water) +
+         " allocs=" + String(g_arena_stats.allocs) +
+         " overflow=" + String(g_arena_stats.overflow) +
+         " rejected=" + String(g_arena_stats.rejected);
+  unlock();
+  return out;
+}
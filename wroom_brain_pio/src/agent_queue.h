@@ -0,0 +1,50 @@
+#ifndef AGENT_QUEUE_H
+#define AGENT_QUEUE_H
+
+#include <Arduino.h>
+
+#include "agent_loop.h"
+
+// Pending work for the agent workers. Jobs are served by class (interactive
+// before reminders before background LLM jobs); a job is promoted one class
+// for every AGENT_AGING_MS it has waited, so background work cannot starve.
+//
+// Each source is handled by one worker at a time, and jobs of the same
+// source and class leave in arrival order.
+
+enum AgentJobClass {
+  AGENT_CLASS_INTERACTIVE,
+  AGENT_CLASS_REMINDER,
+  AGENT_CLASS_BACKGROUND,
+  AGENT_CLASS_COUNT,
+};
+
+struct AgentJob {
+  char *msg;       // NUL-terminated; valid until agent_queue_done()
+  int arena_slot;  // message arena slot, or -1 for a heap overflow copy
+  AgentSource source;
+  AgentJobClass job_class;
+  unsigned long enqueued_ms;
+};
+
+void agent_queue_init();
+
+// Copies `msg` into the message arena (the only copy made between producer
+// and worker). Returns false if the job was dropped because the queue or
+// the arena is full. A background job identical to one already waiting is
+// merged into it.
+bool agent_queue_push(const String &msg, AgentSource source, AgentJobClass job_class);
+
+// Blocks until a job is available whose source no other worker is busy with,
+// and marks that source busy. The text is read in place; call
+// agent_queue_done() when finished to release it.
+void agent_queue_take(AgentJob &job_out);
+void agent_queue_done(AgentJob &job);
+
+// True when nothing is waiting and no worker is busy.
+bool agent_queue_idle();
+
+// Depth and wait times per class plus arena usage, for the health command
+String agent_queue_health_line();
+
+#endif
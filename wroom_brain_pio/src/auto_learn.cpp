@@ -0,0 +1,188 @@
+#include "auto_learn.h"
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+#include "brain_config.h"
+#include "event_log.h"
+#include "file_memory.h"
+#include "intent.h"
+#include "llm_client.h"
+
+namespace {
+
+static const size_t kMaxCandidateChars = 300;
+
+String g_pending[AUTO_LEARN_BATCH_MAX];
+int g_count = 0;
+unsigned long g_first_ms = 0;      // when the oldest pending message arrived
+unsigned long g_requested_ms = 0;  // last time a run was handed out, 0 = none
+uint32_t g_seen = 0;
+SemaphoreHandle_t g_mutex = NULL;
+
+void lock() {
+  xSemaphoreTake(g_mutex, portMAX_DELAY);
+}
+
+void unlock() {
+  xSemaphoreGive(g_mutex);
+}
+
+// Keeps only "- fact" lines the profile (or this batch) does not already have.
+String new_facts_only(const String &raw, const String &existing_profile) {
+  String profile_lc = existing_profile;
+  profile_lc.toLowerCase();
+  String out;
+  int start = 0;
+  while (start < (int)raw.length()) {
+    int end = raw.indexOf('\n', start);
+    if (end < 0) {
+      end = raw.length();
+    }
+    String line = raw.substring(start, end);
+    start = end + 1;
+    line.trim();
+    if (line.startsWith("-") || line.startsWith("*")) {
+      line = line.substring(1);
+      line.trim();
+    }
+    if (line.length() < 3 || line == "NONE") {
+      continue;
+    }
+    String lc = line;
+    lc.toLowerCase();
+    String out_lc = out;
+    out_lc.toLowerCase();
+    if (profile_lc.indexOf(lc) >= 0 || out_lc.indexOf(lc) >= 0) {
+      continue;
+    }
+    out += "- " + line + "\n";
+  }
+  return out;
+}
+
+// Puts a batch whose run failed back in front of anything noted meanwhile;
+// if that overflows, the oldest messages give way as in auto_learn_note().
+// The retry waits a full flush interval.
+void restore_batch(String *taken, int taken_count, unsigned long first_ms) {
+  lock();
+  const int total = taken_count + g_count;
+  const int drop = total > AUTO_LEARN_BATCH_MAX ? total - AUTO_LEARN_BATCH_MAX : 0;
+  String merged[AUTO_LEARN_BATCH_MAX];
+  int n = 0;
+  for (int i = 0; i < total; i++) {
+    if (i < drop) {
+      continue;
+    }
+    merged[n++] = i < taken_count ? taken[i] : g_pending[i - taken_count];
+  }
+  for (int i = 0; i < n; i++) {
+    g_pending[i] = merged[i];
+  }
+  g_count = n;
+  if (drop < taken_count) {
+    g_first_ms = first_ms;
+  }
+  g_requested_ms = millis();
+  unlock();
+}
+
+}  // namespace
+
+void auto_learn_init() {
+  if (g_mutex == NULL) {
+    g_mutex = xSemaphoreCreateMutex();
+  }
+}
+
+void auto_learn_note(const String &msg, uint32_t intents) {
+  if (!AUTO_LEARN_ENABLED || g_mutex == NULL || msg.length() <= 5) {
+    return;
+  }
+  lock();
+  // Every 5th message is sampled even without keywords.
+  g_seen++;
+  if (g_seen % 5 != 0 && !(intents & INTENT_PERSONAL)) {
+    unlock();
+    return;
+  }
+  if (g_count == AUTO_LEARN_BATCH_MAX) {
+    // Batch still waiting for an idle moment: the oldest message gives way.
+    for (int i = 1; i < g_count; i++) {
+      g_pending[i - 1] = g_pending[i];
+    }
+    g_count--;
+  }
+  if (g_count == 0) {
+    g_first_ms = millis();
+  }
+  g_pending[g_count++] = msg.length() > kMaxCandidateChars ? msg.substring(0, kMaxCandidateChars) : msg;
+  unlock();
+}
+
+bool auto_learn_due() {
+  if (g_mutex == NULL) {
+    return false;
+  }
+  lock();
+  const unsigned long now = millis();
+  bool due = g_count >= AUTO_LEARN_BATCH_MAX ||
+             (g_count > 0 && now - g_first_ms >= AUTO_LEARN_FLUSH_MS);
+  // One run at a time; hand out another only if the last one got lost.
+  if (due && g_requested_ms != 0 && now - g_requested_ms < AUTO_LEARN_FLUSH_MS) {
+    due = false;
+  }
+  if (due) {
+    g_requested_ms = now;
+  }
+  unlock();
+  return due;
+}
+
+bool auto_learn_run(String &summary_out, String &error_out) {
+  summary_out = "";
+  if (g_mutex == NULL) {
+    return true;
+  }
+  // The batch leaves the queue while the LLM runs, so new messages can keep
+  // arriving; it is only put back if the run fails.
+  lock();
+  String taken[AUTO_LEARN_BATCH_MAX];
+  String batch;
+  const int count = g_count;
+  const unsigned long first_ms = g_first_ms;
+  for (int i = 0; i < g_count; i++) {
+    batch += "- " + g_pending[i] + "\n";
+    taken[i] = g_pending[i];
+    g_pending[i] = "";
+  }
+  g_count = 0;
+  g_requested_ms = 0;
+  unlock();
+  if (count == 0) {
+    return true;
+  }
+
+  String existing_user, user_err;
+  file_memory_read_user(existing_user, user_err);
+
+  String raw;
+  if (!llm_extract_user_facts(batch, existing_user, raw, error_out)) {
+    restore_batch(taken, count, first_ms);
+    return false;
+  }
+  const String facts = new_facts_only(raw, existing_user);
+  Serial.printf("[auto-learn] batch of %d message(s), %u new fact chars\n", count,
+                (unsigned)facts.length());
+  if (facts.length() == 0) {
+    return true;
+  }
+  if (!file_memory_append_user(facts, error_out)) {
+    restore_batch(taken, count, first_ms);
+    return false;
+  }
+  event_log_append("AUTO_LEARN: " + facts);
+  summary_out = "📝 Learned:\n" + facts;
+  summary_out.trim();
+  return true;
+}
@@ -0,0 +1,24 @@
+#ifndef AUTO_LEARN_H
+#define AUTO_LEARN_H
+
+#include <Arduino.h>
+
+// Learns personal facts about the user (USER.md) off the reply path.
+// Candidate messages are buffered as they come in; once a batch is full or
+// old enough, and the agent queue is idle, one extraction call covers the
+// whole batch.
+
+void auto_learn_init();
+
+// Offers a user message; keeps it if it looks like it carries facts.
+// `intents` is intent_classify(msg).
+void auto_learn_note(const String &msg, uint32_t intents);
+
+// True when a batch should run now; the caller queues "auto_learn_run".
+bool auto_learn_due();
+
+// Runs the extraction over the buffered messages and appends new facts to
+// USER.md. summary_out is a short note for the user, empty if nothing new.
+bool auto_learn_run(String &summary_out, String &error_out);
+
+#endif
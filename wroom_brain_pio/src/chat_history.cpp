@@ -2,11 +2,15 @@
 
 #include <Arduino.h>
 #include <Preferences.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
 
 namespace {
 
 Preferences g_prefs;
 bool g_ready = false;
+// Appends are read-modify-write; agent workers and the web server append concurrently.
+SemaphoreHandle_t g_mutex = nullptr;
 
 const char *kNamespace = "brainchat";
 const char *kKeyLines = "lines";
@@ -78,6 +82,9 @@ String sanitize_text(const String &input) {
 }  // namespace
 
 void chat_history_init() {
+  if (g_mutex == nullptr) {
+    g_mutex = xSemaphoreCreateMutex();
+  }
   String err;
   if (ensure_ready(err)) {
     Serial.println("[chat] NVS history ready");
@@ -97,6 +104,9 @@ bool chat_history_append(char role, const String &text, String &error_out) {
     return true;
   }
 
+  if (g_mutex != nullptr) {
+    xSemaphoreTake(g_mutex, portMAX_DELAY);
+  }
   String lines = g_prefs.getString(kKeyLines, "");
   if (lines.length() > 0 && !lines.endsWith("\n")) {
     lines += "\n";
@@ -111,6 +121,9 @@ bool chat_history_append(char role, const String &text, String &error_out) {
   }
 
   size_t written = g_prefs.putString(kKeyLines, lines);
+  if (g_mutex != nullptr) {
+    xSemaphoreGive(g_mutex);
+  }
   if (written == 0 && lines.length() > 0) {
     error_out = "failed to write history";
     return false;
@@ -0,0 +1,293 @@
+#include "code_scan.h"
+
+#include "keyword_matcher.h"
+
+namespace {
+
+// Feature bits. The first group drives language detection, the P_ bits are
+// the individual markers looks_like_code counts.
+enum : uint64_t {
+  F_HTML_TAG = 1ULL << 0,
+  F_HTML_RICH = 1ULL << 1,
+  F_HTML_OPEN = 1ULL << 2,
+  F_OBRACE = 1ULL << 3,
+  F_CBRACE = 1ULL << 4,
+  F_COLON = 1ULL << 5,
+  F_CSS = 1ULL << 6,
+  F_JS = 1ULL << 7,
+  F_ARROW = 1ULL << 8,
+  F_PY = 1ULL << 9,
+  F_C_INCLUDE = 1ULL << 10,
+  F_C_MAIN = 1ULL << 11,
+  F_CPP = 1ULL << 12,
+  F_FUNCTION = 1ULL << 13,
+  F_CLASS = 1ULL << 14,
+  F_CONST = 1ULL << 15,
+};
+static const int kFirstMarkerBit = 16;
+static const uint64_t kMarkerMask = ~((1ULL << kFirstMarkerBit) - 1);
+
+#define MARKER(n) (1ULL << (kFirstMarkerBit + (n)))
+#define ANY(text, bits) {text, bits, false}
+
+const KeywordPattern kPatterns[] = {
+    ANY("<!doctype html", F_HTML_TAG),
+    ANY("<html", F_HTML_TAG | F_HTML_OPEN),
+    ANY("<div", F_HTML_TAG),
+    ANY("<body", F_HTML_TAG),
+    ANY("<style", F_HTML_RICH),
+    ANY("<script", F_HTML_RICH),
+    ANY(":", F_COLON),
+    ANY("margin", F_CSS),
+    ANY("padding", F_CSS),
+    ANY("background", F_CSS),
+    ANY("display:", F_CSS),
+    ANY("color:", F_CSS),
+    ANY("font-", F_CSS),
+    ANY("border", F_CSS),
+    ANY("flex", F_CSS),
+    ANY("@media", F_CSS),
+    ANY("@keyframes", F_CSS),
+    ANY("=>", F_JS | F_ARROW),
+    ANY("document.", F_JS),
+    ANY("self.", F_PY),
+    ANY("int main", F_C_MAIN),
+    ANY("public:", F_CPP),
+    ANY("namespace", F_CPP),
+    // Markers counted by looks_like_code; some also feed the groups above.
+    ANY("function ", MARKER(0) | F_JS | F_FUNCTION),
+    ANY("def ", MARKER(1) | F_PY),
+    ANY("class ", MARKER(2) | F_CPP | F_CLASS),
+    ANY("import ", MARKER(3) | F_PY),
+    ANY("#include", MARKER(4) | F_C_INCLUDE),
+    ANY("public void", MARKER(5)),
+    ANY("private int", MARKER(6)),
+    ANY("const ", MARKER(7) | F_JS | F_CONST),
+    ANY("let ", MARKER(8) | F_JS),
+    ANY("var ", MARKER(9)),
+    ANY("return ", MARKER(10)),
+    ANY("if (", MARKER(11)),
+    ANY("for (", MARKER(12)),
+    ANY("while (", MARKER(13)),
+    ANY("print(", MARKER(14) | F_PY),
+    ANY("console.log", MARKER(15) | F_JS),
+    ANY("{", MARKER(16) | F_OBRACE),
+    ANY("}", MARKER(17) | F_CBRACE),
+    ANY("//", MARKER(18)),
+    ANY("/*", MARKER(19)),
+    ANY("*/", MARKER(20)),
+    ANY("#!", MARKER(21)),
+};
+
+#undef MARKER
+#undef ANY
+
+struct LangInfo {
+  const char *tag;
+  const char *ext;
+  const char *mime;
+};
+
+// Fence tags (and detected languages) to file type. Unknown tags are sent
+// as .txt.
+const LangInfo kLangs[] = {
+    {"cpp", "cpp", "text/x-c++src"},      {"c++", "cpp", "text/x-c++src"},
+    {"cxx", "cpp", "text/x-c++src"},      {"c", "c", "text/x-csrc"},
+    {"py", "py", "text/x-python"},        {"python", "py", "text/x-python"},
+    {"js", "js", "application/javascript"}, {"javascript", "js", "application/javascript"},
+    {"html", "html", "text/html"},        {"html_full", "html", "text/html"},
+    {"css", "css", "text/css"},           {"json", "json", "application/json"},
+    {"md", "md", "text/markdown"},        {"markdown", "md", "text/markdown"},
+    {"ino", "ino", "text/x-c++src"},      {"arduino", "ino", "text/x-c++src"},
+    {"h", "h", "text/x-csrc"},            {"hpp", "hpp", "text/x-csrc"},
+    {"sh", "sh", "text/x-sh"},            {"bash", "sh", "text/x-sh"},
+    {"shell", "sh", "text/x-sh"},         {"ts", "ts", "text/typescript"},
+    {"typescript", "ts", "text/typescript"}, {"tsx", "tsx", "text/javascript"},
+    {"jsx", "jsx", "text/javascript"},    {"sql", "sql", "text/sql"},
+    {"java", "java", "text/java"},        {"rust", "rs", "text/rust"},
+    {"rs", "rs", "text/rust"},            {"go", "go", "text/go"},
+    {"golang", "go", "text/go"},          {"xml", "xml", "text/plain"},
+    {"yaml", "yaml", "text/plain"},       {"yml", "yml", "text/plain"},
+};
+
+KeywordMatcher g_matcher;
+
+bool is_space(char c) {
+  return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+// Case-insensitive lookup of text[start, end) in kLangs.
+const LangInfo *find_lang(const char *text, int start, int end) {
+  const int len = end - start;
+  for (size_t i = 0; i < sizeof(kLangs) / sizeof(kLangs[0]); i++) {
+    if ((int)strlen(kLangs[i].tag) == len && strncasecmp(kLangs[i].tag, text + start, len) == 0) {
+      return &kLangs[i];
+    }
+  }
+  return nullptr;
+}
+
+const char *detect_language(uint64_t f) {
+  if (f & F_HTML_TAG) {
+    return (f & F_HTML_RICH) ? "html_full" : "html";
+  }
+  if ((f & F_OBRACE) && (f & F_CBRACE) && (f & F_COLON) && (f & F_CSS)) {
+    return "css";
+  }
+  if (f & F_JS) {
+    return "js";
+  }
+  if (f & F_PY) {
+    return "py";
+  }
+  if ((f & F_C_INCLUDE) || ((f & F_C_MAIN) && (f & F_OBRACE))) {
+    return (f & F_CPP) ? "cpp" : "c";
+  }
+  return "";
+}
+
+void set_type(CodeSpan &span, const char *lang) {
+  const LangInfo *info = find_lang(lang, 0, strlen(lang));
+  span.lang = lang;
+  span.ext = info != nullptr ? info->ext : "txt";
+  span.mime = info != nullptr ? info->mime : "text/plain";
+}
+
+bool contains_code(uint64_t f, int fence_count) {
+  return fence_count > 0 || (f & (F_HTML_OPEN | F_FUNCTION | F_CLASS | F_C_INCLUDE)) ||
+         ((f & F_CONST) && (f & F_ARROW));
+}
+
+bool is_fence(const char *s, int i, int len) {
+  return i + 2 < len && s[i] == '`' && s[i + 1] == '`' && s[i + 2] == '`';
+}
+
+}  // namespace
+
+void code_scan_init() {
+  g_matcher.build(kPatterns, sizeof(kPatterns) / sizeof(kPatterns[0]));
+}
+
+void code_scan(const String &text, CodeScan &out) {
+  const char *s = text.c_str();
+  const int len = text.length();
+  out.span_count = 0;
+  out.fence_count = 0;
+
+  uint64_t whole = 0;  // features of the entire reply
+  uint64_t block = 0;  // features of the open fenced block
+  int state = 0;
+  int block_start = -1;
+  int tag_start = 0;
+  int tag_end = 0;
+  int lines = 0;
+  int indented = 0;
+
+  int i = 0;
+  while (i < len) {
+    if (is_fence(s, i, len)) {
+      out.fence_count++;
+      state = 0;
+      if (block_start < 0) {
+        // Opening fence: language tag runs to the first space or newline.
+        tag_start = i + 3;
+        tag_end = tag_start;
+        while (tag_end < len && s[tag_end] != '\n' && s[tag_end] != ' ') {
+          tag_end++;
+        }
+        int p = tag_end;
+        while (p < len && (s[p] == ' ' || s[p] == '\r')) {
+          p++;
+        }
+        if (p < len && s[p] == '\n') {
+          p++;
+        }
+        // The tag and the skipped whitespace still count towards `whole`.
+        for (int k = i + 3; k < p; k++) {
+          state = g_matcher.next(state, s[k]);
+          whole |= g_matcher.matches(state);
+          if (s[k] == '\n') {
+            lines++;
+          }
+        }
+        state = 0;
+        block_start = p;
+        block = 0;
+        i = p;
+        continue;
+      }
+
+      // Closing fence.
+      int start = block_start;
+      int end = i;
+      while (start < end && is_space(s[start])) {
+        start++;
+      }
+      while (end > start && is_space(s[end - 1])) {
+        end--;
+      }
+      if (end - start >= 10 && out.span_count < CODE_SCAN_MAX_SPANS) {
+        CodeSpan &span = out.spans[out.span_count++];
+        span.start = start;
+        span.end = end;
+        int ts = tag_start;
+        int te = tag_end;
+        while (ts < te && is_space(s[ts])) {
+          ts++;
+        }
+        while (te > ts && is_space(s[te - 1])) {
+          te--;
+        }
+        if (ts == te) {
+          set_type(span, detect_language(block));
+        } else {
+          const LangInfo *info = find_lang(s, ts, te);
+          span.lang = info != nullptr ? info->tag : "";
+          span.ext = info != nullptr ? info->ext : "txt";
+          span.mime = info != nullptr ? info->mime : "text/plain";
+        }
+      }
+      block_start = -1;
+      i += 3;
+      continue;
+    }
+
+    const char c = s[i];
+    state = g_matcher.next(state, c);
+    const uint64_t hit = g_matcher.matches(state);
+    whole |= hit;
+    if (block_start >= 0) {
+      block |= hit;
+    }
+    if (c == '\n') {
+      lines++;
+      int spaces = 0;
+      for (int j = i + 1; j < len && (s[j] == ' ' || s[j] == '\t'); j++) {
+        if (s[j] == ' ') {
+          spaces++;
+        }
+      }
+      if (spaces >= 4) {
+        indented++;
+      }
+    }
+    i++;
+  }
+
+  int markers = 0;
+  for (uint64_t m = whole & kMarkerMask; m != 0; m &= m - 1) {
+    markers++;
+  }
+  out.looks_like_code = markers >= 2 || (indented >= 3 && lines > 5);
+  out.contains_code = contains_code(whole, out.fence_count);
+  out.whole.start = 0;
+  out.whole.end = len;
+  set_type(out.whole, detect_language(whole));
+}
+
+bool code_scan_contains_code(const String &text) {
+  if (text.indexOf("```") >= 0) {
+    return true;
+  }
+  return contains_code(g_matcher.scan(text), 0);
+}
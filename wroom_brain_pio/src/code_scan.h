@@ -0,0 +1,38 @@
+#ifndef CODE_SCAN_H
+#define CODE_SCAN_H
+
+#include <Arduino.h>
+
+// Single-pass scan of an LLM reply for code: ``` fenced blocks, language
+// hints, and whether an unfenced reply reads like code. Spans are offsets
+// into the scanned text, so nothing is copied until a file is sent.
+
+#ifndef CODE_SCAN_MAX_SPANS
+#define CODE_SCAN_MAX_SPANS 8
+#endif
+
+struct CodeSpan {
+  int start;  // trimmed code, [start, end) in the scanned text
+  int end;
+  const char *lang;  // fence tag or detected language, "" if unknown
+  const char *ext;
+  const char *mime;
+};
+
+struct CodeScan {
+  CodeSpan spans[CODE_SCAN_MAX_SPANS];
+  int span_count;
+  int fence_count;      // ``` markers seen
+  bool looks_like_code;  // unfenced reply that reads like source code
+  bool contains_code;    // fences or typical code markers anywhere
+  CodeSpan whole;        // the entire reply, with its detected language
+};
+
+void code_scan_init();
+
+void code_scan(const String &text, CodeScan &out);
+
+// Cheap check used before truncating replies.
+bool code_scan_contains_code(const String &text);
+
+#endif
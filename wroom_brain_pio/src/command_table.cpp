@@ -0,0 +1,223 @@
+#include "command_table.h"
+
+namespace {
+
+portMUX_TYPE g_stats_mux = portMUX_INITIALIZER_UNLOCKED;
+
+const uint32_t kFnvOffset = 2166136261UL;
+const uint32_t kFnvPrime = 16777619UL;
+
+inline uint32_t fnv_step(uint32_t h, char c) {
+  return (h ^ (uint8_t)c) * kFnvPrime;
+}
+
+uint32_t fnv(const char *s) {
+  uint32_t h = kFnvOffset;
+  while (*s) {
+    h = fnv_step(h, *s++);
+  }
+  return h;
+}
+
+}  // namespace
+
+CommandTable::CommandTable()
+    : specs_(nullptr), count_(0), slots_(nullptr), slot_mask_(0), max_words_(1), stats_(nullptr) {}
+
+bool CommandTable::build(const CommandSpec *specs, int count) {
+  if (slots_ != nullptr) {
+    return true;
+  }
+  int keys = 0;
+  for (int r = 0; r < count; r++) {
+    for (int n = 0; n < kCommandMaxNames && specs[r].names[n] != nullptr; n++) {
+      keys++;
+    }
+  }
+  if (count * kCommandMaxNames > 32767) {
+    Serial.println("[commands] table too large");
+    return false;
+  }
+  // Keep the load under one half so probe runs stay short.
+  int size = 16;
+  while (size < keys * 2) {
+    size <<= 1;
+  }
+
+  int16_t *slots = (int16_t *)malloc(size * sizeof(int16_t));
+  Stats *stats = (Stats *)calloc(count, sizeof(Stats));
+  if (slots == nullptr || stats == nullptr) {
+    free(slots);
+    free(stats);
+    Serial.println("[commands] out of memory");
+    return false;
+  }
+  for (int i = 0; i < size; i++) {
+    slots[i] = -1;
+  }
+
+  uint8_t max_words = 1;
+  for (int r = 0; r < count; r++) {
+    for (int n = 0; n < kCommandMaxNames && specs[r].names[n] != nullptr; n++) {
+      const char *name = specs[r].names[n];
+      uint8_t words = 1;
+      for (const char *p = name; *p; p++) {
+        if (*p == ' ') {
+          words++;
+        }
+      }
+      if (words > max_words) {
+        max_words = words;
+      }
+      uint32_t i = fnv(name) & (size - 1);
+      while (slots[i] >= 0) {
+        const int other = slots[i];
+        if (strcmp(specs[other / kCommandMaxNames].names[other % kCommandMaxNames], name) == 0) {
+          Serial.printf("[commands] duplicate name: %s\n", name);
+          free(slots);
+          free(stats);
+          return false;
+        }
+        i = (i + 1) & (size - 1);
+      }
+      slots[i] = (int16_t)(r * kCommandMaxNames + n);
+    }
+  }
+
+  specs_ = specs;
+  count_ = count;
+  slot_mask_ = (uint16_t)(size - 1);
+  max_words_ = max_words;
+  stats_ = stats;
+  slots_ = slots;
+  return true;
+}
+
+// Looks up the name text[0, len) and checks its arity against has_args.
+int CommandTable::probe(const char *text, size_t len, uint32_t hash, bool has_args) const {
+  uint32_t i = hash & slot_mask_;
+  while (slots_[i] >= 0) {
+    const int key = slots_[i];
+    const char *name = specs_[key / kCommandMaxNames].names[key % kCommandMaxNames];
+    if (strncmp(name, text, len) == 0 && name[len] == '\0') {
+      const CommandArity arity = specs_[key / kCommandMaxNames].arity;
+      const bool ok = has_args ? arity != CMD_ARGS_NONE : arity != CMD_ARGS_REQUIRED;
+      return ok ? key / kCommandMaxNames : -1;
+    }
+    i = (i + 1) & slot_mask_;
+  }
+  return -1;
+}
+
+int CommandTable::find_exact(const String &cmd_lc) const {
+  if (slots_ == nullptr) {
+    return -1;
+  }
+  return probe(cmd_lc.c_str(), cmd_lc.length(), fnv(cmd_lc.c_str()), false);
+}
+
+int CommandTable::find_prefix(const String &cmd_lc) const {
+  if (slots_ == nullptr) {
+    return -1;
+  }
+  const char *text = cmd_lc.c_str();
+  const size_t len = cmd_lc.length();
+
+  // One pass hashes every word prefix a name could be.
+  size_t cut_len[8];
+  uint32_t cut_hash[8];
+  int cuts = 0;
+  uint32_t h = kFnvOffset;
+  for (size_t i = 0; i < len && cuts < max_words_ && cuts < 8; i++) {
+    if (text[i] == ' ') {
+      cut_len[cuts] = i;
+      cut_hash[cuts] = h;
+      cuts++;
+    }
+    h = fnv_step(h, text[i]);
+  }
+
+  for (int c = cuts - 1; c >= 0; c--) {
+    const int row = probe(text, cut_len[c], cut_hash[c], true);
+    if (row >= 0) {
+      return row;
+    }
+  }
+  return -1;
+}
+
+bool CommandTable::run(int row, const String &input, const String &cmd, const String &cmd_lc,
+                       uint32_t intents, String &out) {
+  const uint32_t started = micros();
+  const bool handled = specs_[row].handler(input, cmd, cmd_lc, intents, out);
+  const uint32_t elapsed = micros() - started;
+
+  portENTER_CRITICAL(&g_stats_mux);
+  Stats &st = stats_[row];
+  st.calls++;
+  st.total_us += elapsed;
+  if (elapsed > st.max_us) {
+    st.max_us = elapsed;
+  }
+  portEXIT_CRITICAL(&g_stats_mux);
+  return handled;
+}
+
+String CommandTable::stats_line(int top) const {
+  if (slots_ == nullptr) {
+    return "off";
+  }
+  uint32_t total = 0;
+  for (int r = 0; r < count_; r++) {
+    total += stats_[r].calls;
+  }
+  String out = "rows=" + String(count_) + " calls=" + String(total);
+
+  // Small selection sort over the busiest rows; the table is read once.
+  int shown[8];
+  int shown_count = 0;
+  if (top > 8) {
+    top = 8;
+  }
+  while (shown_count < top) {
+    int best = -1;
+    for (int r = 0; r < count_; r++) {
+      bool taken = false;
+      for (int s = 0; s < shown_count && !taken; s++) {
+        taken = shown[s] == r;
+      }
+      if (!taken && stats_[r].calls > 0 && (best < 0 || stats_[r].calls > stats_[best].calls)) {
+        best = r;
+      }
+    }
+    if (best < 0) {
+      break;
+    }
+    out += (shown_count == 0 ? " top=" : ",");
+    out += String(specs_[best].names[0]) + ":" + String(stats_[best].calls);
+    shown[shown_count++] = best;
+  }
+  return out;
+}
+
+String CommandTable::stats_text() const {
+  if (slots_ == nullptr) {
+    return "Command table not ready";
+  }
+  String out = "Command calls (avg/max ms):\n";
+  int listed = 0;
+  for (int r = 0; r < count_; r++) {
+    const Stats &st = stats_[r];
+    if (st.calls == 0) {
+      continue;
+    }
+    out += String(specs_[r].names[0]) + " " + String(st.calls) + "x " +
+           String((unsigned long)(st.total_us / st.calls / 1000)) + "/" +
+           String((unsigned long)(st.max_us / 1000)) + "\n";
+    listed++;
+  }
+  if (listed == 0) {
+    out += "(none yet)\n";
+  }
+  return out;
+}
@@ -0,0 +1,68 @@
+#ifndef COMMAND_TABLE_H
+#define COMMAND_TABLE_H
+
+#include <Arduino.h>
+
+// Declarative table of tool commands with an open-addressed hash index over
+// every name and alias, so dispatch costs one pass over the input and a
+// few probes instead of a run of string compares. Per-command call counts
+// and handler latency are kept as a side effect of dispatch.
+
+typedef bool (*CommandHandler)(const String &input, const String &cmd, const String &cmd_lc,
+                               uint32_t intents, String &out);
+
+enum CommandArity {
+  CMD_ARGS_NONE,      // "name" only
+  CMD_ARGS_OPTIONAL,  // "name" or "name <args>"
+  CMD_ARGS_REQUIRED,  // "name <args>" only
+};
+
+static const int kCommandMaxNames = 8;
+
+struct CommandSpec {
+  const char *names[kCommandMaxNames];  // lowercase; primary name first, unused = nullptr
+  CommandArity arity;
+  CommandHandler handler;
+};
+
+class CommandTable {
+ public:
+  CommandTable();
+
+  // Indexes the table; call once at init. Rows compiled out by a feature
+  // flag are simply absent. Fails on a duplicate name.
+  bool build(const CommandSpec *specs, int count);
+  bool ready() const { return slots_ != nullptr; }
+
+  // Row whose name is the whole lowercased command, or -1.
+  int find_exact(const String &cmd_lc) const;
+  // Row whose name is followed by arguments, or -1. Names may span several
+  // words ("model use"); the longest matching name wins.
+  int find_prefix(const String &cmd_lc) const;
+
+  // Runs the row's handler and records its latency.
+  bool run(int row, const String &input, const String &cmd, const String &cmd_lc,
+           uint32_t intents, String &out);
+
+  // Busiest commands with call counts and handler times
+  String stats_line(int top) const;
+  String stats_text() const;
+
+ private:
+  struct Stats {
+    uint32_t calls;
+    uint64_t total_us;
+    uint32_t max_us;
+  };
+
+  int probe(const char *text, size_t len, uint32_t hash, bool has_args) const;
+
+  const CommandSpec *specs_;
+  int count_;
+  int16_t *slots_;  // key = row * kCommandMaxNames + name, -1 = empty
+  uint16_t slot_mask_;
+  uint8_t max_words_;
+  Stats *stats_;
+};
+
+#endif
@@ -6,39 +6,8 @@
 #include <WiFiClientSecure.h>
 
 #include "brain_config.h"
-
-namespace {
-
-String json_escape(const String &src) {
-  String out;
-  out.reserve(src.length() * 1.2);
-  for (size_t i = 0; i < src.length(); i++) {
-    const char c = src[i];
-    switch (c) {
-      case '"':
-        out += "\\\"";
-        break;
-      case '\\':
-        out += "\\\\";
-        break;
-      case '\n':
-        out += "\\n";
-        break;
-      case '\r':
-        out += "\\r";
-        break;
-      case '\t':
-        out += "\\t";
-        break;
-      default:
-        out += c;
-        break;
-    }
-  }
-  return out;
-}
-
-}  // namespace
+#include "json_writer.h"
+#include "tls_session_cache.h"
 
 bool discord_send_message(const String &message, String &error_out) {
   String webhook_url = String(DISCORD_WEBHOOK_URL);
@@ -54,9 +23,10 @@ bool discord_send_message(const String &message, String &error_out) {
     return false;
   }
 
-  String body = "{ \"content\": \"" + json_escape(message) + "\" }";
+  JsonBody body;
+  body.raw("{ \"content\": ").str(message).raw(" }");
 
-  WiFiClientSecure client;
+  TlsSessionClient client;
   client.setInsecure();
 
   HTTPClient https;
@@ -69,7 +39,7 @@ bool discord_send_message(const String &message, String &error_out) {
   https.setTimeout(15000);
   https.addHeader("Content-Type", "application/json");
 
-  int code = https.POST((uint8_t *)body.c_str(), body.length());
+  int code = https.sendRequest("POST", &body, body.length());
   String resp_body;
   if (code > 0) {
     resp_body = https.getString();
@@ -131,7 +101,7 @@ bool discord_send_web_files(const String &topic, const String &html, const Strin
   // Close Boundary
   body += "--" + boundary + "--\r\n";
 
-  WiFiClientSecure client;
+  TlsSessionClient client;
   client.setInsecure();
 
   HTTPClient https;
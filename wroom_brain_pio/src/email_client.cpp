@@ -6,49 +6,27 @@
 #include <HTTPClient.h>
 
 #include "brain_config.h"
+#include "json_writer.h"
+#include "tls_session_cache.h"
 
 namespace {
 
-static String json_escape(const String &src) {
-  String out;
-  out.reserve(src.length() * 1.2);
-  for (size_t i = 0; i < src.length(); i++) {
-    const char c = src[i];
-    switch (c) {
-      case '"':
-        out += "\\\"";
-        break;
-      case '\\':
-        out += "\\\\";
-        break;
-      case '\n':
-        out += "\\n";
-        break;
-      case '\r':
-        out += "\\r";
-        break;
-      case '\t':
-        out += "\\t";
-        break;
-      default:
-        out += c;
-        break;
-    }
-  }
-  return out;
-}
-
 struct HttpResult {
   int status_code;
   String body;
 };
 
-static HttpResult http_post_json(const String &url, const String &json_body,
-                                   const String &auth_header = "") {
+// The body is escaped while it is sent, so an HTML email is never held
+// twice (raw and escaped) in RAM.
+static HttpResult http_post_json(const String &url, JsonBody &json_body,
+                                 const String &auth_header = "") {
   HttpResult result;
   result.status_code = -1;
+  if (!json_body.ok()) {
+    return result;
+  }
 
-  WiFiClientSecure client;
+  TlsSessionClient client;
   client.setInsecure();
 
   HTTPClient https;
@@ -61,7 +39,8 @@ static HttpResult http_post_json(const String &url, const String &json_body,
     https.addHeader("Authorization", auth_header);
   }
 
-  const int code = https.POST(json_body);
+  json_body.rewind();
+  const int code = https.sendRequest("POST", &json_body, json_body.length());
   result.status_code = code;
   result.body = https.getString();
 
@@ -99,20 +78,20 @@ bool email_send(const String &to, const String &subject, const String &html_cont
 
   const String url = "https://api.resend.com/emails";
 
-  String body = "{";
-  body += "\"from\":\"" + json_escape(from_email) + "\",";
-  body += "\"to\":\"" + json_escape(to) + "\",";
-  body += "\"subject\":\"" + json_escape(subject) + "\"";
+  JsonBody body;
+  body.raw("{\"from\":").str(from_email);
+  body.raw(",\"to\":").str(to);
+  body.raw(",\"subject\":").str(subject);
 
   if (html_content.length() > 0) {
-    body += ",\"html\":\"" + json_escape(html_content) + "\"";
+    body.raw(",\"html\":").str(html_content);
   }
 
   if (text_content.length() > 0) {
-    body += ",\"text\":\"" + json_escape(text_content) + "\"";
+    body.raw(",\"text\":").str(text_content);
   }
 
-  body += "}";
+  body.raw("}");
 
   const HttpResult res = http_post_json(url, body, "Bearer " + api_key);
 
@@ -731,6 +731,27 @@ bool file_memory_read_file(const String &filename, String &content_out, String &
   return true;
 }
 
+bool file_memory_open_file(const String &filename, fs::File &file_out, String &error_out) {
+  if (!g_backend_ready) {
+    error_out = "Filesystem not ready";
+    return false;
+  }
+
+  String path = normalize_user_path(filename);
+  if (!fs_exists(path.c_str())) {
+    error_out = "File not found: " + filename;
+    return false;
+  }
+
+  file_out = fs_open(path.c_str(), FILE_READ);
+  if (!file_out || file_out.isDirectory()) {
+    file_out.close();
+    error_out = "Failed to open file: " + filename;
+    return false;
+  }
+  return true;
+}
+
 bool file_memory_write_file(const String &filename, const String &content, String &error_out) {
   if (!g_backend_ready) {
     error_out = "Filesystem not ready";
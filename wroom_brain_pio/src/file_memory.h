@@ -2,6 +2,7 @@
 #define FILE_MEMORY_H
 
 #include <Arduino.h>
+#include <FS.h>
 
 // Initialize SPIFFS and create default files
 void file_memory_init();
@@ -36,5 +37,7 @@ bool file_memory_get_info(String &info_out, String &error_out);
 bool file_memory_list_files(String &list_out, String &error_out);
 bool file_memory_read_file(const String &filename, String &content_out, String &error_out);
 bool file_memory_write_file(const String &filename, const String &content, String &error_out);
+// Open a stored file for streaming reads; caller closes it.
+bool file_memory_open_file(const String &filename, fs::File &file_out, String &error_out);
 
 #endif
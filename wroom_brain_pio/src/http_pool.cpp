@@ -0,0 +1,294 @@
+#include "http_pool.h"
+
+#include <Arduino.h>
+#include <freertos/semphr.h>
+
+#include "brain_config.h"
+#include "tls_session_cache.h"
+
+namespace {
+
+struct PoolSlot {
+  WiFiClient *client;
+  HTTPClient *http;
+  String host_key;  // "scheme://host:port"
+  bool tls;
+  bool busy;
+  unsigned long connected_at_ms;
+  unsigned long last_used_ms;
+  uint32_t requests;   // requests served on the current connection
+  uint32_t reuses;     // requests that skipped the handshake
+};
+
+PoolSlot g_slots[HTTP_POOL_SLOTS];
+SemaphoreHandle_t g_mutex = nullptr;
+
+uint32_t g_total_handshakes = 0;
+uint32_t g_total_reuses = 0;
+uint32_t g_total_ephemeral = 0;
+uint32_t g_total_retries = 0;
+uint32_t g_total_unhealthy = 0;
+
+bool is_plain_http(const String &url) {
+  return url.startsWith("http://") || url.startsWith("HTTP://");
+}
+
+String host_key_from_url(const String &url) {
+  const bool plain = is_plain_http(url);
+  int start = url.indexOf("://");
+  start = (start < 0) ? 0 : start + 3;
+  int end = url.indexOf('/', start);
+  if (end < 0) {
+    end = url.length();
+  }
+  String key = url.substring(start, end);
+  if (key.indexOf(':') < 0) {
+    key += plain ? ":80" : ":443";
+  }
+  key = (plain ? "http://" : "https://") + key;
+  key.toLowerCase();
+  return key;
+}
+
+WiFiClient *new_client(bool tls) {
+  if (!tls) {
+    return new WiFiClient();
+  }
+  TlsSessionClient *client = new TlsSessionClient();
+  client->setInsecure();
+  return client;
+}
+
+void ensure_mutex() {
+  if (g_mutex == nullptr) {
+    g_mutex = xSemaphoreCreateMutex();
+  }
+}
+
+void close_slot(PoolSlot &slot) {
+  if (slot.http != nullptr) {
+    slot.http->setReuse(false);
+    slot.http->end();
+  }
+  if (slot.client != nullptr) {
+    slot.client->stop();
+  }
+  slot.connected_at_ms = 0;
+  slot.requests = 0;
+  slot.reuses = 0;
+}
+
+// Reusable only if the server has not closed the socket and nothing is
+// left unread from an earlier response; stray bytes would be taken as the
+// start of the next reply.
+bool slot_is_healthy(PoolSlot &slot) {
+  if (slot.client == nullptr || !slot.client->connected()) {
+    return false;
+  }
+  if (slot.client->available() > 0) {
+    g_total_unhealthy++;
+    Serial.println("[http_pool] unread bytes on idle connection, reconnecting");
+    return false;
+  }
+  return true;
+}
+
+// Picks an idle slot: same host first, then an empty one, then the least
+// recently used. Returns -1 when every slot is leased. Caller holds the mutex.
+int pick_slot(const String &key) {
+  int empty = -1;
+  int lru = -1;
+  for (int i = 0; i < HTTP_POOL_SLOTS; i++) {
+    PoolSlot &slot = g_slots[i];
+    if (slot.busy) {
+      continue;
+    }
+    if (slot.host_key == key) {
+      return i;
+    }
+    if (slot.host_key.length() == 0) {
+      if (empty < 0) {
+        empty = i;
+      }
+      continue;
+    }
+    if (lru < 0 || slot.last_used_ms < g_slots[lru].last_used_ms) {
+      lru = i;
+    }
+  }
+  return empty >= 0 ? empty : lru;
+}
+
+}  // namespace
+
+void http_pool_init() {
+  ensure_mutex();
+  for (int i = 0; i < HTTP_POOL_SLOTS; i++) {
+    g_slots[i].client = nullptr;
+    g_slots[i].http = nullptr;
+    g_slots[i].host_key = "";
+    g_slots[i].tls = true;
+    g_slots[i].busy = false;
+    g_slots[i].connected_at_ms = 0;
+    g_slots[i].last_used_ms = 0;
+    g_slots[i].requests = 0;
+    g_slots[i].reuses = 0;
+  }
+}
+
+bool http_pool_acquire(const String &url, HttpPoolLease &lease) {
+  ensure_mutex();
+  lease = HttpPoolLease();
+  const String key = host_key_from_url(url);
+  const bool tls = !is_plain_http(url);
+
+  int idx = -1;
+  if (g_mutex != nullptr && xSemaphoreTake(g_mutex, portMAX_DELAY) == pdTRUE) {
+    idx = pick_slot(key);
+    if (idx >= 0) {
+      g_slots[idx].busy = true;
+    }
+    xSemaphoreGive(g_mutex);
+  }
+
+  if (idx < 0) {
+    // Pool exhausted (e.g. a long poll plus a send in flight): one-shot client.
+    lease.client = new_client(tls);
+    lease.http = new HTTPClient();
+    lease.slot = -1;
+    g_total_ephemeral++;
+    g_total_handshakes++;
+    if (!lease.http->begin(*lease.client, url)) {
+      http_pool_release(lease, false);
+      return false;
+    }
+    return true;
+  }
+
+  PoolSlot &slot = g_slots[idx];
+  if (slot.host_key != key) {
+    // Rebinding to another host; drop the old session.
+    close_slot(slot);
+    slot.host_key = key;
+  }
+  if (slot.client != nullptr && slot.tls != tls) {
+    // HTTPClient keeps a pointer to its client, so replace both.
+    delete slot.http;  // destructor stops the client, so delete it first
+    slot.http = nullptr;
+    delete slot.client;
+    slot.client = nullptr;
+  }
+  if (slot.client == nullptr) {
+    slot.client = new_client(tls);
+    slot.tls = tls;
+  }
+  if (slot.http == nullptr) {
+    slot.http = new HTTPClient();
+  }
+
+  // Servers drop idle keep-alive sockets; close proactively rather than
+  // discovering it as a failed write.
+  const unsigned long now = millis();
+  if (slot.connected_at_ms != 0 &&
+      ((now - slot.last_used_ms) > HTTP_POOL_IDLE_MS ||
+       (now - slot.connected_at_ms) > HTTP_POOL_MAX_AGE_MS)) {
+    close_slot(slot);
+  }
+
+  lease.reused = slot_is_healthy(slot);
+  if (lease.reused) {
+    slot.reuses++;
+    g_total_reuses++;
+  } else {
+    close_slot(slot);
+    slot.connected_at_ms = now;
+    g_total_handshakes++;
+  }
+  slot.requests++;
+
+  slot.http->setReuse(true);
+  lease.client = slot.client;
+  lease.http = slot.http;
+  lease.slot = idx;
+
+  if (!slot.http->begin(*slot.client, url)) {
+    http_pool_release(lease, false);
+    return false;
+  }
+  return true;
+}
+
+void http_pool_release(HttpPoolLease &lease, bool keep_alive) {
+  if (lease.slot < 0) {
+    if (lease.http != nullptr) {
+      lease.http->end();
+      delete lease.http;  // destructor stops the client, so delete it first
+    }
+    if (lease.client != nullptr) {
+      delete lease.client;
+    }
+    lease = HttpPoolLease();
+    return;
+  }
+
+  PoolSlot &slot = g_slots[lease.slot];
+  if (keep_alive) {
+    slot.http->end();  // keeps the socket open when the server allows reuse
+  } else {
+    close_slot(slot);
+  }
+  slot.last_used_ms = millis();
+
+  if (g_mutex != nullptr && xSemaphoreTake(g_mutex, portMAX_DELAY) == pdTRUE) {
+    slot.busy = false;
+    xSemaphoreGive(g_mutex);
+  }
+  lease = HttpPoolLease();
+}
+
+bool http_pool_should_retry(const HttpPoolLease &lease, int status_code, const char *method) {
+  if (!lease.reused) {
+    return false;
+  }
+  // Any method may resend a request that never reached the server. Once
+  // headers went out (payload or connection lost) the server may have acted
+  // on a POST, and resending could duplicate a message or an email; a GET
+  // has no such effect and is resent in those cases too.
+  const bool unsent = status_code == HTTPC_ERROR_SEND_HEADER_FAILED ||
+                      status_code == HTTPC_ERROR_NOT_CONNECTED;
+  const bool idempotent = strcmp(method, "GET") == 0 || strcmp(method, "HEAD") == 0;
+  const bool stale = unsent || (idempotent && (status_code == HTTPC_ERROR_SEND_PAYLOAD_FAILED ||
+                                               status_code == HTTPC_ERROR_CONNECTION_LOST));
+  if (stale) {
+    g_total_retries++;
+    Serial.println("[http_pool] stale keep-alive connection, reconnecting");
+  }
+  return stale;
+}
+
+String http_pool_health_line() {
+  String line = "handshakes=" + String(g_total_handshakes) +
+                " reuses=" + String(g_total_reuses) +
+                " ephemeral=" + String(g_total_ephemeral) +
+                " retries=" + String(g_total_retries) +
+                " unhealthy=" + String(g_total_unhealthy);
+  const unsigned long now = millis();
+  for (int i = 0; i < HTTP_POOL_SLOTS; i++) {
+    const PoolSlot &slot = g_slots[i];
+    if (slot.host_key.length() == 0) {
+      continue;
+    }
+    line += " [" + slot.host_key;
+    if (slot.connected_at_ms != 0) {
+      line += " age_s=" + String((now - slot.connected_at_ms) / 1000UL) +
+              " req=" + String(slot.requests) + " reused=" + String(slot.reuses);
+    } else {
+      line += " closed";
+    }
+    if (slot.busy) {
+      line += " busy";
+    }
+    line += "]";
+  }
+  return line;
+}
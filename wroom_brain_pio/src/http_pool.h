@@ -0,0 +1,50 @@
+#ifndef HTTP_POOL_H
+#define HTTP_POOL_H
+
+#include <Arduino.h>
+#include <HTTPClient.h>
+#include <WiFiClientSecure.h>
+
+// Keep-alive HTTP(S) connections shared across callers. Each slot owns a
+// persistent client + HTTPClient pair bound to one scheme://host:port, so
+// consecutive requests to the same host skip the TCP and TLS handshakes.
+// Plain http:// URLs (e.g. a LAN Ollama server) get a non-TLS client.
+//
+// Usage:
+//   HttpPoolLease lease;
+//   if (!http_pool_acquire(url, lease)) { ... }
+//   lease.http->addHeader(...);
+//   int code = lease.http->POST(...);
+//   String body = code > 0 ? lease.http->getString() : "";
+//   const bool retry = http_pool_should_retry(lease, code, "POST");
+//   http_pool_release(lease, code > 0);
+//
+// When every slot is busy the lease falls back to a one-shot connection.
+
+struct HttpPoolLease {
+  HTTPClient *http = nullptr;
+  WiFiClient *client = nullptr;
+  int slot = -1;        // -1 = ephemeral connection
+  bool reused = false;  // true if the TLS session was already open
+};
+
+void http_pool_init();
+
+// Bind a connection to url. Returns false if HTTPClient::begin fails.
+bool http_pool_acquire(const String &url, HttpPoolLease &lease);
+
+// Return the connection. keep_alive=false closes it (use after errors or
+// when the response body was not fully consumed); a connection is only
+// handed out again if it is still open and has no unread bytes.
+void http_pool_release(HttpPoolLease &lease, bool keep_alive);
+
+// True when a request failed because a reused connection had gone stale and
+// resending it is safe: before anything was sent, or for GET/HEAD also when
+// the connection dropped mid-request. The caller should acquire again and
+// resend once.
+bool http_pool_should_retry(const HttpPoolLease &lease, int status_code, const char *method);
+
+// One-line summary for the health command
+String http_pool_health_line();
+
+#endif
@@ -0,0 +1,121 @@
+#include "intent.h"
+
+#include "keyword_matcher.h"
+
+namespace {
+
+#define PREFIX(text, bits) {text, bits, true}
+#define ANY(text, bits) {text, bits, false}
+
+const KeywordPattern kPatterns[] = {
+    PREFIX("/", INTENT_SLASH),
+
+    // Command prefixes that the tool router can usually map to a command.
+    PREFIX("set ", INTENT_ROUTE), PREFIX("show ", INTENT_ROUTE), PREFIX("list ", INTENT_ROUTE),
+    PREFIX("add ", INTENT_ROUTE), PREFIX("delete ", INTENT_ROUTE), PREFIX("clear ", INTENT_ROUTE),
+    PREFIX("turn ", INTENT_ROUTE), PREFIX("switch ", INTENT_ROUTE), PREFIX("enable ", INTENT_ROUTE),
+    PREFIX("disable ", INTENT_ROUTE), PREFIX("remind ", INTENT_ROUTE),
+    PREFIX("schedule ", INTENT_ROUTE), PREFIX("search ", INTENT_ROUTE),
+    PREFIX("look up ", INTENT_ROUTE), PREFIX("find ", INTENT_ROUTE), PREFIX("google ", INTENT_ROUTE),
+    PREFIX("status", INTENT_ROUTE), PREFIX("health", INTENT_ROUTE), PREFIX("logs", INTENT_ROUTE),
+    PREFIX("time", INTENT_ROUTE), PREFIX("timezone", INTENT_ROUTE), PREFIX("task ", INTENT_ROUTE),
+    PREFIX("memory", INTENT_ROUTE), PREFIX("remember ", INTENT_ROUTE | INTENT_REMEMBER),
+    PREFIX("forget", INTENT_ROUTE), PREFIX("flash ", INTENT_ROUTE), PREFIX("blink ", INTENT_ROUTE),
+    PREFIX("led ", INTENT_ROUTE), PREFIX("sensor ", INTENT_ROUTE), PREFIX("relay ", INTENT_ROUTE),
+    PREFIX("safe mode", INTENT_ROUTE), PREFIX("email ", INTENT_ROUTE), PREFIX("plan ", INTENT_ROUTE),
+    PREFIX("confirm", INTENT_ROUTE), PREFIX("cancel", INTENT_ROUTE), PREFIX("create ", INTENT_ROUTE),
+    PREFIX("build ", INTENT_ROUTE), PREFIX("make ", INTENT_ROUTE), PREFIX("generate ", INTENT_ROUTE),
+    PREFIX("website", INTENT_ROUTE), PREFIX("html", INTENT_ROUTE), PREFIX("web ", INTENT_ROUTE),
+    PREFIX("saas", INTENT_ROUTE), PREFIX("landing", INTENT_ROUTE), PREFIX("portfolio", INTENT_ROUTE),
+    PREFIX("host ", INTENT_ROUTE), PREFIX("serve ", INTENT_ROUTE), PREFIX("deploy ", INTENT_ROUTE),
+    PREFIX("what ", INTENT_ROUTE), PREFIX("who ", INTENT_ROUTE), PREFIX("tell me", INTENT_ROUTE),
+    PREFIX("explain", INTENT_ROUTE), PREFIX("define", INTENT_ROUTE),
+    // ...and wording anywhere that hints at a schedule or an update.
+    ANY("every day", INTENT_ROUTE), ANY("everyday", INTENT_ROUTE), ANY("daily", INTENT_ROUTE),
+    ANY("at ", INTENT_ROUTE), ANY("reminder", INTENT_ROUTE), ANY("web search", INTENT_ROUTE),
+    ANY("latest", INTENT_ROUTE),
+
+    // Firmware updates (also route hints).
+    ANY("update", INTENT_ROUTE | INTENT_UPDATE), ANY("upgrade", INTENT_ROUTE | INTENT_UPDATE),
+    ANY("firmware", INTENT_ROUTE | INTENT_UPDATE), ANY("new version", INTENT_ROUTE | INTENT_UPDATE),
+    ANY("flash", INTENT_UPDATE),
+
+    // Multi-step reasoning, search and web generation: worth a ReAct loop.
+    ANY("how do i", INTENT_REACT), ANY("help me", INTENT_REACT), ANY("what should", INTENT_REACT),
+    ANY("can you", INTENT_REACT), ANY("i need to", INTENT_REACT), ANY("remember to", INTENT_REACT),
+    ANY("set up", INTENT_REACT), ANY("configure", INTENT_REACT), ANY("schedule", INTENT_REACT),
+    ANY("remind ", INTENT_REACT), ANY("in 1 ", INTENT_REACT), ANY("in 2 ", INTENT_REACT),
+    ANY("in 3 ", INTENT_REACT), ANY("in 4 ", INTENT_REACT), ANY("in 5 ", INTENT_REACT),
+    ANY("in 10 ", INTENT_REACT), ANY("in 15 ", INTENT_REACT), ANY("in 20 ", INTENT_REACT),
+    ANY("in 30 ", INTENT_REACT), ANY("figure out", INTENT_REACT), ANY("find out", INTENT_REACT),
+    ANY("check if", INTENT_REACT), ANY("make sure", INTENT_REACT), ANY("todo", INTENT_REACT),
+    ANY("task", INTENT_REACT), ANY("plan", INTENT_REACT), ANY("organize", INTENT_REACT),
+    ANY("track", INTENT_REACT), ANY("what is", INTENT_REACT | INTENT_UNDERSTAND),
+    ANY("what's", INTENT_REACT), ANY("who is", INTENT_REACT), ANY("who's", INTENT_REACT),
+    ANY("tell me about", INTENT_REACT), ANY("search for", INTENT_REACT),
+    ANY("look up", INTENT_REACT), ANY("google", INTENT_REACT),
+    ANY("explain", INTENT_REACT | INTENT_UNDERSTAND), ANY("define", INTENT_REACT),
+    ANY("meaning of", INTENT_REACT), ANY("make a", INTENT_REACT), ANY("create a", INTENT_REACT),
+    ANY("generate a", INTENT_REACT), ANY("build a", INTENT_REACT), ANY("website", INTENT_REACT),
+    ANY("html", INTENT_REACT), ANY("saas", INTENT_REACT), ANY("landing page", INTENT_REACT),
+    ANY("portfolio", INTENT_REACT), ANY("app", INTENT_REACT), ANY("email me", INTENT_REACT),
+    ANY("send email", INTENT_REACT), ANY("email those", INTENT_REACT),
+    ANY("email the", INTENT_REACT), ANY("whatsapp", INTENT_REACT), ANY("wa me", INTENT_REACT),
+    ANY("use skill", INTENT_REACT), ANY("use_skill", INTENT_REACT), ANY("skill", INTENT_REACT),
+
+    // Natural-language email requests.
+    ANY("mail", INTENT_MAIL_WORD), ANY("send", INTENT_MAIL_WORD),
+    ANY("to", INTENT_MAIL_TARGET), ANY("@", INTENT_MAIL_TARGET),
+
+    // Document and image questions.
+    ANY("pdf", INTENT_DOCUMENT), ANY("document", INTENT_DOCUMENT), ANY("doc file", INTENT_DOCUMENT),
+    ANY("report", INTENT_DOCUMENT), ANY("summar", INTENT_SUMMARY | INTENT_UNDERSTAND),
+    ANY("tldr", INTENT_SUMMARY), ANY("tl;dr", INTENT_SUMMARY), ANY("key points", INTENT_SUMMARY),
+    ANY("highlights", INTENT_SUMMARY), ANY("gist", INTENT_SUMMARY),
+    ANY("explain this", INTENT_SUMMARY), ANY("review this", INTENT_SUMMARY),
+    ANY("image", INTENT_IMAGE), ANY("photo", INTENT_IMAGE), ANY("picture", INTENT_IMAGE),
+    ANY("screenshot", INTENT_IMAGE), ANY("diagram", INTENT_IMAGE),
+    ANY("describe", INTENT_UNDERSTAND), ANY("what's in", INTENT_UNDERSTAND),
+    ANY("analy", INTENT_UNDERSTAND), ANY("understand", INTENT_UNDERSTAND),
+    ANY("ocr", INTENT_UNDERSTAND), ANY("extract text", INTENT_UNDERSTAND),
+    ANY("read text", INTENT_UNDERSTAND),
+
+    // Facts about the user: auto-learn candidates...
+    ANY("remember", INTENT_PERSONAL), ANY("favorit", INTENT_PERSONAL),
+    ANY("name is", INTENT_PERSONAL), ANY("i am ", INTENT_PERSONAL), ANY("my ", INTENT_PERSONAL),
+    // ...and what is written straight to MEMORY.md.
+    PREFIX("my ", INTENT_REMEMBER), PREFIX("i am ", INTENT_REMEMBER),
+    PREFIX("i'm ", INTENT_REMEMBER), PREFIX("don't forget ", INTENT_REMEMBER),
+    PREFIX("call me ", INTENT_REMEMBER), ANY(" i like ", INTENT_REMEMBER),
+    ANY(" i love ", INTENT_REMEMBER), ANY(" my favorite ", INTENT_REMEMBER),
+    ANY(" remember that ", INTENT_REMEMBER), ANY(" please remember", INTENT_REMEMBER),
+    ANY(" don't forget", INTENT_REMEMBER),
+};
+
+#undef PREFIX
+#undef ANY
+
+KeywordMatcher g_matcher;
+
+bool is_space(char c) {
+  return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+}  // namespace
+
+void intent_init() {
+  g_matcher.build(kPatterns, sizeof(kPatterns) / sizeof(kPatterns[0]));
+}
+
+uint32_t intent_classify(const String &text) {
+  const char *s = text.c_str();
+  size_t start = 0;
+  size_t end = text.length();
+  while (start < end && is_space(s[start])) {
+    start++;
+  }
+  while (end > start && is_space(s[end - 1])) {
+    end--;
+  }
+  return (uint32_t)g_matcher.scan(s + start, end - start);
+}
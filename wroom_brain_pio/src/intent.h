@@ -0,0 +1,31 @@
+#ifndef INTENT_H
+#define INTENT_H
+
+#include <Arduino.h>
+
+// What a message looks like, from a single pass over it with one keyword
+// automaton (keyword_matcher.h). The routing, ReAct, email/update and
+// auto-learn checks test these bits instead of each lowercasing the text
+// and running their own keyword scans.
+enum IntentBits : uint32_t {
+  INTENT_SLASH = 1UL << 0,        // starts with "/"
+  INTENT_ROUTE = 1UL << 1,        // command-like: worth asking the tool router
+  INTENT_REACT = 1UL << 2,        // multi-step, search, web build, email or skill
+  INTENT_MAIL_WORD = 1UL << 3,    // "email", "mail", "send"
+  INTENT_MAIL_TARGET = 1UL << 4,  // "to", "@"
+  INTENT_UPDATE = 1UL << 5,       // firmware update wording
+  INTENT_DOCUMENT = 1UL << 6,     // pdf, document, report
+  INTENT_SUMMARY = 1UL << 7,      // summarize, tl;dr, key points
+  INTENT_IMAGE = 1UL << 8,        // image, photo, screenshot
+  INTENT_UNDERSTAND = 1UL << 9,   // describe, analyze, ocr
+  INTENT_PERSONAL = 1UL << 10,    // may carry facts about the user (auto-learn)
+  INTENT_REMEMBER = 1UL << 11,    // personal info or "remember ..." (MEMORY.md)
+};
+
+void intent_init();
+
+// Case-insensitive. Surrounding whitespace is ignored, so "starts with"
+// patterns match from the first non-space character.
+uint32_t intent_classify(const String &text);
+
+#endif
@@ -0,0 +1,529 @@
+#include "json_stream.h"
+
+#include <Arduino.h>
+#include <utility>
+
+namespace {
+
+bool is_ws(char c) {
+  return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+bool is_literal_char(char c) {
+  return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+         c == '-' || c == '+' || c == '.';
+}
+
+// Drop a multi-byte UTF-8 sequence left incomplete by truncation.
+void trim_partial_utf8(String &s) {
+  int i = (int)s.length() - 1;
+  int continuation = 0;
+  while (i >= 0 && (((uint8_t)s[i]) & 0xC0) == 0x80 && continuation < 3) {
+    i--;
+    continuation++;
+  }
+  if (i < 0) {
+    return;
+  }
+  const uint8_t lead = (uint8_t)s[i];
+  int expected = 0;
+  if ((lead & 0xE0) == 0xC0) expected = 1;
+  else if ((lead & 0xF0) == 0xE0) expected = 2;
+  else if ((lead & 0xF8) == 0xF0) expected = 3;
+  if (expected > continuation) {
+    s.remove(i);
+  }
+}
+
+int hex_value(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+}  // namespace
+
+JsonStreamParser::JsonStreamParser()
+    : on_event_(nullptr), want_(nullptr), ctx_(nullptr), max_value_len_(1024) {
+  reset();
+}
+
+void JsonStreamParser::begin(json_stream_event_cb_t on_event, json_stream_want_cb_t want,
+                             void *ctx, size_t max_value_len) {
+  on_event_ = on_event;
+  want_ = want;
+  ctx_ = ctx;
+  max_value_len_ = max_value_len;
+  reset();
+}
+
+void JsonStreamParser::reset() {
+  frame_count_ = 0;
+  overflow_depth_ = 0;
+  overflow_types_ = 0;
+  state_ = ST_VALUE;
+  in_key_ = false;
+  capturing_ = false;
+  truncated_ = false;
+  failed_ = false;
+  done_ = false;
+  stopped_ = false;
+  unicode_acc_ = 0;
+  unicode_digits_ = 0;
+  pending_high_surrogate_ = 0;
+  value_ = "";
+  value_len_ = 0;
+  value_cap_ = 0;
+  scratch_len_ = 0;
+  literal_len_ = 0;
+}
+
+String JsonStreamParser::take_value() {
+  value_cap_ = 0;
+  return std::move(value_);
+}
+
+// ---------------------------------------------------------------------------
+// Path access
+// ---------------------------------------------------------------------------
+
+int JsonStreamParser::depth() const {
+  return frame_count_;
+}
+
+const char *JsonStreamParser::key_at(int level) const {
+  if (level < 0 || level >= frame_count_ || frames_[level].is_array) {
+    return "";
+  }
+  return frames_[level].key;
+}
+
+int JsonStreamParser::index_at(int level) const {
+  if (level < 0 || level >= frame_count_ || !frames_[level].is_array) {
+    return -1;
+  }
+  return frames_[level].index;
+}
+
+bool JsonStreamParser::path_is(const char *pattern) const {
+  int level = 0;
+  const char *seg = pattern;
+  while (*seg != '\0') {
+    const char *end = strchr(seg, '.');
+    const size_t len = end ? (size_t)(end - seg) : strlen(seg);
+    if (level >= frame_count_) {
+      return false;
+    }
+    const Frame &f = frames_[level];
+    const bool wildcard = (len == 1 && seg[0] == '*');
+    if (!wildcard) {
+      if (f.is_array) {
+        char buf[12];
+        snprintf(buf, sizeof(buf), "%d", f.index);
+        if (strlen(buf) != len || strncmp(buf, seg, len) != 0) {
+          return false;
+        }
+      } else if (strlen(f.key) != len || strncmp(f.key, seg, len) != 0) {
+        return false;
+      }
+    }
+    level++;
+    if (!end) {
+      break;
+    }
+    seg = end + 1;
+  }
+  return level == frame_count_;
+}
+
+// ---------------------------------------------------------------------------
+// Stream sink
+// ---------------------------------------------------------------------------
+
+size_t JsonStreamParser::write(uint8_t c) {
+  const char ch = (char)c;
+  feed(&ch, 1);
+  return 1;
+}
+
+size_t JsonStreamParser::write(const uint8_t *buffer, size_t size) {
+  // Always report the bytes as consumed so HTTPClient drains the body and the
+  // connection stays reusable even after an early stop.
+  feed((const char *)buffer, size);
+  return size;
+}
+
+// ---------------------------------------------------------------------------
+// Tokenizer
+// ---------------------------------------------------------------------------
+
+bool JsonStreamParser::feed(const char *data, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    if (failed_ || stopped_) {
+      break;
+    }
+    if (!step(data[i])) {
+      failed_ = true;
+    }
+  }
+  return !failed_;
+}
+
+void JsonStreamParser::emit(JsonStreamEvent ev, const String &value) {
+  if (on_event_ != nullptr && overflow_depth_ == 0 && !stopped_) {
+    on_event_(*this, ev, value, ctx_);
+  }
+}
+
+bool JsonStreamParser::top_is_array() const {
+  if (overflow_depth_ > 0) {
+    return (overflow_types_ >> (overflow_depth_ - 1)) & 1u;
+  }
+  return frame_count_ > 0 && frames_[frame_count_ - 1].is_array;
+}
+
+void JsonStreamParser::push(bool is_array) {
+  if (frame_count_ >= JSON_STREAM_MAX_DEPTH || overflow_depth_ > 0) {
+    // Too deep to track paths; only remember the container type so the
+    // structure stays balanced, and stop reporting events.
+    if (overflow_depth_ >= 32) {
+      failed_ = true;
+      return;
+    }
+    if (is_array) {
+      overflow_types_ |= (1u << overflow_depth_);
+    } else {
+      overflow_types_ &= ~(1u << overflow_depth_);
+    }
+    overflow_depth_++;
+    return;
+  }
+  Frame &f = frames_[frame_count_++];
+  f.is_array = is_array;
+  f.index = -1;
+  f.key[0] = '\0';
+}
+
+void JsonStreamParser::pop_and_emit(bool is_array) {
+  if (top_is_array() != is_array) {
+    failed_ = true;
+    return;
+  }
+  if (overflow_depth_ > 0) {
+    overflow_depth_--;
+  } else {
+    if (frame_count_ == 0) {
+      failed_ = true;
+      return;
+    }
+    frame_count_--;
+    emit(is_array ? JSON_EV_ARRAY_END : JSON_EV_OBJECT_END, String());
+  }
+  finish_value();
+}
+
+void JsonStreamParser::finish_value() {
+  state_ = ST_AFTER_VALUE;
+  if (frame_count_ == 0 && overflow_depth_ == 0) {
+    done_ = true;
+  }
+}
+
+void JsonStreamParser::flush_scratch() {
+  if (scratch_len_ > 0) {
+    // Double the reservation instead of letting every 64-byte flush
+    // reallocate; long replies and base64 payloads grow in a few steps.
+    const size_t need = value_.length() + scratch_len_;
+    if (need > value_cap_) {
+      size_t cap = value_cap_ < 128 ? 128 : value_cap_ * 2;
+      if (cap > max_value_len_) {
+        cap = max_value_len_;
+      }
+      if (cap < need) {
+        cap = need;
+      }
+      if (value_.reserve(cap)) {
+        value_cap_ = cap;
+      }
+    }
+    value_.concat(scratch_, scratch_len_);
+    scratch_len_ = 0;
+  }
+}
+
+void JsonStreamParser::append_char(char c) {
+  if (in_key_) {
+    if (scratch_len_ < JSON_STREAM_KEY_MAX - 1) {
+      scratch_[scratch_len_++] = c;
+    }
+    return;
+  }
+  if (!capturing_) {
+    return;
+  }
+  if (value_len_ >= max_value_len_) {
+    truncated_ = true;
+    return;
+  }
+  scratch_[scratch_len_++] = c;
+  value_len_++;
+  if (scratch_len_ == sizeof(scratch_)) {
+    flush_scratch();
+  }
+}
+
+void JsonStreamParser::append_codepoint(uint32_t cp) {
+  char buf[4];
+  size_t n = 0;
+  if (cp < 0x80) {
+    buf[n++] = (char)cp;
+  } else if (cp < 0x800) {
+    buf[n++] = (char)(0xC0 | (cp >> 6));
+    buf[n++] = (char)(0x80 | (cp & 0x3F));
+  } else if (cp < 0x10000) {
+    buf[n++] = (char)(0xE0 | (cp >> 12));
+    buf[n++] = (char)(0x80 | ((cp >> 6) & 0x3F));
+    buf[n++] = (char)(0x80 | (cp & 0x3F));
+  } else {
+    buf[n++] = (char)(0xF0 | (cp >> 18));
+    buf[n++] = (char)(0x80 | ((cp >> 12) & 0x3F));
+    buf[n++] = (char)(0x80 | ((cp >> 6) & 0x3F));
+    buf[n++] = (char)(0x80 | (cp & 0x3F));
+  }
+  // Never split a multi-byte sequence when truncating.
+  if (!in_key_ && capturing_ && value_len_ + n > max_value_len_) {
+    truncated_ = true;
+    return;
+  }
+  for (size_t i = 0; i < n; i++) {
+    append_char(buf[i]);
+  }
+}
+
+void JsonStreamParser::set_key_from_scratch() {
+  if (frame_count_ > 0 && overflow_depth_ == 0) {
+    Frame &f = frames_[frame_count_ - 1];
+    const size_t n = scratch_len_ < JSON_STREAM_KEY_MAX - 1 ? scratch_len_ : JSON_STREAM_KEY_MAX - 1;
+    memcpy(f.key, scratch_, n);
+    f.key[n] = '\0';
+  }
+  scratch_len_ = 0;
+}
+
+bool JsonStreamParser::begin_value(char c) {
+  if (is_ws(c)) {
+    return true;
+  }
+
+  if (frame_count_ > 0 && overflow_depth_ == 0 && frames_[frame_count_ - 1].is_array) {
+    frames_[frame_count_ - 1].index++;
+  }
+
+  if (c == '{') {
+    emit(JSON_EV_OBJECT_START, String());
+    push(false);
+    state_ = ST_KEY_OR_END;
+    return !failed_;
+  }
+  if (c == '[') {
+    emit(JSON_EV_ARRAY_START, String());
+    push(true);
+    state_ = ST_VALUE_OR_END;
+    return !failed_;
+  }
+  if (c == '"') {
+    in_key_ = false;
+    truncated_ = false;
+    capturing_ = overflow_depth_ == 0 && (want_ == nullptr || want_(*this, ctx_));
+    value_ = "";
+    value_len_ = 0;
+    scratch_len_ = 0;
+    state_ = ST_STRING;
+    return true;
+  }
+  if (c == '-' || (c >= '0' && c <= '9') || c == 't' || c == 'f' || c == 'n') {
+    literal_len_ = 0;
+    literal_[literal_len_++] = c;
+    state_ = ST_LITERAL;
+    return true;
+  }
+  return false;
+}
+
+bool JsonStreamParser::step(char c) {
+  switch (state_) {
+    case ST_VALUE:
+      return begin_value(c);
+
+    case ST_VALUE_OR_END:
+      if (c == ']') {
+        pop_and_emit(true);
+        return !failed_;
+      }
+      return begin_value(c);
+
+    case ST_KEY_OR_END:
+      if (c == '}') {
+        pop_and_emit(false);
+        return !failed_;
+      }
+      // fall through
+    case ST_KEY:
+      if (is_ws(c)) {
+        return true;
+      }
+      if (c != '"') {
+        return false;
+      }
+      in_key_ = true;
+      scratch_len_ = 0;
+      state_ = ST_STRING;
+      return true;
+
+    case ST_COLON:
+      if (is_ws(c)) {
+        return true;
+      }
+      if (c != ':') {
+        return false;
+      }
+      state_ = ST_VALUE;
+      return true;
+
+    case ST_AFTER_VALUE:
+      if (is_ws(c)) {
+        return true;
+      }
+      if (done_) {
+        return false;  // trailing garbage after the top-level value
+      }
+      if (c == ',') {
+        state_ = top_is_array() ? ST_VALUE : ST_KEY;
+        return true;
+      }
+      if (c == '}' || c == ']') {
+        pop_and_emit(c == ']');
+        return !failed_;
+      }
+      return false;
+
+    case ST_STRING:
+      if (c == '\\') {
+        state_ = ST_STRING_ESC;
+        return true;
+      }
+      if (pending_high_surrogate_ != 0) {
+        append_codepoint(0xFFFD);
+        pending_high_surrogate_ = 0;
+      }
+      if (c == '"') {
+        if (in_key_) {
+          set_key_from_scratch();
+          in_key_ = false;
+          state_ = ST_COLON;
+          return true;
+        }
+        flush_scratch();
+        if (truncated_) {
+          trim_partial_utf8(value_);
+        }
+        emit(JSON_EV_STRING, value_);
+        value_ = "";
+        value_len_ = 0;
+        capturing_ = false;
+        finish_value();
+        return true;
+      }
+      append_char(c);
+      return true;
+
+    case ST_STRING_ESC: {
+      if (c == 'u') {
+        unicode_acc_ = 0;
+        unicode_digits_ = 0;
+        state_ = ST_STRING_UNICODE;
+        return true;
+      }
+      if (pending_high_surrogate_ != 0) {
+        append_codepoint(0xFFFD);
+        pending_high_surrogate_ = 0;
+      }
+      char out;
+      switch (c) {
+        case 'n': out = '\n'; break;
+        case 'r': out = '\r'; break;
+        case 't': out = '\t'; break;
+        case 'b': out = '\b'; break;
+        case 'f': out = '\f'; break;
+        case '/': out = '/'; break;
+        case '\\': out = '\\'; break;
+        case '"': out = '"'; break;
+        default: return false;
+      }
+      append_char(out);
+      state_ = ST_STRING;
+      return true;
+    }
+
+    case ST_STRING_UNICODE: {
+      const int v = hex_value(c);
+      if (v < 0) {
+        return false;
+      }
+      unicode_acc_ = (unicode_acc_ << 4) | (uint32_t)v;
+      if (++unicode_digits_ < 4) {
+        return true;
+      }
+      const uint32_t u = unicode_acc_;
+      if (u >= 0xD800 && u <= 0xDBFF) {
+        if (pending_high_surrogate_ != 0) {
+          append_codepoint(0xFFFD);
+        }
+        pending_high_surrogate_ = u;
+      } else if (u >= 0xDC00 && u <= 0xDFFF) {
+        if (pending_high_surrogate_ != 0) {
+          append_codepoint(0x10000 + ((pending_high_surrogate_ - 0xD800) << 10) + (u - 0xDC00));
+          pending_high_surrogate_ = 0;
+        } else {
+          append_codepoint(0xFFFD);
+        }
+      } else {
+        if (pending_high_surrogate_ != 0) {
+          append_codepoint(0xFFFD);
+          pending_high_surrogate_ = 0;
+        }
+        append_codepoint(u);
+      }
+      state_ = ST_STRING;
+      return true;
+    }
+
+    case ST_LITERAL:
+      if (is_literal_char(c)) {
+        if (literal_len_ >= sizeof(literal_) - 1) {
+          return false;
+        }
+        literal_[literal_len_++] = c;
+        return true;
+      }
+      {
+        literal_[literal_len_] = '\0';
+        JsonStreamEvent ev;
+        if (strcmp(literal_, "true") == 0 || strcmp(literal_, "false") == 0) {
+          ev = JSON_EV_BOOL;
+        } else if (strcmp(literal_, "null") == 0) {
+          ev = JSON_EV_NULL;
+        } else if (literal_[0] == '-' || (literal_[0] >= '0' && literal_[0] <= '9')) {
+          ev = JSON_EV_NUMBER;
+        } else {
+          return false;
+        }
+        emit(ev, ev == JSON_EV_NULL ? String() : String(literal_));
+        finish_value();
+      }
+      // The terminating character belongs to the enclosing structure.
+      return step(c);
+  }
+  return false;
+}
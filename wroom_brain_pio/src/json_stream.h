@@ -0,0 +1,144 @@
+#ifndef JSON_STREAM_H
+#define JSON_STREAM_H
+
+#include <Arduino.h>
+
+// Incremental (push) JSON tokenizer. Bytes are fed as they arrive from the
+// network; the parser keeps only a small path stack plus the scalar currently
+// being captured, and reports events through a callback. It derives from
+// Stream so it can be handed straight to HTTPClient::writeToStream().
+//
+// Paths are '.'-separated: object keys by name, array elements as their
+// index. In patterns, '*' matches any single segment, e.g.
+//   "result.*.message.chat.id"
+
+#ifndef JSON_STREAM_MAX_DEPTH
+#define JSON_STREAM_MAX_DEPTH 12
+#endif
+
+#ifndef JSON_STREAM_KEY_MAX
+#define JSON_STREAM_KEY_MAX 24
+#endif
+
+enum JsonStreamEvent {
+  JSON_EV_OBJECT_START,
+  JSON_EV_OBJECT_END,
+  JSON_EV_ARRAY_START,
+  JSON_EV_ARRAY_END,
+  JSON_EV_STRING,
+  JSON_EV_NUMBER,
+  JSON_EV_BOOL,
+  JSON_EV_NULL,
+};
+
+class JsonStreamParser;
+
+// Called for every token. `value` holds the decoded scalar for STRING /
+// NUMBER / BOOL events (empty if the want callback declined it). For
+// container start/end events the path is that of the container itself.
+typedef void (*json_stream_event_cb_t)(JsonStreamParser &parser, JsonStreamEvent ev,
+                                       const String &value, void *ctx);
+
+// Asked before a string value is buffered; return false to skip it cheaply.
+// nullptr = capture every string.
+typedef bool (*json_stream_want_cb_t)(const JsonStreamParser &parser, void *ctx);
+
+class JsonStreamParser : public Stream {
+ public:
+  JsonStreamParser();
+
+  void begin(json_stream_event_cb_t on_event, json_stream_want_cb_t want, void *ctx,
+             size_t max_value_len);
+  void reset();
+
+  bool feed(const char *data, size_t len);
+  bool feed(const String &data) { return feed(data.c_str(), data.length()); }
+
+  // True once a syntax error was seen; further input is ignored.
+  bool failed() const { return failed_; }
+  // True after the top-level value has been closed.
+  bool done() const { return done_; }
+  // True if the last reported string was cut at max_value_len.
+  bool truncated() const { return truncated_; }
+  // Call from the event callback to stop parsing early.
+  void stop() { stopped_ = true; }
+  // Moves the string of the current JSON_EV_STRING event out instead of
+  // copying it; the callback's `value` is empty afterwards.
+  String take_value();
+  bool stopped() const { return stopped_; }
+
+  int depth() const;
+  const char *key_at(int level) const;
+  int index_at(int level) const;
+  bool path_is(const char *pattern) const;
+
+  // Stream sink for HTTPClient::writeToStream()
+  size_t write(uint8_t c) override;
+  size_t write(const uint8_t *buffer, size_t size) override;
+  int available() override { return 0; }
+  int read() override { return -1; }
+  int peek() override { return -1; }
+
+ private:
+  struct Frame {
+    bool is_array;
+    int index;
+    char key[JSON_STREAM_KEY_MAX];
+  };
+
+  enum State {
+    ST_VALUE,
+    ST_KEY_OR_END,
+    ST_KEY,
+    ST_COLON,
+    ST_AFTER_VALUE,
+    ST_VALUE_OR_END,
+    ST_STRING,
+    ST_STRING_ESC,
+    ST_STRING_UNICODE,
+    ST_LITERAL,
+  };
+
+  bool step(char c);
+  bool begin_value(char c);
+  bool top_is_array() const;
+  void push(bool is_array);
+  void pop_and_emit(bool is_array);
+  void finish_value();
+  void emit(JsonStreamEvent ev, const String &value);
+  void append_char(char c);
+  void append_codepoint(uint32_t cp);
+  void flush_scratch();
+  void set_key_from_scratch();
+
+  json_stream_event_cb_t on_event_;
+  json_stream_want_cb_t want_;
+  void *ctx_;
+  size_t max_value_len_;
+
+  Frame frames_[JSON_STREAM_MAX_DEPTH];
+  int frame_count_;
+  int overflow_depth_;       // containers nested beyond JSON_STREAM_MAX_DEPTH
+  uint32_t overflow_types_;  // bit i set = overflow level i is an array
+  State state_;
+  bool in_key_;
+  bool capturing_;
+  bool truncated_;
+  bool failed_;
+  bool done_;
+  bool stopped_;
+
+  uint32_t unicode_acc_;
+  int unicode_digits_;
+  uint32_t pending_high_surrogate_;
+
+  String value_;
+  size_t value_len_;
+  size_t value_cap_;  // capacity reserved for value_, grown geometrically
+  char scratch_[64];
+  size_t scratch_len_;
+  char literal_[32];
+  size_t literal_len_;
+};
+
+#endif
@@ -0,0 +1,241 @@
+#include "json_writer.h"
+
+namespace {
+
+const char kHex[] = "0123456789abcdef";
+
+// Writes the escaped form of c to out (up to 6 bytes) and returns its length.
+size_t escape_char(char c, char *out) {
+  switch (c) {
+    case '"':
+      out[0] = '\\';
+      out[1] = '"';
+      return 2;
+    case '\\':
+      out[0] = '\\';
+      out[1] = '\\';
+      return 2;
+    case '\n':
+      out[0] = '\\';
+      out[1] = 'n';
+      return 2;
+    case '\r':
+      out[0] = '\\';
+      out[1] = 'r';
+      return 2;
+    case '\t':
+      out[0] = '\\';
+      out[1] = 't';
+      return 2;
+    case '\b':
+      out[0] = '\\';
+      out[1] = 'b';
+      return 2;
+    case '\f':
+      out[0] = '\\';
+      out[1] = 'f';
+      return 2;
+    default:
+      break;
+  }
+  const uint8_t u = (uint8_t)c;
+  if (u < 0x20) {
+    out[0] = '\\';
+    out[1] = 'u';
+    out[2] = '0';
+    out[3] = '0';
+    out[4] = kHex[u >> 4];
+    out[5] = kHex[u & 0x0F];
+    return 6;
+  }
+  out[0] = c;
+  return 1;
+}
+
+size_t escaped_char_length(char c) {
+  switch (c) {
+    case '"':
+    case '\\':
+    case '\n':
+    case '\r':
+    case '\t':
+    case '\b':
+    case '\f':
+      return 2;
+    default:
+      return (uint8_t)c < 0x20 ? 6 : 1;
+  }
+}
+
+}  // namespace
+
+size_t json_escaped_length(const char *text, size_t len) {
+  size_t n = 0;
+  for (size_t i = 0; i < len; i++) {
+    n += escaped_char_length(text[i]);
+  }
+  return n;
+}
+
+String json_escape(const String &src) {
+  String out;
+  out.reserve(json_escaped_length(src.c_str(), src.length()));
+  char buf[6];
+  for (size_t i = 0; i < src.length(); i++) {
+    const size_t n = escape_char(src[i], buf);
+    if (n == 1) {
+      out += buf[0];
+    } else {
+      out.concat(buf, n);
+    }
+  }
+  return out;
+}
+
+JsonBody::JsonBody() : count_(0), overflow_(false), total_(0) {
+  rewind();
+}
+
+JsonBody &JsonBody::add(const char *data, size_t len, bool escape) {
+  if (count_ >= JSON_BODY_MAX_PARTS) {
+    overflow_ = true;
+    return *this;
+  }
+  parts_[count_].data = data;
+  parts_[count_].len = len;
+  parts_[count_].escape = escape;
+  count_++;
+  total_ += escape ? json_escaped_length(data, len) : len;
+  return *this;
+}
+
+JsonBody &JsonBody::raw(const char *json) {
+  return add(json, strlen(json), false);
+}
+
+JsonBody &JsonBody::raw(const String &json) {
+  return add(json.c_str(), json.length(), false);
+}
+
+JsonBody &JsonBody::esc(const char *text) {
+  return add(text, strlen(text), true);
+}
+
+JsonBody &JsonBody::esc(const char *text, size_t len) {
+  return add(text, len, true);
+}
+
+JsonBody &JsonBody::esc(const String &text) {
+  return add(text.c_str(), text.length(), true);
+}
+
+JsonBody &JsonBody::str(const char *text) {
+  return raw("\"").esc(text).raw("\"");
+}
+
+JsonBody &JsonBody::str(const String &text) {
+  return raw("\"").esc(text).raw("\"");
+}
+
+void JsonBody::rewind() {
+  part_ = 0;
+  offset_ = 0;
+  sent_ = 0;
+  pending_len_ = 0;
+  pending_pos_ = 0;
+}
+
+String JsonBody::to_string() const {
+  String out;
+  out.reserve(length());
+  for (int i = 0; i < count_; i++) {
+    const Part &p = parts_[i];
+    if (!p.escape) {
+      out.concat(p.data, p.len);
+      continue;
+    }
+    char buf[6];
+    for (size_t j = 0; j < p.len; j++) {
+      out.concat(buf, escape_char(p.data[j], buf));
+    }
+  }
+  return out;
+}
+
+int JsonBody::available() {
+  return sent_ < total_ ? (int)(total_ - sent_) : 0;
+}
+
+size_t JsonBody::readBytes(char *buffer, size_t len) {
+  size_t out = 0;
+  while (out < len) {
+    if (pending_pos_ < pending_len_) {
+      buffer[out++] = pending_[pending_pos_++];
+      continue;
+    }
+    if (part_ >= count_) {
+      break;
+    }
+    const Part &p = parts_[part_];
+    if (offset_ >= p.len) {
+      part_++;
+      offset_ = 0;
+      continue;
+    }
+    if (!p.escape) {
+      const size_t n = min(len - out, p.len - offset_);
+      memcpy(buffer + out, p.data + offset_, n);
+      out += n;
+      offset_ += n;
+      continue;
+    }
+    // Escape straight into the caller's buffer; a sequence that does not
+    // fit is finished on the next call.
+    while (out < len && offset_ < p.len) {
+      const char c = p.data[offset_];
+      if (escaped_char_length(c) == 1) {
+        buffer[out++] = c;
+        offset_++;
+        continue;
+      }
+      pending_len_ = (uint8_t)escape_char(c, pending_);
+      pending_pos_ = 0;
+      offset_++;
+      break;
+    }
+  }
+  sent_ += out;
+  return out;
+}
+
+bool JsonBody::fill_pending() {
+  while (pending_pos_ >= pending_len_) {
+    if (part_ >= count_) {
+      return false;
+    }
+    const Part &p = parts_[part_];
+    if (offset_ >= p.len) {
+      part_++;
+      offset_ = 0;
+      continue;
+    }
+    if (p.escape) {
+      pending_len_ = (uint8_t)escape_char(p.data[offset_], pending_);
+    } else {
+      pending_[0] = p.data[offset_];
+      pending_len_ = 1;
+    }
+    pending_pos_ = 0;
+    offset_++;
+  }
+  return true;
+}
+
+int JsonBody::read() {
+  char c;
+  return readBytes(&c, 1) == 1 ? (uint8_t)c : -1;
+}
+
+int JsonBody::peek() {
+  return fill_pending() ? (uint8_t)pending_[pending_pos_] : -1;
+}
@@ -0,0 +1,83 @@
+#ifndef JSON_WRITER_H
+#define JSON_WRITER_H
+
+#include <Arduino.h>
+
+// JSON string escaping shared by every module that builds request bodies.
+// Quotes, backslashes and control characters are escaped; UTF-8 passes
+// through unchanged.
+size_t json_escaped_length(const char *text, size_t len);
+String json_escape(const String &src);
+
+#ifndef JSON_BODY_MAX_PARTS
+#define JSON_BODY_MAX_PARTS 24
+#endif
+
+// A request body described as a list of parts and escaped while it is sent,
+// so large prompts are never copied into an escaped String and a body
+// String. Escaped lengths are summed as parts are added (Content-Length);
+// the bytes are then produced through the Stream interface for
+// HTTPClient::sendRequest(). Call rewind() before sending it again.
+//
+// Parts reference the caller's strings: they must stay alive and unchanged
+// until the request is done. Temporaries are rejected at compile time.
+class JsonBody : public Stream {
+ public:
+  JsonBody();
+
+  // JSON text copied as is
+  JsonBody &raw(const char *json);
+  JsonBody &raw(const String &json);
+  // String contents escaped, without quotes; lets one JSON string be built
+  // from several pieces
+  JsonBody &esc(const char *text);
+  JsonBody &esc(const char *text, size_t len);
+  JsonBody &esc(const String &text);
+  // Quoted and escaped string value
+  JsonBody &str(const char *text);
+  JsonBody &str(const String &text);
+
+  JsonBody &raw(String &&) = delete;
+  JsonBody &esc(String &&) = delete;
+  JsonBody &str(String &&) = delete;
+
+  // False if more than JSON_BODY_MAX_PARTS parts were added; the body is
+  // then incomplete and senders refuse it before connecting.
+  bool ok() const { return !overflow_; }
+  size_t length() const { return total_; }
+  void rewind();
+  // Materializes the body; for logging and callers that need a String.
+  String to_string() const;
+
+  int available() override;
+  int read() override;
+  int peek() override;
+  using Stream::readBytes;
+  size_t readBytes(char *buffer, size_t len) override;
+  size_t write(uint8_t) override { return 0; }
+
+ private:
+  struct Part {
+    const char *data;
+    size_t len;
+    bool escape;
+  };
+
+  JsonBody &add(const char *data, size_t len, bool escape);
+  bool fill_pending();
+
+  Part parts_[JSON_BODY_MAX_PARTS];
+  int count_;
+  bool overflow_;
+  size_t total_;
+
+  // Read cursor
+  int part_;
+  size_t offset_;
+  size_t sent_;
+  char pending_[6];  // rest of an escape sequence cut by the buffer end
+  uint8_t pending_len_;
+  uint8_t pending_pos_;
+};
+
+#endif
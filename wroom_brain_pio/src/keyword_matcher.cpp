@@ -0,0 +1,150 @@
+#include "keyword_matcher.h"
+
+namespace {
+
+inline uint8_t fold(char c) {
+  return (c >= 'A' && c <= 'Z') ? (uint8_t)(c - 'A' + 'a') : (uint8_t)c;
+}
+
+}  // namespace
+
+KeywordMatcher::KeywordMatcher() : nodes_(nullptr), terms_(nullptr), node_count_(0) {
+  for (int i = 0; i < 128; i++) {
+    root_next_[i] = 0;
+  }
+}
+
+int KeywordMatcher::find_child(int node, uint8_t c) const {
+  for (int n = nodes_[node].child; n >= 0; n = nodes_[n].sibling) {
+    if (nodes_[n].c == c) {
+      return n;
+    }
+  }
+  return -1;
+}
+
+bool KeywordMatcher::build(const KeywordPattern *patterns, size_t count) {
+  if (nodes_ != nullptr) {
+    return true;
+  }
+  size_t capacity = 1;
+  for (size_t i = 0; i < count; i++) {
+    capacity += strlen(patterns[i].text);
+  }
+  if (capacity > 32767) {
+    Serial.println("[matcher] pattern table too large");
+    return false;
+  }
+
+  // Sized once from the table and kept for the life of the firmware.
+  Node *nodes = (Node *)malloc(capacity * sizeof(Node));
+  Term *terms = (Term *)malloc((count > 0 ? count : 1) * sizeof(Term));
+  int16_t *queue = (int16_t *)malloc(capacity * sizeof(int16_t));
+  if (nodes == nullptr || terms == nullptr || queue == nullptr) {
+    free(nodes);
+    free(terms);
+    free(queue);
+    Serial.println("[matcher] out of memory");
+    return false;
+  }
+  nodes_ = nodes;
+  terms_ = terms;
+
+  nodes_[0] = {-1, -1, 0, -1, -1, 0};
+  node_count_ = 1;
+  int term_count = 0;
+  for (size_t i = 0; i < count; i++) {
+    int node = 0;
+    uint16_t len = 0;
+    for (const char *p = patterns[i].text; *p != '\0'; p++, len++) {
+      const uint8_t c = fold(*p);
+      int child = find_child(node, c);
+      if (child < 0) {
+        child = node_count_++;
+        nodes_[child] = {-1, nodes_[node].child, 0, -1, -1, c};
+        nodes_[node].child = (int16_t)child;
+      }
+      node = child;
+    }
+    if (node == 0) {
+      continue;  // empty pattern
+    }
+    if (nodes_[node].term < 0) {
+      nodes_[node].term = (int16_t)term_count;
+      terms_[term_count++] = {0, 0, len};
+    }
+    Term &term = terms_[nodes_[node].term];
+    if (patterns[i].anchored) {
+      term.anchored |= patterns[i].mask;
+    } else {
+      term.mask |= patterns[i].mask;
+    }
+  }
+
+  // Breadth-first, so a node's fail target is always finished before it.
+  int head = 0;
+  int tail = 0;
+  for (int n = nodes_[0].child; n >= 0; n = nodes_[n].sibling) {
+    queue[tail++] = (int16_t)n;
+    if (nodes_[n].c < 128) {
+      root_next_[nodes_[n].c] = (int16_t)n;
+    }
+  }
+  while (head < tail) {
+    const int u = queue[head++];
+    for (int v = nodes_[u].child; v >= 0; v = nodes_[v].sibling) {
+      queue[tail++] = (int16_t)v;
+      int f = nodes_[u].fail;
+      int target = find_child(f, nodes_[v].c);
+      while (target < 0 && f != 0) {
+        f = nodes_[f].fail;
+        target = find_child(f, nodes_[v].c);
+      }
+      nodes_[v].fail = (int16_t)(target >= 0 ? target : 0);
+      const Node &fn = nodes_[nodes_[v].fail];
+      nodes_[v].dict = nodes_[v].fail != 0 && fn.term >= 0 ? nodes_[v].fail : fn.dict;
+    }
+  }
+  free(queue);
+  return true;
+}
+
+int KeywordMatcher::next(int state, char ch) const {
+  if (nodes_ == nullptr) {
+    return 0;
+  }
+  const uint8_t c = fold(ch);
+  while (state != 0) {
+    const int child = find_child(state, c);
+    if (child >= 0) {
+      return child;
+    }
+    state = nodes_[state].fail;
+  }
+  return c < 128 ? root_next_[c] : 0;
+}
+
+uint64_t KeywordMatcher::matches(int state, size_t consumed) const {
+  if (nodes_ == nullptr) {
+    return 0;
+  }
+  uint64_t mask = 0;
+  for (int n = nodes_[state].term >= 0 ? state : nodes_[state].dict; n > 0; n = nodes_[n].dict) {
+    const Term &term = terms_[nodes_[n].term];
+    mask |= term.mask;
+    if (term.len == consumed) {
+      mask |= term.anchored;
+    }
+  }
+  return mask;
+}
+
+uint64_t KeywordMatcher::scan(const char *text, size_t len) const {
+  uint64_t mask = 0;
+  int state = 0;
+  for (size_t i = 0; i < len; i++) {
+    state = next(state, text[i]);
+    mask |= matches(state, i + 1);
+  }
+  return mask;
+}
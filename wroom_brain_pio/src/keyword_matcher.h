@@ -0,0 +1,62 @@
+#ifndef KEYWORD_MATCHER_H
+#define KEYWORD_MATCHER_H
+
+#include <Arduino.h>
+
+// Multi-pattern substring matcher (Aho-Corasick). A pattern table is
+// compiled once into a trie with failure links; a text is then read a
+// single time, ASCII case-insensitively, and every pattern occurring in it
+// is reported through its bit mask. Replaces lowercased copies followed by
+// a run of indexOf() calls.
+
+struct KeywordPattern {
+  const char *text;  // lowercase ASCII
+  uint64_t mask;     // bits reported when the pattern occurs
+  bool anchored;     // only at the start of the text (startsWith)
+};
+
+class KeywordMatcher {
+ public:
+  KeywordMatcher();
+
+  // Compiles the table; call once at init. Patterns with the same text have
+  // their masks merged.
+  bool build(const KeywordPattern *patterns, size_t count);
+  bool ready() const { return nodes_ != nullptr; }
+
+  // Streaming use: start from state 0 and feed the text one char at a time.
+  int next(int state, char c) const;
+  // Masks of every pattern that ends at this state. `consumed` is the number
+  // of chars fed since state 0; anchored patterns count only when they
+  // cover all of them, so pass 0 to ignore anchored patterns.
+  uint64_t matches(int state, size_t consumed = 0) const;
+
+  // OR of the masks of all patterns occurring in the text.
+  uint64_t scan(const char *text, size_t len) const;
+  uint64_t scan(const String &text) const { return scan(text.c_str(), text.length()); }
+
+ private:
+  struct Node {
+    int16_t child;    // first child
+    int16_t sibling;  // next child of the same parent
+    int16_t fail;     // longest proper suffix that is also in the trie
+    int16_t dict;     // nearest node on the fail chain that ends a pattern
+    int16_t term;     // index into terms_, -1 if no pattern ends here
+    uint8_t c;
+  };
+
+  struct Term {
+    uint64_t mask;      // anywhere in the text
+    uint64_t anchored;  // only as a prefix
+    uint16_t len;
+  };
+
+  int find_child(int node, uint8_t c) const;
+
+  Node *nodes_;
+  Term *terms_;
+  int node_count_;
+  int16_t root_next_[128];
+};
+
+#endif
@@ -11,12 +11,18 @@
 #include "chat_history.h"
 #include "memory_store.h"
 #include "file_memory.h"
+#include "http_pool.h"
+#include "intent.h"
 #include "model_config.h"
 #include "persona_store.h"
+#include "request_ctx.h"
 #include "usage_stats.h"
 #include "skill_registry.h"
 #include "scheduler.h"
 #include "cron_store.h"
+#include "json_stream.h"
+#include "json_writer.h"
+#include "tls_session_cache.h"
 #include <time.h>
 
 namespace {
@@ -210,139 +216,502 @@ String keep_tail_with_marker(const String &value, size_t max_chars) {
   return String("...(truncated)\n") + value.substring(value.length() - max_chars);
 }
 
-String json_escape(const String &src) {
-  String out;
-  out.reserve(src.length() + 32);
-  for (size_t i = 0; i < src.length(); i++) {
-    const char c = src[i];
-    switch (c) {
-      case '\\':
-        out += "\\\\";
-        break;
-      case '"':
-        out += "\\\"";
-        break;
-      case '\n':
-        out += "\\n";
-        break;
-      case '\r':
-        out += "\\r";
-        break;
-      case '\t':
-        out += "\\t";
-        break;
-      default:
-        if ((unsigned char)c < 0x20) {
-          out += ' ';
-        } else {
-          out += c;
-        }
-        break;
+// Counts are cumulative where a provider repeats them, so the last wins.
+void take_usage(const JsonStreamParser &p, const String &value, LlmUsage &usage) {
+  const uint32_t n = (uint32_t)value.toInt();
+  if (p.path_is("usage.prompt_tokens_details.cached_tokens") ||
+      p.path_is("usage.cache_read_input_tokens") ||
+      p.path_is("message.usage.cache_read_input_tokens") ||
+      p.path_is("usageMetadata.cachedContentTokenCount")) {
+    usage.cached_tokens = n;
+  } else if (p.path_is("usage.cache_creation_input_tokens") ||
+             p.path_is("message.usage.cache_creation_input_tokens")) {
+    usage.cache_write_tokens = n;
+  } else if (p.path_is("usage.prompt_tokens") || p.path_is("usage.input_tokens") ||
+      p.path_is("message.usage.input_tokens") || p.path_is("usageMetadata.promptTokenCount") ||
+      p.path_is("prompt_eval_count")) {
+    usage.input_tokens = n;
+  } else if (p.path_is("usage.completion_tokens") || p.path_is("usage.output_tokens") ||
+             p.path_is("usageMetadata.candidatesTokenCount") || p.path_is("eval_count")) {
+    usage.output_tokens = n;
+  }
+}
+
+// Anthropic reports cache reads and writes apart from input_tokens; the
+// other providers count them in it.
+void fold_anthropic_cache_tokens(LlmUsage &usage) {
+  usage.input_tokens += usage.cached_tokens + usage.cache_write_tokens;
+}
+
+void record_usage(const LlmUsage &usage) {
+  if (usage.input_tokens == 0 && usage.output_tokens == 0) {
+    return;  // provider reported nothing
+  }
+  usage_record_tokens(usage.input_tokens, usage.output_tokens, usage.cached_tokens,
+                      usage.cache_write_tokens);
+}
+
+// One value pulled out of a response body: the string at the first of
+// `paths` that matches (earlier entries win), else one stored under any of
+// `fallback_keys` at any depth.
+struct JsonPathSlot {
+  const char *const *paths;
+  size_t path_count;
+  const char *const *fallback_keys;
+  size_t fallback_count;
+  String *out;
+  int rank;  // rank of the value in *out, -1 while empty
+};
+
+struct JsonPathScan {
+  JsonPathSlot *slots;
+  size_t slot_count;
+  LlmUsage *usage;
+};
+
+int json_path_rank(const JsonStreamParser &p, const JsonPathSlot &slot) {
+  for (size_t i = 0; i < slot.path_count; i++) {
+    if (p.path_is(slot.paths[i])) {
+      return (int)i;
     }
   }
-  return out;
+  const char *key = p.key_at(p.depth() - 1);
+  for (size_t i = 0; i < slot.fallback_count; i++) {
+    if (strcmp(key, slot.fallback_keys[i]) == 0) {
+      return (int)(slot.path_count + i);
+    }
+  }
+  return -1;
 }
 
-static bool is_json_ws(const char c) {
-  return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+// Index of the slot that would take the current string, or -1.
+int json_path_target(const JsonStreamParser &p, const JsonPathScan &scan) {
+  for (size_t i = 0; i < scan.slot_count; i++) {
+    const JsonPathSlot &slot = scan.slots[i];
+    const int rank = json_path_rank(p, slot);
+    if (rank >= 0 && (slot.rank < 0 || rank < slot.rank)) {
+      return (int)i;
+    }
+  }
+  return -1;
 }
 
-bool extract_json_string_field(const String &body, const char *field_name, String &out) {
-  const String key = String("\"") + field_name + "\"";
-  int search_from = 0;
+bool json_path_want(const JsonStreamParser &p, void *ctx) {
+  return json_path_target(p, *(const JsonPathScan *)ctx) >= 0;
+}
 
-  while (true) {
-    const int key_pos = body.indexOf(key, search_from);
-    if (key_pos < 0) {
-      return false;
+void json_path_event(JsonStreamParser &p, JsonStreamEvent ev, const String &value, void *ctx) {
+  JsonPathScan &scan = *(JsonPathScan *)ctx;
+  if (ev == JSON_EV_NUMBER) {
+    if (scan.usage != nullptr) {
+      take_usage(p, value, *scan.usage);
     }
+    return;
+  }
+  if (ev != JSON_EV_STRING) {
+    return;
+  }
+  const int target = json_path_target(p, scan);
+  if (target < 0) {
+    return;
+  }
+  JsonPathSlot &slot = scan.slots[target];
+  slot.rank = json_path_rank(p, slot);
+  *slot.out = p.take_value();
 
-    int i = key_pos + (int)key.length();
-    while (i < (int)body.length() && is_json_ws(body[i])) {
-      i++;
+  if (scan.usage != nullptr) {
+    return;  // token counts usually follow the text
+  }
+  for (size_t i = 0; i < scan.slot_count; i++) {
+    if (scan.slots[i].rank != 0) {
+      return;
     }
-    if (i >= (int)body.length() || body[i] != ':') {
-      search_from = key_pos + 1;
-      continue;
+  }
+  p.stop();  // every slot holds its preferred path
+}
+
+// Walks `body` once with the streaming parser, so escapes (\uXXXX and
+// surrogate pairs included) are decoded once and only matching strings are
+// buffered. Slots left with rank -1 were not found; a syntax error after a
+// match (cut or trailing bytes) keeps what was found before it.
+void extract_json_paths(const String &body, JsonPathSlot *slots, size_t slot_count,
+                        LlmUsage *usage) {
+  for (size_t i = 0; i < slot_count; i++) {
+    slots[i].rank = -1;
+  }
+  JsonPathScan scan = {slots, slot_count, usage};
+  JsonStreamParser parser;
+  parser.begin(json_path_event, json_path_want, &scan, body.length());
+  parser.feed(body);
+}
+
+bool extract_json_path(const String &body, const char *const *paths, size_t path_count,
+                       const char *fallback_key, String &out) {
+  const char *const fallback[] = {fallback_key};
+  JsonPathSlot slot = {paths, path_count, fallback, fallback_key != nullptr ? 1u : 0u, &out, -1};
+  extract_json_paths(body, &slot, 1, nullptr);
+  return slot.rank >= 0;
+}
+
+// Where each provider puts the reply text, in order of preference. Any
+// "content" or "text" string is the last resort, for compatible servers
+// that nest it differently.
+const char *const kReplyTextPaths[] = {
+    "output_text",                        // OpenAI responses API
+    "choices.0.message.content",          // OpenAI, GLM, OpenRouter
+    "content.*.text",                     // Anthropic
+    "candidates.0.content.parts.*.text",  // Gemini
+    "message.content",                    // Ollama /api/chat
+    "response",                           // Ollama /api/generate
+};
+const char *const kReplyTextKeys[] = {"content", "text"};
+
+const char *const kErrorMessagePaths[] = {"error.message", "message", "error", "detail"};
+const char *const kErrorMessageKeys[] = {"message"};
+
+// A connection goes back to the pool only if the response was read to the
+// end; otherwise its leftovers would be read as the next reply.
+static bool body_fully_read(HTTPClient &https, const String &body) {
+  const int size = https.getSize();
+  return size < 0 || body.length() == (size_t)size;
+}
+
+// The body is escaped straight into the socket; see JsonBody.
+HttpResult http_post_json(const String &url, JsonBody &body,
+                          const String &h1_name = "", const String &h1_value = "",
+                          const String &h2_name = "", const String &h2_value = "",
+                          const String &h3_name = "", const String &h3_value = "") {
+  HttpResult result{};
+  result.status_code = -1;
+
+  if (WiFi.status() != WL_CONNECTED) {
+    result.error = "WiFi not connected";
+    return result;
+  }
+  if (!body.ok()) {
+    result.error = "Request body has too many parts";
+    return result;
+  }
+
+  const int kMaxAttempts = 2;
+  bool retried_stale = false;
+  for (int attempt = 0; attempt < kMaxAttempts; attempt++) {
+    if (request_ctx_should_stop(result.error)) {
+      result.status_code = -1;
+      return result;
     }
+    // Pooled keep-alive connection: a ReAct run or a router call followed by
+    // a reply pays the TLS handshake to the provider once.
+    HttpPoolLease lease;
+    if (!http_pool_acquire(url, lease)) {
+      result.error = "HTTP begin failed";
+      if (attempt + 1 < kMaxAttempts) {
+        delay(220);
+        continue;
+      }
+      return result;
+    }
+    HTTPClient &https = *lease.http;
+
+    https.setConnectTimeout(request_ctx_clamp_timeout(12000));
+    https.setTimeout(request_ctx_clamp_timeout(compute_llm_timeout_ms(body.length())));
+    https.addHeader("Content-Type", "application/json");
 
-    i++;
-    while (i < (int)body.length() && is_json_ws(body[i])) {
-      i++;
+    if (h1_name.length()) {
+      https.addHeader(h1_name, h1_value);
     }
-    if (i >= (int)body.length() || body[i] != '"') {
-      search_from = key_pos + 1;
+    if (h2_name.length()) {
+      https.addHeader(h2_name, h2_value);
+    }
+    if (h3_name.length()) {
+      https.addHeader(h3_name, h3_value);
+    }
+
+    body.rewind();
+    result.status_code = https.sendRequest("POST", &body, body.length());
+    if (result.status_code > 0) {
+      result.body = https.getString();
+      result.error = "";
+      http_pool_release(lease, body_fully_read(https, result.body));
+      return result;
+    }
+
+    result.error = https.errorToString(result.status_code);
+    const bool stale = http_pool_should_retry(lease, result.status_code, "POST");
+    http_pool_release(lease, false);
+    if (stale && !retried_stale) {
+      // The server had dropped the kept-alive socket; resend on a new one.
+      retried_stale = true;
+      attempt--;
       continue;
     }
-    i++;
-
-    String text;
-    text.reserve(256);
-    bool esc = false;
-    for (; i < (int)body.length(); i++) {
-      const char c = body[i];
-
-      if (esc) {
-        switch (c) {
-          case 'n':
-            text += '\n';
-            break;
-          case 'r':
-            text += '\r';
-            break;
-          case 't':
-            text += '\t';
-            break;
-          case '\\':
-            text += '\\';
-            break;
-          case '"':
-            text += '"';
-            break;
-          default:
-            text += c;
-            break;
+
+    if (attempt + 1 < kMaxAttempts) {
+      delay(260 + (attempt * 120));
+    }
+  }
+
+  return result;
+}
+
+// Streaming: while a *_streaming() call runs, provider calls made from the
+// same task use the providers' streaming endpoints and forward events here.
+struct ReplyStreamSink {
+  llm_stream_cb_t cb;
+  void *ctx;
+  TaskHandle_t owner;
+};
+
+ReplyStreamSink g_reply_sink = {nullptr, nullptr, nullptr};
+
+const ReplyStreamSink *active_reply_sink() {
+  if (g_reply_sink.cb == nullptr || g_reply_sink.owner != xTaskGetCurrentTaskHandle()) {
+    return nullptr;
+  }
+  return &g_reply_sink;
+}
+
+enum SseDialect {
+  SSE_OPENAI,     // choices[].delta.content (OpenAI, OpenRouter, GLM)
+  SSE_ANTHROPIC,  // content_block_delta -> delta.text
+  SSE_GEMINI,     // candidates[].content.parts[].text
+  SSE_OLLAMA,     // not SSE: one JSON object per line, message.content
+};
+
+// Receives a decoded text/event-stream (or NDJSON) body from
+// HTTPClient::writeToStream(). Each event's "data:" lines are fed straight
+// into a JsonStreamParser, so nothing larger than one text delta is
+// buffered. Token counts are picked up from whichever event carries them.
+// A reply is only complete once the dialect's terminal event has been seen
+// ("[DONE]", message_stop, finishReason or done:true).
+class SseTextSink : public Stream {
+ public:
+  SseTextSink(SseDialect dialect, const ReplyStreamSink *sink, String &text_out)
+      : dialect_(dialect), sink_(sink), text_(text_out), usage_(), stopped_(false),
+        finished_(false), mode_(LINE_START), prefix_len_(0), in_event_(false),
+        done_pos_(-1) {}
+
+  size_t write(uint8_t c) override {
+    if (stopped_) {
+      return 0;
+    }
+    step((char)c);
+    return 1;
+  }
+  size_t write(const uint8_t *buffer, size_t size) override {
+    // A short write makes writeToStream() give up, closing the stream.
+    if (stopped_ || request_ctx_canceled()) {
+      return 0;
+    }
+    for (size_t i = 0; i < size; i++) {
+      step((char)buffer[i]);
+    }
+    return size;
+  }
+  int available() override { return 0; }
+  int read() override { return -1; }
+  int peek() override { return -1; }
+
+  const String &error() const { return error_; }
+  // True once the stream ended normally or the consumer stopped it early.
+  bool complete() const { return finished_ || stopped_; }
+  LlmUsage usage() const {
+    LlmUsage usage = usage_;
+    if (dialect_ == SSE_ANTHROPIC) {
+      fold_anthropic_cache_tokens(usage);
+    }
+    return usage;
+  }
+
+ private:
+  enum LineMode {
+    LINE_START,  // matching the "data:" field name
+    LINE_DATA,   // payload bytes go to the parser
+    LINE_SKIP,   // event:, id:, comments
+  };
+
+  void step(char c) {
+    if (c == '\r') {
+      return;
+    }
+    if (c == '\n') {
+      if (mode_ == LINE_START && prefix_len_ == 0) {
+        in_event_ = false;  // blank line ends the event
+      } else if (mode_ == LINE_DATA) {
+        if (done_pos_ == 6) {
+          finished_ = true;
         }
-        esc = false;
-        continue;
+        parser_.feed("\n", 1);
       }
+      mode_ = LINE_START;
+      prefix_len_ = 0;
+      return;
+    }
 
-      if (c == '\\') {
-        esc = true;
-        continue;
-      }
+    if (mode_ == LINE_DATA) {
+      match_done(c);
+      parser_.feed(&c, 1);
+      return;
+    }
+    if (mode_ == LINE_SKIP) {
+      return;
+    }
 
-      if (c == '"') {
-        out = text;
-        return true;
+    if (dialect_ == SSE_OLLAMA) {
+      // NDJSON: every line is a complete event.
+      parser_.begin(on_json_event, want_json_string, this, 4096);
+      mode_ = LINE_DATA;
+      parser_.feed(&c, 1);
+      return;
+    }
+
+    // LINE_START: match "data:"; the JSON parser skips the optional space.
+    static const char kData[] = "data:";
+    if (c != kData[prefix_len_]) {
+      mode_ = LINE_SKIP;
+      return;
+    }
+    prefix_len_++;
+    if (prefix_len_ == 5) {
+      if (!in_event_) {
+        // "[DONE]" and other non-JSON payloads just fail this parser instance.
+        parser_.begin(on_json_event, want_json_string, this, 4096);
+        in_event_ = true;
       }
+      mode_ = LINE_DATA;
+      done_pos_ = 0;
+    }
+  }
 
-      text += c;
+  // Tracks whether the current data line is exactly "[DONE]" (OpenAI).
+  void match_done(char c) {
+    static const char kDone[] = "[DONE]";
+    if (done_pos_ < 0 || (c == ' ' && done_pos_ == 0)) {
+      return;
     }
+    done_pos_ = (done_pos_ < 6 && c == kDone[done_pos_]) ? done_pos_ + 1 : -1;
+  }
 
+  static bool is_terminal_path(const JsonStreamParser &p, SseDialect dialect) {
+    switch (dialect) {
+      case SSE_ANTHROPIC:
+        return p.path_is("type");  // "message_stop"
+      case SSE_GEMINI:
+        return p.path_is("candidates.*.finishReason");
+      case SSE_OLLAMA:
+        return p.path_is("done");
+      case SSE_OPENAI:
+        break;  // "[DONE]" is not JSON, see match_done()
+    }
     return false;
   }
-}
 
-HttpResult http_post_json(const String &url, const String &body,
-                          const String &h1_name = "", const String &h1_value = "",
-                          const String &h2_name = "", const String &h2_value = "",
-                          const String &h3_name = "", const String &h3_value = "") {
+  static bool is_delta_path(const JsonStreamParser &p, SseDialect dialect) {
+    switch (dialect) {
+      case SSE_OPENAI:
+        return p.path_is("choices.*.delta.content");
+      case SSE_ANTHROPIC:
+        return p.path_is("delta.text");
+      case SSE_GEMINI:
+        return p.path_is("candidates.*.content.parts.*.text");
+      case SSE_OLLAMA:
+        return p.path_is("message.content") || p.path_is("response");
+    }
+    return false;
+  }
+
+  static bool is_error_path(const JsonStreamParser &p) {
+    return p.path_is("error.message") || p.path_is("error");  // Ollama: {"error":"..."}
+  }
+
+  static bool want_json_string(const JsonStreamParser &p, void *ctx) {
+    const SseTextSink &self = *(const SseTextSink *)ctx;
+    return is_delta_path(p, self.dialect_) || is_error_path(p) ||
+           is_terminal_path(p, self.dialect_);
+  }
+
+  static void on_json_event(JsonStreamParser &p, JsonStreamEvent ev, const String &value,
+                            void *ctx) {
+    SseTextSink &self = *(SseTextSink *)ctx;
+    if (ev == JSON_EV_NUMBER) {
+      take_usage(p, value, self.usage_);
+      return;
+    }
+    if (ev == JSON_EV_BOOL) {
+      if (value == "true" && is_terminal_path(p, self.dialect_)) {
+        self.finished_ = true;
+      }
+      return;
+    }
+    if (ev != JSON_EV_STRING || value.length() == 0) {
+      return;
+    }
+    if (is_terminal_path(p, self.dialect_)) {
+      if (self.dialect_ != SSE_ANTHROPIC || value == "message_stop") {
+        self.finished_ = true;
+      }
+      return;
+    }
+    if (is_error_path(p)) {
+      self.error_ = value;
+      return;
+    }
+    if (!is_delta_path(p, self.dialect_)) {
+      return;
+    }
+    self.text_ += value;
+    if (self.sink_ != nullptr &&
+        !self.sink_->cb(LLM_STREAM_DELTA, value, self.usage_, self.sink_->ctx)) {
+      self.stopped_ = true;
+      p.stop();
+    }
+  }
+
+  SseDialect dialect_;
+  const ReplyStreamSink *sink_;
+  String &text_;
+  String error_;
+  LlmUsage usage_;
+  bool stopped_;
+  bool finished_;
+  JsonStreamParser parser_;
+  LineMode mode_;
+  int prefix_len_;
+  bool in_event_;
+  int done_pos_;  // chars of "[DONE]" matched on this data line, -1 once it differs
+};
+
+// http_post_json() for a streaming request: the reply text is assembled from
+// SSE deltas into text_out instead of returned as a body. On HTTP errors the
+// body is read as usual so summarize_http_error() still works. A stream cut
+// off before its terminal event is an error; text_out then only holds what
+// was already shown.
+HttpResult http_post_sse(const String &url, JsonBody &body, SseDialect dialect,
+                         const ReplyStreamSink *sink, String &text_out,
+                         const String &h1_name = "", const String &h1_value = "",
+                         const String &h2_name = "", const String &h2_value = "") {
   HttpResult result{};
   result.status_code = -1;
+  text_out = "";
 
   if (WiFi.status() != WL_CONNECTED) {
     result.error = "WiFi not connected";
     return result;
   }
+  if (!body.ok()) {
+    result.error = "Request body has too many parts";
+    return result;
+  }
 
   const int kMaxAttempts = 2;
+  bool retried_stale = false;
   for (int attempt = 0; attempt < kMaxAttempts; attempt++) {
-    WiFiClientSecure client;
-    client.setInsecure();
-
-    HTTPClient https;
-    if (!https.begin(client, url)) {
+    if (request_ctx_should_stop(result.error)) {
+      result.status_code = -1;
+      return result;
+    }
+    HttpPoolLease lease;
+    if (!http_pool_acquire(url, lease)) {
       result.error = "HTTP begin failed";
       if (attempt + 1 < kMaxAttempts) {
         delay(220);
@@ -350,31 +719,64 @@ HttpResult http_post_json(const String &url, const String &body,
       }
       return result;
     }
+    HTTPClient &https = *lease.http;
 
-    https.setConnectTimeout(12000);
-    https.setTimeout(compute_llm_timeout_ms(body.length()));
+    https.setConnectTimeout(request_ctx_clamp_timeout(12000));
+    // Read timeout now bounds the gap between tokens, not the whole reply.
+    https.setTimeout(request_ctx_clamp_timeout(compute_llm_timeout_ms(body.length())));
     https.addHeader("Content-Type", "application/json");
-
+    https.addHeader("Accept",
+                    dialect == SSE_OLLAMA ? "application/x-ndjson" : "text/event-stream");
     if (h1_name.length()) {
       https.addHeader(h1_name, h1_value);
     }
     if (h2_name.length()) {
       https.addHeader(h2_name, h2_value);
     }
-    if (h3_name.length()) {
-      https.addHeader(h3_name, h3_value);
-    }
 
-    result.status_code = https.POST((uint8_t *)body.c_str(), body.length());
+    body.rewind();
+    result.status_code = https.sendRequest("POST", &body, body.length());
+    if (result.status_code >= 200 && result.status_code < 300) {
+      if (sink != nullptr) {
+        sink->cb(LLM_STREAM_BEGIN, "", LlmUsage(), sink->ctx);
+      }
+      SseTextSink sse(dialect, sink, text_out);
+      const int written = https.writeToStream(&sse);
+      // A cancel or parse error leaves the rest of the stream unread.
+      http_pool_release(lease, written >= 0 && sse.error().length() == 0 && sse.complete());
+      if (sse.error().length() > 0) {
+        result.error = sse.error();
+        result.body = "{\"error\":{\"message\":\"" + json_escape(sse.error()) + "\"}}";
+        result.status_code = 502;
+      } else if (!sse.complete()) {
+        result.error = written < 0 ? HTTPClient::errorToString(written)
+                                   : String("stream ended before the reply was complete");
+        result.status_code = written < 0 ? written : -1;
+      } else {
+        result.error = "";
+        const LlmUsage usage = sse.usage();
+        record_usage(usage);
+        if (sink != nullptr) {
+          sink->cb(LLM_STREAM_END, "", usage, sink->ctx);
+        }
+      }
+      return result;
+    }
     if (result.status_code > 0) {
       result.body = https.getString();
       result.error = "";
-      https.end();
+      http_pool_release(lease, body_fully_read(https, result.body));
       return result;
     }
 
     result.error = https.errorToString(result.status_code);
-    https.end();
+    const bool stale = http_pool_should_retry(lease, result.status_code, "POST");
+    http_pool_release(lease, false);
+    if (stale && !retried_stale) {
+      retried_stale = true;
+      attempt--;
+      continue;
+    }
 
     if (attempt + 1 < kMaxAttempts) {
       delay(260 + (attempt * 120));
@@ -384,32 +786,295 @@ HttpResult http_post_json(const String &url, const String &body,
   return result;
 }
 
-bool parse_response_text(const String &body, String &text) {
-  // OpenAI responses API compatibility fallback
-  if (extract_json_string_field(body, "output_text", text)) {
-    return true;
+#if ENABLE_MEDIA_UNDERSTANDING
+
+// JSON request body of the form <prefix><media as base64><suffix>, produced
+// while HTTPClient writes it. The prefix and suffix are JsonBody parts,
+// escaped as they are sent. The media is either already base64 (a String)
+// or raw bytes pulled from a Stream and encoded a chunk at a time, so a large
+// photo never has to sit in RAM.
+class MediaJsonBody : public Stream {
+ public:
+  MediaJsonBody(JsonBody &prefix, JsonBody &suffix)
+      : prefix_(prefix),
+        suffix_(suffix),
+        b64_(nullptr),
+        raw_(nullptr),
+        raw_len_(0),
+        raw_read_(0),
+        pos_(0),
+        enc_len_(0),
+        enc_pos_(0),
+        failed_(false) {
+    prefix_.rewind();
+    suffix_.rewind();
+  }
+
+  void set_base64(const String *b64) { b64_ = b64; }
+  void set_raw(Stream *raw, size_t raw_len) {
+    raw_ = raw;
+    raw_len_ = raw_len;
+  }
+
+  size_t media_length() const {
+    return b64_ != nullptr ? b64_->length() : ((raw_len_ + 2) / 3) * 4;
+  }
+  size_t length() const { return prefix_.length() + media_length() + suffix_.length(); }
+  bool failed() const { return failed_; }
+
+  int available() override {
+    if (failed_) {
+      return -1;  // makes HTTPClient abandon the upload
+    }
+    return (int)(length() - pos_);
+  }
+
+  using Stream::readBytes;
+  size_t readBytes(char *buffer, size_t len) override {
+    size_t out = 0;
+    while (out < len && pos_ < length() && !failed_) {
+      const size_t media_start = prefix_.length();
+      const size_t media_end = media_start + media_length();
+      size_t n = len - out;
+      if (pos_ < media_start) {
+        n = prefix_.readBytes(buffer + out, min(n, media_start - pos_));
+        if (n == 0) {
+          break;
+        }
+      } else if (pos_ >= media_end) {
+        n = suffix_.readBytes(buffer + out, min(n, length() - pos_));
+        if (n == 0) {
+          break;
+        }
+      } else if (b64_ != nullptr) {
+        n = min(n, media_end - pos_);
+        memcpy(buffer + out, b64_->c_str() + (pos_ - media_start), n);
+      } else {
+        if (enc_pos_ >= enc_len_ && !refill()) {
+          break;
+        }
+        n = min(n, enc_len_ - enc_pos_);
+        memcpy(buffer + out, enc_ + enc_pos_, n);
+        enc_pos_ += n;
+      }
+      out += n;
+      pos_ += n;
+    }
+    return out;
   }
 
-  // OpenAI/GLM chat-completions style
-  if (extract_json_string_field(body, "content", text)) {
-    return true;
+  int read() override {
+    char c;
+    return readBytes(&c, 1) == 1 ? (uint8_t)c : -1;
   }
 
-  // Anthropic and Gemini both include "text" fields
-  if (extract_json_string_field(body, "text", text)) {
-    return true;
+  int peek() override {
+    const size_t media_start = prefix_.length();
+    const size_t media_end = media_start + media_length();
+    if (failed_ || pos_ >= length()) {
+      return -1;
+    }
+    if (pos_ < media_start) {
+      return prefix_.peek();
+    }
+    if (pos_ >= media_end) {
+      return suffix_.peek();
+    }
+    if (b64_ != nullptr) {
+      return (uint8_t)(*b64_)[pos_ - media_start];
+    }
+    if (enc_pos_ >= enc_len_ && !refill()) {
+      return -1;
+    }
+    return (uint8_t)enc_[enc_pos_];
   }
 
-  return false;
+  size_t write(uint8_t) override { return 0; }
+
+ private:
+  static const size_t kRawChunk = 384;  // multiple of 3 -> 512 base64 chars
+
+  bool refill() {
+    static const char *kTable = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    uint8_t raw[kRawChunk];
+    size_t want = raw_len_ - raw_read_;
+    if (want > kRawChunk) {
+      want = kRawChunk;
+    }
+    size_t got = 0;
+    while (got < want) {
+      const size_t n = raw_->readBytes(raw + got, want - got);
+      if (n == 0) {
+        Serial.println("[llm] media stream ended early");
+        failed_ = true;
+        return false;
+      }
+      got += n;
+    }
+    raw_read_ += got;
+
+    enc_len_ = 0;
+    enc_pos_ = 0;
+    for (size_t i = 0; i < got; i += 3) {
+      const uint32_t b0 = raw[i];
+      const uint32_t b1 = (i + 1 < got) ? raw[i + 1] : 0;
+      const uint32_t b2 = (i + 2 < got) ? raw[i + 2] : 0;
+      const uint32_t triple = (b0 << 16) | (b1 << 8) | b2;
+      enc_[enc_len_++] = kTable[(triple >> 18) & 0x3F];
+      enc_[enc_len_++] = kTable[(triple >> 12) & 0x3F];
+      enc_[enc_len_++] = (i + 1 < got) ? kTable[(triple >> 6) & 0x3F] : '=';
+      enc_[enc_len_++] = (i + 2 < got) ? kTable[triple & 0x3F] : '=';
+    }
+    return enc_len_ > 0;
+  }
+
+  JsonBody &prefix_;
+  JsonBody &suffix_;
+  const String *b64_;
+  Stream *raw_;
+  size_t raw_len_;
+  size_t raw_read_;
+  size_t pos_;
+  char enc_[(kRawChunk / 3) * 4];
+  size_t enc_len_;
+  size_t enc_pos_;
+  bool failed_;
+};
+
+// Where the media for one request comes from: a base64 String already in
+// RAM, or an LlmMediaSource opened afresh for every attempt.
+struct MediaPayload {
+  const String *base64;
+  const LlmMediaSource *source;
+};
+
+// Gemini generateContent body around inline media: the data string is left
+// open at the end of prefix and closed by suffix.
+void gemini_media_body(JsonBody &prefix, JsonBody &suffix, const String &prompt,
+                       const String &mime) {
+  prefix.raw("{\"contents\":[{\"parts\":[{\"text\":").str(prompt);
+  prefix.raw("},{\"inlineData\":{\"mimeType\":").str(mime).raw(",\"data\":\"");
+  suffix.raw("\"}}]}],\"generationConfig\":{\"temperature\":0.2}}");
+}
+
+// http_post_json() for a <prefix><media><suffix> body.
+HttpResult http_post_media_json(const String &url, JsonBody &prefix, const MediaPayload &media,
+                                JsonBody &suffix, const String &h1_name,
+                                const String &h1_value) {
+  HttpResult result{};
+  result.status_code = -1;
+
+  if (WiFi.status() != WL_CONNECTED) {
+    result.error = "WiFi not connected";
+    return result;
+  }
+  if (!prefix.ok() || !suffix.ok()) {
+    result.error = "Request body has too many parts";
+    return result;
+  }
+
+  const int kMaxAttempts = 2;
+  for (int attempt = 0; attempt < kMaxAttempts; attempt++) {
+    if (request_ctx_should_stop(result.error)) {
+      result.status_code = -1;
+      return result;
+    }
+    MediaJsonBody body(prefix, suffix);
+    if (media.base64 != nullptr) {
+      body.set_base64(media.base64);
+    } else {
+      Stream *raw = nullptr;
+      size_t raw_len = 0;
+      if (!media.source->open(media.source->ctx, &raw, &raw_len, result.error)) {
+        return result;
+      }
+      body.set_raw(raw, raw_len);
+    }
+
+    HttpPoolLease lease;
+    bool sent = false;
+    if (http_pool_acquire(url, lease)) {
+      HTTPClient &https = *lease.http;
+      const size_t length = body.length();
+      https.setConnectTimeout(request_ctx_clamp_timeout(12000));
+      https.setTimeout(request_ctx_clamp_timeout(compute_llm_timeout_ms(length)));
+      https.addHeader("Content-Type", "application/json");
+      if (h1_name.length()) {
+        https.addHeader(h1_name, h1_value);
+      }
+
+      result.status_code = https.sendRequest("POST", &body, length);
+      if (result.status_code > 0) {
+        result.body = https.getString();
+        result.error = "";
+        sent = true;
+        http_pool_release(lease, body_fully_read(https, result.body));
+      } else {
+        result.error = https.errorToString(result.status_code);
+        http_pool_release(lease, false);
+      }
+    } else {
+      result.error = "HTTP begin failed";
+    }
+
+    if (media.source != nullptr) {
+      media.source->close(media.source->ctx, sent && !body.failed());
+    }
+    if (sent) {
+      return result;
+    }
+    if (attempt + 1 < kMaxAttempts) {
+      delay(260 + (attempt * 120));
+    }
+  }
+
+  return result;
+}
+
+#endif  // ENABLE_MEDIA_UNDERSTANDING
+
+// The parts of a system prompt before and after LLM_PROMPT_CACHE_BREAK,
+// pointing into the caller's String. Without a marker the whole prompt is
+// the tail and nothing is marked cacheable.
+struct SystemPromptParts {
+  const char *head;
+  size_t head_len;
+  const char *tail;
+  size_t tail_len;
+};
+
+SystemPromptParts split_system_prompt(const String &system_prompt) {
+  SystemPromptParts parts = {"", 0, system_prompt.c_str(), system_prompt.length()};
+  const int mark = system_prompt.indexOf(LLM_PROMPT_CACHE_BREAK);
+  if (mark >= 0) {
+    parts.head = system_prompt.c_str();
+    parts.head_len = (size_t)mark;
+    parts.tail = system_prompt.c_str() + mark + 1;
+    parts.tail_len = system_prompt.length() - (size_t)mark - 1;
+  }
+  return parts;
+}
+
+// Reply text of a non-streaming call; token counts go to `usage` if given.
+bool parse_response_text(const String &body, String &text, LlmUsage *usage = nullptr) {
+  JsonPathSlot slot = {kReplyTextPaths, sizeof(kReplyTextPaths) / sizeof(kReplyTextPaths[0]),
+                       kReplyTextKeys, sizeof(kReplyTextKeys) / sizeof(kReplyTextKeys[0]),
+                       &text, -1};
+  extract_json_paths(body, &slot, 1, usage);
+  return slot.rank >= 0;
 }
 
-bool extract_json_string_field_after_anchor(const String &body, const char *anchor,
-                                            const char *field_name, String &out) {
-  const int anchor_pos = body.indexOf(anchor);
-  if (anchor_pos < 0) {
+// parse_response_text() for a provider call, adding its usage to the totals.
+bool parse_call_reply(const String &body, String &text, bool anthropic) {
+  LlmUsage usage = {};
+  if (!parse_response_text(body, text, &usage)) {
     return false;
   }
-  return extract_json_string_field(body.substring(anchor_pos), field_name, out);
+  if (anthropic) {
+    fold_anthropic_cache_tokens(usage);
+  }
+  record_usage(usage);
+  return true;
 }
 
 String summarize_http_error(const String &label, const HttpResult &res) {
@@ -421,7 +1086,12 @@ String summarize_http_error(const String &label, const HttpResult &res) {
   }
 
   String msg;
-  if (extract_json_string_field(res.body, "message", msg) && msg.length() > 0) {
+  JsonPathSlot slot = {kErrorMessagePaths,
+                       sizeof(kErrorMessagePaths) / sizeof(kErrorMessagePaths[0]),
+                       kErrorMessageKeys, sizeof(kErrorMessageKeys) / sizeof(kErrorMessageKeys[0]),
+                       &msg, -1};
+  extract_json_paths(res.body, &slot, 1, nullptr);
+  if (slot.rank >= 0 && msg.length() > 0) {
     msg.replace('\n', ' ');
     msg.replace('\r', ' ');
     if (msg.length() > 160) {
@@ -447,14 +1117,49 @@ String summarize_http_error(const String &label, const HttpResult &res) {
   return label + " HTTP " + String(res.status_code);
 }
 
+// {"model":..,"messages":[system,user]<tail>, for the OpenAI-style chat
+// APIs. `tail` closes the object. The prompts are referenced, not copied.
+void chat_messages_body(JsonBody &body, const String &model, const String &system_prompt,
+                        const String &task, const char *tail) {
+  // The cache marker is dropped; these APIs reuse a matching prefix by
+  // themselves.
+  const SystemPromptParts sys = split_system_prompt(system_prompt);
+  body.raw("{\"model\":").str(model)
+      .raw(",\"messages\":[{\"role\":\"system\",\"content\":\"")
+      .esc(sys.head, sys.head_len).esc(sys.tail, sys.tail_len)
+      .raw("\"},{\"role\":\"user\",\"content\":").str(task)
+      .raw("}]").raw(tail);
+}
+
+bool finish_streamed_call(const HttpResult &res, String &response_out, String &error_out) {
+  if (res.status_code < 200 || res.status_code >= 300) {
+    error_out = summarize_http_error("LLM", res);
+    return false;
+  }
+  response_out.trim();
+  if (response_out.length() == 0) {
+    error_out = "Empty streamed response";
+    return false;
+  }
+  return true;
+}
+
 bool call_openai_like(const String &base_url, const String &api_key, const String &model,
                       const String &system_prompt, const String &task,
                       String &response_out, String &error_out) {
   const String url = join_url(base_url, "/v1/chat/completions");
-  const String body = String("{\"model\":\"") + json_escape(model) +
-                      "\",\"messages\":[{\"role\":\"system\",\"content\":\"" +
-                      json_escape(system_prompt) + "\"},{\"role\":\"user\",\"content\":\"" +
-                      json_escape(task) + "\"}],\"temperature\":0.2}";
+  const ReplyStreamSink *sink = active_reply_sink();
+  JsonBody body;
+  if (sink != nullptr) {
+    // include_usage adds a final chunk with the token counts.
+    chat_messages_body(body, model, system_prompt, task,
+                       ",\"temperature\":0.2,\"stream\":true,"
+                       "\"stream_options\":{\"include_usage\":true}}");
+    const HttpResult res = http_post_sse(url, body, SSE_OPENAI, sink, response_out,
+                                         "Authorization", "Bearer " + api_key);
+    return finish_streamed_call(res, response_out, error_out);
+  }
+  chat_messages_body(body, model, system_prompt, task, ",\"temperature\":0.2}");
 
   const HttpResult res =
       http_post_json(url, body, "Authorization", "Bearer " + api_key);
@@ -463,7 +1168,7 @@ bool call_openai_like(const String &base_url, const String &api_key, const Strin
     return false;
   }
 
-  if (!parse_response_text(res.body, response_out)) {
+  if (!parse_call_reply(res.body, response_out, false)) {
     error_out = "Could not parse provider response";
     return false;
   }
@@ -475,10 +1180,31 @@ bool call_anthropic(const String &base_url, const String &api_key, const String
                     const String &system_prompt, const String &task,
                     String &response_out, String &error_out) {
   const String url = join_url(base_url, "/v1/messages");
-  const String body = String("{\"model\":\"") + json_escape(model) +
-                      "\",\"max_tokens\":512,\"system\":\"" + json_escape(system_prompt) +
-                      "\",\"messages\":[{\"role\":\"user\",\"content\":\"" +
-                      json_escape(task) + "\"}]}";
+  const ReplyStreamSink *sink = active_reply_sink();
+  const SystemPromptParts sys = split_system_prompt(system_prompt);
+  JsonBody body;
+  body.raw("{\"model\":").str(model).raw(",\"max_tokens\":512,\"system\":");
+  if (LLM_PROMPT_CACHE && sys.head_len > 0) {
+    // Cache breakpoint after the stable head; the tail is sent as a second
+    // block (Anthropic rejects empty ones).
+    body.raw("[{\"type\":\"text\",\"text\":\"").esc(sys.head, sys.head_len)
+        .raw("\",\"cache_control\":{\"type\":\"ephemeral\"}}");
+    if (sys.tail_len > 0) {
+      body.raw(",{\"type\":\"text\",\"text\":\"").esc(sys.tail, sys.tail_len).raw("\"}");
+    }
+    body.raw("]");
+  } else {
+    body.raw("\"").esc(sys.head, sys.head_len).esc(sys.tail, sys.tail_len).raw("\"");
+  }
+  body.raw(",\"messages\":[{\"role\":\"user\",\"content\":").str(task)
+      .raw(sink != nullptr ? "}],\"stream\":true}" : "}]}");
+
+  if (sink != nullptr) {
+    const HttpResult res =
+        http_post_sse(url, body, SSE_ANTHROPIC, sink, response_out,
+                      "x-api-key", api_key, "anthropic-version", "2023-06-01");
+    return finish_streamed_call(res, response_out, error_out);
+  }
 
   const HttpResult res = http_post_json(url, body, "x-api-key", api_key,
                                         "anthropic-version", "2023-06-01");
@@ -487,7 +1213,7 @@ bool call_anthropic(const String &base_url, const String &api_key, const String
     return false;
   }
 
-  if (!parse_response_text(res.body, response_out)) {
+  if (!parse_call_reply(res.body, response_out, true)) {
     error_out = "Could not parse provider response";
     return false;
   }
@@ -498,19 +1224,32 @@ bool call_anthropic(const String &base_url, const String &api_key, const String
 bool call_gemini(const String &base_url, const String &api_key, const String &model,
                  const String &system_prompt, const String &task,
                  String &response_out, String &error_out) {
+  // Gemini caches a repeated prefix implicitly; the marker is dropped.
+  const SystemPromptParts sys = split_system_prompt(system_prompt);
+  JsonBody body;
+  body.raw("{\"contents\":[{\"parts\":[{\"text\":\"")
+      .esc(sys.head, sys.head_len).esc(sys.tail, sys.tail_len)
+      .raw("\\n\\nUser message:\\n").esc(task)
+      .raw("\"}]}]}");
+
+  const ReplyStreamSink *sink = active_reply_sink();
+  if (sink != nullptr) {
+    const String path =
+        String("/v1beta/models/") + model + ":streamGenerateContent?alt=sse&key=" + api_key;
+    const HttpResult res =
+        http_post_sse(join_url(base_url, path), body, SSE_GEMINI, sink, response_out);
+    return finish_streamed_call(res, response_out, error_out);
+  }
+
   const String path = String("/v1beta/models/") + model + ":generateContent?key=" + api_key;
   const String url = join_url(base_url, path);
-  const String prompt = system_prompt + String("\\n\\nUser message:\\n") + task;
-  const String body = String("{\"contents\":[{\"parts\":[{\"text\":\"") +
-                      json_escape(prompt) + "\"}]}]}";
-
   const HttpResult res = http_post_json(url, body);
   if (res.status_code < 200 || res.status_code >= 300) {
     error_out = summarize_http_error("LLM", res);
     return false;
   }
 
-  if (!parse_response_text(res.body, response_out)) {
+  if (!parse_call_reply(res.body, response_out, false)) {
     error_out = "Could not parse provider response";
     return false;
   }
@@ -526,10 +1265,17 @@ bool call_glm_zai(const String &endpoint_url, const String &api_key, const Strin
     url = join_url(url, "/chat/completions");
   }
 
-  const String body = String("{\"model\":\"") + json_escape(model) +
-                      "\",\"messages\":[{\"role\":\"system\",\"content\":\"" +
-                      json_escape(system_prompt) + "\"},{\"role\":\"user\",\"content\":\"" +
-                      json_escape(task) + "\"}],\"temperature\":0.2,\"stream\":false}";
+  const ReplyStreamSink *sink = active_reply_sink();
+  JsonBody body;
+  chat_messages_body(body, model, system_prompt, task,
+                     sink != nullptr ? ",\"temperature\":0.2,\"stream\":true}"
+                                     : ",\"temperature\":0.2,\"stream\":false}");
+
+  if (sink != nullptr) {
+    const HttpResult res = http_post_sse(url, body, SSE_OPENAI, sink, response_out,
+                                         "Authorization", "Bearer " + api_key);
+    return finish_streamed_call(res, response_out, error_out);
+  }
 
   const HttpResult res =
       http_post_json(url, body, "Authorization", "Bearer " + api_key);
@@ -538,7 +1284,7 @@ bool call_glm_zai(const String &endpoint_url, const String &api_key, const Strin
     return false;
   }
 
-  if (!parse_response_text(res.body, response_out)) {
+  if (!parse_call_reply(res.body, response_out, false)) {
     error_out = "Could not parse provider response";
     return false;
   }
@@ -557,10 +1303,20 @@ bool call_ollama(const String &base_url, const String &model,
   }
 
   // Ollama /api/chat uses OpenAI-compatible format
-  const String body = String("{\"model\":\"") + json_escape(model) +
-                      "\",\"messages\":[{\"role\":\"system\",\"content\":\"" +
-                      json_escape(system_prompt) + "\"},{\"role\":\"user\",\"content\":\"" +
-                      json_escape(task) + "\"}],\"stream\":false}";
+  const ReplyStreamSink *sink = active_reply_sink();
+  JsonBody body;
+  chat_messages_body(body, model, system_prompt, task,
+                     sink != nullptr ? ",\"stream\":true}" : ",\"stream\":false}");
+
+  if (sink != nullptr) {
+    // Streams newline-delimited JSON objects rather than SSE.
+    const HttpResult res = http_post_sse(url, body, SSE_OLLAMA, sink, response_out);
+    if (res.status_code < 200 || res.status_code >= 300) {
+      error_out = summarize_http_error("Ollama", res);
+      return false;
+    }
+    return finish_streamed_call(res, response_out, error_out);
+  }
 
   // Ollama doesn't use API key, pass empty string
   const HttpResult res = http_post_json(url, body);
@@ -570,7 +1326,7 @@ bool call_ollama(const String &base_url, const String &model,
   }
 
   // Ollama /api/chat returns OpenAI-compatible format
-  if (!parse_response_text(res.body, response_out)) {
+  if (!parse_call_reply(res.body, response_out, false)) {
     error_out = "Could not parse Ollama response";
     return false;
   }
@@ -944,28 +1700,6 @@ bool llm_generate_reply(const String &message, String &reply_out, String &error_
                    "- When user asks to modify previous code, prefer loading from SPIFFS file path instead of relying only on chat memory.\n"
                    "- Keep edits incremental and return updated file output.";
 
-  // Inject current time awareness
-  String time_ctx = build_time_context();
-  if (time_ctx.length() > 0) {
-    system_prompt += "\n\nCURRENT TIME: " + time_ctx +
-                     "\nUse this to greet appropriately (good morning/afternoon/evening) "
-                     "and be aware of timing context in conversations.";
-  }
-
-  String stored_tz;
-  String tz_err;
-  if (!persona_get_timezone(stored_tz, tz_err) || stored_tz.length() == 0) {
-    system_prompt += "\n\nCRITICAL: User timezone is NOT SET! If they ask to schedule a cron job, reminder, or ask for the time, "
-                     "STOP and explicitly ask them 'What City/Country are you in?' FIRST. Then use the timezone_set tool.";
-  }
-
-  // Inject real schedule state so LLM doesn't hallucinate reminder/cron status.
-  String schedule_ctx = build_schedule_context();
-  schedule_ctx = trim_with_ellipsis(schedule_ctx, kMaxScheduleChars);
-  system_prompt += "\n\nACTIVE SCHEDULE STATE (source of truth from cron.json + reminder store):\n" +
-                   schedule_ctx +
-                   "\nWhen user asks about reminders/cron, rely on this state before suggesting changes.";
-
   // Inject available skills so the agent knows what it can do
   String skill_descs = skill_get_descriptions_for_react();
   if (skill_descs.length() > 0 && !long_user_message) {
@@ -1004,21 +1738,6 @@ bool llm_generate_reply(const String &message, String &reply_out, String &error_
     }
   }
 
-  String task = trim_with_ellipsis(message, kMaxTaskChars);
-  String msg_lc = message;
-  msg_lc.toLowerCase();
-
-  // Always include recent chat history for better context and follow-ups
-  // History is stored in NVS and persists across reboots
-  String history;
-  String history_err;
-  if (!long_user_message && chat_history_get(history, history_err)) {
-    history.trim();
-    if (history.length() > 0) {
-      history = keep_tail_with_marker(history, kMaxHistoryChars);
-      task = "Recent conversation (last 15-30 turns):\n" + history + "\n\nCurrent user message:\n" + message;
-    }
-  }
   // Include last generated file for iteration (short-term memory fallback).
   // Primary preference is project files in SPIFFS (/projects/...).
   // MOVED: Append to system prompt to avoid "User sent this" hallucination
@@ -1037,6 +1756,48 @@ bool llm_generate_reply(const String &message, String &reply_out, String &error_
                      "==========================================================\n";
   }
 
+  // Everything above is the same from one message to the next and is cached
+  // by the provider; what follows changes every call.
+  system_prompt += LLM_PROMPT_CACHE_BREAK;
+
+  // Inject current time awareness
+  String time_ctx = build_time_context();
+  if (time_ctx.length() > 0) {
+    system_prompt += "\n\nCURRENT TIME: " + time_ctx +
+                     "\nUse this to greet appropriately (good morning/afternoon/evening) "
+                     "and be aware of timing context in conversations.";
+  }
+
+  String stored_tz;
+  String tz_err;
+  if (!persona_get_timezone(stored_tz, tz_err) || stored_tz.length() == 0) {
+    system_prompt += "\n\nCRITICAL: User timezone is NOT SET! If they ask to schedule a cron job, reminder, or ask for the time, "
+                     "STOP and explicitly ask them 'What City/Country are you in?' FIRST. Then use the timezone_set tool.";
+  }
+
+  // Inject real schedule state so LLM doesn't hallucinate reminder/cron status.
+  String schedule_ctx = build_schedule_context();
+  schedule_ctx = trim_with_ellipsis(schedule_ctx, kMaxScheduleChars);
+  system_prompt += "\n\nACTIVE SCHEDULE STATE (source of truth from cron.json + reminder store):\n" +
+                   schedule_ctx +
+                   "\nWhen user asks about reminders/cron, rely on this state before suggesting changes.";
+
+  String task = trim_with_ellipsis(message, kMaxTaskChars);
+  String msg_lc = message;
+  msg_lc.toLowerCase();
+
+  // Always include recent chat history for better context and follow-ups
+  // History is stored in NVS and persists across reboots
+  String history;
+  String history_err;
+  if (!long_user_message && chat_history_get(history, history_err)) {
+    history.trim();
+    if (history.length() > 0) {
+      history = keep_tail_with_marker(history, kMaxHistoryChars);
+      task = "Recent conversation (last 15-30 turns):\n" + history + "\n\nCurrent user message:\n" + message;
+    }
+  }
+
   if (task.length() > kMaxTaskChars) {
     task = trim_with_ellipsis(task, kMaxTaskChars);
   }
@@ -1059,29 +1820,8 @@ bool llm_generate_reply(const String &message, String &reply_out, String &error_
 
   // Auto-save important info to MEMORY.md
   if (result) {
-    // Check if user is sharing something important about themselves
-    String msg_lc_check = message;
-    msg_lc_check.toLowerCase();
-
-    // Patterns that indicate important info to remember
-    const bool is_personal_info =
-      msg_lc_check.startsWith("my ") ||
-      msg_lc_check.startsWith("i am ") ||
-      msg_lc_check.startsWith("i'm ") ||
-      msg_lc_check.indexOf(" i like ") >= 0 ||
-      msg_lc_check.indexOf(" i love ") >= 0 ||
-      msg_lc_check.indexOf(" my favorite ") >= 0 ||
-      msg_lc_check.indexOf(" remember that ") >= 0 ||
-      msg_lc_check.startsWith("don't forget ") ||
-      (msg_lc_check.startsWith("my name is ") || msg_lc_check.startsWith("call me "));
-
-    // Also check if user explicitly asks to remember
-    const bool explicit_remember =
-      msg_lc_check.startsWith("remember ") ||
-      msg_lc_check.indexOf(" please remember") >= 0 ||
-      msg_lc_check.indexOf(" don't forget") >= 0;
-
-    if (is_personal_info || explicit_remember) {
+    // Personal info or an explicit "remember ..."
+    if (intent_classify(message) & INTENT_REMEMBER) {
       // Auto-save to MEMORY.md
       String save_err;
       String memory_entry = "- " + message;
@@ -1107,6 +1847,48 @@ bool llm_generate_reply(const String &message, String &reply_out, String &error_
   return result;
 }
 
+// Routes provider calls from this task to `cb` until end_stream_sink().
+// Only one task streams at a time; others fall back to whole responses.
+static bool begin_stream_sink(llm_stream_cb_t cb, void *ctx) {
+  if (cb == nullptr || g_reply_sink.cb != nullptr) {
+    return false;
+  }
+  g_reply_sink.cb = cb;
+  g_reply_sink.ctx = ctx;
+  g_reply_sink.owner = xTaskGetCurrentTaskHandle();
+  return true;
+}
+
+static void end_stream_sink() {
+  g_reply_sink.cb = nullptr;
+  g_reply_sink.ctx = nullptr;
+  g_reply_sink.owner = nullptr;
+}
+
+bool llm_generate_reply_streaming(const String &message, llm_stream_cb_t cb, void *ctx,
+                                  String &reply_out, String &error_out) {
+  if (!begin_stream_sink(cb, ctx)) {
+    return llm_generate_reply(message, reply_out, error_out);
+  }
+  const bool ok = llm_generate_reply(message, reply_out, error_out);
+  end_stream_sink();
+  return ok;
+}
+
+bool llm_generate_with_custom_prompt_streaming(const String &system_prompt, const String &task,
+                                               bool include_memory, llm_stream_cb_t cb,
+                                               void *ctx, String &reply_out,
+                                               String &error_out) {
+  if (!begin_stream_sink(cb, ctx)) {
+    return llm_generate_with_custom_prompt(system_prompt, task, include_memory, reply_out,
+                                           error_out);
+  }
+  const bool ok =
+      llm_generate_with_custom_prompt(system_prompt, task, include_memory, reply_out, error_out);
+  end_stream_sink();
+  return ok;
+}
+
 bool llm_generate_heartbeat(const String &heartbeat_doc, String &reply_out, String &error_out) {
   String task = heartbeat_doc;
   task.trim();
@@ -1123,17 +1905,17 @@ bool llm_generate_heartbeat(const String &heartbeat_doc, String &reply_out, Stri
   return llm_generate_with_custom_prompt(String(kHeartbeatSystemPrompt), task, false, reply_out, error_out);
 }
 
-bool llm_extract_user_facts(const String &user_message, const String &existing_profile,
+bool llm_extract_user_facts(const String &user_messages, const String &existing_profile,
                             String &facts_out, String &error_out) {
   static const char *kExtractPrompt =
-      "Extract ONLY new personal facts from the user's message. "
+      "Extract ONLY new personal facts from the user's messages. "
       "Facts include: name, location, age, job, interests, preferences, schedule, family, pets. "
       "Ignore questions, commands, or temporary context. "
       "If the user's existing profile already contains the fact, skip it. "
       "Return ONLY the new facts as bullet points (- fact). "
       "If no new facts found, return exactly: NONE";
 
-  String task = "User message: " + user_message;
+  String task = "User messages:\n" + user_messages;
   if (existing_profile.length() > 0) {
     String profile = existing_profile;
     if (profile.length() > 600) {
@@ -1275,18 +2057,18 @@ bool llm_generate_image(const String &prompt, String &base64_out, String &error_
       const String model = String(native_models[i]);
       const String gen_url =
           join_url(gemini_base, String("/v1beta/models/") + model + ":generateContent");
-      const String gen_body =
-          String("{\"contents\":[{\"parts\":[{\"text\":\"") + json_escape(prompt) +
-          "\"}]}],\"generationConfig\":{\"responseModalities\":[\"TEXT\",\"IMAGE\"]}}";
+      JsonBody gen_body;
+      gen_body.raw("{\"contents\":[{\"parts\":[{\"text\":").str(prompt);
+      gen_body.raw("}]}],\"generationConfig\":{\"responseModalities\":[\"TEXT\",\"IMAGE\"]}}");
 
       const HttpResult gen_res =
           http_post_json(gen_url, gen_body, "x-goog-api-key", api_key);
       if (gen_res.status_code >= 200 && gen_res.status_code < 300) {
-        if (extract_json_string_field_after_anchor(gen_res.body, "\"inlineData\"", "data",
-                                                   base64_out) ||
-            extract_json_string_field_after_anchor(gen_res.body, "\"inline_data\"", "data",
-                                                   base64_out) ||
-            extract_json_string_field(gen_res.body, "data", base64_out)) {
+        static const char *const kImagePaths[] = {
+            "candidates.0.content.parts.*.inlineData.data",
+            "candidates.0.content.parts.*.inline_data.data",
+        };
+        if (extract_json_path(gen_res.body, kImagePaths, 2, "data", base64_out)) {
           return true;
         }
         last_err = "Could not parse Gemini image response";
@@ -1303,13 +2085,16 @@ bool llm_generate_image(const String &prompt, String &base64_out, String &error_
     // Optional Imagen endpoint (requires billed access in many projects).
     const String imagen_url =
         join_url(gemini_base, "/v1beta/models/imagen-4.0-generate-001:predict");
-    const String imagen_body = String("{\"instances\":[{\"prompt\":\"") + json_escape(prompt) +
-                               "\"}],\"parameters\":{\"sampleCount\":1}}";
+    JsonBody imagen_body;
+    imagen_body.raw("{\"instances\":[{\"prompt\":").str(prompt);
+    imagen_body.raw("}],\"parameters\":{\"sampleCount\":1}}");
 
     const HttpResult imagen_res =
         http_post_json(imagen_url, imagen_body, "x-goog-api-key", api_key);
     if (imagen_res.status_code >= 200 && imagen_res.status_code < 300) {
-      if (extract_json_string_field(imagen_res.body, "bytesBase64Encoded", base64_out)) {
+      static const char *const kImagenPaths[] = {"predictions.0.bytesBase64Encoded"};
+      if (extract_json_path(imagen_res.body, kImagenPaths, 1, "bytesBase64Encoded",
+                            base64_out)) {
         return true;
       }
       error_out = "Could not parse Imagen response";
@@ -1340,8 +2125,9 @@ bool llm_generate_image(const String &prompt, String &base64_out, String &error_
     }
 
     const String url = join_url(openai_base, "/v1/images/generations");
-    const String body = String("{\"model\":\"dall-e-3\",\"prompt\":\"") + json_escape(prompt) +
-                        "\",\"n\":1,\"size\":\"1024x1024\",\"response_format\":\"b64_json\"}";
+    JsonBody body;
+    body.raw("{\"model\":\"dall-e-3\",\"prompt\":").str(prompt);
+    body.raw(",\"n\":1,\"size\":\"1024x1024\",\"response_format\":\"b64_json\"}");
 
     const HttpResult res = http_post_json(url, body, "Authorization", "Bearer " + api_key);
     if (res.status_code < 200 || res.status_code >= 300) {
@@ -1350,7 +2136,8 @@ bool llm_generate_image(const String &prompt, String &base64_out, String &error_
       return false;
     }
 
-    if (!extract_json_string_field(res.body, "b64_json", base64_out)) {
+    static const char *const kDallePaths[] = {"data.0.b64_json"};
+    if (!extract_json_path(res.body, kDallePaths, 1, "b64_json", base64_out)) {
       error_out = "Could not parse DALL-E response";
       usage_record_call("image", 500, "openai", "dall-e-3");
       return false;
@@ -1368,8 +2155,8 @@ bool llm_generate_image(const String &prompt, String &base64_out, String &error_
 
 #if ENABLE_MEDIA_UNDERSTANDING
 
-bool llm_understand_media(const String &instruction, const String &mime_type,
-                          const String &base64_data, String &reply_out, String &error_out) {
+static bool understand_media(const String &instruction, const String &mime_type,
+                             const MediaPayload &media, String &reply_out, String &error_out) {
   reply_out = "";
 
   // Try to get config from NVS first, fallback to .env
@@ -1419,14 +2206,10 @@ bool llm_understand_media(const String &instruction, const String &mime_type,
     media_mime = "image/jpeg";
   }
 
-  if (base64_data.length() == 0) {
+  if (media.base64 != nullptr && media.base64->length() == 0) {
     error_out = "Missing media data";
     return false;
   }
-  if (base64_data.length() > 260000) {
-    error_out = "Media payload too large for ESP32";
-    return false;
-  }
 
   // ── Gemini path ──
   if (provider == "gemini") {
@@ -1441,13 +2224,12 @@ bool llm_understand_media(const String &instruction, const String &mime_type,
 
     const String url = join_url(gemini_base,
                                 String("/v1beta/models/") + model + ":generateContent");
-    const String body =
-        String("{\"contents\":[{\"parts\":[{\"text\":\"") + json_escape(prompt) +
-        "\"},{\"inlineData\":{\"mimeType\":\"" + json_escape(media_mime) +
-        "\",\"data\":\"" + base64_data +
-        "\"}}]}],\"generationConfig\":{\"temperature\":0.2}}";
+    JsonBody prefix;
+    JsonBody suffix;
+    gemini_media_body(prefix, suffix, prompt, media_mime);
 
-    const HttpResult res = http_post_json(url, body, "x-goog-api-key", api_key);
+    const HttpResult res =
+        http_post_media_json(url, prefix, media, suffix, "x-goog-api-key", api_key);
     if (res.status_code < 200 || res.status_code >= 300) {
       error_out = summarize_http_error("Gemini media", res);
       usage_record_call("media", res.status_code, "gemini", model.c_str());
@@ -1498,21 +2280,20 @@ bool llm_understand_media(const String &instruction, const String &mime_type,
 
     const String url = join_url(vision_base, "/v1/chat/completions");
 
-    // Build data URI: data:<mime>;base64,<data>
-    const String data_uri = "data:" + media_mime + ";base64," + base64_data;
-
     // Retry loop: Try requested model, then fallback if it fails
     for (int attempt = 0; attempt < 2; attempt++) {
-      // OpenAI vision format with image_url
-      const String body =
-          String("{\"model\":\"") + json_escape(vision_model) +
-          "\",\"messages\":[{\"role\":\"user\",\"content\":[" +
-          "{\"type\":\"text\",\"text\":\"" + json_escape(prompt) + "\"}," +
-          "{\"type\":\"image_url\",\"image_url\":{\"url\":\"" + data_uri + "\"}}" +
-          "]}],\"temperature\":0.2,\"max_tokens\":1024}";
+      // OpenAI vision format with image_url; the media goes in a data URI:
+      // data:<mime>;base64,<data>
+      JsonBody prefix;
+      prefix.raw("{\"model\":").str(vision_model);
+      prefix.raw(",\"messages\":[{\"role\":\"user\",\"content\":[{\"type\":\"text\",\"text\":");
+      prefix.str(prompt).raw("},{\"type\":\"image_url\",\"image_url\":{\"url\":\"data:");
+      prefix.esc(media_mime).raw(";base64,");
+      JsonBody suffix;
+      suffix.raw("\"}}]}],\"temperature\":0.2,\"max_tokens\":1024}");
 
       const HttpResult res =
-          http_post_json(url, body, "Authorization", "Bearer " + api_key);
+          http_post_media_json(url, prefix, media, suffix, "Authorization", "Bearer " + api_key);
 
       if (res.status_code >= 200 && res.status_code < 300) {
         if (parse_response_text(res.body, reply_out)) {
@@ -1542,12 +2323,12 @@ bool llm_understand_media(const String &instruction, const String &mime_type,
             // Execute Gemini logic inline
             String gemini_base = String(LLM_GEMINI_BASE_URL);
             String g_url = join_url(gemini_base, String("/v1beta/models/") + gemini_model + ":generateContent");
-            String g_body = String("{\"contents\":[{\"parts\":[{\"text\":\"") + json_escape(prompt) +
-                            "\"},{\"inlineData\":{\"mimeType\":\"" + json_escape(media_mime) +
-                            "\",\"data\":\"" + base64_data +
-                            "\"}}]}],\"generationConfig\":{\"temperature\":0.2}}";
+            JsonBody g_prefix;
+            JsonBody g_suffix;
+            gemini_media_body(g_prefix, g_suffix, prompt, media_mime);
 
-            HttpResult g_res = http_post_json(g_url, g_body, "x-goog-api-key", gemini_key);
+            HttpResult g_res =
+                http_post_media_json(g_url, g_prefix, media, g_suffix, "x-goog-api-key", gemini_key);
             if (g_res.status_code >= 200 && g_res.status_code < 300) {
                if (parse_response_text(g_res.body, reply_out)) {
                    reply_out.trim();
@@ -1580,6 +2361,18 @@ bool llm_understand_media(const String &instruction, const String &mime_type,
   return false;
 }
 
+bool llm_understand_media(const String &instruction, const String &mime_type,
+                          const String &base64_data, String &reply_out, String &error_out) {
+  MediaPayload media = {&base64_data, nullptr};
+  return understand_media(instruction, mime_type, media, reply_out, error_out);
+}
+
+bool llm_understand_media_stream(const String &instruction, const LlmMediaSource &source,
+                                 String &reply_out, String &error_out) {
+  MediaPayload media = {nullptr, &source};
+  return understand_media(instruction, source.mime_type, media, reply_out, error_out);
+}
+
 #endif  // ENABLE_MEDIA_UNDERSTANDING
 
 namespace {
@@ -1653,10 +2446,10 @@ bool llm_parse_email_request(const String &message, String &to_out, String &subj
         "- body: the main message content\n"
         "- Return ONLY valid JSON, nothing else";
 
-    const String json_body =
-        String("{\"model\":\"") + String(LLM_MODEL) +
-        "\",\"messages\":[{\"role\":\"system\",\"content\":\"" + json_escape(system_prompt) +
-        "\"},{\"role\":\"user\",\"content\":\"" + json_escape(message) + "\"}]}";
+    JsonBody json_body;
+    json_body.raw("{\"model\":").str(LLM_MODEL);
+    json_body.raw(",\"messages\":[{\"role\":\"system\",\"content\":").str(system_prompt);
+    json_body.raw("},{\"role\":\"user\",\"content\":").str(message).raw("}]}");
 
     const HttpResult res = http_post_json(url, json_body, "Authorization", "Bearer " + api_key);
 
@@ -1700,8 +2493,8 @@ bool llm_parse_email_request(const String &message, String &to_out, String &subj
         "Use empty string \"\" for missing fields.";
 
     if (provider == "gemini") {
-      const String json_body =
-          String("{\"contents\":[{\"parts\":[{\"text\":\"" + json_escape(prompt) + "\"}]}]}");
+      JsonBody json_body;
+      json_body.raw("{\"contents\":[{\"parts\":[{\"text\":").str(prompt).raw("}]}]}");
       const HttpResult res = http_post_json(url, json_body);
 
       if (res.status_code < 200 || res.status_code >= 300) {
@@ -1729,9 +2522,10 @@ bool llm_parse_email_request(const String &message, String &to_out, String &subj
     }
 
     // Anthropic
-    const String json_body =
-        String("{\"model\":\"claude-3-haiku-20240307\",\"max_tokens\":1024,") +
-        "\"messages\":[{\"role\":\"user\",\"content\":\"" + json_escape(prompt) + "\"}]}";
+    JsonBody json_body;
+    json_body.raw("{\"model\":\"claude-3-haiku-20240307\",\"max_tokens\":1024,"
+                  "\"messages\":[{\"role\":\"user\",\"content\":");
+    json_body.str(prompt).raw("}]}");
 
     const HttpResult res = http_post_json(url, json_body, "x-api-key",
                                            "sk-ant-" + api_key);
@@ -1800,10 +2594,10 @@ bool llm_parse_update_request(const String &message, String &url_out, bool &shou
         "- If user wants latest release from GitHub, set check_github=true and url=\"\"\n"
         "- Return ONLY valid JSON, nothing else";
 
-    const String json_body =
-        String("{\"model\":\"") + String(LLM_MODEL) +
-        "\",\"messages\":[{\"role\":\"system\",\"content\":\"" + json_escape(system_prompt) +
-        "\"},{\"role\":\"user\",\"content\":\"" + json_escape(message) + "\"}]}";
+    JsonBody json_body;
+    json_body.raw("{\"model\":").str(LLM_MODEL);
+    json_body.raw(",\"messages\":[{\"role\":\"system\",\"content\":").str(system_prompt);
+    json_body.raw("},{\"role\":\"user\",\"content\":").str(message).raw("}]}");
 
     const HttpResult res = http_post_json(url, json_body, "Authorization", "Bearer " + api_key);
 
@@ -1846,8 +2640,8 @@ bool llm_parse_update_request(const String &message, String &url_out, bool &shou
         "url: firmware URL or empty, should_update: true/false, check_github: true if user wants latest from GitHub";
 
     if (provider == "gemini") {
-      const String json_body =
-          String("{\"contents\":[{\"parts\":[{\"text\":\"" + json_escape(prompt) + "\"}]}]}");
+      JsonBody json_body;
+      json_body.raw("{\"contents\":[{\"parts\":[{\"text\":").str(prompt).raw("}]}]}");
       const HttpResult res = http_post_json(url, json_body);
 
       if (res.status_code < 200 || res.status_code >= 300) {
@@ -1874,9 +2668,10 @@ bool llm_parse_update_request(const String &message, String &url_out, bool &shou
     }
 
     // Anthropic
-    const String json_body =
-        String("{\"model\":\"claude-3-haiku-20240307\",\"max_tokens\":1024,") +
-        "\"messages\":[{\"role\":\"user\",\"content\":\"" + json_escape(prompt) + "\"}]}";
+    JsonBody json_body;
+    json_body.raw("{\"model\":\"claude-3-haiku-20240307\",\"max_tokens\":1024,"
+                  "\"messages\":[{\"role\":\"user\",\"content\":");
+    json_body.str(prompt).raw("}]}");
 
     const HttpResult res = http_post_json(url, json_body, "x-api-key",
                                            "sk-ant-" + api_key);
@@ -1929,7 +2724,7 @@ bool llm_fetch_provider_models(const String &provider, String &models_out, Strin
     return false;
   }
 
-  WiFiClientSecure client;
+  TlsSessionClient client;
   client.setInsecure();
 
   HTTPClient https;
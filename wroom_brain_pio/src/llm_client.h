@@ -3,6 +3,13 @@
 
 #include <Arduino.h>
 
+// Splits a system prompt into a head that is byte-identical from call to
+// call (persona, instructions, tool list) and a tail that is not (time,
+// schedule, history). Providers cache the head: Anthropic gets a
+// cache_control breakpoint here, OpenAI/GLM/Gemini reuse the common prefix
+// automatically. The marker itself is never sent.
+#define LLM_PROMPT_CACHE_BREAK "\x1e"
+
 // Generate text with a custom system prompt (for ReAct agent, etc.)
 // Returns true on success, false on error
 bool llm_generate_with_custom_prompt(const String &system_prompt, const String &task,
@@ -10,18 +17,73 @@ bool llm_generate_with_custom_prompt(const String &system_prompt, const String &
 
 bool llm_generate_plan(const String &task, String &plan_out, String &error_out);
 bool llm_generate_reply(const String &message, String &reply_out, String &error_out);
+
+// Streaming responses. Every provider streams in its own format: SSE for
+// OpenAI/OpenRouter/GLM (choices[].delta), Anthropic (content_block_delta)
+// and Gemini (streamGenerateContent), NDJSON for Ollama.
+//
+// BEGIN fires when a provider starts answering (again after a fallback, so
+// discard any text shown so far); each DELTA carries the next piece of the
+// reply; END closes the call with the token usage the provider reported
+// (zero where it reports none). Non-2xx responses produce no events.
+enum LlmStreamEvent {
+  LLM_STREAM_BEGIN,
+  LLM_STREAM_DELTA,
+  LLM_STREAM_END,
+};
+
+// input_tokens counts the whole prompt; cached_tokens is the part of it
+// read from the provider's prompt cache, cache_write_tokens the part that
+// was added to it (Anthropic only).
+struct LlmUsage {
+  uint32_t input_tokens;
+  uint32_t output_tokens;
+  uint32_t cached_tokens;
+  uint32_t cache_write_tokens;
+};
+
+// Return false to stop reading the response early; the text received so far
+// becomes the reply. `usage` is only filled in for END.
+typedef bool (*llm_stream_cb_t)(LlmStreamEvent ev, const String &text, const LlmUsage &usage,
+                                void *ctx);
+
+// llm_generate_reply() with the reply text forwarded to `cb` as it arrives.
+// reply_out still receives the complete reply.
+bool llm_generate_reply_streaming(const String &message, llm_stream_cb_t cb, void *ctx,
+                                  String &reply_out, String &error_out);
+
+// llm_generate_with_custom_prompt() with the response streamed to `cb`.
+bool llm_generate_with_custom_prompt_streaming(const String &system_prompt, const String &task,
+                                               bool include_memory, llm_stream_cb_t cb,
+                                               void *ctx, String &reply_out,
+                                               String &error_out);
 bool llm_generate_heartbeat(const String &heartbeat_doc, String &reply_out, String &error_out);
 bool llm_route_tool_command(const String &message, String &command_out, String &error_out);
 bool llm_generate_image(const String &prompt, String &base64_out, String &error_out);
 bool llm_understand_media(const String &instruction, const String &mime_type,
                           const String &base64_data, String &reply_out, String &error_out);
+
+// Media streamed into the request instead of held in RAM. open() is called
+// once per HTTP attempt and returns a fresh stream of *len_out raw bytes;
+// close() follows every successful open().
+struct LlmMediaSource {
+  String mime_type;
+  bool (*open)(void *ctx, Stream **stream_out, size_t *len_out, String &error_out);
+  void (*close)(void *ctx, bool complete);
+  void *ctx;
+};
+
+// Same as llm_understand_media(), but base64-encodes the media on the fly
+// while uploading, so RAM use does not grow with the file size.
+bool llm_understand_media_stream(const String &instruction, const LlmMediaSource &source,
+                                 String &reply_out, String &error_out);
 bool llm_parse_email_request(const String &message, String &to_out, String &subject_out,
                              String &body_out, String &error_out);
 bool llm_parse_update_request(const String &message, String &url_out, bool &should_update_out,
                               bool &check_github_out, String &error_out);
 
-// Auto-learn: extract personal facts from user messages
-bool llm_extract_user_facts(const String &user_message, const String &existing_profile,
+// Auto-learn: extract personal facts from a batch of user messages (one per line)
+bool llm_extract_user_facts(const String &user_messages, const String &existing_profile,
                             String &facts_out, String &error_out);
 
 // Proactive: generate a proactive message based on context
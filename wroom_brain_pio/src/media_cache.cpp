@@ -0,0 +1,387 @@
+#include "media_cache.h"
+
+#include <Arduino.h>
+#include <SPIFFS.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+#include "brain_config.h"
+
+namespace {
+
+const char *kCacheDir = "/mcache";
+const char *kIndexPath = "/mcache/index";
+// Never fill SPIFFS past this point; memory and project files come first.
+const size_t kFreeMarginBytes = 64 * 1024;
+
+struct CacheEntry {
+  String unique_id;
+  size_t size;
+  uint32_t last_used;  // g_clock value, higher = more recent
+  bool valid;
+};
+
+CacheEntry g_entries[MEDIA_CACHE_MAX_ENTRIES];
+uint32_t g_clock = 0;
+size_t g_bytes = 0;
+bool g_ready = false;
+
+uint32_t g_hits = 0;
+uint32_t g_misses = 0;
+uint32_t g_stored = 0;
+uint32_t g_evicted = 0;
+
+// Guards the index (g_entries, g_bytes, g_clock) and the files it names;
+// agent workers open and store media concurrently.
+SemaphoreHandle_t g_mutex = NULL;
+
+void lock() {
+  xSemaphoreTake(g_mutex, portMAX_DELAY);
+}
+
+void unlock() {
+  xSemaphoreGive(g_mutex);
+}
+
+// SPIFFS names are limited to 32 chars, so files are named by a hash of the
+// id; the index keeps the full id to rule out collisions.
+String entry_path(const String &unique_id) {
+  uint32_t h = 2166136261UL;
+  for (size_t i = 0; i < unique_id.length(); i++) {
+    h ^= (uint8_t)unique_id[i];
+    h *= 16777619UL;
+  }
+  char name[9];
+  snprintf(name, sizeof(name), "%08lx", (unsigned long)h);
+  return String(kCacheDir) + "/" + name;
+}
+
+String temp_path(const String &unique_id) {
+  return entry_path(unique_id) + ".tmp";
+}
+
+bool valid_id(const String &unique_id) {
+  if (unique_id.length() == 0 || unique_id.length() > 64) {
+    return false;
+  }
+  for (size_t i = 0; i < unique_id.length(); i++) {
+    const char c = unique_id[i];
+    if (c <= ' ' || c == 0x7F) {
+      return false;
+    }
+  }
+  return true;
+}
+
+int find_entry(const String &unique_id) {
+  for (int i = 0; i < MEDIA_CACHE_MAX_ENTRIES; i++) {
+    if (g_entries[i].valid && g_entries[i].unique_id == unique_id) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+int free_slot() {
+  for (int i = 0; i < MEDIA_CACHE_MAX_ENTRIES; i++) {
+    if (!g_entries[i].valid) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+int lru_entry() {
+  int lru = -1;
+  for (int i = 0; i < MEDIA_CACHE_MAX_ENTRIES; i++) {
+    if (g_entries[i].valid && (lru < 0 || g_entries[i].last_used < g_entries[lru].last_used)) {
+      lru = i;
+    }
+  }
+  return lru;
+}
+
+void drop_entry(int idx) {
+  CacheEntry &e = g_entries[idx];
+  SPIFFS.remove(entry_path(e.unique_id));
+  g_bytes -= e.size;
+  e.valid = false;
+  e.unique_id = "";
+  e.size = 0;
+}
+
+// Index lines are "<unique_id> <size>", least recently used first, so the
+// LRU order survives a reboot. Hits only update RAM to spare the flash.
+void save_index() {
+  fs::File f = SPIFFS.open(kIndexPath, FILE_WRITE);
+  if (!f) {
+    Serial.println("[media_cache] could not write index");
+    return;
+  }
+  bool written[MEDIA_CACHE_MAX_ENTRIES] = {false};
+  while (true) {
+    int next = -1;
+    for (int i = 0; i < MEDIA_CACHE_MAX_ENTRIES; i++) {
+      if (g_entries[i].valid && !written[i] &&
+          (next < 0 || g_entries[i].last_used < g_entries[next].last_used)) {
+        next = i;
+      }
+    }
+    if (next < 0) {
+      break;
+    }
+    written[next] = true;
+    f.print(g_entries[next].unique_id + " " + String((unsigned long)g_entries[next].size) + "\n");
+  }
+  f.close();
+}
+
+void load_index() {
+  fs::File f = SPIFFS.open(kIndexPath, FILE_READ);
+  if (!f) {
+    return;
+  }
+  while (f.available()) {
+    String line = f.readStringUntil('\n');
+    line.trim();
+    const int sp = line.indexOf(' ');
+    if (sp <= 0) {
+      continue;
+    }
+    const String id = line.substring(0, sp);
+    const size_t size = (size_t)line.substring(sp + 1).toInt();
+    const int slot = free_slot();
+    if (slot < 0 || !valid_id(id) || find_entry(id) >= 0) {
+      continue;
+    }
+    fs::File data = SPIFFS.open(entry_path(id), FILE_READ);
+    const bool ok = data && data.size() == size && size > 0;
+    if (data) {
+      data.close();
+    }
+    if (!ok) {
+      continue;
+    }
+    g_entries[slot].unique_id = id;
+    g_entries[slot].size = size;
+    g_entries[slot].last_used = ++g_clock;
+    g_entries[slot].valid = true;
+    g_bytes += size;
+  }
+  f.close();
+}
+
+// Deletes files the index does not know about (interrupted downloads,
+// entries dropped from a damaged index).
+void remove_orphans() {
+  fs::File dir = SPIFFS.open(kCacheDir);
+  if (!dir || !dir.isDirectory()) {
+    return;
+  }
+  String stale[MEDIA_CACHE_MAX_ENTRIES];
+  int stale_count = 0;
+  fs::File f = dir.openNextFile();
+  while (f && stale_count < MEDIA_CACHE_MAX_ENTRIES) {
+    const String path = f.path();
+    f.close();
+    bool known = path == kIndexPath;
+    for (int i = 0; i < MEDIA_CACHE_MAX_ENTRIES && !known; i++) {
+      known = g_entries[i].valid && entry_path(g_entries[i].unique_id) == path;
+    }
+    if (!known) {
+      stale[stale_count++] = path;
+    }
+    f = dir.openNextFile();
+  }
+  dir.close();
+  for (int i = 0; i < stale_count; i++) {
+    SPIFFS.remove(stale[i]);
+  }
+}
+
+size_t spiffs_free_bytes() {
+  const size_t total = SPIFFS.totalBytes();
+  const size_t used = SPIFFS.usedBytes();
+  return total > used ? total - used : 0;
+}
+
+// Evicts least recently used entries until `size` more bytes fit.
+bool make_room(size_t size) {
+  if (size == 0 || size > MEDIA_CACHE_MAX_BYTES) {
+    return false;
+  }
+  bool changed = false;
+  while (free_slot() < 0 || g_bytes + size > MEDIA_CACHE_MAX_BYTES ||
+         spiffs_free_bytes() < size + kFreeMarginBytes) {
+    const int lru = lru_entry();
+    if (lru < 0) {
+      break;
+    }
+    drop_entry(lru);
+    g_evicted++;
+    changed = true;
+  }
+  if (changed) {
+    save_index();
+  }
+  return free_slot() >= 0 && g_bytes + size <= MEDIA_CACHE_MAX_BYTES &&
+         spiffs_free_bytes() >= size + kFreeMarginBytes;
+}
+
+}  // namespace
+
+void media_cache_init() {
+  if (g_ready) {
+    return;
+  }
+#if ENABLE_MEDIA_CACHE
+  if (g_mutex == NULL) {
+    g_mutex = xSemaphoreCreateMutex();
+  }
+  if (g_mutex == NULL || !SPIFFS.begin(true)) {
+    Serial.println("[media_cache] SPIFFS mount failed, cache disabled");
+    return;
+  }
+  for (int i = 0; i < MEDIA_CACHE_MAX_ENTRIES; i++) {
+    g_entries[i].valid = false;
+    g_entries[i].size = 0;
+    g_entries[i].last_used = 0;
+  }
+  load_index();
+  remove_orphans();
+  g_ready = true;
+  Serial.printf("[media_cache] %u bytes cached\n", (unsigned)g_bytes);
+#endif
+}
+
+bool media_cache_open(const String &unique_id, fs::File &file_out, size_t *len_out) {
+  if (!g_ready || !valid_id(unique_id)) {
+    return false;
+  }
+  lock();
+  const int idx = find_entry(unique_id);
+  if (idx < 0) {
+    g_misses++;
+    unlock();
+    return false;
+  }
+  file_out = SPIFFS.open(entry_path(unique_id), FILE_READ);
+  if (!file_out || file_out.size() != g_entries[idx].size) {
+    if (file_out) {
+      file_out.close();
+    }
+    drop_entry(idx);
+    save_index();
+    g_misses++;
+    unlock();
+    return false;
+  }
+  g_entries[idx].last_used = ++g_clock;
+  *len_out = g_entries[idx].size;
+  g_hits++;
+  unlock();
+  return true;
+}
+
+MediaCacheTee::MediaCacheTee()
+    : source_(nullptr), length_(0), written_(0), caching_(false) {}
+
+void MediaCacheTee::begin(Stream *source, const String &unique_id, size_t length) {
+  source_ = source;
+  unique_id_ = unique_id;
+  length_ = length;
+  written_ = 0;
+  caching_ = false;
+  if (!g_ready || !valid_id(unique_id)) {
+    return;
+  }
+  lock();
+  if (find_entry(unique_id) < 0 && make_room(length)) {
+    file_ = SPIFFS.open(temp_path(unique_id), FILE_WRITE);
+    caching_ = (bool)file_;
+  }
+  unlock();
+}
+
+void MediaCacheTee::capture(const uint8_t *data, size_t len) {
+  if (!caching_ || len == 0) {
+    return;
+  }
+  if (file_.write(data, len) != len) {
+    // Flash full or failing: stop copying, the download itself carries on.
+    Serial.println("[media_cache] write failed, not caching this file");
+    file_.close();
+    SPIFFS.remove(temp_path(unique_id_));
+    caching_ = false;
+    return;
+  }
+  written_ += len;
+}
+
+void MediaCacheTee::finish(bool complete) {
+  source_ = nullptr;
+  if (!caching_) {
+    return;
+  }
+  caching_ = false;
+  file_.close();
+
+  const String tmp = temp_path(unique_id_);
+  lock();
+  // Another worker may have stored the same file meanwhile.
+  const int slot = find_entry(unique_id_) < 0 ? free_slot() : -1;
+  if (!complete || written_ != length_ || slot < 0 ||
+      !SPIFFS.rename(tmp, entry_path(unique_id_))) {
+    SPIFFS.remove(tmp);
+    unlock();
+    return;
+  }
+  g_entries[slot].unique_id = unique_id_;
+  g_entries[slot].size = length_;
+  g_entries[slot].last_used = ++g_clock;
+  g_entries[slot].valid = true;
+  g_bytes += length_;
+  g_stored++;
+  save_index();
+  unlock();
+}
+
+int MediaCacheTee::available() {
+  return source_ != nullptr ? source_->available() : 0;
+}
+
+size_t MediaCacheTee::readBytes(char *buffer, size_t length) {
+  if (source_ == nullptr) {
+    return 0;
+  }
+  const size_t n = source_->readBytes(buffer, length);
+  capture((const uint8_t *)buffer, n);
+  return n;
+}
+
+int MediaCacheTee::read() {
+  char c;
+  return readBytes(&c, 1) == 1 ? (uint8_t)c : -1;
+}
+
+int MediaCacheTee::peek() {
+  return source_ != nullptr ? source_->peek() : -1;
+}
+
+String media_cache_health_line() {
+  if (!g_ready) {
+    return "off";
+  }
+  int count = 0;
+  lock();
+  for (int i = 0; i < MEDIA_CACHE_MAX_ENTRIES; i++) {
+    if (g_entries[i].valid) {
+      count++;
+    }
+  }
+  const size_t bytes = g_bytes;
+  unlock();
+  return "entries=" + String(count) + " bytes=" + String((unsigned long)bytes) +
+         " hits=" + String(g_hits) + " misses=" + String(g_misses) +
+         " stored=" + String(g_stored) + " evicted=" + String(g_evicted);
+}
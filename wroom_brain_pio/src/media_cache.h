@@ -0,0 +1,53 @@
+#ifndef MEDIA_CACHE_H
+#define MEDIA_CACHE_H
+
+#include <Arduino.h>
+#include <FS.h>
+
+// LRU cache of downloaded Telegram media on SPIFFS, keyed by file_unique_id
+// (stable across bots and re-sends, so identical content shares one entry).
+// Follow-up questions about the same photo or document are answered from
+// flash instead of repeating getFile + download.
+//
+// Entries are raw file bytes; base64 is produced while uploading, so a
+// pre-encoded copy would only cost flash. Bounded by MEDIA_CACHE_MAX_BYTES
+// and MEDIA_CACHE_MAX_ENTRIES, least recently used evicted first.
+
+void media_cache_init();
+
+// Opens a cached copy for reading. Returns false on a miss.
+bool media_cache_open(const String &unique_id, fs::File &file_out, size_t *len_out);
+
+// Passes a download through unchanged while copying it to the cache. If the
+// entry cannot be cached (too big, no space) begin() still succeeds and the
+// tee is a plain pass-through.
+class MediaCacheTee : public Stream {
+ public:
+  MediaCacheTee();
+
+  void begin(Stream *source, const String &unique_id, size_t length);
+  // Commits the entry if every byte went through; otherwise discards it.
+  void finish(bool complete);
+
+  int available() override;
+  int read() override;
+  int peek() override;
+  using Stream::readBytes;
+  size_t readBytes(char *buffer, size_t length) override;
+  size_t write(uint8_t) override { return 0; }
+
+ private:
+  void capture(const uint8_t *data, size_t len);
+
+  Stream *source_;
+  String unique_id_;
+  fs::File file_;
+  size_t length_;
+  size_t written_;
+  bool caching_;
+};
+
+// One-line summary for the health command
+String media_cache_health_line();
+
+#endif
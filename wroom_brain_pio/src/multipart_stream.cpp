@@ -0,0 +1,206 @@
+#include "multipart_stream.h"
+
+#include <Arduino.h>
+
+MultipartStream::MultipartStream()
+    : segment_count_(0),
+      finished_(false),
+      failed_(false),
+      overflowed_(false),
+      total_(0),
+      consumed_(0),
+      cursor_(0),
+      cursor_offset_(0) {
+  boundary_ = "----esp32boundary" + String((unsigned long)millis()) +
+              String((unsigned long)esp_random(), HEX);
+}
+
+void MultipartStream::add_field(const char *name, const String &value) {
+  pending_ += "--" + boundary_ + "\r\n";
+  pending_ += "Content-Disposition: form-data; name=\"" + String(name) + "\"\r\n\r\n";
+  pending_ += value;
+  pending_ += "\r\n";
+}
+
+void MultipartStream::part_header(const char *field, const String &filename,
+                                  const String &mime_type) {
+  pending_ += "--" + boundary_ + "\r\n";
+  pending_ += "Content-Disposition: form-data; name=\"" + String(field) + "\"; filename=\"" +
+              filename + "\"\r\n";
+  pending_ += "Content-Type: " + mime_type + "\r\n\r\n";
+}
+
+void MultipartStream::add_file(const char *field, const String &filename,
+                               const String &mime_type, const String &content) {
+  part_header(field, filename, mime_type);
+  if (push_text() && push_segment(SRC_STRING, content.length())) {
+    segments_[segment_count_ - 1].ref = &content;
+  }
+  pending_ = "\r\n";
+}
+
+void MultipartStream::add_file(const char *field, const String &filename,
+                               const String &mime_type, fs::File &file) {
+  part_header(field, filename, mime_type);
+  file.seek(0);
+  if (push_text() && push_segment(SRC_FILE, file.size())) {
+    segments_[segment_count_ - 1].file = &file;
+  }
+  pending_ = "\r\n";
+}
+
+void MultipartStream::add_file(const char *field, const String &filename,
+                               const String &mime_type, size_t length, multipart_gen_cb_t gen,
+                               void *ctx) {
+  part_header(field, filename, mime_type);
+  if (push_text() && push_segment(SRC_GENERATOR, length)) {
+    segments_[segment_count_ - 1].gen = gen;
+    segments_[segment_count_ - 1].ctx = ctx;
+  }
+  pending_ = "\r\n";
+}
+
+bool MultipartStream::push_text() {
+  if (pending_.length() == 0) {
+    return true;
+  }
+  if (!push_segment(SRC_TEXT, pending_.length())) {
+    return false;
+  }
+  segments_[segment_count_ - 1].text = pending_;
+  pending_ = "";
+  return true;
+}
+
+bool MultipartStream::push_segment(Source source, size_t length) {
+  if (finished_ || segment_count_ >= MULTIPART_MAX_SEGMENTS) {
+    overflowed_ = true;
+    return false;
+  }
+  Segment &seg = segments_[segment_count_++];
+  seg.source = source;
+  seg.text = "";
+  seg.ref = nullptr;
+  seg.file = nullptr;
+  seg.gen = nullptr;
+  seg.ctx = nullptr;
+  seg.length = length;
+  total_ += length;
+  return true;
+}
+
+void MultipartStream::finish() {
+  if (finished_) {
+    return;
+  }
+  pending_ += "--" + boundary_ + "--\r\n";
+  push_text();
+  finished_ = true;
+}
+
+size_t MultipartStream::length() {
+  finish();
+  return total_;
+}
+
+String MultipartStream::content_type() const {
+  return "multipart/form-data; boundary=" + boundary_;
+}
+
+bool MultipartStream::rewind() {
+  finish();
+  for (int i = 0; i < segment_count_; i++) {
+    if (segments_[i].source == SRC_FILE && !segments_[i].file->seek(0)) {
+      return false;
+    }
+  }
+  consumed_ = 0;
+  cursor_ = 0;
+  cursor_offset_ = 0;
+  failed_ = false;
+  return true;
+}
+
+int MultipartStream::available() {
+  finish();
+  if (failed_) {
+    return -1;  // makes HTTPClient abandon the upload instead of waiting
+  }
+  const size_t remaining = total_ - consumed_;
+  return remaining > 0x7FFFFFFF ? 0x7FFFFFFF : (int)remaining;
+}
+
+size_t MultipartStream::read_segment(Segment &seg, uint8_t *buf, size_t len) {
+  switch (seg.source) {
+    case SRC_TEXT:
+      memcpy(buf, seg.text.c_str() + cursor_offset_, len);
+      return len;
+    case SRC_STRING:
+      memcpy(buf, seg.ref->c_str() + cursor_offset_, len);
+      return len;
+    case SRC_FILE:
+      return seg.file->read(buf, len);
+    case SRC_GENERATOR:
+      return seg.gen(buf, len, cursor_offset_, seg.ctx);
+  }
+  return 0;
+}
+
+size_t MultipartStream::readBytes(char *buffer, size_t length) {
+  finish();
+  size_t out = 0;
+  while (out < length && cursor_ < segment_count_ && !failed_) {
+    Segment &seg = segments_[cursor_];
+    if (cursor_offset_ >= seg.length) {
+      cursor_++;
+      cursor_offset_ = 0;
+      continue;
+    }
+    size_t want = seg.length - cursor_offset_;
+    if (want > length - out) {
+      want = length - out;
+    }
+    const size_t got = read_segment(seg, (uint8_t *)buffer + out, want);
+    if (got == 0 || got > want) {
+      Serial.println("[multipart] body source ended early");
+      failed_ = true;
+      break;
+    }
+    out += got;
+    cursor_offset_ += got;
+    consumed_ += got;
+  }
+  return out;
+}
+
+int MultipartStream::read() {
+  char c;
+  return readBytes(&c, 1) == 1 ? (uint8_t)c : -1;
+}
+
+int MultipartStream::peek() {
+  finish();
+  int idx = cursor_;
+  size_t off = cursor_offset_;
+  while (idx < segment_count_ && off >= segments_[idx].length) {
+    idx++;
+    off = 0;
+  }
+  if (idx >= segment_count_ || failed_) {
+    return -1;
+  }
+  const Segment &seg = segments_[idx];
+  switch (seg.source) {
+    case SRC_TEXT:
+      return (uint8_t)seg.text[off];
+    case SRC_STRING:
+      return (uint8_t)(*seg.ref)[off];
+    case SRC_FILE:
+      return seg.file->peek();
+    case SRC_GENERATOR: {
+      uint8_t b;
+      return seg.gen(&b, 1, off, seg.ctx) == 1 ? b : -1;
+    }
+  }
+  return -1;
+}
@@ -0,0 +1,90 @@
+#ifndef MULTIPART_STREAM_H
+#define MULTIPART_STREAM_H
+
+#include <Arduino.h>
+#include <FS.h>
+
+// multipart/form-data request body that is produced on the fly, so a file
+// never has to be copied into one big payload String. Pass it to
+// HTTPClient::sendRequest("POST", &body, body.length()).
+//
+// File parts can come from a String (referenced, not copied - it must stay
+// alive until the request is done), an open fs::File, or a generator
+// callback. Content-Length is known up front from the declared sizes.
+
+#ifndef MULTIPART_MAX_SEGMENTS
+#define MULTIPART_MAX_SEGMENTS 10
+#endif
+
+// Fill `buf` with up to `max_len` bytes of the part starting at `offset`.
+// Return the number of bytes written; 0 before the declared length is an error.
+typedef size_t (*multipart_gen_cb_t)(uint8_t *buf, size_t max_len, size_t offset, void *ctx);
+
+class MultipartStream : public Stream {
+ public:
+  MultipartStream();
+
+  void add_field(const char *name, const String &value);
+  void add_file(const char *field, const String &filename, const String &mime_type,
+                const String &content);
+  void add_file(const char *field, const String &filename, const String &mime_type,
+                fs::File &file);
+  void add_file(const char *field, const String &filename, const String &mime_type,
+                size_t length, multipart_gen_cb_t gen, void *ctx);
+
+  // Total body size; closes the body with the final boundary on first call.
+  size_t length();
+  String content_type() const;
+
+  // Restart from the first byte (e.g. to retry on a fresh connection).
+  bool rewind();
+  // True if a file or generator came up short; the body is then incomplete.
+  bool failed() const { return failed_; }
+  bool overflowed() const { return overflowed_; }
+
+  int available() override;
+  int read() override;
+  int peek() override;
+  using Stream::readBytes;
+  size_t readBytes(char *buffer, size_t length) override;
+  size_t write(uint8_t) override { return 0; }
+
+ private:
+  enum Source {
+    SRC_TEXT,
+    SRC_STRING,
+    SRC_FILE,
+    SRC_GENERATOR,
+  };
+
+  struct Segment {
+    Source source;
+    String text;
+    const String *ref;
+    fs::File *file;
+    multipart_gen_cb_t gen;
+    void *ctx;
+    size_t length;
+  };
+
+  void part_header(const char *field, const String &filename, const String &mime_type);
+  bool push_text();
+  bool push_segment(Source source, size_t length);
+  void finish();
+  size_t read_segment(Segment &seg, uint8_t *buf, size_t len);
+
+  Segment segments_[MULTIPART_MAX_SEGMENTS];
+  int segment_count_;
+  String boundary_;
+  String pending_;  // text not yet turned into a segment
+  bool finished_;
+  bool failed_;
+  bool overflowed_;
+
+  size_t total_;
+  size_t consumed_;
+  int cursor_;
+  size_t cursor_offset_;
+};
+
+#endif
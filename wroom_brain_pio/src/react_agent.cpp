@@ -2,9 +2,11 @@
 
 #include "brain_config.h"
 #include "llm_client.h"
+#include "request_ctx.h"
 #include "tool_registry.h"
 #include "file_memory.h"
 #include "event_log.h"
+#include "intent.h"
 #include "chat_history.h"
 #include "skill_registry.h"
 
@@ -25,6 +27,7 @@ static const ReactTool s_react_tools[] = {
     {"file_memory", "Show SPIFFS file system info", "none", "file_memory"},
     {"files_list", "List all files in SPIFFS", "none", "files_list"},
     {"files_get", "Read a file from SPIFFS", "<filename>", "files_get: /projects/demo/index.html"},
+    {"files_send", "Send a SPIFFS file to the user as a Telegram document", "<filename>", "files_send: /projects/demo/index.html"},
     {"user_read", "Read user profile (USER.md)", "none", "user_read"},
     {"soul_show", "Show current personality/soul (SOUL.md)", "none", "soul_show"},
     {"soul_set", "Set new personality/soul (SOUL.md)", "<soul description>", "soul_set: You are a helpful robot assistant"},
@@ -132,11 +135,9 @@ static const size_t s_num_tools = sizeof(s_react_tools) / sizeof(s_react_tools[0
 // REACT SYSTEM PROMPTS
 // ============================================================================
 
-// Build the ReAct system prompt dynamically (needs iteration count)
-String build_react_system_prompt() {
-  String prompt = "🦖 You are Timi, a clever dinosaur assistant on an ESP32. Think step-by-step!\n\n";
-
-  // Inject current time awareness
+// Current time for the volatile part of the prompt (after the cache break)
+String build_react_time_context() {
+  String prompt;
   struct tm timeinfo;
   if (getLocalTime(&timeinfo)) {
     const char* days[] = {"Sunday", "Monday", "Tuesday", "Wednesday", "Thursday", "Friday", "Saturday"};
@@ -153,10 +154,18 @@ String build_react_system_prompt() {
     strftime(buf, sizeof(buf), "%b %d, %Y", &timeinfo);
     String date_str = String(buf);
 
-    prompt += "CURRENT TIME: It is " + String(days[timeinfo.tm_wday]) + " " +
+    prompt += "\n\nCURRENT TIME: It is " + String(days[timeinfo.tm_wday]) + " " +
               String(period) + ", " + time_str + " (" + date_str + ")\n";
-    prompt += "Greet appropriately and be time-aware.\n\n";
+    prompt += "Greet appropriately and be time-aware.\n";
   }
+  return prompt;
+}
+
+// The fixed part of the ReAct prompt. Together with the tool list it is
+// byte-identical on every iteration, so providers serve it from their prompt
+// cache; keep anything that changes out of it.
+String build_react_system_prompt() {
+  String prompt = "🦖 You are Timi, a clever dinosaur assistant on an ESP32. Think step-by-step!\n\n";
 
   prompt += "Format for each step:\n"
             "🤔 THINK: <what you're analyzing>\n"
@@ -336,8 +345,8 @@ bool execute_tool_action(const String &action, String &result, String &error) {
 
   event_log_append("[ReAct] Executing: " + command);
 
-  // Execute via tool registry
-  if (!tool_registry_execute(command, result)) {
+  // The model already chose the tool; no second classification round trip.
+  if (!tool_registry_execute(command, result, TOOL_COST_HEURISTIC)) {
     error = "Tool not found or failed: " + tool_name;
     return false;
   }
@@ -358,6 +367,8 @@ String build_react_context(const String &user_query, const ReactStep *steps,
 
   context += build_react_system_prompt();
   context += tools_prompt;
+  context += LLM_PROMPT_CACHE_BREAK;
+  context += build_react_time_context();
 
   // Add recent chat history for context
   String history;
@@ -405,46 +416,16 @@ void react_agent_init() {
   Serial.println("[ReAct] Agent initialized with " + String(s_num_tools) + " tools");
 }
 
-bool react_agent_should_use(const String &query) {
-  // Use ReAct for complex queries that suggest multi-step reasoning
-  String lc = query;
-  lc.toLowerCase();
-
+bool react_agent_should_use(const String &query, uint32_t intents) {
   // Check if query matches a skill (explicit or keyword-based)
-  String matched_skill = skill_match(lc);
+  String matched_skill = skill_match(query);
   if (matched_skill.length() > 0) {
     Serial.println("[ReAct] Skill matched: " + matched_skill);
     return true;
   }
 
-  // Keywords that suggest multi-step reasoning OR web generation
-  const char *complex_keywords[] = {
-      "how do i", "help me", "what should", "can you", "i need to",
-      "remember to", "set up", "configure", "schedule", "remind ", "remind me to",
-      "in 1 ", "in 2 ", "in 3 ", "in 4 ", "in 5 ", "in 10 ", "in 15 ", "in 20 ", "in 30 ",
-      "figure out", "find out", "check if", "make sure", "todo", "task",
-      "plan", "organize", "track",
-      // Search/info triggers
-      "what is", "what's", "who is", "who's", "tell me about", "search for",
-      "look up", "google", "explain", "define", "meaning of",
-      // Web generation triggers
-      "make a", "create a", "generate a", "build a", "website", "html",
-      "saas", "landing page", "portfolio", "app", "web app",
-      // Email triggers
-      "email me", "send email", "email those", "email the",
-      // WhatsApp triggers
-      "whatsapp", "send to whatsapp", "wa me", "via whatsapp",
-      // Skill triggers
-      "use skill", "use_skill", "skill"
-  };
-
-  for (size_t i = 0; i < sizeof(complex_keywords) / sizeof(complex_keywords[0]); i++) {
-    if (lc.indexOf(complex_keywords[i]) >= 0) {
-      return true;
-    }
-  }
-
-  return false;
+  // Multi-step reasoning, search, web generation, email and skill wording
+  return (intents & INTENT_REACT) != 0;
 }
 
 bool react_agent_run(const String &user_query, String &response_out,
@@ -456,6 +437,10 @@ bool react_agent_run(const String &user_query, String &response_out,
   Serial.println("[ReAct] Starting for: " + user_query);
 
   for (int iter = 0; iter < REACT_MAX_ITERATIONS; iter++) {
+    if (request_ctx_should_stop(error_out)) {
+      return false;
+    }
+
     // Build context with all previous steps
     String context = build_react_context(user_query, steps, step_count, tools_prompt);
 
@@ -486,6 +471,11 @@ bool react_agent_run(const String &user_query, String &response_out,
       return true;
     }
 
+    // The thought may have taken the rest of the budget; skip the tool.
+    if (request_ctx_should_stop(error_out)) {
+      return false;
+    }
+
     // Execute the action
     String tool_result, tool_error;
     if (!execute_tool_action(step.action, tool_result, tool_error)) {
@@ -500,8 +490,13 @@ bool react_agent_run(const String &user_query, String &response_out,
     steps[step_count++] = step;
   }
 
+  if (request_ctx_should_stop(error_out)) {
+    return false;
+  }
+
   // Max iterations reached - ask LLM for final summary
-  String summary_context = build_react_system_prompt() + build_tools_prompt() +
+  String summary_context = build_react_system_prompt() + tools_prompt +
+      LLM_PROMPT_CACHE_BREAK + build_react_time_context() +
       "\n\n=== Conversation ===\n👤 User: " + user_query + "\n\n";
 
   for (int i = 0; i < step_count; i++) {
@@ -29,7 +29,8 @@ void react_agent_init();
 // response_out contains the final answer or error message
 bool react_agent_run(const String &user_query, String &response_out, String &error_out);
 
-// Check if a query should use ReAct (complex reasoning needed)
-bool react_agent_should_use(const String &query);
+// Check if a query should use ReAct (complex reasoning needed).
+// `intents` is intent_classify(query).
+bool react_agent_should_use(const String &query, uint32_t intents);
 
 #endif
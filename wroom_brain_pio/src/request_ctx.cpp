@@ -0,0 +1,113 @@
+#include "request_ctx.h"
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include "brain_config.h"
+
+namespace {
+
+// Never hand out a network timeout shorter than this; a call that cannot
+// finish in time fails fast through request_ctx_should_stop() instead.
+static const uint32_t kMinTimeoutMs = 1000;
+
+struct RequestCtx {
+  TaskHandle_t owner;  // NULL = slot free
+  AgentSource source;
+  unsigned long deadline_ms;
+  volatile bool canceled;
+};
+
+// One request per worker at a time.
+RequestCtx g_ctx[AGENT_WORKERS];
+portMUX_TYPE g_mux = portMUX_INITIALIZER_UNLOCKED;
+
+RequestCtx *own_ctx() {
+  const TaskHandle_t self = xTaskGetCurrentTaskHandle();
+  for (int i = 0; i < AGENT_WORKERS; i++) {
+    if (g_ctx[i].owner == self) {
+      return &g_ctx[i];
+    }
+  }
+  return nullptr;
+}
+
+bool past(unsigned long deadline_ms) {
+  return (long)(millis() - deadline_ms) >= 0;
+}
+
+}  // namespace
+
+void request_ctx_begin(AgentSource source, unsigned long deadline_ms) {
+  const TaskHandle_t self = xTaskGetCurrentTaskHandle();
+  portENTER_CRITICAL(&g_mux);
+  RequestCtx *ctx = own_ctx();
+  for (int i = 0; i < AGENT_WORKERS && ctx == nullptr; i++) {
+    if (g_ctx[i].owner == NULL) {
+      ctx = &g_ctx[i];
+    }
+  }
+  if (ctx != nullptr) {
+    ctx->owner = self;
+    ctx->source = source;
+    ctx->deadline_ms = deadline_ms;
+    ctx->canceled = false;
+  }
+  portEXIT_CRITICAL(&g_mux);
+}
+
+void request_ctx_end() {
+  portENTER_CRITICAL(&g_mux);
+  RequestCtx *ctx = own_ctx();
+  if (ctx != nullptr) {
+    ctx->owner = NULL;
+    ctx->canceled = false;
+  }
+  portEXIT_CRITICAL(&g_mux);
+}
+
+bool request_ctx_canceled() {
+  const RequestCtx *ctx = own_ctx();
+  return ctx != nullptr && ctx->canceled;
+}
+
+bool request_ctx_should_stop(String &reason_out) {
+  const RequestCtx *ctx = own_ctx();
+  if (ctx == nullptr) {
+    return false;
+  }
+  if (ctx->canceled) {
+    reason_out = "Canceled.";
+    return true;
+  }
+  if (past(ctx->deadline_ms)) {
+    reason_out = "Timed out after " + String(AGENT_REQUEST_TIMEOUT_MS / 1000UL) + "s.";
+    return true;
+  }
+  return false;
+}
+
+uint32_t request_ctx_clamp_timeout(uint32_t timeout_ms) {
+  const RequestCtx *ctx = own_ctx();
+  if (ctx == nullptr) {
+    return timeout_ms;
+  }
+  const long left = (long)(ctx->deadline_ms - millis());
+  if (left <= (long)kMinTimeoutMs) {
+    return kMinTimeoutMs;
+  }
+  return (uint32_t)left < timeout_ms ? (uint32_t)left : timeout_ms;
+}
+
+bool request_ctx_cancel(AgentSource source) {
+  bool found = false;
+  portENTER_CRITICAL(&g_mux);
+  for (int i = 0; i < AGENT_WORKERS; i++) {
+    if (g_ctx[i].owner != NULL && g_ctx[i].source == source) {
+      g_ctx[i].canceled = true;
+      found = true;
+    }
+  }
+  portEXIT_CRITICAL(&g_mux);
+  return found;
+}
@@ -0,0 +1,30 @@
+#ifndef REQUEST_CTX_H
+#define REQUEST_CTX_H
+
+#include <Arduino.h>
+
+#include "agent_loop.h"
+
+// Deadline and cancel flag for the agent request a task is working on.
+// A worker opens one per queued message; LLM calls, ReAct steps and the
+// send path look it up through the calling task, so it does not have to be
+// threaded through every signature. Tasks without a context (web handlers,
+// setup) are never stopped.
+
+// deadline_ms is an absolute millis() value.
+void request_ctx_begin(AgentSource source, unsigned long deadline_ms);
+void request_ctx_end();
+
+// True once the current task's request was canceled or ran out of time;
+// reason_out is a short user-facing explanation.
+bool request_ctx_should_stop(String &reason_out);
+bool request_ctx_canceled();
+
+// Caps a network timeout to the time left before the deadline.
+uint32_t request_ctx_clamp_timeout(uint32_t timeout_ms);
+
+// Cancels the in-flight request from `source`, from any task. Returns false
+// if nothing from that source is running.
+bool request_ctx_cancel(AgentSource source);
+
+#endif
@@ -0,0 +1,90 @@
+#include "telegram_live_reply.h"
+
+#include <Arduino.h>
+
+#include "brain_config.h"
+#include "transport_telegram.h"
+
+namespace {
+
+// Leave room below Telegram's 4096 limit for the progress marker.
+static const size_t kMaxLiveChars = 3400;
+// Slow streams still get an update this often once anything new arrived.
+static const unsigned long kIdleEditMs = TELEGRAM_STREAM_EDIT_MS * 4UL;
+static const char kPlaceholder[] = "…";
+
+String preview_text(const String &text) {
+  if (text.length() > kMaxLiveChars) {
+    return text.substring(0, kMaxLiveChars) + "\n…";
+  }
+  return text + " …";
+}
+
+}  // namespace
+
+void telegram_live_reply_begin(TelegramLiveReply &live) {
+  live.message_id = "";
+  live.text = "";
+  live.shown_len = 0;
+  live.last_edit_ms = 0;
+  live.failed = false;
+}
+
+bool telegram_live_reply_open(TelegramLiveReply &live) {
+  if (live.message_id.length() > 0 || live.failed) {
+    return !live.failed;
+  }
+  live.message_id = transport_telegram_send_streaming_start(kPlaceholder);
+  if (live.message_id.length() == 0) {
+    Serial.println("[live] could not create message, reply will be sent at the end");
+    live.failed = true;
+    return false;
+  }
+  live.last_edit_ms = millis();
+  return true;
+}
+
+void telegram_live_reply_restart(TelegramLiveReply &live) {
+  live.text = "";
+  live.shown_len = 0;
+}
+
+void telegram_live_reply_append(TelegramLiveReply &live, const String &delta) {
+  live.text += delta;
+  // Without a placeholder there is nothing to edit; never create one here.
+  if (live.message_id.length() == 0 || live.text.length() == 0) {
+    return;
+  }
+
+  // Past the visible limit further edits would not change anything.
+  if (live.shown_len >= kMaxLiveChars || live.text.length() <= live.shown_len) {
+    return;
+  }
+  // The first text replaces the placeholder right away.
+  const unsigned long now = millis();
+  const unsigned long elapsed = now - live.last_edit_ms;
+  const size_t grown = live.text.length() - live.shown_len;
+  if (live.shown_len > 0 && elapsed < TELEGRAM_STREAM_EDIT_MS) {
+    return;
+  }
+  if (live.shown_len > 0 && grown < TELEGRAM_STREAM_EDIT_CHARS && elapsed < kIdleEditMs) {
+    return;
+  }
+
+  transport_telegram_send_streaming_edit(live.message_id, preview_text(live.text));
+  live.shown_len = live.text.length();
+  live.last_edit_ms = now;
+}
+
+bool telegram_live_reply_active(const TelegramLiveReply &live) {
+  return live.message_id.length() > 0;
+}
+
+bool telegram_live_reply_finish(TelegramLiveReply &live, const String &final_text) {
+  if (!telegram_live_reply_active(live)) {
+    return false;
+  }
+  const bool ok = transport_telegram_send_streaming_edit(live.message_id, final_text);
+  telegram_live_reply_begin(live);
+  return ok;
+}
@@ -0,0 +1,35 @@
+#ifndef TELEGRAM_LIVE_REPLY_H
+#define TELEGRAM_LIVE_REPLY_H
+
+#include <Arduino.h>
+
+// A reply that is shown in Telegram while it is still being generated. A
+// placeholder message is created before the request starts; streamed text
+// then updates it with throttled, queued edits (TELEGRAM_STREAM_EDIT_MS /
+// TELEGRAM_STREAM_EDIT_CHARS), so the stream callback never waits on
+// Telegram. When the reply is complete, telegram_live_reply_finish() puts
+// the final text in place.
+
+struct TelegramLiveReply {
+  String message_id;  // "" until the message exists
+  String text;        // everything received so far
+  size_t shown_len;   // length of text at the last edit
+  unsigned long last_edit_ms;
+  bool failed;        // creating the message failed; stay quiet until finish
+};
+
+// Forget any previous reply (call once per incoming message).
+void telegram_live_reply_begin(TelegramLiveReply &live);
+// Send the placeholder (blocking). Returns false if it could not be created;
+// the reply is then sent normally at the end.
+bool telegram_live_reply_open(TelegramLiveReply &live);
+// Drop the text received so far but keep the message (provider fallback).
+void telegram_live_reply_restart(TelegramLiveReply &live);
+void telegram_live_reply_append(TelegramLiveReply &live, const String &delta);
+
+bool telegram_live_reply_active(const TelegramLiveReply &live);
+// Replace the live message with `final_text` (at most one Telegram message).
+// Returns false if there is no live message; the caller sends normally then.
+bool telegram_live_reply_finish(TelegramLiveReply &live, const String &final_text);
+
+#endif
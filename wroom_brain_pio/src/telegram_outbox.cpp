@@ -0,0 +1,386 @@
+#include "telegram_outbox.h"
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+#include <utility>
+
+#include "brain_config.h"
+#include "transport_telegram.h"
+
+namespace {
+
+enum OutboxKind {
+  OUTBOX_TEXT,
+  OUTBOX_DOCUMENT,
+  OUTBOX_FILE,  // document streamed from flash at send time
+  OUTBOX_EDIT,  // editMessageText of message_id
+};
+
+struct OutboxItem {
+  OutboxKind kind;
+  String chat_id;
+  String text;  // message text, or document caption
+  String filename;  // document name, or the stored path for OUTBOX_FILE
+  String mime_type;
+  String content;
+  String message_id;
+};
+
+// GCRA limiter: `tat` is the theoretical arrival time of the next send.
+// A send is allowed once now >= tat - (burst - 1) * interval.
+struct RateLimit {
+  unsigned long tat_ms;
+  bool primed;
+};
+
+struct ChatState {
+  String chat_id;
+  RateLimit limit;
+  unsigned long blocked_until_ms;  // set from 429 retry_after
+  unsigned long last_used_ms;
+};
+
+static const int kTrackedChats = 4;
+static const unsigned long kGlobalIntervalMs =
+    (TELEGRAM_OUTBOX_GLOBAL_PER_SEC > 0) ? (1000UL / TELEGRAM_OUTBOX_GLOBAL_PER_SEC) : 0;
+static const unsigned long kMaxBackoffMs = 8000;
+static const unsigned long kEnqueueWaitMs = 2000;
+
+QueueHandle_t g_queue = nullptr;
+ChatState g_chats[kTrackedChats];
+RateLimit g_global = {0, false};
+int g_pending = 0;  // queued + in flight
+portMUX_TYPE g_pending_mux = portMUX_INITIALIZER_UNLOCKED;
+
+uint32_t g_sent = 0;
+uint32_t g_merged = 0;
+uint32_t g_retries = 0;
+uint32_t g_throttled = 0;
+uint32_t g_dropped = 0;
+uint32_t g_full_waits = 0;
+
+void adjust_pending(int delta) {
+  portENTER_CRITICAL(&g_pending_mux);
+  g_pending += delta;
+  portEXIT_CRITICAL(&g_pending_mux);
+}
+
+// Milliseconds until the limiter admits another send (0 = now).
+unsigned long rate_wait_ms(const RateLimit &rl, unsigned long interval_ms, int burst,
+                           unsigned long now) {
+  if (!rl.primed || interval_ms == 0) {
+    return 0;
+  }
+  const long slack = (long)((burst > 1 ? burst - 1 : 0) * interval_ms);
+  const long wait = (long)(rl.tat_ms - now) - slack;
+  return wait > 0 ? (unsigned long)wait : 0;
+}
+
+void rate_consume(RateLimit &rl, unsigned long interval_ms, unsigned long now) {
+  if (!rl.primed || (long)(rl.tat_ms - now) < 0) {
+    rl.tat_ms = now;
+    rl.primed = true;
+  }
+  rl.tat_ms += interval_ms;
+}
+
+ChatState &chat_state(const String &chat_id) {
+  int lru = 0;
+  for (int i = 0; i < kTrackedChats; i++) {
+    if (g_chats[i].chat_id == chat_id) {
+      return g_chats[i];
+    }
+    if (g_chats[i].last_used_ms < g_chats[lru].last_used_ms) {
+      lru = i;
+    }
+  }
+  ChatState &slot = g_chats[lru];
+  slot.chat_id = chat_id;
+  slot.limit.primed = false;
+  slot.blocked_until_ms = 0;
+  return slot;
+}
+
+// Sleeps until both limiters (and any 429 block) admit a send to this chat.
+void wait_for_turn(ChatState &chat) {
+  while (true) {
+    const unsigned long now = millis();
+    unsigned long wait = 0;
+    if ((long)(chat.blocked_until_ms - now) > 0) {
+      wait = chat.blocked_until_ms - now;
+    }
+    const unsigned long chat_wait = rate_wait_ms(chat.limit, TELEGRAM_OUTBOX_CHAT_INTERVAL_MS,
+                                                 TELEGRAM_OUTBOX_CHAT_BURST, now);
+    const unsigned long global_wait = rate_wait_ms(g_global, kGlobalIntervalMs, 1, now);
+    if (chat_wait > wait) {
+      wait = chat_wait;
+    }
+    if (global_wait > wait) {
+      wait = global_wait;
+    }
+    if (wait == 0) {
+      rate_consume(chat.limit, TELEGRAM_OUTBOX_CHAT_INTERVAL_MS, now);
+      rate_consume(g_global, kGlobalIntervalMs, now);
+      chat.last_used_ms = now;
+      return;
+    }
+    vTaskDelay(pdMS_TO_TICKS(wait));
+  }
+}
+
+// Folds queued text items for the same chat into `item` while they fit in one
+// Telegram message. Only this task receives from the queue, so peek+receive
+// is race-free.
+void merge_following(OutboxItem *item) {
+  OutboxItem *next = nullptr;
+  while (xQueuePeek(g_queue, &next, 0) == pdTRUE && next != nullptr) {
+    if (next->kind != OUTBOX_TEXT || next->chat_id != item->chat_id) {
+      return;
+    }
+    if (item->text.length() + 1 + next->text.length() > TELEGRAM_OUTBOX_MERGE_MAX) {
+      return;
+    }
+    xQueueReceive(g_queue, &next, 0);
+    item->text += "\n";
+    item->text += next->text;
+    delete next;
+    adjust_pending(-1);
+    g_merged++;
+  }
+}
+
+// A live reply queues an edit per update; if newer edits of the same message
+// are already waiting, only the latest text is worth sending.
+void collapse_edits(OutboxItem *item) {
+  OutboxItem *next = nullptr;
+  while (xQueuePeek(g_queue, &next, 0) == pdTRUE && next != nullptr) {
+    if (next->kind != OUTBOX_EDIT || next->chat_id != item->chat_id ||
+        next->message_id != item->message_id) {
+      return;
+    }
+    xQueueReceive(g_queue, &next, 0);
+    item->text = next->text;
+    delete next;
+    adjust_pending(-1);
+    g_merged++;
+  }
+}
+
+long parse_retry_after_s(const String &response) {
+  const int pos = response.indexOf("\"retry_after\":");
+  if (pos < 0) {
+    return 0;
+  }
+  return response.substring(pos + 14).toInt();
+}
+
+int deliver(const OutboxItem &item, String &response, bool &permanent) {
+  if (item.kind == OUTBOX_FILE) {
+    String err;
+    const int code = transport_telegram_post_file(item.chat_id, item.filename, item.mime_type,
+                                                  item.text, &response, err);
+    if (err.length() > 0) {
+      Serial.println("[tg_out] " + err);
+      permanent = true;
+    }
+    return code;
+  }
+  if (item.kind == OUTBOX_DOCUMENT) {
+    return transport_telegram_post_document(item.chat_id, item.filename, item.content,
+                                            item.mime_type, item.text, &response);
+  }
+  if (item.kind == OUTBOX_EDIT) {
+    return transport_telegram_post_edit(item.chat_id, item.message_id, item.text, &response);
+  }
+  return transport_telegram_post_message(item.chat_id, item.text, &response);
+}
+
+const char *kind_name(OutboxKind kind) {
+  switch (kind) {
+    case OUTBOX_TEXT:
+      return "message";
+    case OUTBOX_EDIT:
+      return "edit";
+    default:
+      return "document";
+  }
+}
+
+void send_item(OutboxItem *item) {
+  ChatState &chat = chat_state(item->chat_id);
+  unsigned long backoff_ms = TELEGRAM_OUTBOX_BACKOFF_MS;
+  unsigned long throttled_ms = 0;
+
+  for (int attempt = 1;; attempt++) {
+    wait_for_turn(chat);
+    if (item->kind == OUTBOX_TEXT) {
+      // Messages that queued up while we waited go out as one.
+      merge_following(item);
+    } else if (item->kind == OUTBOX_EDIT) {
+      collapse_edits(item);
+    }
+
+    String response;
+    bool permanent = false;
+    const int code = deliver(*item, response, permanent);
+    if (code >= 200 && code < 300) {
+      g_sent++;
+      return;
+    }
+
+    if (code == 429) {
+      long retry_s = parse_retry_after_s(response);
+      if (retry_s <= 0) {
+        retry_s = 1;
+      }
+      throttled_ms += (unsigned long)retry_s * 1000UL;
+      if (throttled_ms > TELEGRAM_OUTBOX_MAX_THROTTLE_MS) {
+        g_dropped++;
+        Serial.printf("[tg_out] dropping %s, throttled for %lus\n", kind_name(item->kind),
+                      throttled_ms / 1000UL);
+        return;
+      }
+      chat.blocked_until_ms = millis() + (unsigned long)retry_s * 1000UL;
+      g_throttled++;
+      Serial.printf("[tg_out] 429, retry after %lds\n", retry_s);
+      // Rate limiting is not a failure of the item itself.
+      attempt--;
+      continue;
+    }
+
+    const bool transient = !permanent && (code <= 0 || code >= 500);
+    if (!transient || attempt >= TELEGRAM_OUTBOX_MAX_ATTEMPTS) {
+      g_dropped++;
+      Serial.printf("[tg_out] dropping %s after %d attempt(s), code=%d\n",
+                    kind_name(item->kind), attempt, code);
+      return;
+    }
+
+    g_retries++;
+    vTaskDelay(pdMS_TO_TICKS(backoff_ms));
+    backoff_ms = backoff_ms * 2 > kMaxBackoffMs ? kMaxBackoffMs : backoff_ms * 2;
+  }
+}
+
+void outbox_task_code(void *param) {
+  (void)param;
+  OutboxItem *item = nullptr;
+  while (true) {
+    if (xQueueReceive(g_queue, &item, portMAX_DELAY) == pdTRUE && item != nullptr) {
+      send_item(item);
+      delete item;
+      adjust_pending(-1);
+    }
+  }
+}
+
+bool enqueue(OutboxItem *item) {
+  if (g_queue == nullptr) {
+    delete item;
+    return false;
+  }
+  adjust_pending(1);
+  // A full queue means we are already far behind. Wait for room however long
+  // it takes: a synchronous send here would overtake everything queued. The
+  // queue always drains, since retries and 429 waits are bounded.
+  if (xQueueSend(g_queue, &item, pdMS_TO_TICKS(kEnqueueWaitMs)) != pdTRUE) {
+    g_full_waits++;
+    Serial.println("[tg_out] queue full, waiting for room");
+    xQueueSend(g_queue, &item, portMAX_DELAY);
+  }
+  return true;
+}
+
+}  // namespace
+
+void telegram_outbox_init() {
+  if (g_queue != nullptr) {
+    return;
+  }
+  for (int i = 0; i < kTrackedChats; i++) {
+    g_chats[i].chat_id = "";
+    g_chats[i].limit.primed = false;
+    g_chats[i].blocked_until_ms = 0;
+    g_chats[i].last_used_ms = 0;
+  }
+  g_queue = xQueueCreate(TELEGRAM_OUTBOX_DEPTH, sizeof(OutboxItem *));
+  if (g_queue == nullptr) {
+    Serial.println("[tg_out] queue alloc failed, sends stay synchronous");
+    return;
+  }
+  xTaskCreate(outbox_task_code, "TgSendTask", 8192, NULL, 1, NULL);
+}
+
+bool telegram_outbox_send_text(const String &chat_id, const String &text) {
+  if (text.length() == 0) {
+    return true;
+  }
+  OutboxItem *item = new OutboxItem();
+  item->kind = OUTBOX_TEXT;
+  item->chat_id = chat_id;
+  item->text = text;
+  return enqueue(item);
+}
+
+bool telegram_outbox_send_document(const String &chat_id, const String &filename,
+                                   String &&content, const String &mime_type,
+                                   const String &caption) {
+  if (g_queue == nullptr) {
+    return false;
+  }
+  OutboxItem *item = new OutboxItem();
+  item->kind = OUTBOX_DOCUMENT;
+  item->chat_id = chat_id;
+  item->filename = filename;
+  item->content = std::move(content);
+  item->mime_type = mime_type;
+  item->text = caption;
+  return enqueue(item);
+}
+
+bool telegram_outbox_send_file(const String &chat_id, const String &path,
+                               const String &mime_type, const String &caption) {
+  OutboxItem *item = new OutboxItem();
+  item->kind = OUTBOX_FILE;
+  item->chat_id = chat_id;
+  item->filename = path;
+  item->mime_type = mime_type;
+  item->text = caption;
+  return enqueue(item);
+}
+
+bool telegram_outbox_edit_text(const String &chat_id, const String &message_id,
+                               const String &text) {
+  OutboxItem *item = new OutboxItem();
+  item->kind = OUTBOX_EDIT;
+  item->chat_id = chat_id;
+  item->message_id = message_id;
+  item->text = text;
+  return enqueue(item);
+}
+
+bool telegram_outbox_wait_idle(uint32_t timeout_ms) {
+  const unsigned long start = millis();
+  while (true) {
+    portENTER_CRITICAL(&g_pending_mux);
+    const int pending = g_pending;
+    portEXIT_CRITICAL(&g_pending_mux);
+    if (pending <= 0) {
+      return true;
+    }
+    if ((millis() - start) >= timeout_ms) {
+      return false;
+    }
+    vTaskDelay(pdMS_TO_TICKS(20));
+  }
+}
+
+String telegram_outbox_health_line() {
+  const int queued = g_queue != nullptr ? (int)uxQueueMessagesWaiting(g_queue) : -1;
+  return "queued=" + String(queued) + " sent=" + String(g_sent) +
+         " merged=" + String(g_merged) + " retries=" + String(g_retries) +
+         " throttled=" + String(g_throttled) + " dropped=" + String(g_dropped) +
+         " full_waits=" + String(g_full_waits);
+}
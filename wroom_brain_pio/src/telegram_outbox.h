@@ -0,0 +1,38 @@
+#ifndef TELEGRAM_OUTBOX_H
+#define TELEGRAM_OUTBOX_H
+
+#include <Arduino.h>
+
+// Background queue for outgoing Telegram messages and documents. Callers
+// enqueue and return immediately; a dedicated task delivers items in order,
+// applies per-chat and bot-wide rate limits, honors 429 retry_after, merges
+// consecutive short messages to the same chat and retries transient failures.
+
+void telegram_outbox_init();
+
+// Return false only if the outbox is not running; the caller should then send
+// synchronously. A full queue blocks the caller until there is room, so
+// output keeps its order.
+bool telegram_outbox_send_text(const String &chat_id, const String &text);
+// Takes the content over instead of copying it; it is moved from only when
+// the document is queued.
+bool telegram_outbox_send_document(const String &chat_id, const String &filename,
+                                   String &&content, const String &mime_type,
+                                   const String &caption);
+// The file is opened and streamed from flash when its turn comes.
+bool telegram_outbox_send_file(const String &chat_id, const String &path,
+                               const String &mime_type, const String &caption);
+
+// Replace the text of an already sent message. Consecutive queued edits of
+// the same message collapse into the newest one.
+bool telegram_outbox_edit_text(const String &chat_id, const String &message_id,
+                               const String &text);
+
+// Block until everything queued so far has been delivered (or dropped).
+// Returns false on timeout.
+bool telegram_outbox_wait_idle(uint32_t timeout_ms);
+
+// One-line summary for the health command
+String telegram_outbox_health_line();
+
+#endif
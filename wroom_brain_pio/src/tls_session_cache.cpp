@@ -0,0 +1,355 @@
+#include "tls_session_cache.h"
+
+#include <Arduino.h>
+
+#include "brain_config.h"
+
+#if TLS_SESSION_RESUME
+
+#include <WiFi.h>
+#include <freertos/semphr.h>
+#include <lwip/netdb.h>
+#include <lwip/sockets.h>
+#include <mbedtls/ctr_drbg.h>
+#include <mbedtls/entropy.h>
+#include <mbedtls/net_sockets.h>
+#include <mbedtls/ssl.h>
+
+namespace {
+
+struct CachedSession {
+  char host[64];
+  uint16_t port;
+  bool valid;
+  unsigned long stored_ms;
+  unsigned long last_used_ms;
+  mbedtls_ssl_session session;
+};
+
+CachedSession g_cache[TLS_SESSION_CACHE_SIZE];
+bool g_cache_ready = false;
+SemaphoreHandle_t g_mutex = nullptr;
+
+uint32_t g_hits = 0;      // handshake resumed a cached session
+uint32_t g_misses = 0;    // no usable cached session
+uint32_t g_rejected = 0;  // cached session offered but server did a full handshake
+uint32_t g_fallbacks = 0; // non-insecure client, stock handshake
+
+bool lock() {
+  if (g_mutex == nullptr) {
+    g_mutex = xSemaphoreCreateMutex();
+    if (g_mutex == nullptr) {
+      return false;
+    }
+  }
+  if (!g_cache_ready) {
+    for (int i = 0; i < TLS_SESSION_CACHE_SIZE; i++) {
+      g_cache[i].host[0] = '\0';
+      g_cache[i].port = 0;
+      g_cache[i].valid = false;
+      mbedtls_ssl_session_init(&g_cache[i].session);
+    }
+    g_cache_ready = true;
+  }
+  return xSemaphoreTake(g_mutex, portMAX_DELAY) == pdTRUE;
+}
+
+void unlock() {
+  xSemaphoreGive(g_mutex);
+}
+
+void drop_entry(CachedSession &entry) {
+  if (entry.valid) {
+    mbedtls_ssl_session_free(&entry.session);
+    mbedtls_ssl_session_init(&entry.session);
+  }
+  entry.valid = false;
+  entry.host[0] = '\0';
+  entry.port = 0;
+}
+
+// Caller holds the mutex.
+CachedSession *find_entry(const char *host, uint16_t port) {
+  const unsigned long now = millis();
+  for (int i = 0; i < TLS_SESSION_CACHE_SIZE; i++) {
+    CachedSession &entry = g_cache[i];
+    if (!entry.valid || entry.port != port || strcmp(entry.host, host) != 0) {
+      continue;
+    }
+    if ((now - entry.stored_ms) > TLS_SESSION_TTL_MS) {
+      drop_entry(entry);
+      return nullptr;
+    }
+    return &entry;
+  }
+  return nullptr;
+}
+
+// Offer a cached session to the handshake. Returns true if one was set.
+bool apply_cached_session(mbedtls_ssl_context *ssl, const char *host, uint16_t port,
+                          unsigned char *master_out) {
+  if (!lock()) {
+    return false;
+  }
+  bool applied = false;
+  CachedSession *entry = find_entry(host, port);
+  if (entry != nullptr && mbedtls_ssl_set_session(ssl, &entry->session) == 0) {
+    memcpy(master_out, entry->session.master, sizeof(entry->session.master));
+    entry->last_used_ms = millis();
+    applied = true;
+  }
+  unlock();
+  return applied;
+}
+
+void store_session(mbedtls_ssl_context *ssl, const char *host, uint16_t port) {
+  if (strlen(host) >= sizeof(g_cache[0].host) || !lock()) {
+    return;
+  }
+
+  CachedSession *slot = nullptr;
+  for (int i = 0; i < TLS_SESSION_CACHE_SIZE && slot == nullptr; i++) {
+    CachedSession &entry = g_cache[i];
+    if (entry.valid && entry.port == port && strcmp(entry.host, host) == 0) {
+      slot = &entry;
+    }
+  }
+  for (int i = 0; i < TLS_SESSION_CACHE_SIZE && slot == nullptr; i++) {
+    if (!g_cache[i].valid) {
+      slot = &g_cache[i];
+    }
+  }
+  if (slot == nullptr) {
+    slot = &g_cache[0];
+    for (int i = 1; i < TLS_SESSION_CACHE_SIZE; i++) {
+      if (g_cache[i].last_used_ms < slot->last_used_ms) {
+        slot = &g_cache[i];
+      }
+    }
+  }
+
+  drop_entry(*slot);
+  if (mbedtls_ssl_get_session(ssl, &slot->session) == 0) {
+    strncpy(slot->host, host, sizeof(slot->host) - 1);
+    slot->host[sizeof(slot->host) - 1] = '\0';
+    slot->port = port;
+    slot->valid = true;
+    slot->stored_ms = millis();
+    slot->last_used_ms = slot->stored_ms;
+  } else {
+    mbedtls_ssl_session_free(&slot->session);
+    mbedtls_ssl_session_init(&slot->session);
+  }
+  unlock();
+}
+
+void forget_session(const char *host, uint16_t port) {
+  if (!lock()) {
+    return;
+  }
+  CachedSession *entry = find_entry(host, port);
+  if (entry != nullptr) {
+    drop_entry(*entry);
+  }
+  unlock();
+}
+
+// TCP connect with timeout; mirrors the socket setup in the core's
+// start_ssl_client(). Returns the socket fd or -1.
+int open_socket(const char *host, uint16_t port, int timeout_ms) {
+  IPAddress srv;
+  if (!WiFi.hostByName(host, srv)) {
+    return -1;
+  }
+
+  const int fd = lwip_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+  if (fd < 0) {
+    return -1;
+  }
+
+  struct sockaddr_in serv_addr;
+  memset(&serv_addr, 0, sizeof(serv_addr));
+  serv_addr.sin_family = AF_INET;
+  serv_addr.sin_addr.s_addr = (uint32_t)srv;
+  serv_addr.sin_port = htons(port);
+
+  if (timeout_ms <= 0) {
+    timeout_ms = 30000;
+  }
+
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+  int res = lwip_connect(fd, (struct sockaddr *)&serv_addr, sizeof(serv_addr));
+  if (res < 0 && errno != EINPROGRESS) {
+    close(fd);
+    return -1;
+  }
+
+  fd_set fdset;
+  struct timeval tv;
+  FD_ZERO(&fdset);
+  FD_SET(fd, &fdset);
+  tv.tv_sec = timeout_ms / 1000;
+  tv.tv_usec = (timeout_ms % 1000) * 1000;
+  res = select(fd + 1, nullptr, &fdset, nullptr, &tv);
+  if (res <= 0) {
+    close(fd);
+    return -1;
+  }
+
+  int sockerr = 0;
+  socklen_t len = sizeof(sockerr);
+  if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &sockerr, &len) < 0 || sockerr != 0) {
+    close(fd);
+    return -1;
+  }
+
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) & (~O_NONBLOCK));
+  lwip_setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  lwip_setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+  const int enable = 1;
+  lwip_setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+  lwip_setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &enable, sizeof(enable));
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+  return fd;
+}
+
+// start_ssl_client() for the insecure (no verification) case, with a
+// session resumption hook between mbedtls_ssl_setup() and the handshake.
+int start_resumable_ssl(sslclient_context *ctx, const char *host, uint16_t port, int timeout_ms,
+                        const char **alpn_protos) {
+  static const char *kPers = "esp32-tls";
+
+  ctx->socket = open_socket(host, port, timeout_ms);
+  if (ctx->socket < 0) {
+    return -1;
+  }
+
+  mbedtls_ssl_init(&ctx->ssl_ctx);
+  mbedtls_ssl_config_init(&ctx->ssl_conf);
+  mbedtls_ctr_drbg_init(&ctx->drbg_ctx);
+  mbedtls_entropy_init(&ctx->entropy_ctx);
+
+  int ret = mbedtls_ctr_drbg_seed(&ctx->drbg_ctx, mbedtls_entropy_func, &ctx->entropy_ctx,
+                                  (const unsigned char *)kPers, strlen(kPers));
+  if (ret != 0) {
+    return ret;
+  }
+
+  ret = mbedtls_ssl_config_defaults(&ctx->ssl_conf, MBEDTLS_SSL_IS_CLIENT,
+                                    MBEDTLS_SSL_TRANSPORT_STREAM, MBEDTLS_SSL_PRESET_DEFAULT);
+  if (ret != 0) {
+    return ret;
+  }
+  if (alpn_protos != nullptr) {
+    mbedtls_ssl_conf_alpn_protocols(&ctx->ssl_conf, alpn_protos);
+  }
+  mbedtls_ssl_conf_authmode(&ctx->ssl_conf, MBEDTLS_SSL_VERIFY_NONE);
+  mbedtls_ssl_conf_rng(&ctx->ssl_conf, mbedtls_ctr_drbg_random, &ctx->drbg_ctx);
+
+  ret = mbedtls_ssl_setup(&ctx->ssl_ctx, &ctx->ssl_conf);
+  if (ret != 0) {
+    return ret;
+  }
+  ret = mbedtls_ssl_set_hostname(&ctx->ssl_ctx, host);
+  if (ret != 0) {
+    return ret;
+  }
+
+  unsigned char offered_master[48];
+  const bool offered = apply_cached_session(&ctx->ssl_ctx, host, port, offered_master);
+
+  mbedtls_ssl_set_bio(&ctx->ssl_ctx, &ctx->socket, mbedtls_net_send, mbedtls_net_recv, NULL);
+
+  const unsigned long start_ms = millis();
+  while ((ret = mbedtls_ssl_handshake(&ctx->ssl_ctx)) != 0) {
+    if (ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
+      if (offered) {
+        // A stale ticket must not poison every later connect.
+        forget_session(host, port);
+      }
+      return ret;
+    }
+    if ((millis() - start_ms) > ctx->handshake_timeout) {
+      return -1;
+    }
+    vTaskDelay(2);
+  }
+
+  // A resumed session keeps the cached master secret; a full handshake
+  // derives a new one.
+  const bool resumed =
+      offered && memcmp(offered_master, ctx->ssl_ctx.session->master, sizeof(offered_master)) == 0;
+  if (resumed) {
+    g_hits++;
+  } else {
+    g_misses++;
+    if (offered) {
+      g_rejected++;
+    }
+  }
+
+  store_session(&ctx->ssl_ctx, host, port);
+  return 0;
+}
+
+}  // namespace
+
+int TlsSessionClient::connect(const char *host, uint16_t port, int32_t timeout) {
+  _timeout = timeout;
+  return connect(host, port);
+}
+
+int TlsSessionClient::connect(const char *host, uint16_t port) {
+  const bool resumable = _use_insecure && _CA_cert == nullptr && _cert == nullptr &&
+                         _private_key == nullptr && _pskIdent == nullptr &&
+                         _psKey == nullptr && !_use_ca_bundle;
+  if (!resumable) {
+    g_fallbacks++;
+    return WiFiClientSecure::connect(host, port);
+  }
+
+  const int ret = start_resumable_ssl(sslclient, host, port, _timeout, _alpn_protos);
+  _lastError = ret;
+  if (ret != 0) {
+    Serial.printf("[tls] handshake with %s failed: %d\n", host, ret);
+    stop();
+    return 0;
+  }
+  _connected = true;
+  return 1;
+}
+
+void tls_session_cache_clear() {
+  if (!lock()) {
+    return;
+  }
+  for (int i = 0; i < TLS_SESSION_CACHE_SIZE; i++) {
+    drop_entry(g_cache[i]);
+  }
+  unlock();
+}
+
+String tls_session_cache_health_line() {
+  int cached = 0;
+  if (lock()) {
+    for (int i = 0; i < TLS_SESSION_CACHE_SIZE; i++) {
+      if (g_cache[i].valid) {
+        cached++;
+      }
+    }
+    unlock();
+  }
+  return "hits=" + String(g_hits) + " misses=" + String(g_misses) +
+         " rejected=" + String(g_rejected) + " fallback=" + String(g_fallbacks) +
+         " cached=" + String(cached) + "/" + String(TLS_SESSION_CACHE_SIZE);
+}
+
+#else
+
+void tls_session_cache_clear() {}
+
+String tls_session_cache_health_line() {
+  return "off (core " + String(ESP_ARDUINO_VERSION_MAJOR) + ".x)";
+}
+
+#endif
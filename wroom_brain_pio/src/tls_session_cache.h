@@ -0,0 +1,41 @@
+#ifndef TLS_SESSION_CACHE_H
+#define TLS_SESSION_CACHE_H
+
+#include <Arduino.h>
+#include <WiFiClientSecure.h>
+#include <esp_arduino_version.h>
+
+// The resumable handshake reuses the 2.x core's sslclient_context and the
+// mbedTLS 2 session layout. Other cores get a plain WiFiClientSecure.
+#if defined(ESP_ARDUINO_VERSION_MAJOR) && ESP_ARDUINO_VERSION_MAJOR == 2
+#define TLS_SESSION_RESUME 1
+#else
+#define TLS_SESSION_RESUME 0
+#endif
+
+// Drop-in WiFiClientSecure that resumes TLS sessions (session tickets / IDs)
+// from a process-wide cache keyed by host:port, so reconnecting to a host we
+// talked to recently skips the full ECDHE handshake.
+//
+// Only the setInsecure() configuration used throughout this firmware is
+// resumed; clients configured with CA certs, client certs or PSK fall back
+// to the stock WiFiClientSecure handshake.
+#if TLS_SESSION_RESUME
+class TlsSessionClient : public WiFiClientSecure {
+ public:
+  using WiFiClientSecure::connect;
+  int connect(const char *host, uint16_t port) override;
+  int connect(const char *host, uint16_t port, int32_t timeout) override;
+};
+#else
+class TlsSessionClient : public WiFiClientSecure {};
+#endif
+
+// Forget every cached session. Called after a WiFi reconnect, from
+// ensure_wifi() and the agent loop's link watch.
+void tls_session_cache_clear();
+
+// One-line summary for the health command
+String tls_session_cache_health_line();
+
+#endif
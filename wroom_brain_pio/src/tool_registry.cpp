@@ -5,18 +5,28 @@
 #include <WiFi.h>
 #include <HTTPUpdate.h>
 #include <HTTPClient.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
 #include <time.h>
 
 #include "agent_loop.h"
+#include "agent_queue.h"
+#include "auto_learn.h"
 #include "brain_config.h"
 #include "chat_history.h"
+#include "code_scan.h"
+#include "command_table.h"
 #include "cron_store.h"
 #include "event_log.h"
 #include "llm_client.h"
+#include "media_cache.h"
 #include "memory_store.h"
 #include "file_memory.h"
+#include "http_pool.h"
+#include "intent.h"
 #include "model_config.h"
 #include "persona_store.h"
+#include "request_ctx.h"
 #include "scheduler.h"
 #include "task_store.h"
 #include "transport_telegram.h"
@@ -28,6 +38,8 @@
 #include "discord_client.h"
 #include "usage_stats.h"
 #include "skill_registry.h"
+#include "telegram_outbox.h"
+#include "tls_session_cache.h"
 #include "minos/minos.h"
 
 namespace {
@@ -81,10 +93,27 @@ struct PendingReminderDetailsDraft {
 PendingReminderDetailsDraft s_pending_reminder_details{false, 0};
 const char *kWebJobPrefix = "webjob:";
 
+// Guards the pending dialog state above, which any agent worker may read or
+// change. Created in tool_registry_init(), before the workers start.
+SemaphoreHandle_t s_pending_mutex = NULL;
+
+void lock_pending() {
+  if (s_pending_mutex != NULL) {
+    xSemaphoreTake(s_pending_mutex, portMAX_DELAY);
+  }
+}
+
+void unlock_pending() {
+  if (s_pending_mutex != NULL) {
+    xSemaphoreGive(s_pending_mutex);
+  }
+}
+
 bool is_expired(unsigned long deadline_ms) {
   return (long)(millis() - deadline_ms) >= 0;
 }
 
+// The clear_* helpers expect the caller to hold the pending lock.
 void clear_pending() {
   s_pending.active = false;
   s_pending.id = 0;
@@ -107,6 +136,92 @@ void clear_pending_reminder_details() {
   s_pending_reminder_details.expires_ms = 0;
 }
 
+void set_pending_update(const String &version, const String &download_url) {
+  lock_pending();
+  s_pending_update.available = true;
+  s_pending_update.version = version;
+  s_pending_update.download_url = download_url;
+  s_pending_update.notified_ms = millis();
+  unlock_pending();
+}
+
+bool pending_update_available() {
+  lock_pending();
+  const bool available = s_pending_update.available;
+  unlock_pending();
+  return available;
+}
+
+// Copies the update offer and withdraws it, so only one caller flashes it.
+PendingUpdate take_pending_update() {
+  lock_pending();
+  const PendingUpdate update = s_pending_update;
+  s_pending_update.available = false;
+  unlock_pending();
+  return update;
+}
+
+// Starts a confirm dialog. Returns its id, or 0 with busy_id_out set when
+// another action is still waiting for confirmation.
+unsigned long arm_pending(PendingActionType type, int pin, int state, int led_count,
+                          unsigned long &busy_id_out) {
+  lock_pending();
+  if (s_pending.active) {
+    busy_id_out = s_pending.id;
+    unlock_pending();
+    return 0;
+  }
+  s_pending.active = true;
+  s_pending.id = s_next_pending_id++;
+  s_pending.type = type;
+  s_pending.pin = pin;
+  s_pending.state = state;
+  s_pending.led_count = led_count;
+  s_pending.expires_ms = millis() + ACTION_CONFIRM_TIMEOUT_MS;
+  const unsigned long id = s_pending.id;
+  unlock_pending();
+  return id;
+}
+
+PendingAction pending_snapshot() {
+  lock_pending();
+  const PendingAction action = s_pending;
+  unlock_pending();
+  return action;
+}
+
+void set_pending_reminder_tz(const String &hhmm, const String &message) {
+  lock_pending();
+  s_pending_reminder_tz.active = true;
+  s_pending_reminder_tz.hhmm = hhmm;
+  s_pending_reminder_tz.message = message;
+  s_pending_reminder_tz.expires_ms = millis() + kPendingReminderTzMs;
+  clear_pending_reminder_details();
+  unlock_pending();
+}
+
+// Copies the reminder waiting for a timezone and clears it, so a second
+// worker cannot set it again.
+bool take_pending_reminder_tz(PendingReminderTzDraft &draft_out) {
+  lock_pending();
+  const bool taken =
+      s_pending_reminder_tz.active && !is_expired(s_pending_reminder_tz.expires_ms);
+  if (taken) {
+    draft_out = s_pending_reminder_tz;
+  }
+  clear_pending_reminder_tz();
+  unlock_pending();
+  return taken;
+}
+
+void clear_all_pending() {
+  lock_pending();
+  clear_pending();
+  clear_pending_reminder_tz();
+  clear_pending_reminder_details();
+  unlock_pending();
+}
+
 static bool clear_all_conversation_context(String &out) {
   String warnings = "";
   String err;
@@ -131,9 +246,7 @@ static bool clear_all_conversation_context(String &out) {
   agent_loop_set_last_file("", "");
   agent_loop_set_last_response("");
 
-  clear_pending();
-  clear_pending_reminder_tz();
-  clear_pending_reminder_details();
+  clear_all_pending();
 
   // Best-effort clear chat session file (if used).
   file_memory_session_clear(String(TELEGRAM_ALLOWED_CHAT_ID), err);
@@ -227,6 +340,7 @@ void build_help_text(String &out) {
   out += "/status - Show system status\n";
   out += "/help - Show this help\n";
   out += "/health - Check health\n";
+  out += "/command_stats - Command call counts and timings\n";
   out += "/specs - Show specs\n";
   out += "/usage - Show usage stats\n";
   out += "/update [url] - Update firmware\n";
@@ -257,6 +371,7 @@ void build_help_text(String &out) {
   out += "/files_list - List all SPIFFS files\n";
   out += "Say \"list projects\" - List saved /projects folders\n";
   out += "/files_get <filename> - Read a file (supports /projects/... paths)\n";
+  out += "/files_send <filename> - Send a file as a Telegram document\n";
   out += "/files_email <filename> <email> - Email a file\n";
   out += "/files_email_all <email> - Email all files\n";
 #endif
@@ -383,27 +498,33 @@ String wifi_health_line() {
   return "disconnected";
 }
 
-static bool looks_like_email_request(const String &text_lc) {
-  return (text_lc.indexOf("email") >= 0 || text_lc.indexOf("send") >= 0 ||
-          text_lc.indexOf("mail") >= 0) &&
-          (text_lc.indexOf("to") >= 0 || text_lc.indexOf("@") >= 0);
+static bool looks_like_email_request(uint32_t intents) {
+  return (intents & INTENT_MAIL_WORD) && (intents & INTENT_MAIL_TARGET);
 }
 
-static bool looks_like_update_request(const String &text_lc) {
-  return (text_lc.indexOf("update") >= 0 || text_lc.indexOf("upgrade") >= 0 ||
-          text_lc.indexOf("firmware") >= 0 || text_lc.indexOf("flash") >= 0 ||
-          text_lc.indexOf("new version") >= 0);
+static bool looks_like_update_request(uint32_t intents) {
+  return (intents & INTENT_UPDATE) != 0;
+}
+
+static bool should_route(const String &input, uint32_t intents) {
+  return input.length() > 0 && (intents & INTENT_ROUTE) && !(intents & INTENT_SLASH);
 }
 
 }  // namespace
 
+static void command_table_init();
+
 void tool_registry_init() {
+  if (s_pending_mutex == NULL) {
+    s_pending_mutex = xSemaphoreCreateMutex();
+  }
+  command_table_init();
   Serial.println(
       "[tools] allowlist: status, "
 #if ENABLE_GPIO
       "relay_set <pin> <0|1>, sensor_read <pin>, flash_led [count], "
 #endif
-      "help, health, specs, usage, security, update [url], confirm, cancel, "
+      "help, health, command_stats, specs, usage, security, update [url], confirm, cancel, "
 #if ENABLE_PLAN
       "plan <task>, "
 #endif
@@ -1798,16 +1919,19 @@ static void build_small_web_files(const String &topic, String &html_out, String
       "});\n";
 }
 
-static bool telegram_send_document_retry(const String &filename, const String &content,
-                                         const String &mime_type, const String &caption) {
-  for (int attempt = 0; attempt < 3; attempt++) {
-    if (transport_telegram_send_document(filename, content, mime_type, caption)) {
-      return true;
-    }
-    delay(180 + (attempt * 120));
-  }
-  return false;
+#if ENABLE_MEDIA_UNDERSTANDING
+// LlmMediaSource callbacks streaming the last Telegram photo/document;
+// ctx points to a bool selecting the document.
+static bool telegram_media_open_cb(void *ctx, Stream **stream_out, size_t *len_out,
+                                   String &error_out) {
+  return transport_telegram_media_open(*(const bool *)ctx, stream_out, len_out, error_out);
+}
+
+static void telegram_media_close_cb(void *ctx, bool complete) {
+  (void)ctx;
+  transport_telegram_media_close(complete);
 }
+#endif
 
 static bool send_small_web_files(const String &topic, String &out) {
   String html;
@@ -1836,12 +1960,10 @@ static bool send_small_web_files(const String &topic, String &out) {
   web_server_publish_file("script.js", js, "application/javascript");
 
   // Send files via Telegram too
-  bool ok_html = telegram_send_document_retry("index.html", html, "text/html", "Generated HTML");
-  delay(120);
-  bool ok_css = telegram_send_document_retry("styles.css", css, "text/css", "Generated CSS");
-  delay(120);
+  bool ok_html = transport_telegram_send_document("index.html", html, "text/html", "Generated HTML");
+  bool ok_css = transport_telegram_send_document("styles.css", css, "text/css", "Generated CSS");
   bool ok_js =
-      telegram_send_document_retry("script.js", js, "application/javascript", "Generated JS");
+      transport_telegram_send_document("script.js", js, "application/javascript", "Generated JS");
 
   if (!ok_html && !ok_css && !ok_js) {
     out = "ERR: failed to send files";
@@ -2078,50 +2200,12 @@ static bool text_has_any(const String &text_lc, const char *const terms[], size_
   return false;
 }
 
-static bool is_pdf_summary_request(const String &cmd_lc) {
-  const char *doc_terms[] = {
-      "pdf",
-      "document",
-      "doc file",
-      "report",
-  };
-  const char *summary_terms[] = {
-      "summar",
-      "tldr",
-      "tl;dr",
-      "key points",
-      "highlights",
-      "gist",
-      "explain this",
-      "review this",
-  };
-  return text_has_any(cmd_lc, doc_terms, sizeof(doc_terms) / sizeof(doc_terms[0])) &&
-         text_has_any(cmd_lc, summary_terms, sizeof(summary_terms) / sizeof(summary_terms[0]));
+static bool is_pdf_summary_request(uint32_t intents) {
+  return (intents & INTENT_DOCUMENT) && (intents & INTENT_SUMMARY);
 }
 
-static bool is_image_understanding_request(const String &cmd_lc) {
-  const char *image_terms[] = {
-      "image",
-      "photo",
-      "picture",
-      "screenshot",
-      "diagram",
-  };
-  const char *understand_terms[] = {
-      "describe",
-      "what is",
-      "what's in",
-      "analy",
-      "explain",
-      "understand",
-      "ocr",
-      "extract text",
-      "read text",
-      "summar",
-  };
-  return text_has_any(cmd_lc, image_terms, sizeof(image_terms) / sizeof(image_terms[0])) &&
-         text_has_any(cmd_lc, understand_terms,
-                      sizeof(understand_terms) / sizeof(understand_terms[0]));
+static bool is_image_understanding_request(uint32_t intents) {
+  return (intents & INTENT_IMAGE) && (intents & INTENT_UNDERSTAND);
 }
 
 static bool extract_natural_image_prompt(const String &cmd, String &prompt_out) {
@@ -2700,7 +2784,7 @@ static bool run_natural_web_iteration(const String &user_request, String &out) {
   agent_loop_set_last_file(target_path, updated_content);
 
   const String mime = mime_from_filename(filename);
-  bool doc_sent = telegram_send_document_retry(filename, updated_content, mime, "Updated file");
+  bool doc_sent = transport_telegram_send_document(filename, updated_content, mime, "Updated file");
 
   String base_lc = filename;
   base_lc.toLowerCase();
@@ -2804,7 +2888,7 @@ void tool_registry_check_updates_async() {
     github_repo = "timiclaw/timiclaw";  // Default
   }
 
-  WiFiClientSecure client;
+  TlsSessionClient client;
   client.setInsecure();
   HTTPClient http;
 
@@ -2835,10 +2919,7 @@ void tool_registry_check_updates_async() {
         String download_url = payload.substring(url_start, url_end);
 
         // Store pending update
-        s_pending_update.available = true;
-        s_pending_update.version = version;
-        s_pending_update.download_url = download_url;
-        s_pending_update.notified_ms = millis();
+        set_pending_update(version, download_url);
 
         // Send notification to user
         String notification = "🔄 **New Firmware Available!**\n\n";
@@ -2862,2172 +2943,2705 @@ void tool_registry_check_updates_async() {
 
 // Trigger the pending firmware update
 bool tool_registry_trigger_update(String &out) {
-  if (!s_pending_update.available) {
+  const PendingUpdate update = take_pending_update();
+  if (!update.available) {
     out = "No pending update available";
     return false;
   }
 
   // Check if notification is still recent (5 minutes)
-  if (is_expired(s_pending_update.notified_ms + 300000UL)) {
-    s_pending_update.available = false;
+  if (is_expired(update.notified_ms + 300000UL)) {
     out = "Update offer expired. Say 'update' again to check.";
     return false;
   }
 
   out = "=== Updating Firmware ===\n\n";
-  out += "Version: " + s_pending_update.version + "\n";
+  out += "Version: " + update.version + "\n";
   out += "Downloading and flashing...\n";
   out += "(ESP32 will restart after update)\n";
 
-  Serial.println("[update] Starting update to " + s_pending_update.version);
+  Serial.println("[update] Starting update to " + update.version);
 
-  WiFiClientSecure client;
+  TlsSessionClient client;
   client.setInsecure();
 
-  t_httpUpdate_return ret = httpUpdate.update(client, s_pending_update.download_url);
+  t_httpUpdate_return ret = httpUpdate.update(client, update.download_url);
 
   switch (ret) {
     case HTTP_UPDATE_FAILED:
       Serial.println("[update] Failed: " + String(httpUpdate.getLastError()));
       out = "ERR: Update failed\n" + httpUpdate.getLastErrorString();
-      s_pending_update.available = false;
       break;
     case HTTP_UPDATE_NO_UPDATES:
       Serial.println("[update] No updates available");
       out = "ERR: No updates available";
-      s_pending_update.available = false;
       break;
     case HTTP_UPDATE_OK:
       Serial.println("[update] Success! Restarting...");
-      out = "OK: Updated to " + s_pending_update.version + "! Restarting...";
-      s_pending_update.available = false;
+      out = "OK: Updated to " + update.version + "! Restarting...";
       break;
   }
 
   return true;
 }
 
-bool tool_registry_execute(const String &input, String &out) {
-  String cmd = normalize_command(input);
-  cmd.trim();
-  String cmd_lc = cmd;
-  cmd_lc.toLowerCase();
-
-  if (s_pending.active && is_expired(s_pending.expires_ms)) {
-    clear_pending();
-  }
-  if (s_pending_reminder_tz.active && is_expired(s_pending_reminder_tz.expires_ms)) {
-    clear_pending_reminder_tz();
-  }
-  if (s_pending_reminder_details.active &&
-      is_expired(s_pending_reminder_details.expires_ms)) {
-    clear_pending_reminder_details();
-  }
+// ---------------------------------------------------------------------------
+// Command table. Explicit commands are looked up by name in one hash probe;
+// anything the table does not claim falls through to the natural-language
+// stage in tool_registry_execute().
 
-  if (s_pending_reminder_tz.active) {
-    String guessed_tz;
-    if (extract_timezone_from_text(cmd, guessed_tz)) {
-      String err;
-      if (!persona_set_timezone(guessed_tz, err)) {
-        out = "ERR: " + err;
-        return true;
-      }
-      if (!persona_set_daily_reminder(s_pending_reminder_tz.hhmm, s_pending_reminder_tz.message, err)) {
-        out = "ERR: " + err;
-        return true;
-      }
-      if (is_webjob_message(s_pending_reminder_tz.message)) {
-        event_log_append("WEBJOB set daily " + s_pending_reminder_tz.hhmm);
-      } else {
-        event_log_append("REMINDER set daily " + s_pending_reminder_tz.hhmm);
-      }
-      String msg_for_user = reminder_message_for_user(s_pending_reminder_tz.message);
-      out = "OK: timezone set to " + guessed_tz +
-            "\nOK: daily reminder set at " + s_pending_reminder_tz.hhmm +
-            "\nMessage: " + msg_for_user + unsynced_time_warning();
-      clear_pending_reminder_tz();
-      return true;
-    }
-  }
+static CommandTable s_commands;
 
-  if (handle_onboarding_flow(cmd, cmd_lc, out)) {
-    return true;
-  }
+static bool cmd_help(const String &input, const String &cmd, const String &cmd_lc,
+                     uint32_t intents, String &out) {
+  build_help_text(out);
+  return true;
+}
 
-  if (looks_like_email_request(cmd_lc) && !cmd_lc.startsWith("send_email ") &&
-      !cmd_lc.startsWith("email_")) {
-    String to, subject, body, llm_err;
-    if (llm_parse_email_request(cmd, to, subject, body, llm_err)) {
-      if (to.length() > 0) {
-        // Use default subject if LLM didn't provide one
-        if (subject.length() == 0) {
-          subject = "Message from ESP32 Bot";
-        }
-        String email_err;
-        String html_content = "<p>" + body + "</p>";
+static bool cmd_status(const String &input, const String &cmd, const String &cmd_lc,
+                       uint32_t intents, String &out) {
+  out = "OK: alive";
+  return true;
+}
 
-        if (email_send(to, subject, html_content, body, email_err)) {
-          out = "OK: Email sent to " + to;
-          return true;
-        } else {
-          out = "ERR: " + email_err;
-          return true;
-        }
-      }
-    }
-    // If LLM parsing failed, fall through to normal command processing
-  }
+static bool cmd_pc_status(const String &input, const String &cmd, const String &cmd_lc,
+                          uint32_t intents, String &out) {
+  const String target = pc_target_read();
+  out = pc_bridge_quickstart(target);
+  return true;
+}
 
-  if (cmd_lc == "help") {
-    build_help_text(out);
+static bool cmd_pc_connect(const String &input, const String &cmd, const String &cmd_lc,
+                           uint32_t intents, String &out) {
+  String value = cmd.length() > 10 ? cmd.substring(10) : "";
+  value.trim();
+  if (value.length() == 0) {
+    out = "Usage: /pc_connect <alias|host>\nExample: /pc_connect office-pc";
     return true;
   }
+  return pc_target_write(value, out);
+}
 
-  if (cmd_lc == "status") {
-    out = "OK: alive";
+static bool cmd_pc_run(const String &input, const String &cmd, const String &cmd_lc,
+                       uint32_t intents, String &out) {
+  String payload = cmd.length() > 6 ? cmd.substring(6) : "";
+  payload = compact_spaces(payload);
+  if (payload.length() == 0) {
+    out = "Usage: /pc_run <allowlisted_command>";
     return true;
   }
+  return queue_pc_bridge_task("shell", payload, out);
+}
 
-  if (cmd_lc == "pc_status") {
-    const String target = pc_target_read();
-    out = pc_bridge_quickstart(target);
+static bool cmd_pc_browser(const String &input, const String &cmd, const String &cmd_lc,
+                           uint32_t intents, String &out) {
+  String payload = cmd.length() > 10 ? cmd.substring(10) : "";
+  payload = compact_spaces(payload);
+  if (payload.length() == 0) {
+    out = "Usage: /pc_browser <task_description>";
     return true;
   }
+  return queue_pc_bridge_task("browser", payload, out);
+}
 
-  if (cmd_lc == "pc_connect" || cmd_lc.startsWith("pc_connect ")) {
-    String value = cmd.length() > 10 ? cmd.substring(10) : "";
-    value.trim();
-    if (value.length() == 0) {
-      out = "Usage: /pc_connect <alias|host>\nExample: /pc_connect office-pc";
-      return true;
-    }
-    return pc_target_write(value, out);
-  }
+static bool cmd_fresh_start(const String &input, const String &cmd, const String &cmd_lc,
+                            uint32_t intents, String &out) {
+  return clear_all_conversation_context(out);
+}
 
-  if (cmd_lc == "pc_run" || cmd_lc.startsWith("pc_run ")) {
-    String payload = cmd.length() > 6 ? cmd.substring(6) : "";
-    payload = compact_spaces(payload);
-    if (payload.length() == 0) {
-      out = "Usage: /pc_run <allowlisted_command>";
-      return true;
-    }
-    return queue_pc_bridge_task("shell", payload, out);
-  }
+static bool cmd_health(const String &input, const String &cmd, const String &cmd_lc,
+                       uint32_t intents, String &out) {
+  String notes;
+  String mem_err;
+  size_t note_chars = 0;
+  if (memory_get_notes(notes, mem_err)) {
+    note_chars = notes.length();
+  }
+  String soul;
+  String heartbeat;
+  String persona_err;
+  size_t soul_chars = 0;
+  size_t heartbeat_chars = 0;
+  if (persona_get_soul(soul, persona_err)) {
+    soul_chars = soul.length();
+  }
+  if (persona_get_heartbeat(heartbeat, persona_err)) {
+    heartbeat_chars = heartbeat.length();
+  }
+
+  String pending = "none";
+  const PendingAction action = pending_snapshot();
+  if (action.active) {
+    unsigned long remain_ms = 0;
+    if (!is_expired(action.expires_ms)) {
+      remain_ms = action.expires_ms - millis();
+    }
+    if (action.type == PENDING_RELAY_SET) {
+      pending = "relay_set id=" + String(action.id) + " pin=" + String(action.pin) +
+                " state=" + String(action.state) + " ttl_ms=" + String(remain_ms);
+    } else if (action.type == PENDING_LED_FLASH) {
+      pending = "flash_led id=" + String(action.id) + " count=" + String(action.led_count) +
+                " ttl_ms=" + String(remain_ms);
+    } else {
+      pending = "unknown id=" + String(action.id) + " ttl_ms=" + String(remain_ms);
+    }
+  }
+
+  out = "OK: health\n"
+        "uptime_s=" + String(millis() / 1000UL) + "\n"
+        "heap=" + String(ESP.getFreeHeap()) + "\n"
+        "wifi=" + wifi_health_line() + "\n"
+        "http_pool=" + http_pool_health_line() + "\n"
+        "tls_cache=" + tls_session_cache_health_line() + "\n"
+        "tg_outbox=" + telegram_outbox_health_line() + "\n"
+        "media_cache=" + media_cache_health_line() + "\n"
+        "agent_queue=" + agent_queue_health_line() + "\n"
+        "commands=" + s_commands.stats_line(5) + "\n"
+        "memory_chars=" + String(note_chars) + "\n"
+        "soul_chars=" + String(soul_chars) + "\n"
+        "heartbeat_chars=" + String(heartbeat_chars) + "\n"
+        "pending=" + pending + "\n"
+        "safe_mode=" + String(is_safe_mode_enabled() ? "on" : "off");
 
-  if (cmd_lc == "pc_browser" || cmd_lc.startsWith("pc_browser ")) {
-    String payload = cmd.length() > 10 ? cmd.substring(10) : "";
-    payload = compact_spaces(payload);
-    if (payload.length() == 0) {
-      out = "Usage: /pc_browser <task_description>";
-      return true;
+  String tz;
+  if (persona_get_timezone(tz, persona_err)) {
+    tz.trim();
+    if (tz.length() == 0) {
+      tz = String(TIMEZONE_TZ) + " (default)";
     }
-    return queue_pc_bridge_task("browser", payload, out);
-  }
-
-  if (cmd_lc == "fresh_start" || cmd_lc == "start_fresh" || cmd_lc == "context_clear" ||
-      cmd_lc == "clear context" || cmd_lc == "reset context" ||
-      cmd_lc == "start from scratch" || cmd_lc == "new chat") {
-    return clear_all_conversation_context(out);
+    out += "\ntimezone=" + tz;
   }
 
-  if (cmd_lc == "health") {
-    String notes;
-    String mem_err;
-    size_t note_chars = 0;
-    if (memory_get_notes(notes, mem_err)) {
-      note_chars = notes.length();
-    }
-    String soul;
-    String heartbeat;
-    String persona_err;
-    size_t soul_chars = 0;
-    size_t heartbeat_chars = 0;
-    if (persona_get_soul(soul, persona_err)) {
-      soul_chars = soul.length();
-    }
-    if (persona_get_heartbeat(heartbeat, persona_err)) {
-      heartbeat_chars = heartbeat.length();
-    }
-
-    String pending = "none";
-    if (s_pending.active) {
-      unsigned long remain_ms = 0;
-      if (!is_expired(s_pending.expires_ms)) {
-        remain_ms = s_pending.expires_ms - millis();
-      }
-      if (s_pending.type == PENDING_RELAY_SET) {
-        pending = "relay_set id=" + String(s_pending.id) + " pin=" + String(s_pending.pin) +
-                  " state=" + String(s_pending.state) + " ttl_ms=" + String(remain_ms);
-      } else if (s_pending.type == PENDING_LED_FLASH) {
-        pending = "flash_led id=" + String(s_pending.id) + " count=" + String(s_pending.led_count) +
-                  " ttl_ms=" + String(remain_ms);
-      } else {
-        pending = "unknown id=" + String(s_pending.id) + " ttl_ms=" + String(remain_ms);
-      }
-    }
-
-    out = "OK: health\n"
-          "uptime_s=" + String(millis() / 1000UL) + "\n"
-          "heap=" + String(ESP.getFreeHeap()) + "\n"
-          "wifi=" + wifi_health_line() + "\n"
-          "memory_chars=" + String(note_chars) + "\n"
-          "soul_chars=" + String(soul_chars) + "\n"
-          "heartbeat_chars=" + String(heartbeat_chars) + "\n"
-          "pending=" + pending + "\n"
-          "safe_mode=" + String(is_safe_mode_enabled() ? "on" : "off");
-
-    String tz;
-    if (persona_get_timezone(tz, persona_err)) {
-      tz.trim();
-      if (tz.length() == 0) {
-        tz = String(TIMEZONE_TZ) + " (default)";
-      }
-      out += "\ntimezone=" + tz;
-    }
-
-    String rem_hhmm;
-    String rem_msg;
-    if (persona_get_daily_reminder(rem_hhmm, rem_msg, persona_err)) {
-      rem_hhmm.trim();
-      rem_msg.trim();
-      if (rem_hhmm.length() > 0 && rem_msg.length() > 0) {
-        if (is_webjob_message(rem_msg)) {
-          String task = webjob_task_from_message(rem_msg);
-          out += "\nwebjob_daily=" + rem_hhmm + " task_chars=" + String(task.length());
-        } else {
-          out += "\nreminder_daily=" + rem_hhmm + " msg_chars=" + String(rem_msg.length());
-        }
+  String rem_hhmm;
+  String rem_msg;
+  if (persona_get_daily_reminder(rem_hhmm, rem_msg, persona_err)) {
+    rem_hhmm.trim();
+    rem_msg.trim();
+    if (rem_hhmm.length() > 0 && rem_msg.length() > 0) {
+      if (is_webjob_message(rem_msg)) {
+        String task = webjob_task_from_message(rem_msg);
+        out += "\nwebjob_daily=" + rem_hhmm + " task_chars=" + String(task.length());
       } else {
-        out += "\nreminder_daily=none";
+        out += "\nreminder_daily=" + rem_hhmm + " msg_chars=" + String(rem_msg.length());
       }
-    }
-    return true;
-  }
-
-  if (cmd_lc == "specs") {
-    // Chip and flash info
-    out = "=== ESP32 Specs ===\n\n";
-    out += "Chip: " + String(ESP.getChipModel()) + "\n";
-    out += "Cores: " + String(ESP.getChipCores()) + "\n";
-    out += "CPU Frequency: " + String(ESP.getCpuFreqMHz()) + " MHz\n";
-    out += "Flash Size: " + String(ESP.getFlashChipSize() / 1024) + " KB\n";
-    out += "Sketch Size: " + String(ESP.getSketchSize() / 1024) + " KB\n";
-    out += "Free Sketch Space: " + String(ESP.getFreeSketchSpace() / 1024) + " KB\n\n";
-
-    // RAM info
-    out += "=== RAM ===\n";
-    out += "Free Heap: " + String(ESP.getFreeHeap()) + " bytes\n";
-    out += "Largest Free Block: " + String(ESP.getMaxAllocHeap()) + " bytes\n";
-    out += "Total Heap: " + String(ESP.getHeapSize()) + " bytes\n\n";
-
-    // PSRAM info (if available)
-    if (psramFound()) {
-      out += "=== PSRAM ===\n";
-      out += "PSRAM Total: " + String(ESP.getPsramSize()) + " bytes\n";
-      out += "PSRAM Free: " + String(ESP.getFreePsram()) + " bytes\n\n";
     } else {
-      out += "=== PSRAM: Not Available ===\n\n";
+      out += "\nreminder_daily=none";
     }
+  }
+  return true;
+}
 
-    // NVS Storage breakdown
-    out += "=== NVS Storage (61KB partition) ===\n";
-    out += "Used / Limit:\n\n";
-
-    // Memory
-    String mem;
-    String mem_err;
-    if (memory_get_notes(mem, mem_err)) {
-      size_t used = mem.length();
-      size_t limit = MEMORY_MAX_CHARS;
-      int percent = (used * 100) / limit;
-      out += "memory: " + String(used) + " / " + String(limit) + " chars (" + String(percent) + "%)\n";
-    } else {
-      out += "memory: Error\n";
-    }
+static bool cmd_specs(const String &input, const String &cmd, const String &cmd_lc,
+                      uint32_t intents, String &out) {
+  // Chip and flash info
+  out = "=== ESP32 Specs ===\n\n";
+  out += "Chip: " + String(ESP.getChipModel()) + "\n";
+  out += "Cores: " + String(ESP.getChipCores()) + "\n";
+  out += "CPU Frequency: " + String(ESP.getCpuFreqMHz()) + " MHz\n";
+  out += "Flash Size: " + String(ESP.getFlashChipSize() / 1024) + " KB\n";
+  out += "Sketch Size: " + String(ESP.getSketchSize() / 1024) + " KB\n";
+  out += "Free Sketch Space: " + String(ESP.getFreeSketchSpace() / 1024) + " KB\n\n";
+
+  // RAM info
+  out += "=== RAM ===\n";
+  out += "Free Heap: " + String(ESP.getFreeHeap()) + " bytes\n";
+  out += "Largest Free Block: " + String(ESP.getMaxAllocHeap()) + " bytes\n";
+  out += "Total Heap: " + String(ESP.getHeapSize()) + " bytes\n\n";
+
+  // PSRAM info (if available)
+  if (psramFound()) {
+    out += "=== PSRAM ===\n";
+    out += "PSRAM Total: " + String(ESP.getPsramSize()) + " bytes\n";
+    out += "PSRAM Free: " + String(ESP.getFreePsram()) + " bytes\n\n";
+  } else {
+    out += "=== PSRAM: Not Available ===\n\n";
+  }
 
-    // Chat history
-    String chat;
-    String chat_err;
-    if (chat_history_get(chat, chat_err)) {
-      size_t used = chat.length();
-      size_t lines = 0;
-      for (size_t i = 0; i < chat.length(); i++) {
-        if (chat[i] == '\n') lines++;
-      }
-      out += "chat_history: " + String(lines) + " lines, " + String(used) + " chars\n";
-    } else {
-      out += "chat_history: " + String(chat_err) + "\n";
-    }
+  // NVS Storage breakdown
+  out += "=== NVS Storage (61KB partition) ===\n";
+  out += "Used / Limit:\n\n";
 
-    // Persona (soul + heartbeat)
-    String soul, heartbeat, persona_err;
-    size_t persona_used = 0;
-    if (persona_get_soul(soul, persona_err)) {
-      persona_used += soul.length();
-    }
-    if (persona_get_heartbeat(heartbeat, persona_err)) {
-      persona_used += heartbeat.length();
-    }
-    out += "persona: " + String(persona_used) + " chars used\n";
+  // Memory
+  String mem;
+  String mem_err;
+  if (memory_get_notes(mem, mem_err)) {
+    size_t used = mem.length();
+    size_t limit = MEMORY_MAX_CHARS;
+    int percent = (used * 100) / limit;
+    out += "memory: " + String(used) + " / " + String(limit) + " chars (" + String(percent) + "%)\n";
+  } else {
+    out += "memory: Error\n";
+  }
 
-    // Tasks
-    String tasks, tasks_err;
-    if (task_list(tasks, tasks_err)) {
-      size_t used = tasks.length();
-      size_t limit = TASKS_MAX_CHARS;
-      int percent = (used * 100) / limit;
-      out += "tasks: " + String(used) + " / " + String(limit) + " chars (" + String(percent) + "%)\n";
-    } else {
-      out += "tasks: " + tasks_err + "\n";
+  // Chat history
+  String chat;
+  String chat_err;
+  if (chat_history_get(chat, chat_err)) {
+    size_t used = chat.length();
+    size_t lines = 0;
+    for (size_t i = 0; i < chat.length(); i++) {
+      if (chat[i] == '\n') lines++;
     }
-
-    // Model config
-    String active_provider = model_config_get_active_provider();
-    out += "\n=== LLM Config ===\n";
-    out += "Active Provider: " + (active_provider.length() > 0 ? active_provider : "(none)") + "\n";
-    out += "Configured: " + model_config_get_configured_list() + "\n";
-
-    // WiFi
-    out += "\n=== WiFi ===\n";
-    out += wifi_health_line() + "\n";
-    out += "RSSI: " + String(WiFi.RSSI()) + " dBm\n";
-
-    return true;
+    out += "chat_history: " + String(lines) + " lines, " + String(used) + " chars\n";
+  } else {
+    out += "chat_history: " + String(chat_err) + "\n";
   }
 
-  if (cmd_lc == "usage") {
-    usage_get_report(out);
-    return true;
+  // Persona (soul + heartbeat)
+  String soul, heartbeat, persona_err;
+  size_t persona_used = 0;
+  if (persona_get_soul(soul, persona_err)) {
+    persona_used += soul.length();
+  }
+  if (persona_get_heartbeat(heartbeat, persona_err)) {
+    persona_used += heartbeat.length();
   }
+  out += "persona: " + String(persona_used) + " chars used\n";
 
-  if (cmd_lc == "usage_reset") {
-    usage_reset();
-    out = "Usage statistics have been reset.";
-    return true;
+  // Tasks
+  String tasks, tasks_err;
+  if (task_list(tasks, tasks_err)) {
+    size_t used = tasks.length();
+    size_t limit = TASKS_MAX_CHARS;
+    int percent = (used * 100) / limit;
+    out += "tasks: " + String(used) + " / " + String(limit) + " chars (" + String(percent) + "%)\n";
+  } else {
+    out += "tasks: " + tasks_err + "\n";
   }
 
-  if (cmd_lc == "security") {
-    out = "=== Security Status ===\n\n";
+  // Model config
+  String active_provider = model_config_get_active_provider();
+  out += "\n=== LLM Config ===\n";
+  out += "Active Provider: " + (active_provider.length() > 0 ? active_provider : "(none)") + "\n";
+  out += "Configured: " + model_config_get_configured_list() + "\n";
 
-    // Allowed Chat ID
-    out += "Allowed Chat ID: " + String(TELEGRAM_ALLOWED_CHAT_ID) + "\n";
+  // WiFi
+  out += "\n=== WiFi ===\n";
+  out += wifi_health_line() + "\n";
+  out += "RSSI: " + String(WiFi.RSSI()) + " dBm\n";
+
+  return true;
+}
 
-    // Safe Mode
-    out += "Safe Mode: " + String(is_safe_mode_enabled() ? "ON (risky actions blocked)" : "OFF (risky actions allowed)") + "\n";
+static bool cmd_usage(const String &input, const String &cmd, const String &cmd_lc,
+                      uint32_t intents, String &out) {
+  usage_get_report(out);
+  return true;
+}
 
-    // WiFi Security
-    out += "\n=== WiFi ===\n";
-    out += "Connected: " + String(WiFi.isConnected() ? "Yes" : "No") + "\n";
-    if (WiFi.isConnected()) {
-      out += "SSID: " + WiFi.SSID() + "\n";
-      out += "RSSI: " + String(WiFi.RSSI()) + " dBm\n";
-      out += "IP: " + WiFi.localIP().toString() + "\n";
-    }
+static bool cmd_usage_reset(const String &input, const String &cmd, const String &cmd_lc,
+                            uint32_t intents, String &out) {
+  usage_reset();
+  out = "Usage statistics have been reset.";
+  return true;
+}
 
-    // TLS Status (we use insecure TLS - setInsecure)
-    out += "\n=== TLS ===\n";
-    out += "Mode: INSECURE (setInsecure)\n";
-    out += "Note: For production, use certificate pinning\n";
+static bool cmd_security(const String &input, const String &cmd, const String &cmd_lc,
+                         uint32_t intents, String &out) {
+  out = "=== Security Status ===\n\n";
 
-    // Firmware integrity
-    out += "\n=== Firmware ===\n";
-    out += "Sketch Size: " + String(ESP.getSketchSize() / 1024) + " KB\n";
-    out += "Free Sketch Space: " + String(ESP.getFreeSketchSpace() / 1024) + " KB\n";
-    out += "Flash Chip Size: " + String(ESP.getFlashChipSize() / (1024 * 1024)) + " MB\n";
-    out += "CPU: " + String(ESP.getChipModel()) + " @ " + String(ESP.getCpuFreqMHz()) + " MHz\n";
+  // Allowed Chat ID
+  out += "Allowed Chat ID: " + String(TELEGRAM_ALLOWED_CHAT_ID) + "\n";
 
-    // Recent activity hint
-    out += "\n=== Recommendations ===\n";
-    if (!is_safe_mode_enabled()) {
-      out += "⚠️ Enable safe_mode to block risky GPIO actions\n";
-    }
-    out += "✅ Chat ID restriction active\n";
-    out += "⚠️ Consider using HTTPS/TLS certificates for production\n";
+  // Safe Mode
+  out += "Safe Mode: " + String(is_safe_mode_enabled() ? "ON (risky actions blocked)" : "OFF (risky actions allowed)") + "\n";
 
-    return true;
+  // WiFi Security
+  out += "\n=== WiFi ===\n";
+  out += "Connected: " + String(WiFi.isConnected() ? "Yes" : "No") + "\n";
+  if (WiFi.isConnected()) {
+    out += "SSID: " + WiFi.SSID() + "\n";
+    out += "RSSI: " + String(WiFi.RSSI()) + " dBm\n";
+    out += "IP: " + WiFi.localIP().toString() + "\n";
   }
 
-  // Natural language update request handling
-  // Skip if it's "update http/https" (let exact handler process URLs)
-  if (looks_like_update_request(cmd_lc) && !cmd_lc.startsWith("update http")) {
-    String url;
-    bool should_update;
-    bool check_github = false;
-    String llm_err;
-    if (llm_parse_update_request(cmd, url, should_update, check_github, llm_err)) {
-      if (should_update) {
-        // If check_github is true, fetch from GitHub releases
-        if (check_github) {
-          out = "=== Checking GitHub Releases ===\n\n";
+  // TLS Status (we use insecure TLS - setInsecure)
+  out += "\n=== TLS ===\n";
+  out += "Mode: INSECURE (setInsecure)\n";
+  out += "Note: For production, use certificate pinning\n";
 
-          // Get GitHub repo from env (default to timiclaw project)
-          String github_repo = GITHUB_REPO;
-          if (github_repo.length() == 0) {
-            github_repo = "timiclaw/timiclaw";  // Default
-          }
+  // Firmware integrity
+  out += "\n=== Firmware ===\n";
+  out += "Sketch Size: " + String(ESP.getSketchSize() / 1024) + " KB\n";
+  out += "Free Sketch Space: " + String(ESP.getFreeSketchSpace() / 1024) + " KB\n";
+  out += "Flash Chip Size: " + String(ESP.getFlashChipSize() / (1024 * 1024)) + " MB\n";
+  out += "CPU: " + String(ESP.getChipModel()) + " @ " + String(ESP.getCpuFreqMHz()) + " MHz\n";
 
-          out += "Repo: " + github_repo + "\n";
-          out += "Fetching latest release...\n";
-
-          // Fetch latest release from GitHub API
-          WiFiClientSecure client;
-          client.setInsecure();
-          HTTPClient http;
-
-          String api_url = "https://api.github.com/repos/" + github_repo + "/releases/latest";
-          Serial.println("[update] Fetching: " + api_url);
-
-          if (http.begin(client, api_url)) {
-            int http_code = http.GET();
-
-            if (http_code == 200) {
-              String payload = http.getString();
-
-              // Parse JSON to find the firmware.bin download URL
-              // GitHub API returns: {"tag_name":"v1.0","assets":[{"name":"firmware.bin","browser_download_url":"..."}]}
-              int tag_idx = payload.indexOf("\"tag_name\":");
-              int assets_idx = payload.indexOf("\"assets\":");
-              int name_idx = payload.indexOf("\"name\":\"firmware.bin\"", assets_idx);
-              int url_idx = payload.indexOf("\"browser_download_url\":", name_idx);
-
-              if (tag_idx > 0 && assets_idx > 0 && name_idx > 0 && url_idx > 0) {
-                // Extract version tag
-                int tag_start = payload.indexOf("\"", tag_idx + 11) + 1;
-                int tag_end = payload.indexOf("\"", tag_start);
-                String version = payload.substring(tag_start, tag_end);
-
-                // Extract download URL
-                int url_start = payload.indexOf("\"", url_idx + 23) + 1;
-                int url_end = payload.indexOf("\"", url_start);
-                String download_url = payload.substring(url_start, url_end);
-
-                out += "\nLatest Release: " + version + "\n";
-                out += "Download URL: " + download_url + "\n";
-                out += "\nStarting update...\n";
-
-                Serial.println("[update] Latest: " + version + " from " + download_url);
-
-                // Perform update
-                t_httpUpdate_return ret = httpUpdate.update(client, download_url);
-
-                switch (ret) {
-                  case HTTP_UPDATE_FAILED:
-                    Serial.println("[update] Failed: " + String(httpUpdate.getLastError()));
-                    out = "\nERR: Update failed\n" + httpUpdate.getLastErrorString();
-                    break;
-                  case HTTP_UPDATE_NO_UPDATES:
-                    Serial.println("[update] No updates available");
-                    out = "\nERR: No updates available";
-                    break;
-                  case HTTP_UPDATE_OK:
-                    Serial.println("[update] Success! Restarting...");
-                    out = "\nOK: Updated to " + version + "! Restarting...";
-                    break;
-                }
-                http.end();
-                return true;
-              } else {
-                out += "\nERR: No firmware.bin found in release assets\n";
-                out += "Please upload firmware.bin to GitHub Releases";
-                http.end();
-                return true;
-              }
-            } else {
-              out += "\nERR: GitHub API HTTP " + String(http_code) + "\n";
-              out += "Check that GITHUB_REPO is set correctly";
-              http.end();
-              return true;
-            }
-          } else {
-            out = "\nERR: Could not connect to GitHub API";
-            return true;
-          }
-        }
-        // If URL was provided, trigger update
-        else if (url.length() > 0) {
-          out = "=== Firmware Update ===\n\n";
-          out += "URL: " + url + "\n";
-          out += "Downloading and flashing...\n";
-          out += "(ESP32 will restart after update)\n";
-
-          Serial.println("[update] Starting update from: " + url);
-
-          WiFiClientSecure client;
-          client.setInsecure();
-
-          t_httpUpdate_return ret = httpUpdate.update(client, url);
-
-          switch (ret) {
-            case HTTP_UPDATE_FAILED:
-              Serial.println("[update] Failed: " + String(httpUpdate.getLastError()) + " - " + httpUpdate.getLastErrorString());
-              out = "ERR: Update failed\n" + httpUpdate.getLastErrorString();
-              break;
-            case HTTP_UPDATE_NO_UPDATES:
-              Serial.println("[update] No updates available");
-              out = "ERR: No updates available";
-              break;
-            case HTTP_UPDATE_OK:
-              Serial.println("[update] Success! Restarting...");
-              out = "OK: Update complete! Restarting...";
-              break;
-          }
-          return true;
-        } else {
-          // No URL provided, show update info (like plain /update command)
-          cmd = "update";  // Fall through to exact command handler
-        }
-      }
-    }
-    // If LLM parsing fails or doesn't detect update intent, fall through to normal command processing
+  // Recent activity hint
+  out += "\n=== Recommendations ===\n";
+  if (!is_safe_mode_enabled()) {
+    out += "⚠️ Enable safe_mode to block risky GPIO actions\n";
   }
+  out += "✅ Chat ID restriction active\n";
+  out += "⚠️ Consider using HTTPS/TLS certificates for production\n";
 
-  // Update command - show firmware info or trigger OTA update from URL
-  if (cmd_lc == "update") {
-    // Check if user wants latest from GitHub (check original input for keywords)
-    String input_lc = input;
-    input_lc.toLowerCase();
-    bool wants_latest = (input_lc.indexOf("latest") >= 0 || input_lc.indexOf("newest") >= 0 ||
-                        input_lc.indexOf("github") >= 0 || input_lc.indexOf("to version") >= 0);
+  return true;
+}
 
-    if (wants_latest) {
-      // User wants to check GitHub for latest release
-      out = "=== Checking GitHub Releases ===\n\n";
+// Update command - show firmware info or trigger OTA update from URL
+static bool cmd_update(const String &input, const String &cmd, const String &cmd_lc,
+                       uint32_t intents, String &out) {
+  // Check if user wants latest from GitHub (check original input for keywords)
+  String input_lc = input;
+  input_lc.toLowerCase();
+  bool wants_latest = (input_lc.indexOf("latest") >= 0 || input_lc.indexOf("newest") >= 0 ||
+                      input_lc.indexOf("github") >= 0 || input_lc.indexOf("to version") >= 0);
 
-      String github_repo = GITHUB_REPO;
-      if (github_repo.length() == 0) {
-        github_repo = "timiclaw/timiclaw";
-      }
+  if (wants_latest) {
+    // User wants to check GitHub for latest release
+    out = "=== Checking GitHub Releases ===\n\n";
 
-      out += "Repo: " + github_repo + "\n";
-      out += "Fetching latest release...\n";
+    String github_repo = GITHUB_REPO;
+    if (github_repo.length() == 0) {
+      github_repo = "timiclaw/timiclaw";
+    }
 
-      // Fetch latest release from GitHub API
-      WiFiClientSecure client;
-      client.setInsecure();
-      HTTPClient http;
+    out += "Repo: " + github_repo + "\n";
+    out += "Fetching latest release...\n";
 
-      String api_url = "https://api.github.com/repos/" + github_repo + "/releases/latest";
-      Serial.println("[update] Fetching: " + api_url);
+    // Fetch latest release from GitHub API
+    TlsSessionClient client;
+    client.setInsecure();
+    HTTPClient http;
 
-      if (http.begin(client, api_url)) {
-        int http_code = http.GET();
+    String api_url = "https://api.github.com/repos/" + github_repo + "/releases/latest";
+    Serial.println("[update] Fetching: " + api_url);
 
-        if (http_code == 200) {
-          String payload = http.getString();
+    if (http.begin(client, api_url)) {
+      int http_code = http.GET();
 
-          // Parse JSON to find version and download URL
-          int tag_idx = payload.indexOf("\"tag_name\":");
-          int assets_idx = payload.indexOf("\"assets\":");
-          int name_idx = payload.indexOf("\"name\":\"firmware.bin\"", assets_idx);
-          int url_idx = payload.indexOf("\"browser_download_url\":", name_idx);
+      if (http_code == 200) {
+        String payload = http.getString();
 
-          if (tag_idx > 0 && assets_idx > 0 && name_idx > 0 && url_idx > 0) {
-            // Extract version tag
-            int tag_start = payload.indexOf("\"", tag_idx + 11) + 1;
-            int tag_end = payload.indexOf("\"", tag_start);
-            String version = payload.substring(tag_start, tag_end);
+        // Parse JSON to find version and download URL
+        int tag_idx = payload.indexOf("\"tag_name\":");
+        int assets_idx = payload.indexOf("\"assets\":");
+        int name_idx = payload.indexOf("\"name\":\"firmware.bin\"", assets_idx);
+        int url_idx = payload.indexOf("\"browser_download_url\":", name_idx);
 
-            // Extract download URL
-            int url_start = payload.indexOf("\"", url_idx + 23) + 1;
-            int url_end = payload.indexOf("\"", url_start);
-            String download_url = payload.substring(url_start, url_end);
+        if (tag_idx > 0 && assets_idx > 0 && name_idx > 0 && url_idx > 0) {
+          // Extract version tag
+          int tag_start = payload.indexOf("\"", tag_idx + 11) + 1;
+          int tag_end = payload.indexOf("\"", tag_start);
+          String version = payload.substring(tag_start, tag_end);
 
-            // Store pending update for "yes" confirmation
-            s_pending_update.available = true;
-            s_pending_update.version = version;
-            s_pending_update.download_url = download_url;
-            s_pending_update.notified_ms = millis();
+          // Extract download URL
+          int url_start = payload.indexOf("\"", url_idx + 23) + 1;
+          int url_end = payload.indexOf("\"", url_start);
+          String download_url = payload.substring(url_start, url_end);
 
-            out += "\nLatest Release: " + version + "\n";
-            out += "Reply **yes** to update now\n";
-            out += "(ESP32 will restart after update)";
+          // Store pending update for "yes" confirmation
+          set_pending_update(version, download_url);
 
-            Serial.println("[update] Latest: " + version + " from " + download_url);
-            http.end();
-            return true;
-          } else {
-            out += "\nNo firmware.bin found in release\n";
-            out += "Please upload firmware.bin to GitHub Releases";
-            http.end();
-            return true;
-          }
+          out += "\nLatest Release: " + version + "\n";
+          out += "Reply **yes** to update now\n";
+          out += "(ESP32 will restart after update)";
+
+          Serial.println("[update] Latest: " + version + " from " + download_url);
+          http.end();
+          return true;
         } else {
-          out += "\nGitHub API HTTP " + String(http_code) + "\n";
-          out += "Check that GITHUB_REPO is set correctly";
+          out += "\nNo firmware.bin found in release\n";
+          out += "Please upload firmware.bin to GitHub Releases";
           http.end();
           return true;
         }
       } else {
-        out = "\nCould not connect to GitHub API";
+        out += "\nGitHub API HTTP " + String(http_code) + "\n";
+        out += "Check that GITHUB_REPO is set correctly";
+        http.end();
         return true;
       }
+    } else {
+      out = "\nCould not connect to GitHub API";
+      return true;
+    }
+  }
+
+  // Show firmware info
+  out = "=== Firmware Update ===\n\n";
+  out += "Current Firmware:\n";
+  out += "Sketch Size: " + String(ESP.getSketchSize() / 1024) + " KB\n";
+  out += "Free Space: " + String(ESP.getFreeSketchSpace() / 1024) + " KB\n";
+  out += "Flash Chip: " + String(ESP.getFlashChipSize() / (1024 * 1024)) + " MB\n";
+  out += "CPU: " + String(ESP.getChipModel()) + " @ " + String(ESP.getCpuFreqMHz()) + " MHz\n";
+  out += "SDK Version: " + String(ESP.getSdkVersion()) + "\n";
+
+  // Check for URL parameter
+  int space_idx = cmd.indexOf(' ');
+  if (space_idx > 0) {
+    String url = cmd.substring(space_idx + 1);
+    url.trim();
+
+    if (url.length() > 0) {
+      out += "\n=== Starting Update ===\n";
+      out += "URL: " + url + "\n";
+      out += "Downloading and flashing...\n";
+      out += "(ESP32 will restart after update)\n";
+
+      // Send status message first
+      String status_msg = out;
+
+      // Perform the update (this will restart ESP32 on success)
+      Serial.println("[update] Starting update from: " + url);
+
+      TlsSessionClient client;
+      client.setInsecure();  // For HTTPS URLs
+
+      t_httpUpdate_return ret = httpUpdate.update(client, url);
+
+      switch (ret) {
+        case HTTP_UPDATE_FAILED:
+          Serial.println("[update] Failed: " + String(httpUpdate.getLastError()) + " - " + httpUpdate.getLastErrorString());
+          out = status_msg + "\n\nERR: Update failed\n" + httpUpdate.getLastErrorString();
+          break;
+        case HTTP_UPDATE_NO_UPDATES:
+          Serial.println("[update] No updates available");
+          out = status_msg + "\n\nERR: No updates available";
+          break;
+        case HTTP_UPDATE_OK:
+          Serial.println("[update] Success! Restarting...");
+          out = status_msg + "\n\nOK: Update complete! Restarting...";
+          break;
+      }
+      return true;
     }
+  }
 
-    // Show firmware info
-    out = "=== Firmware Update ===\n\n";
-    out += "Current Firmware:\n";
-    out += "Sketch Size: " + String(ESP.getSketchSize() / 1024) + " KB\n";
-    out += "Free Space: " + String(ESP.getFreeSketchSpace() / 1024) + " KB\n";
-    out += "Flash Chip: " + String(ESP.getFlashChipSize() / (1024 * 1024)) + " MB\n";
-    out += "CPU: " + String(ESP.getChipModel()) + " @ " + String(ESP.getCpuFreqMHz()) + " MHz\n";
-    out += "SDK Version: " + String(ESP.getSdkVersion()) + "\n";
+  // No URL provided, show instructions
+  out += "\n=== How to Update ===\n";
+  out += "\nOption 1: OTA from Computer\n";
+  out += "1. Build firmware: pio run\n";
+  out += "2. Flash via OTA: pio run -t upload --upload-port espota --upload-port " + WiFi.localIP().toString() + "\n";
 
-    // Check for URL parameter
-    int space_idx = cmd.indexOf(' ');
-    if (space_idx > 0) {
-      String url = cmd.substring(space_idx + 1);
-      url.trim();
+  out += "\nOption 2: Self-Update from URL\n";
+  out += "Usage: update <firmware_url>\n";
+  out += "Example: update https://github.com/user/timiclaw/releases/download/v1.0/firmware.bin\n";
+  out += "\nNote: For self-update, host your firmware.bin on GitHub Releases or a web server.";
 
-      if (url.length() > 0) {
-        out += "\n=== Starting Update ===\n";
-        out += "URL: " + url + "\n";
-        out += "Downloading and flashing...\n";
-        out += "(ESP32 will restart after update)\n";
+  return true;
+}
 
-        // Send status message first
-        String status_msg = out;
+static bool cmd_logs(const String &input, const String &cmd, const String &cmd_lc,
+                     uint32_t intents, String &out) {
+  event_log_dump(out, 1400);
+  return true;
+}
 
-        // Perform the update (this will restart ESP32 on success)
-        Serial.println("[update] Starting update from: " + url);
+static bool cmd_logs_clear(const String &input, const String &cmd, const String &cmd_lc,
+                           uint32_t intents, String &out) {
+  event_log_clear();
+  out = "OK: logs cleared";
+  return true;
+}
 
-        WiFiClientSecure client;
-        client.setInsecure();  // For HTTPS URLs
+// Web search command (Serper > Tavily fallback + summary)
+static bool cmd_search(const String &input, const String &cmd, const String &cmd_lc,
+                       uint32_t intents, String &out) {
+  String query;
+  if (cmd_lc.startsWith("search ")) {
+    query = cmd.substring(7);
+  }
+  query.trim();
 
-        t_httpUpdate_return ret = httpUpdate.update(client, url);
+  if (query.length() == 0) {
+    out = "ERR: usage search <query>\nExample: search ESP32 programming tips";
+    return true;
+  }
 
-        switch (ret) {
-          case HTTP_UPDATE_FAILED:
-            Serial.println("[update] Failed: " + String(httpUpdate.getLastError()) + " - " + httpUpdate.getLastErrorString());
-            out = status_msg + "\n\nERR: Update failed\n" + httpUpdate.getLastErrorString();
-            break;
-          case HTTP_UPDATE_NO_UPDATES:
-            Serial.println("[update] No updates available");
-            out = status_msg + "\n\nERR: No updates available";
-            break;
-          case HTTP_UPDATE_OK:
-            Serial.println("[update] Success! Restarting...");
-            out = status_msg + "\n\nOK: Update complete! Restarting...";
-            break;
-        }
-        return true;
-      }
-    }
+  return tool_web_search(query, out);
+}
 
-    // No URL provided, show instructions
-    out += "\n=== How to Update ===\n";
-    out += "\nOption 1: OTA from Computer\n";
-    out += "1. Build firmware: pio run\n";
-    out += "2. Flash via OTA: pio run -t upload --upload-port espota --upload-port " + WiFi.localIP().toString() + "\n";
+#if ENABLE_VOICE
+// Voice capture commands - continuous streaming to Serial
+static bool cmd_voice_start(const String &input, const String &cmd, const String &cmd_lc,
+                            uint32_t intents, String &out) {
+  if (voice_start_streaming()) {
+    out = "🎤 Voice streaming STARTED!\n\n";
+    out += "Audio is now streaming to Serial as binary PCM.\n";
+    out += "Connect to COM port and capture using Python.\n";
+    out += "Use /voice_stop to end streaming.";
+  } else {
+    out = "ERR: Already streaming";
+  }
+  return true;
+}
 
-    out += "\nOption 2: Self-Update from URL\n";
-    out += "Usage: update <firmware_url>\n";
-    out += "Example: update https://github.com/user/timiclaw/releases/download/v1.0/firmware.bin\n";
-    out += "\nNote: For self-update, host your firmware.bin on GitHub Releases or a web server.";
+static bool cmd_voice_stop(const String &input, const String &cmd, const String &cmd_lc,
+                           uint32_t intents, String &out) {
+  voice_stop_streaming();
+  out = "🎤 Voice streaming STOPPED";
+  return true;
+}
 
-    return true;
+static bool cmd_voice_status(const String &input, const String &cmd, const String &cmd_lc,
+                             uint32_t intents, String &out) {
+  if (voice_is_streaming()) {
+    out = "🎤 Currently streaming audio to Serial...";
+  } else {
+    out = "🎤 Voice idle (not streaming)";
   }
+  return true;
+}
+
+#endif
+static bool cmd_time_show(const String &input, const String &cmd, const String &cmd_lc,
+                          uint32_t intents, String &out) {
+  scheduler_time_debug(out);
+  return true;
+}
+
+static bool cmd_safe_mode(const String &input, const String &cmd, const String &cmd_lc,
+                          uint32_t intents, String &out) {
+  out = String("Safe mode: ") + (is_safe_mode_enabled() ? "ON" : "OFF");
+  return true;
+}
 
-  if (cmd_lc == "logs") {
-    event_log_dump(out, 1400);
+static bool cmd_safe_mode_on(const String &input, const String &cmd, const String &cmd_lc,
+                             uint32_t intents, String &out) {
+  String err;
+  if (!persona_set_safe_mode(true, err)) {
+    out = "ERR: " + err;
     return true;
   }
+  clear_pending();
+  out = "OK: safe mode ON (risky actions blocked)";
+  return true;
+}
 
-  if (cmd_lc == "logs_clear") {
-    event_log_clear();
-    out = "OK: logs cleared";
+static bool cmd_safe_mode_off(const String &input, const String &cmd, const String &cmd_lc,
+                              uint32_t intents, String &out) {
+  String err;
+  if (!persona_set_safe_mode(false, err)) {
+    out = "ERR: " + err;
     return true;
   }
+  out = "OK: safe mode OFF";
+  return true;
+}
 
-  // Web search command (Serper > Tavily fallback + summary)
-  if (cmd_lc == "search" || cmd_lc.startsWith("search ")) {
-    String query;
-    if (cmd_lc.startsWith("search ")) {
-      query = cmd.substring(7);
-    }
-    query.trim();
-
-    if (query.length() == 0) {
-      out = "ERR: usage search <query>\nExample: search ESP32 programming tips";
-      return true;
-    }
-
-    return tool_web_search(query, out);
+#if ENABLE_TASKS
+static bool cmd_task_list(const String &input, const String &cmd, const String &cmd_lc,
+                          uint32_t intents, String &out) {
+  String err;
+  if (!task_list(out, err)) {
+    out = "ERR: " + err;
   }
+  return true;
+}
 
-#if ENABLE_VOICE
-  // Voice capture commands - continuous streaming to Serial
-  if (cmd_lc == "voice_start" || cmd_lc == "voice_stream") {
-    if (voice_start_streaming()) {
-      out = "🎤 Voice streaming STARTED!\n\n";
-      out += "Audio is now streaming to Serial as binary PCM.\n";
-      out += "Connect to COM port and capture using Python.\n";
-      out += "Use /voice_stop to end streaming.";
-    } else {
-      out = "ERR: Already streaming";
-    }
+static bool cmd_task_clear(const String &input, const String &cmd, const String &cmd_lc,
+                           uint32_t intents, String &out) {
+  String err;
+  if (!task_clear(err)) {
+    out = "ERR: " + err;
     return true;
   }
+  out = "OK: tasks cleared";
+  return true;
+}
 
-  if (cmd_lc == "voice_stop" || cmd_lc == "voice_stop") {
-    voice_stop_streaming();
-    out = "🎤 Voice streaming STOPPED";
+static bool cmd_task_add(const String &input, const String &cmd, const String &cmd_lc,
+                         uint32_t intents, String &out) {
+  String text = cmd.length() > 8 ? cmd.substring(8) : "";
+  text.trim();
+  if (text.length() == 0) {
+    out = "ERR: usage task_add <text>";
+    return true;
+  }
+  int task_id = 0;
+  String err;
+  if (!task_add(text, task_id, err)) {
+    out = "ERR: " + err;
     return true;
   }
+  out = "OK: task #" + String(task_id) + " added";
+  return true;
+}
 
-  if (cmd_lc == "voice_status" || cmd_lc == "voice_status") {
-    if (voice_is_streaming()) {
-      out = "🎤 Currently streaming audio to Serial...";
-    } else {
-      out = "🎤 Voice idle (not streaming)";
-    }
+static bool cmd_task_done(const String &input, const String &cmd, const String &cmd_lc,
+                          uint32_t intents, String &out) {
+  String tail = cmd.length() > 9 ? cmd.substring(9) : "";
+  tail.trim();
+  int id = -1;
+  if (!parse_one_int(tail, "%d", &id) || id <= 0) {
+    out = "ERR: usage task_done <id>";
+    return true;
+  }
+  String err;
+  if (!task_done(id, err)) {
+    out = "ERR: " + err;
     return true;
   }
+  out = "OK: task #" + String(id) + " done";
+  return true;
+}
+
 #endif
+#if ENABLE_EMAIL
+static bool cmd_email_show(const String &input, const String &cmd, const String &cmd_lc,
+                           uint32_t intents, String &out) {
+  String to;
+  String subject;
+  String body;
+  String err;
+  if (!persona_get_email_draft(to, subject, body, err)) {
+    out = "ERR: " + err;
+    return true;
+  }
+  to.trim();
+  subject.trim();
+  body.trim();
+  if (to.length() == 0 && subject.length() == 0 && body.length() == 0) {
+    out = "Email draft is empty";
+    return true;
+  }
+  out = "Email draft:\nTo: " + to + "\nSubject: " + subject + "\nBody:\n" + body;
+  if (out.length() > 1400) {
+    out = out.substring(0, 1400) + "...";
+  }
+  return true;
+}
 
-  if (cmd_lc == "time_show" || cmd_lc == "clock" || cmd_lc == "time") {
-    scheduler_time_debug(out);
+static bool cmd_email_clear(const String &input, const String &cmd, const String &cmd_lc,
+                            uint32_t intents, String &out) {
+  String err;
+  if (!persona_clear_email_draft(err)) {
+    out = "ERR: " + err;
     return true;
   }
+  out = "OK: email draft cleared";
+  return true;
+}
 
-  if (cmd_lc == "safe_mode") {
-    out = String("Safe mode: ") + (is_safe_mode_enabled() ? "ON" : "OFF");
+static bool cmd_email_draft(const String &input, const String &cmd, const String &cmd_lc,
+                            uint32_t intents, String &out) {
+  String tail = cmd.length() > 11 ? cmd.substring(11) : "";
+  tail.trim();
+  int p1 = tail.indexOf('|');
+  int p2 = p1 >= 0 ? tail.indexOf('|', p1 + 1) : -1;
+  if (p1 <= 0 || p2 <= p1) {
+    out = "ERR: usage email_draft <to>|<subject>|<body>";
     return true;
   }
 
-  if (cmd_lc == "safe_mode_on") {
-    String err;
-    if (!persona_set_safe_mode(true, err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-    clear_pending();
-    out = "OK: safe mode ON (risky actions blocked)";
+  String to = tail.substring(0, p1);
+  String subject = tail.substring(p1 + 1, p2);
+  String body = tail.substring(p2 + 1);
+  to.trim();
+  subject.trim();
+  body.trim();
+
+  if (to.length() == 0 || subject.length() == 0 || body.length() == 0) {
+    out = "ERR: usage email_draft <to>|<subject>|<body>";
     return true;
   }
 
-  if (cmd_lc == "safe_mode_off") {
-    String err;
-    if (!persona_set_safe_mode(false, err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-    out = "OK: safe mode OFF";
+  String err;
+  if (!persona_set_email_draft(to, subject, body, err)) {
+    out = "ERR: " + err;
     return true;
   }
+  out = "OK: email draft saved (draft only, not sent)";
+  return true;
+}
 
-#if ENABLE_TASKS
-  if (cmd_lc == "task_list") {
-    String err;
-    if (!task_list(out, err)) {
-      out = "ERR: " + err;
-    }
+#endif
+static bool cmd_timezone_show(const String &input, const String &cmd, const String &cmd_lc,
+                              uint32_t intents, String &out) {
+  String tz;
+  String err;
+  if (!persona_get_timezone(tz, err)) {
+    out = "ERR: " + err;
     return true;
   }
+  tz.trim();
+  if (tz.length() == 0) {
+    out = "Timezone not set. Using default: " + String(TIMEZONE_TZ) +
+          "\nSet with: timezone_set <Area/City>";
+    return true;
+  }
+  out = "Timezone: " + tz;
+  return true;
+}
 
-  if (cmd_lc == "task_clear") {
-    String err;
-    if (!task_clear(err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-    out = "OK: tasks cleared";
+static bool cmd_timezone_clear(const String &input, const String &cmd, const String &cmd_lc,
+                               uint32_t intents, String &out) {
+  String err;
+  if (!persona_clear_timezone(err)) {
+    out = "ERR: " + err;
     return true;
   }
+  out = "OK: timezone cleared. Using default " + String(TIMEZONE_TZ);
+  return true;
+}
 
-  if (cmd_lc == "task_add" || cmd_lc.startsWith("task_add ")) {
-    String text = cmd.length() > 8 ? cmd.substring(8) : "";
-    text.trim();
-    if (text.length() == 0) {
-      out = "ERR: usage task_add <text>";
-      return true;
-    }
-    int task_id = 0;
-    String err;
-    if (!task_add(text, task_id, err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-    out = "OK: task #" + String(task_id) + " added";
+static bool cmd_timezone_set(const String &input, const String &cmd, const String &cmd_lc,
+                             uint32_t intents, String &out) {
+  String tz = cmd.length() > 12 ? cmd.substring(12) : "";
+  tz.trim();
+  if (!is_valid_timezone_string(tz)) {
+    out = "ERR: usage timezone_set <Area/City or UTC offset>\n"
+          "Example: timezone_set Asia/Kolkata";
     return true;
   }
 
-  if (cmd_lc == "task_done" || cmd_lc.startsWith("task_done ")) {
-    String tail = cmd.length() > 9 ? cmd.substring(9) : "";
-    tail.trim();
-    int id = -1;
-    if (!parse_one_int(tail, "%d", &id) || id <= 0) {
-      out = "ERR: usage task_done <id>";
-      return true;
-    }
-    String err;
-    if (!task_done(id, err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-    out = "OK: task #" + String(id) + " done";
+  String err;
+  if (!persona_set_timezone(tz, err)) {
+    out = "ERR: " + err;
     return true;
   }
-#endif
 
-#if ENABLE_EMAIL
-  if (cmd_lc == "email_show") {
-    String to;
-    String subject;
-    String body;
-    String err;
-    if (!persona_get_email_draft(to, subject, body, err)) {
+  PendingReminderTzDraft draft;
+  if (take_pending_reminder_tz(draft)) {
+    if (!persona_set_daily_reminder(draft.hhmm, draft.message, err)) {
       out = "ERR: " + err;
       return true;
     }
-    to.trim();
-    subject.trim();
-    body.trim();
-    if (to.length() == 0 && subject.length() == 0 && body.length() == 0) {
-      out = "Email draft is empty";
-      return true;
-    }
-    out = "Email draft:\nTo: " + to + "\nSubject: " + subject + "\nBody:\n" + body;
-    if (out.length() > 1400) {
-      out = out.substring(0, 1400) + "...";
+    if (is_webjob_message(draft.message)) {
+      event_log_append("WEBJOB set daily " + draft.hhmm);
+    } else {
+      event_log_append("REMINDER set daily " + draft.hhmm);
     }
+    String msg_for_user = reminder_message_for_user(draft.message);
+    out = "OK: timezone set to " + tz + "\nOK: daily reminder set at " + draft.hhmm +
+          "\nMessage: " + msg_for_user + unsynced_time_warning();
     return true;
   }
 
-  if (cmd_lc == "email_clear") {
-    String err;
-    if (!persona_clear_email_draft(err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-    out = "OK: email draft cleared";
+  out = "OK: timezone set to " + tz;
+  return true;
+}
+
+static bool cmd_reminder_set_daily(const String &input, const String &cmd, const String &cmd_lc,
+                                   uint32_t intents, String &out) {
+  int first_space = cmd.indexOf(' ');
+  String tail = first_space >= 0 ? cmd.substring(first_space + 1) : "";
+  tail.trim();
+  int sp = tail.indexOf(' ');
+  if (sp <= 0) {
+    out = "ERR: usage reminder_set_daily <HH:MM> <message>";
     return true;
   }
 
-  if (cmd_lc == "email_draft" || cmd_lc.startsWith("email_draft ")) {
-    String tail = cmd.length() > 11 ? cmd.substring(11) : "";
-    tail.trim();
-    int p1 = tail.indexOf('|');
-    int p2 = p1 >= 0 ? tail.indexOf('|', p1 + 1) : -1;
-    if (p1 <= 0 || p2 <= p1) {
-      out = "ERR: usage email_draft <to>|<subject>|<body>";
-      return true;
-    }
+  String hhmm = tail.substring(0, sp);
+  String message = tail.substring(sp + 1);
+  hhmm.trim();
+  message.trim();
+  if (!is_valid_hhmm(hhmm) || message.length() == 0) {
+    out = "ERR: usage reminder_set_daily <HH:MM> <message>";
+    return true;
+  }
 
-    String to = tail.substring(0, p1);
-    String subject = tail.substring(p1 + 1, p2);
-    String body = tail.substring(p2 + 1);
-    to.trim();
-    subject.trim();
-    body.trim();
+  if (!has_user_timezone()) {
+    set_pending_reminder_tz(hhmm, message);
+    out = "Before I set that reminder, tell me your timezone.\n"
+          "Reply: timezone_set Asia/Kolkata";
+    return true;
+  }
 
-    if (to.length() == 0 || subject.length() == 0 || body.length() == 0) {
-      out = "ERR: usage email_draft <to>|<subject>|<body>";
-      return true;
-    }
+  String err;
+  if (!persona_set_daily_reminder(hhmm, message, err)) {
+    out = "ERR: " + err;
+    return true;
+  }
+  event_log_append("REMINDER set daily " + hhmm);
+  out = "OK: daily reminder set at " + hhmm + "\nMessage: " + reminder_message_for_user(message) +
+        unsynced_time_warning();
+  return true;
+}
 
-    String err;
-    if (!persona_set_email_draft(to, subject, body, err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-    out = "OK: email draft saved (draft only, not sent)";
+static bool cmd_reminder_show(const String &input, const String &cmd, const String &cmd_lc,
+                              uint32_t intents, String &out) {
+  String hhmm;
+  String msg;
+  String err;
+  if (!persona_get_daily_reminder(hhmm, msg, err)) {
+    out = "ERR: " + err;
     return true;
   }
-#endif
+  hhmm.trim();
+  msg.trim();
+  if (hhmm.length() == 0 || msg.length() == 0 || is_webjob_message(msg)) {
+    out = "Daily reminder is empty";
+    return true;
+  }
+  out = "Daily reminder at " + hhmm + "\nMessage: " + msg;
+  return true;
+}
 
-  if (cmd_lc == "time" || cmd_lc == "time_show") {
-    scheduler_time_debug(out);
+static bool cmd_reminder_clear(const String &input, const String &cmd, const String &cmd_lc,
+                               uint32_t intents, String &out) {
+  String hhmm;
+  String msg;
+  String err;
+  if (!persona_get_daily_reminder(hhmm, msg, err)) {
+    out = "ERR: " + err;
+    return true;
+  }
+  hhmm.trim();
+  msg.trim();
+  if (hhmm.length() == 0 || msg.length() == 0 || is_webjob_message(msg)) {
+    out = "Daily reminder is empty";
+    return true;
+  }
+  if (!persona_clear_daily_reminder(err)) {
+    out = "ERR: " + err;
     return true;
   }
+  out = "OK: daily reminder cleared";
+  return true;
+}
 
-  if (cmd_lc == "timezone_show") {
-    String tz;
-    String err;
-    if (!persona_get_timezone(tz, err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-    tz.trim();
-    if (tz.length() == 0) {
-      out = "Timezone not set. Using default: " + String(TIMEZONE_TZ) +
-            "\nSet with: timezone_set <Area/City>";
-      return true;
-    }
-    out = "Timezone: " + tz;
+static bool cmd_reminder_run(const String &input, const String &cmd, const String &cmd_lc,
+                             uint32_t intents, String &out) {
+  String hhmm;
+  String msg;
+  String err;
+  if (!persona_get_daily_reminder(hhmm, msg, err)) {
+    out = "ERR: " + err;
+    return true;
+  }
+  hhmm.trim();
+  msg.trim();
+  if (hhmm.length() == 0 || msg.length() == 0) {
+    out = "Daily reminder is empty";
     return true;
   }
+  if (is_webjob_message(msg)) {
+    return run_webjob_now_task(webjob_task_from_message(msg), out);
+  }
+  out = "Reminder: " + reminder_message_for_user(msg);
+  return true;
+}
 
-  if (cmd_lc == "timezone_clear") {
-    String err;
-    if (!persona_clear_timezone(err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-    out = "OK: timezone cleared. Using default " + String(TIMEZONE_TZ);
+#if ENABLE_WEB_JOBS
+static bool cmd_webjob_show(const String &input, const String &cmd, const String &cmd_lc,
+                            uint32_t intents, String &out) {
+  String hhmm;
+  String msg;
+  String err;
+  if (!persona_get_daily_reminder(hhmm, msg, err)) {
+    out = "ERR: " + err;
+    return true;
+  }
+  hhmm.trim();
+  msg.trim();
+  if (hhmm.length() == 0 || msg.length() == 0 || !is_webjob_message(msg)) {
+    out = "Daily web job is empty";
     return true;
   }
+  out = "Daily web job " + hhmm + ":\nTask: " + webjob_task_from_message(msg);
+  return true;
+}
 
-  if (cmd_lc == "timezone_set" || cmd_lc.startsWith("timezone_set ")) {
-    String tz = cmd.length() > 12 ? cmd.substring(12) : "";
-    tz.trim();
-    if (!is_valid_timezone_string(tz)) {
-      out = "ERR: usage timezone_set <Area/City or UTC offset>\n"
-            "Example: timezone_set Asia/Kolkata";
-      return true;
-    }
+#endif
+// Cron commands
+static bool cmd_cron_add(const String &input, const String &cmd, const String &cmd_lc,
+                         uint32_t intents, String &out) {
+  String tail = cmd.length() > 8 ? cmd.substring(8) : "";
+  tail.trim();
 
-    String err;
-    if (!persona_set_timezone(tz, err)) {
-      out = "ERR: " + err;
-      return true;
-    }
+  if (tail.length() == 0) {
+    out = "ERR: usage: cron_add <minute> <hour> <day> <month> <weekday> | <command>\n"
+          "       cron_add every <seconds> | <command>\n"
+          "       cron_add at <epoch> | <command>\n"
+          "Shortcut: cron_add <HH:MM> | <command>\n"
+          "Example: cron_add 0 9 * * * | Good morning\n"
+          "Fields: minute(0-59) hour(0-23) day(1-31) month(1-12) weekday(0-6, Sun=0)\n"
+          "Use * for wildcard";
+    return true;
+  }
 
-    if (s_pending_reminder_tz.active) {
-      if (!persona_set_daily_reminder(s_pending_reminder_tz.hhmm, s_pending_reminder_tz.message, err)) {
-        out = "ERR: " + err;
-        return true;
-      }
-      if (is_webjob_message(s_pending_reminder_tz.message)) {
-        event_log_append("WEBJOB set daily " + s_pending_reminder_tz.hhmm);
-      } else {
-        event_log_append("REMINDER set daily " + s_pending_reminder_tz.hhmm);
-      }
-      String msg_for_user = reminder_message_for_user(s_pending_reminder_tz.message);
-      out = "OK: timezone set to " + tz + "\nOK: daily reminder set at " + s_pending_reminder_tz.hhmm +
-            "\nMessage: " + msg_for_user + unsynced_time_warning();
-      clear_pending_reminder_tz();
-      return true;
-    }
+  String expanded;
+  if (cron_expand_hhmm_shortcut(tail, expanded)) {
+    tail = expanded;
+  }
 
-    out = "OK: timezone set to " + tz;
+  String err;
+  if (!cron_store_add(tail, err)) {
+    out = "ERR: " + err;
     return true;
   }
 
-  if (cmd_lc == "reminder_set_daily" || cmd_lc.startsWith("reminder_set_daily ") ||
-      cmd_lc == "remider_set_daily" || cmd_lc.startsWith("remider_set_daily ") ||
-      cmd_lc == "remainder_set_daily" || cmd_lc.startsWith("remainder_set_daily ")) {
-    int first_space = cmd.indexOf(' ');
-    String tail = first_space >= 0 ? cmd.substring(first_space + 1) : "";
-    tail.trim();
-    int sp = tail.indexOf(' ');
-    if (sp <= 0) {
-      out = "ERR: usage reminder_set_daily <HH:MM> <message>";
-      return true;
-    }
-
-    String hhmm = tail.substring(0, sp);
-    String message = tail.substring(sp + 1);
-    hhmm.trim();
-    message.trim();
-    if (!is_valid_hhmm(hhmm) || message.length() == 0) {
-      out = "ERR: usage reminder_set_daily <HH:MM> <message>";
-      return true;
-    }
+  int count = cron_store_count();
+  out = "OK: cron job added\nTotal jobs: " + String(count);
+  return true;
+}
 
-    if (!has_user_timezone()) {
-      s_pending_reminder_tz.active = true;
-      s_pending_reminder_tz.hhmm = hhmm;
-      s_pending_reminder_tz.message = message;
-      s_pending_reminder_tz.expires_ms = millis() + kPendingReminderTzMs;
-      clear_pending_reminder_details();
-      out = "Before I set that reminder, tell me your timezone.\n"
-            "Reply: timezone_set Asia/Kolkata";
-      return true;
-    }
+static bool cmd_cron_list(const String &input, const String &cmd, const String &cmd_lc,
+                          uint32_t intents, String &out) {
+  CronJob jobs[CRON_MAX_JOBS];
+  int count = cron_store_get_all(jobs, CRON_MAX_JOBS);
 
-    String err;
-    if (!persona_set_daily_reminder(hhmm, message, err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-    event_log_append("REMINDER set daily " + hhmm);
-    out = "OK: daily reminder set at " + hhmm + "\nMessage: " + reminder_message_for_user(message) +
-          unsynced_time_warning();
+  if (count == 0) {
+    out = "No cron jobs configured";
     return true;
   }
 
-  if (cmd_lc == "reminder_show") {
-    String hhmm;
-    String msg;
-    String err;
-    if (!persona_get_daily_reminder(hhmm, msg, err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-    hhmm.trim();
-    msg.trim();
-    if (hhmm.length() == 0 || msg.length() == 0 || is_webjob_message(msg)) {
-      out = "Daily reminder is empty";
-      return true;
-    }
-    out = "Daily reminder at " + hhmm + "\nMessage: " + msg;
-    return true;
+  out = "Cron Jobs (" + String(count) + "):\n";
+  for (int i = 0; i < count; i++) {
+    out += String(i + 1) + ". " + cron_job_to_string(jobs[i]) + "\n";
   }
 
-  if (cmd_lc == "reminder_clear") {
-    String hhmm;
-    String msg;
+  if (cmd_lc == "cron_show") {
+    String content;
     String err;
-    if (!persona_get_daily_reminder(hhmm, msg, err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-    hhmm.trim();
-    msg.trim();
-    if (hhmm.length() == 0 || msg.length() == 0 || is_webjob_message(msg)) {
-      out = "Daily reminder is empty";
-      return true;
-    }
-    if (!persona_clear_daily_reminder(err)) {
-      out = "ERR: " + err;
-      return true;
+    if (cron_store_get_content(content, err)) {
+      out += "\n--- cron store ---\n" + content;
     }
-    out = "OK: daily reminder cleared";
-    return true;
   }
 
-  if (cmd_lc == "reminder_run") {
-    String hhmm;
-    String msg;
-    String err;
-    if (!persona_get_daily_reminder(hhmm, msg, err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-    hhmm.trim();
-    msg.trim();
-    if (hhmm.length() == 0 || msg.length() == 0) {
-      out = "Daily reminder is empty";
-      return true;
-    }
-    if (is_webjob_message(msg)) {
-      return run_webjob_now_task(webjob_task_from_message(msg), out);
+  return true;
+}
+
+static bool cmd_cron_remove(const String &input, const String &cmd, const String &cmd_lc,
+                            uint32_t intents, String &out) {
+  String id = cmd.length() > 11 ? cmd.substring(11) : "";
+  id.trim();
+  if (id.length() == 0) {
+    out = "ERR: usage cron_remove <id>";
+    return true;
+  }
+  String err;
+  if (!cron_store_remove(id, err)) {
+    out = "ERR: " + err;
+    return true;
+  }
+  out = "OK: cron job removed: " + id;
+  return true;
+}
+
+static bool cmd_cron_pause(const String &input, const String &cmd, const String &cmd_lc,
+                           uint32_t intents, String &out) {
+  String id = cmd.length() > 10 ? cmd.substring(10) : "";
+  id.trim();
+  if (id.length() == 0) {
+    out = "ERR: usage cron_pause <id>";
+    return true;
+  }
+  String err;
+  if (!cron_store_set_enabled(id, false, err)) {
+    out = "ERR: " + err;
+    return true;
+  }
+  out = "OK: cron job paused: " + id;
+  return true;
+}
+
+static bool cmd_cron_resume(const String &input, const String &cmd, const String &cmd_lc,
+                            uint32_t intents, String &out) {
+  String id = cmd.length() > 11 ? cmd.substring(11) : "";
+  id.trim();
+  if (id.length() == 0) {
+    out = "ERR: usage cron_resume <id>";
+    return true;
+  }
+  String err;
+  if (!cron_store_set_enabled(id, true, err)) {
+    out = "ERR: " + err;
+    return true;
+  }
+  struct tm tm_now{};
+  if (scheduler_get_local_time(tm_now)) {
+    time_t now_epoch = time(nullptr);
+    String prime_err;
+    if (!cron_store_prime_job(id, now_epoch, prime_err)) {
+      Serial.printf("[tools] cron_resume prime failed for %s: %s\n", id.c_str(), prime_err.c_str());
     }
-    out = "Reminder: " + reminder_message_for_user(msg);
+  }
+  out = "OK: cron job resumed: " + id;
+  return true;
+}
+
+static bool cmd_cron_clear(const String &input, const String &cmd, const String &cmd_lc,
+                           uint32_t intents, String &out) {
+  String err;
+  if (!cron_store_clear(err)) {
+    out = "ERR: " + err;
     return true;
   }
+  out = "OK: all cron jobs cleared";
+  return true;
+}
 
 #if ENABLE_WEB_JOBS
-  if (cmd_lc == "webjob_show") {
-    String hhmm;
-    String msg;
-    String err;
-    if (!persona_get_daily_reminder(hhmm, msg, err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-    hhmm.trim();
-    msg.trim();
-    if (hhmm.length() == 0 || msg.length() == 0 || !is_webjob_message(msg)) {
-      out = "Daily web job is empty";
-      return true;
-    }
-    out = "Daily web job " + hhmm + ":\nTask: " + webjob_task_from_message(msg);
+static bool cmd_webjob_clear(const String &input, const String &cmd, const String &cmd_lc,
+                             uint32_t intents, String &out) {
+  String hhmm;
+  String msg;
+  String err;
+  if (!persona_get_daily_reminder(hhmm, msg, err)) {
+    out = "ERR: " + err;
     return true;
   }
-#endif
+  hhmm.trim();
+  msg.trim();
+  if (hhmm.length() == 0 || msg.length() == 0 || !is_webjob_message(msg)) {
+    out = "Daily web job is empty";
+    return true;
+  }
+  if (!persona_clear_daily_reminder(err)) {
+    out = "ERR: " + err;
+    return true;
+  }
+  out = "OK: daily web job cleared";
+  return true;
+}
 
-  // Cron commands
-  if (cmd_lc == "cron_add" || cmd_lc.startsWith("cron_add ")) {
-    String tail = cmd.length() > 8 ? cmd.substring(8) : "";
-    tail.trim();
+static bool cmd_webjob_run(const String &input, const String &cmd, const String &cmd_lc,
+                           uint32_t intents, String &out) {
+  String hhmm;
+  String msg;
+  String err;
+  if (!persona_get_daily_reminder(hhmm, msg, err)) {
+    out = "ERR: " + err;
+    return true;
+  }
+  hhmm.trim();
+  msg.trim();
+  if (hhmm.length() == 0 || msg.length() == 0 || !is_webjob_message(msg)) {
+    out = "ERR: daily web job is empty";
+    return true;
+  }
+  String task = webjob_task_from_message(msg);
+  if (task.length() == 0) {
+    out = "ERR: empty web job task";
+    return true;
+  }
+  String job_out;
+  if (!web_job_run(task, effective_timezone_for_jobs(), job_out, err)) {
+    out = "ERR: " + err;
+    return true;
+  }
+  out = "Web job now:\n" + job_out;
+  return true;
+}
 
-    if (tail.length() == 0) {
-      out = "ERR: usage: cron_add <minute> <hour> <day> <month> <weekday> | <command>\n"
-            "       cron_add every <seconds> | <command>\n"
-            "       cron_add at <epoch> | <command>\n"
-            "Shortcut: cron_add <HH:MM> | <command>\n"
-            "Example: cron_add 0 9 * * * | Good morning\n"
-            "Fields: minute(0-59) hour(0-23) day(1-31) month(1-12) weekday(0-6, Sun=0)\n"
-            "Use * for wildcard";
-      return true;
-    }
+static bool cmd_host_file(const String &input, const String &cmd, const String &cmd_lc,
+                          uint32_t intents, String &out) {
+  String tail = cmd.substring(10);
+  tail.trim();
+  int sp = tail.indexOf(' ');
+  String filename = "index.html";
+  String content = tail;
+  if (sp > 0) {
+    filename = tail.substring(0, sp);
+    content = tail.substring(sp + 1);
+  }
+  content.trim();
+  filename.trim();
+  
+  // Unescape content if needed (simple check)
+  if (content.startsWith("\"") && content.endsWith("\"")) {
+    content = content.substring(1, content.length() - 1);
+    content.replace("\\n", "\n");
+    content.replace("\\\"", "\"");
+  }
+
+  web_server_publish_file(filename, content, "text/html");
+  String ip = WiFi.localIP().toString();
+  out = "File hosted: http://" + ip + "/" + filename;
+  return true;
+}
 
-    String expanded;
-    if (cron_expand_hhmm_shortcut(tail, expanded)) {
-      tail = expanded;
-    }
+#if ENABLE_EMAIL
+static bool cmd_email_files(const String &input, const String &cmd, const String &cmd_lc,
+                            uint32_t intents, String &out) {
+  String remaining = cmd.substring(cmd.indexOf(' ') + 1);
+  remaining.trim();
 
-    String err;
-    if (!cron_store_add(tail, err)) {
-      out = "ERR: " + err;
-      return true;
-    }
+  // Parse: email_files <email> <topic>
+  int first_space = remaining.indexOf(' ');
+  if (first_space < 0) {
+    out = "ERR: usage email_files <email> <topic>";
+    return true;
+  }
+
+  String email = remaining.substring(0, first_space);
+  email.trim();
 
-    int count = cron_store_count();
-    out = "OK: cron job added\nTotal jobs: " + String(count);
+  String topic = remaining.substring(first_space + 1);
+  topic = sanitize_web_topic(topic);
+
+  if (email.length() == 0 || email.indexOf('@') < 0) {
+    out = "ERR: usage email_files <email> <topic>";
     return true;
   }
 
-  if (cmd_lc == "cron_list" || cmd_lc == "cron_show") {
-    CronJob jobs[CRON_MAX_JOBS];
-    int count = cron_store_get_all(jobs, CRON_MAX_JOBS);
+  return email_small_web_files(email, topic, out);
+}
 
-    if (count == 0) {
-      out = "No cron jobs configured";
-      return true;
-    }
+#endif
+static bool cmd_webjob_set_daily(const String &input, const String &cmd, const String &cmd_lc,
+                                 uint32_t intents, String &out) {
+  String tail = cmd.length() > 16 ? cmd.substring(16) : "";
+  tail.trim();
+  int sp = tail.indexOf(' ');
+  if (sp <= 0) {
+    out = "ERR: usage webjob_set_daily <HH:MM> <task>";
+    return true;
+  }
 
-    out = "Cron Jobs (" + String(count) + "):\n";
-    for (int i = 0; i < count; i++) {
-      out += String(i + 1) + ". " + cron_job_to_string(jobs[i]) + "\n";
-    }
+  String hhmm = tail.substring(0, sp);
+  String task = tail.substring(sp + 1);
+  hhmm.trim();
+  task.trim();
 
-    if (cmd_lc == "cron_show") {
-      String content;
-      String err;
-      if (cron_store_get_content(content, err)) {
-        out += "\n--- cron store ---\n" + content;
-      }
-    }
+  if (!is_valid_hhmm(hhmm) || task.length() == 0) {
+    out = "ERR: usage webjob_set_daily <HH:MM> <task>";
+    return true;
+  }
 
+  String encoded_msg = encode_webjob_message(task);
+  String err;
+  if (!has_user_timezone()) {
+    set_pending_reminder_tz(hhmm, encoded_msg);
+    out = "Before I set that web job, tell me your timezone.\n"
+          "Reply: timezone_set Asia/Kolkata";
     return true;
   }
 
-  if (cmd_lc == "cron_remove" || cmd_lc.startsWith("cron_remove ")) {
-    String id = cmd.length() > 11 ? cmd.substring(11) : "";
-    id.trim();
-    if (id.length() == 0) {
-      out = "ERR: usage cron_remove <id>";
-      return true;
-    }
-    String err;
-    if (!cron_store_remove(id, err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-    out = "OK: cron job removed: " + id;
+  if (!persona_set_daily_reminder(hhmm, encoded_msg, err)) {
+    out = "ERR: " + err;
     return true;
   }
+  event_log_append("WEBJOB set daily " + hhmm);
+  out = "OK: daily web job set at " + hhmm + "\nTask: " + task + unsynced_time_warning();
+  return true;
+}
 
-  if (cmd_lc == "cron_pause" || cmd_lc.startsWith("cron_pause ")) {
-    String id = cmd.length() > 10 ? cmd.substring(10) : "";
-    id.trim();
-    if (id.length() == 0) {
-      out = "ERR: usage cron_pause <id>";
-      return true;
-    }
-    String err;
-    if (!cron_store_set_enabled(id, false, err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-    out = "OK: cron job paused: " + id;
+#endif
+static bool cmd_soul_show(const String &input, const String &cmd, const String &cmd_lc,
+                          uint32_t intents, String &out) {
+  String soul, err;
+  if (!file_memory_read_soul(soul, err)) {
+    out = "ERR: " + err;
+    return true;
+  }
+  soul.trim();
+  if (soul.length() == 0) {
+    out = "🦖 SOUL.md is empty";
     return true;
   }
+  if (soul.length() > 1400) {
+    soul = soul.substring(0, 1400) + "...";
+  }
+  out = "🦖 SOUL.md:\n" + soul;
+  return true;
+}
 
-  if (cmd_lc == "cron_resume" || cmd_lc.startsWith("cron_resume ")) {
-    String id = cmd.length() > 11 ? cmd.substring(11) : "";
-    id.trim();
-    if (id.length() == 0) {
-      out = "ERR: usage cron_resume <id>";
-      return true;
-    }
-    String err;
-    if (!cron_store_set_enabled(id, true, err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-    struct tm tm_now{};
-    if (scheduler_get_local_time(tm_now)) {
-      time_t now_epoch = time(nullptr);
-      String prime_err;
-      if (!cron_store_prime_job(id, now_epoch, prime_err)) {
-        Serial.printf("[tools] cron_resume prime failed for %s: %s\n", id.c_str(), prime_err.c_str());
-      }
-    }
-    out = "OK: cron job resumed: " + id;
+static bool cmd_soul_clear(const String &input, const String &cmd, const String &cmd_lc,
+                           uint32_t intents, String &out) {
+  String err;
+  // Clear both SPIFFS SOUL.md and NVS soul
+  if (!file_memory_write_soul("", err)) {
+    out = "ERR: " + err;
     return true;
   }
+  // Also clear NVS soul to remove old gamer soul
+  String nvs_err;
+  persona_clear_soul(nvs_err);  // Ignore error since NVS might not have a soul
 
-  if (cmd_lc == "cron_clear") {
-    String err;
-    if (!cron_store_clear(err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-    out = "OK: all cron jobs cleared";
+  out = "🦖 OK: Soul cleared (both SOUL.md and old storage)";
+  return true;
+}
+
+static bool cmd_soul_set(const String &input, const String &cmd, const String &cmd_lc,
+                         uint32_t intents, String &out) {
+  String text = cmd.length() > 8 ? cmd.substring(8) : "";
+  text.trim();
+  if (text.length() == 0) {
+    out = "ERR: usage soul_set <text>";
+    return true;
+  }
+  String err;
+  if (!file_memory_write_soul(text, err)) {
+    out = "ERR: " + err;
     return true;
   }
+  out = "🦖 OK: SOUL.md updated";
+  return true;
+}
 
-#if ENABLE_WEB_JOBS
-  if (cmd_lc == "webjob_clear") {
-    String hhmm;
-    String msg;
-    String err;
-    if (!persona_get_daily_reminder(hhmm, msg, err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-    hhmm.trim();
-    msg.trim();
-    if (hhmm.length() == 0 || msg.length() == 0 || !is_webjob_message(msg)) {
-      out = "Daily web job is empty";
-      return true;
-    }
-    if (!persona_clear_daily_reminder(err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-    out = "OK: daily web job cleared";
+static bool cmd_heartbeat_show(const String &input, const String &cmd, const String &cmd_lc,
+                               uint32_t intents, String &out) {
+  String hb;
+  String err;
+  if (!persona_get_heartbeat(hb, err)) {
+    out = "ERR: " + err;
     return true;
   }
-#endif
+  hb.trim();
+  if (hb.length() == 0) {
+    out = "Heartbeat is empty";
+    return true;
+  }
+  if (hb.length() > 1400) {
+    hb = hb.substring(0, 1400);
+  }
+  out = "HEARTBEAT:\n" + hb;
+  return true;
+}
 
-#if ENABLE_WEB_JOBS
-  if (cmd_lc == "webjob_run") {
-    String hhmm;
-    String msg;
-    String err;
-    if (!persona_get_daily_reminder(hhmm, msg, err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-    hhmm.trim();
-    msg.trim();
-    if (hhmm.length() == 0 || msg.length() == 0 || !is_webjob_message(msg)) {
-      out = "ERR: daily web job is empty";
-      return true;
-    }
-    String task = webjob_task_from_message(msg);
-    if (task.length() == 0) {
-      out = "ERR: empty web job task";
-      return true;
-    }
-    String job_out;
-    if (!web_job_run(task, effective_timezone_for_jobs(), job_out, err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-    out = "Web job now:\n" + job_out;
+static bool cmd_heartbeat_clear(const String &input, const String &cmd, const String &cmd_lc,
+                                uint32_t intents, String &out) {
+  String err;
+  if (!persona_clear_heartbeat(err)) {
+    out = "ERR: " + err;
     return true;
   }
+  out = "OK: heartbeat cleared";
+  return true;
+}
 
-  if (cmd_lc.startsWith("host_file ")) {
-    String tail = cmd.substring(10);
-    tail.trim();
-    int sp = tail.indexOf(' ');
-    String filename = "index.html";
-    String content = tail;
-    if (sp > 0) {
-      filename = tail.substring(0, sp);
-      content = tail.substring(sp + 1);
-    }
-    content.trim();
-    filename.trim();
-    
-    // Unescape content if needed (simple check)
-    if (content.startsWith("\"") && content.endsWith("\"")) {
-      content = content.substring(1, content.length() - 1);
-      content.replace("\\n", "\n");
-      content.replace("\\\"", "\"");
-    }
+static bool cmd_heartbeat_set(const String &input, const String &cmd, const String &cmd_lc,
+                              uint32_t intents, String &out) {
+  String text = cmd.length() > 13 ? cmd.substring(13) : "";
+  text.trim();
+  if (text.length() == 0) {
+    out = "ERR: usage heartbeat_set <text>";
+    return true;
+  }
+  String err;
+  if (!persona_set_heartbeat(text, err)) {
+    out = "ERR: " + err;
+    return true;
+  }
+  out = "OK: heartbeat updated";
+  return true;
+}
 
-    web_server_publish_file(filename, content, "text/html");
-    String ip = WiFi.localIP().toString();
-    out = "File hosted: http://" + ip + "/" + filename;
+static bool cmd_heartbeat_run(const String &input, const String &cmd, const String &cmd_lc,
+                              uint32_t intents, String &out) {
+  String hb;
+  String hb_err;
+  if (!persona_get_heartbeat(hb, hb_err)) {
+    out = "ERR: " + hb_err;
+    return true;
+  }
+  hb.trim();
+  if (hb.length() == 0) {
+    out = "ERR: heartbeat is empty";
     return true;
   }
 
-#if ENABLE_EMAIL
-  if (cmd_lc.startsWith("email_files ") || cmd_lc.startsWith("email_files  ")) {
-    String remaining = cmd.substring(cmd.indexOf(' ') + 1);
-    remaining.trim();
-
-    // Parse: email_files <email> <topic>
-    int first_space = remaining.indexOf(' ');
-    if (first_space < 0) {
-      out = "ERR: usage email_files <email> <topic>";
-      return true;
-    }
+  String reply;
+  String llm_err;
+  if (!llm_generate_heartbeat(hb, reply, llm_err)) {
+    out = "ERR: " + llm_err;
+    return true;
+  }
+  if (reply.length() > 1400) {
+    reply = reply.substring(0, 1400) + "...";
+  }
+  out = "Heartbeat:\n" + reply;
+  return true;
+}
 
-    String email = remaining.substring(0, first_space);
-    email.trim();
+static bool cmd_auto_learn_run(const String &input, const String &cmd, const String &cmd_lc,
+                               uint32_t intents, String &out) {
+  // Runs as a background job: a failure is logged, not sent to the user, and
+  // the batch is kept for the next run.
+  String err;
+  if (!auto_learn_run(out, err)) {
+    Serial.println("[auto-learn] run failed: " + err);
+    out = "";
+  }
+  return true;
+}
 
-    String topic = remaining.substring(first_space + 1);
-    topic = sanitize_web_topic(topic);
+static bool cmd_proactive_check(const String &input, const String &cmd, const String &cmd_lc,
+                                uint32_t intents, String &out) {
+  // Build context for proactive decision
+  String context = build_time_context();
 
-    if (email.length() == 0 || email.indexOf('@') < 0) {
-      out = "ERR: usage email_files <email> <topic>";
-      return true;
+  // Add user profile
+  String user_profile, user_err;
+  if (file_memory_read_user(user_profile, user_err)) {
+    user_profile.trim();
+    if (user_profile.length() > 0) {
+      if (user_profile.length() > 400) {
+        user_profile = user_profile.substring(user_profile.length() - 400);
+      }
+      context += "\n\nUser profile:\n" + user_profile;
     }
+  }
 
-    return email_small_web_files(email, topic, out);
+  // Add pending tasks
+  String tasks, task_err;
+  if (task_list(tasks, task_err)) {
+    tasks.trim();
+    if (tasks.length() > 0) {
+      if (tasks.length() > 300) {
+        tasks = tasks.substring(0, 300) + "...";
+      }
+      context += "\n\nPending tasks:\n" + tasks;
+    }
   }
-#endif
 
-  String web_files_topic;
-  if (extract_web_files_topic_from_text(cmd, web_files_topic)) {
-    return send_small_web_files(web_files_topic, out);
+  // Add recent memory
+  String memory, mem_err;
+  if (file_memory_read_long_term(memory, mem_err)) {
+    memory.trim();
+    if (memory.length() > 0) {
+      if (memory.length() > 300) {
+        memory = memory.substring(memory.length() - 300);
+      }
+      context += "\n\nRecent memory:\n" + memory;
+    }
   }
 
-  String web_query;
-  if (extract_web_query_from_text(cmd, web_query)) {
-    return run_webjob_now_task(web_query, out);
+  String reply, llm_err;
+  if (!llm_generate_proactive(context, reply, llm_err)) {
+    out = "ERR: " + llm_err;
+    return true;
   }
-#endif
 
-  if (is_natural_web_iteration_request(cmd_lc)) {
-    return run_natural_web_iteration(cmd, out);
+  if (reply.length() == 0) {
+    out = "🦖 (proactive: staying silent)";
+    return true;
   }
 
-  // HOST / SERVE / DEPLOY - publish last response as web page (always available)
-  if (cmd_lc == "host_code" || cmd_lc.startsWith("host_code ") ||
-      cmd_lc.startsWith("host ") || cmd_lc == "host" ||
-      cmd_lc.startsWith("serve ") || cmd_lc == "serve" ||
-      cmd_lc.startsWith("deploy ") || cmd_lc == "deploy" ||
-      cmd_lc.indexOf("host the") >= 0 || cmd_lc.indexOf("host this") >= 0 ||
-      cmd_lc.indexOf("host it") >= 0 || cmd_lc.indexOf("serve the") >= 0 ||
-      cmd_lc.indexOf("serve this") >= 0 || cmd_lc.indexOf("serve it") >= 0 ||
-      cmd_lc.indexOf("deploy the") >= 0 || cmd_lc.indexOf("deploy this") >= 0 ||
-      cmd_lc.indexOf("deploy it") >= 0 ||
-      (cmd_lc.indexOf("host") >= 0 && cmd_lc.indexOf("server") >= 0)) {
-    String last_resp = agent_loop_get_last_response();
-    String file_content = agent_loop_get_last_file_content();
-    String file_name = agent_loop_get_last_file_name();
-    String html_from_response;
-    const bool has_html_from_response = extract_html_from_response_text(last_resp, html_from_response);
+  if (reply.length() > 1400) {
+    reply = reply.substring(0, 1400) + "...";
+  }
+  out = reply;
+  return true;
+}
 
-    // Priority 1: Use exact file memory if available
-    if (file_content.length() > 0) {
-      if (file_name.length() == 0) file_name = "index.html";
+static bool cmd_proactive_on(const String &input, const String &cmd, const String &cmd_lc,
+                             uint32_t intents, String &out) {
+  out = "OK: proactive agent is enabled (runs every " + String(PROACTIVE_INTERVAL_MS / 60000) + " min)";
+  return true;
+}
 
-      String file_name_lc = file_name;
-      file_name_lc.toLowerCase();
-      String content_to_host = file_content;
-      String mime = mime_from_filename(file_name);
+static bool cmd_proactive_off(const String &input, const String &cmd, const String &cmd_lc,
+                              uint32_t intents, String &out) {
+  out = "OK: proactive agent disabled. Use /proactive_on to re-enable.";
+  return true;
+}
 
-      // If the last remembered file is CSS/JS, prefer the HTML from last response.
-      if ((file_name_lc.endsWith(".js") || file_name_lc.endsWith(".css")) && has_html_from_response) {
-        file_name = "index.html";
-        content_to_host = html_from_response;
-        mime = "text/html";
-      }
+static bool cmd_profile(const String &input, const String &cmd, const String &cmd_lc,
+                        uint32_t intents, String &out) {
+  String user_profile, user_err;
+  if (!file_memory_read_user(user_profile, user_err)) {
+    out = "ERR: " + user_err;
+    return true;
+  }
+  user_profile.trim();
+  if (user_profile.length() == 0) {
+    out = "🦖 I don't know much about you yet! Tell me your name or interests.";
+  } else {
+    out = "👤 **User Profile (what I know about you):**\n" + user_profile;
+  }
+  return true;
+}
 
-      // If filename is not a web asset, default to index.html for hosting.
-      if (!file_name_lc.endsWith(".html") && !file_name_lc.endsWith(".htm") &&
-          !file_name_lc.endsWith(".js") && !file_name_lc.endsWith(".css")) {
-        file_name = "index.html";
-        mime = "text/html";
-      }
+static bool cmd_cancel(const String &input, const String &cmd, const String &cmd_lc,
+                       uint32_t intents, String &out) {
+  lock_pending();
+  if (s_pending.active) {
+    out = "OK: pending action canceled";
+  } else if (s_pending_reminder_tz.active || s_pending_reminder_details.active) {
+    out = "OK: pending reminder flow canceled";
+  } else {
+    out = "OK: no pending action";
+  }
+  clear_pending();
+  clear_pending_reminder_tz();
+  clear_pending_reminder_details();
+  unlock_pending();
+  return true;
+}
 
-      web_server_publish_file(file_name, content_to_host, mime);
-      String ip = WiFi.localIP().toString();
-      String public_path = file_name;
-      if (!public_path.startsWith("/")) {
-        public_path = "/" + public_path;
+// Handle "yes" as confirmation for firmware update
+static bool cmd_yes(const String &input, const String &cmd, const String &cmd_lc,
+                    uint32_t intents, String &out) {
+  if (pending_update_available()) {
+    return tool_registry_trigger_update(out);
+  }
+  // Fall through to confirm handler if no firmware update pending
+  return false;
+}
+
+static bool cmd_confirm(const String &input, const String &cmd, const String &cmd_lc,
+                        uint32_t intents, String &out) {
+  int user_id = -1;
+  if (cmd_lc.startsWith("confirm ") && !parse_one_int(cmd_lc.substring(8), "%d", &user_id)) {
+    out = "ERR: usage confirm [id]";
+    return true;
+  }
+
+  // Check and clear in one step so the action runs once.
+  lock_pending();
+  const PendingAction action = s_pending;
+  const bool expired = action.active && is_expired(action.expires_ms);
+  const bool id_matches = user_id < 0 || (unsigned long)user_id == action.id;
+  if (action.active && (expired || id_matches)) {
+    clear_pending();
+  }
+  unlock_pending();
+  if (!action.active) {
+    out = "ERR: no pending action";
+    return true;
+  }
+  if (expired) {
+    out = "ERR: pending action expired";
+    return true;
+  }
+  if (!id_matches) {
+    out = "ERR: confirm id mismatch";
+    return true;
+  }
+
+  const int pin = action.pin;
+  const int state = action.state;
+  const int led_count = action.led_count;
+  const PendingActionType type = action.type;
+  const unsigned long id = action.id;
+  if (is_safe_mode_enabled() &&
+      (type == PENDING_RELAY_SET || type == PENDING_LED_FLASH)) {
+    out = "ERR: safe mode ON. Disable with safe_mode_off first";
+    return true;
+  }
+  if (type == PENDING_RELAY_SET) {
+    relay_set_now(pin, state, out);
+  } else if (type == PENDING_LED_FLASH) {
+    flash_led_now(led_count, out);
+  } else {
+    out = "ERR: unknown pending action";
+    return true;
+  }
+  out += " (confirmed id=" + String(id) + ")";
+  return true;
+}
+
+#if ENABLE_GPIO
+static bool cmd_relay_set(const String &input, const String &cmd, const String &cmd_lc,
+                          uint32_t intents, String &out) {
+  if (is_safe_mode_enabled()) {
+    out = "ERR: safe mode ON. relay_set blocked";
+    return true;
+  }
+  int pin = -1;
+  int state = -1;
+  if (parse_two_ints(cmd_lc, "relay_set %d %d", &pin, &state)) {
+    if (pin >= 0 && pin <= 39 && (state == 0 || state == 1)) {
+      unsigned long busy_id = 0;
+      const unsigned long id = arm_pending(PENDING_RELAY_SET, pin, state, 0, busy_id);
+      if (id == 0) {
+        out = "ERR: pending action exists (id=" + String(busy_id) + "). confirm/cancel first";
+        return true;
       }
-      out = "Website hosted on ESP32 (from memory)!\nAccess it at: http://" + ip + public_path;
+      out = "CONFIRM relay_set pin " + String(pin) + " -> " + String(state) +
+            "\nRun: confirm " + String(id) +
+            "\nOr: cancel";
       return true;
     }
+  }
+  out = "ERR: usage relay_set <pin> <0|1>";
+  return true;
+}
 
-    if (last_resp.length() == 0) {
-      out = "No previous response to host. Ask me to create something first!";
+static bool cmd_sensor_read(const String &input, const String &cmd, const String &cmd_lc,
+                            uint32_t intents, String &out) {
+  int pin = -1;
+  if (parse_one_int(cmd_lc, "sensor_read %d", &pin)) {
+    if (pin >= 0 && pin <= 39) {
+      pinMode(pin, INPUT);
+      int v = digitalRead(pin);
+      out = "OK: sensor pin " + String(pin) + " = " + String(v);
       return true;
     }
+  }
+  out = "ERR: usage sensor_read <pin>";
+  return true;
+}
 
-    // Priority 2: Try to extract HTML from model response
-    String html_content = "";
-    extract_html_from_response_text(last_resp, html_content);
+#endif
+#if ENABLE_PLAN
+static bool cmd_plan(const String &input, const String &cmd, const String &cmd_lc,
+                     uint32_t intents, String &out) {
+  String task = cmd.length() > 4 ? cmd.substring(4) : "";
+  task.trim();
+  if (task.length() == 0) {
+    out = "ERR: usage plan <what to build>";
+    return true;
+  }
 
-    if (html_content.length() == 0) {
-      out = "Could not find HTML content in the last response. Ask me to create a website first!";
-      return true;
-    }
+  String plan_text;
+  String plan_error;
+  if (!llm_generate_plan(task, plan_text, plan_error)) {
+    out = "ERR: " + plan_error;
+    return true;
+  }
 
-    html_content.trim();
-    web_server_publish_file("index.html", html_content, "text/html");
+  if (plan_text.length() > 1400) {
+    plan_text = plan_text.substring(0, 1400) + "...";
+  }
+  out = plan_text;
+  return true;
+}
 
-    // Get IP for the URL
-    String ip = WiFi.localIP().toString();
-    out = "Website hosted on ESP32!\nAccess it at: http://" + ip + "/index.html";
+#endif
+static bool cmd_memory(const String &input, const String &cmd, const String &cmd_lc,
+                       uint32_t intents, String &out) {
+  String notes;
+  String err;
+  if (!memory_get_notes(notes, err)) {
+    out = "ERR: " + err;
     return true;
   }
+  notes.trim();
+  if (notes.length() == 0) {
+    out = "Memory is empty";
+    return true;
+  }
+  if (notes.length() > 1400) {
+    notes = notes.substring(notes.length() - 1400);
+  }
+  out = "Memory:\n" + notes;
+  return true;
+}
 
-  if (cmd_lc.indexOf("search web") >= 0 || cmd_lc.indexOf("web search") >= 0) {
-    out = "Yes. Tell me what to search.\nExample: search for cricket matches today";
+static bool cmd_forget(const String &input, const String &cmd, const String &cmd_lc,
+                       uint32_t intents, String &out) {
+  String err;
+  if (!memory_clear_notes(err)) {
+    out = "ERR: " + err;
     return true;
   }
+  out = "OK: memory cleared";
+  return true;
+}
 
-#if ENABLE_WEB_JOBS
-  if (cmd_lc == "webjob_set_daily" || cmd_lc.startsWith("webjob_set_daily ")) {
-    String tail = cmd.length() > 16 ? cmd.substring(16) : "";
-    tail.trim();
-    int sp = tail.indexOf(' ');
-    if (sp <= 0) {
-      out = "ERR: usage webjob_set_daily <HH:MM> <task>";
-      return true;
-    }
+static bool cmd_remember(const String &input, const String &cmd, const String &cmd_lc,
+                         uint32_t intents, String &out) {
+  String note = cmd.length() > 8 ? cmd.substring(8) : "";
+  note.trim();
+  if (note.length() == 0) {
+    out = "ERR: usage remember <note>";
+    return true;
+  }
+  String err;
+  if (!memory_append_note(note, err)) {
+    out = "ERR: " + err;
+    return true;
+  }
+  out = "OK: remembered";
+  return true;
+}
 
-    String hhmm = tail.substring(0, sp);
-    String task = tail.substring(sp + 1);
-    hhmm.trim();
-    task.trim();
+// File memory commands (SPIFFS-based)
+static bool cmd_file_memory(const String &input, const String &cmd, const String &cmd_lc,
+                            uint32_t intents, String &out) {
+  String info, err;
+  if (!file_memory_get_info(info, err)) {
+    out = "ERR: " + err;
+    return true;
+  }
+  out = info;
+  return true;
+}
 
-    if (!is_valid_hhmm(hhmm) || task.length() == 0) {
-      out = "ERR: usage webjob_set_daily <HH:MM> <task>";
-      return true;
-    }
+static bool cmd_memory_read(const String &input, const String &cmd, const String &cmd_lc,
+                            uint32_t intents, String &out) {
+  String content, err;
+  if (!file_memory_read_long_term(content, err)) {
+    out = "ERR: " + err;
+    return true;
+  }
+  content.trim();
+  if (content.length() == 0) {
+    out = "📚 MEMORY.md is empty";
+    return true;
+  }
+  if (content.length() > 1400) {
+    content = "...(truncated)\n" + content.substring(content.length() - 1400);
+  }
+  out = "📚 MEMORY.md:\n" + content;
+  return true;
+}
 
-    String encoded_msg = encode_webjob_message(task);
-    String err;
-    if (!has_user_timezone()) {
-      s_pending_reminder_tz.active = true;
-      s_pending_reminder_tz.hhmm = hhmm;
-      s_pending_reminder_tz.message = encoded_msg;
-      s_pending_reminder_tz.expires_ms = millis() + kPendingReminderTzMs;
-      clear_pending_reminder_details();
-      out = "Before I set that web job, tell me your timezone.\n"
-            "Reply: timezone_set Asia/Kolkata";
-      return true;
-    }
+static bool cmd_memory_write(const String &input, const String &cmd, const String &cmd_lc,
+                             uint32_t intents, String &out) {
+  String text = cmd.substring(cmd.indexOf(" ") + 1);
+  text.trim();
+  if (text.length() == 0) {
+    out = "ERR: usage memory_write <text>";
+    return true;
+  }
+  String err;
+  if (!file_memory_append_long_term(text, err)) {
+    out = "ERR: " + err;
+    return true;
+  }
+  out = "🦖 OK: Written to MEMORY.md";
+  return true;
+}
 
-    if (!persona_set_daily_reminder(hhmm, encoded_msg, err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-    event_log_append("WEBJOB set daily " + hhmm);
-    out = "OK: daily web job set at " + hhmm + "\nTask: " + task + unsynced_time_warning();
+static bool cmd_user_read(const String &input, const String &cmd, const String &cmd_lc,
+                          uint32_t intents, String &out) {
+  String user, err;
+  if (!file_memory_read_user(user, err)) {
+    out = "ERR: " + err;
+    return true;
+  }
+  user.trim();
+  if (user.length() == 0) {
+    out = "👤 USER.md is empty";
+    return true;
+  }
+  if (user.length() > 1400) {
+    user = user.substring(0, 1400) + "...";
+  }
+  out = "👤 USER.md:\n" + user;
+  return true;
+}
+
+static bool cmd_daily_note(const String &input, const String &cmd, const String &cmd_lc,
+                           uint32_t intents, String &out) {
+  String note = cmd.substring(11);
+  note.trim();
+  if (note.length() == 0) {
+    out = "ERR: usage daily_note <text>";
+    return true;
+  }
+  String err;
+  if (!file_memory_append_daily(note, err)) {
+    out = "ERR: " + err;
+    return true;
+  }
+  out = "📝 OK: Added to today's notes";
+  return true;
+}
+
+// Skill commands (lazy-loaded from SPIFFS)
+static bool cmd_skill_list(const String &input, const String &cmd, const String &cmd_lc,
+                           uint32_t intents, String &out) {
+  String list, err;
+  if (!skill_list(list, err)) {
+    out = "ERR: " + err;
+    return true;
+  }
+  out = list;
+  return true;
+}
+
+static bool cmd_skill_show(const String &input, const String &cmd, const String &cmd_lc,
+                           uint32_t intents, String &out) {
+  String name = cmd.substring(cmd.indexOf(' ', cmd.indexOf(' ') + 1) + 1);
+  if (cmd_lc.startsWith("skill_show ")) {
+    name = cmd.substring(11);
+  }
+  name.trim();
+  name.toLowerCase();
+  if (name.length() == 0) {
+    out = "ERR: usage skill_show <name>";
+    return true;
+  }
+  String content, err;
+  if (!skill_show(name, content, err)) {
+    out = "ERR: " + err;
+    return true;
+  }
+  if (content.length() > 1400) {
+    content = content.substring(0, 1400) + "...(truncated)";
+  }
+  out = "🧩 Skill: " + name + "\n\n" + content;
+  return true;
+}
+
+static bool cmd_skill_add(const String &input, const String &cmd, const String &cmd_lc,
+                          uint32_t intents, String &out) {
+  // Format: skill_add <name> <description>: <instructions>
+  String rest = cmd.substring(cmd.indexOf(' ') + 1);
+  if (cmd_lc.startsWith("skill_add ")) {
+    rest = cmd.substring(10);
+  } else {
+    rest = cmd.substring(10);
+  }
+  rest.trim();
+
+  // Parse name
+  int space = rest.indexOf(' ');
+  if (space < 0) {
+    out = "ERR: usage skill_add <name> <description>: <instructions>";
+    return true;
+  }
+  String name = rest.substring(0, space);
+  String remainder = rest.substring(space + 1);
+  remainder.trim();
+
+  // Split description and instructions at ':'
+  int colon = remainder.indexOf(':');
+  String description, instructions;
+  if (colon > 0) {
+    description = remainder.substring(0, colon);
+    instructions = remainder.substring(colon + 1);
+  } else {
+    description = remainder;
+    instructions = remainder;
+  }
+  description.trim();
+  instructions.trim();
+
+  String err;
+  if (!skill_add(name, description, instructions, err)) {
+    out = "ERR: " + err;
+    return true;
+  }
+  out = "🧩 Skill '" + name + "' created!";
+  return true;
+}
+
+static bool cmd_skill_remove(const String &input, const String &cmd, const String &cmd_lc,
+                             uint32_t intents, String &out) {
+  String name = cmd.substring(cmd.lastIndexOf(' ') + 1);
+  name.trim();
+  name.toLowerCase();
+  if (name.length() == 0) {
+    out = "ERR: usage skill_remove <name>";
+    return true;
+  }
+  String err;
+  if (!skill_remove(name, err)) {
+    out = "ERR: " + err;
+    return true;
+  }
+  out = "🧩 Skill '" + name + "' removed.";
+  return true;
+}
+
+// use_skill command (explicit skill activation)
+static bool cmd_use_skill(const String &input, const String &cmd, const String &cmd_lc,
+                          uint32_t intents, String &out) {
+  String name = cmd.substring(cmd.indexOf(' ') + 1);
+  if (cmd_lc.startsWith("use_skill ")) {
+    name = cmd.substring(10);
+  } else {
+    name = cmd.substring(10);
+  }
+  // Might be "use_skill frontend_dev build a portfolio"
+  int space = name.indexOf(' ');
+  String extra_context = "";
+  if (space > 0) {
+    extra_context = name.substring(space + 1);
+    name = name.substring(0, space);
+  }
+  name.trim();
+  name.toLowerCase();
+
+  String content, err;
+  if (!skill_load(name, content, err)) {
+    out = "ERR: " + err;
+    return true;
+  }
+
+  // Build enhanced prompt with skill instructions
+  String prompt = "You are executing the '" + name + "' skill.\n\n"
+                  "=== SKILL INSTRUCTIONS ===\n" + content + "\n"
+                  "=== END SKILL ===\n\n";
+  if (extra_context.length() > 0) {
+    prompt += "User's specific request: " + extra_context + "\n\n";
+  }
+  prompt += "Follow the skill instructions precisely. Be thorough and detailed.";
+
+  String reply, llm_err;
+  if (llm_generate_reply(prompt, reply, llm_err)) {
+    out = "🧩 [" + name + "] " + reply;
+  } else {
+    out = "ERR: Skill execution failed: " + llm_err;
+  }
+  return true;
+}
+
+#if ENABLE_IMAGE_GEN
+static bool cmd_generate_image(const String &input, const String &cmd, const String &cmd_lc,
+                               uint32_t intents, String &out) {
+  String prompt = "";
+  if (cmd_lc.startsWith("generate_image ")) {
+    prompt = cmd.substring(14);
+    prompt.trim();
+  }
+  if (prompt.length() == 0) {
+    out = "ERR: usage generate_image <prompt>";
+    return true;
+  }
+
+  String base64_image;
+  String llm_error;
+  if (!llm_generate_image(prompt, base64_image, llm_error)) {
+    out = "ERR: " + llm_error;
     return true;
   }
+
+  if (!transport_telegram_send_photo_base64(base64_image, "")) {
+    out = "ERR: failed to send photo";
+    return true;
+  }
+
+  out = "Image generated and sent";
+  return true;
+}
+
 #endif
+#if ENABLE_EMAIL
+// files_list - List all files in SPIFFS
+static bool cmd_files_list(const String &input, const String &cmd, const String &cmd_lc,
+                           uint32_t intents, String &out) {
+  String list, err;
+  if (!file_memory_list_files(list, err)) {
+    out = "ERR: " + err;
+    return true;
+  }
+  out = list;
+  return true;
+}
 
-  // Natural-language scheduling (without explicit command prefix)
-  String natural_web_hhmm;
-  String natural_web_task;
-  if (parse_natural_daily_webjob(cmd, natural_web_hhmm, natural_web_task)) {
-    String encoded_msg = encode_webjob_message(natural_web_task);
-    String err;
-    if (!has_user_timezone()) {
-      s_pending_reminder_tz.active = true;
-      s_pending_reminder_tz.hhmm = natural_web_hhmm;
-      s_pending_reminder_tz.message = encoded_msg;
-      s_pending_reminder_tz.expires_ms = millis() + kPendingReminderTzMs;
-      clear_pending_reminder_details();
-      out = "Before I set that web job, tell me your timezone.\n"
-            "Reply: timezone_set Asia/Kolkata";
-      return true;
-    }
-    if (!persona_set_daily_reminder(natural_web_hhmm, encoded_msg, err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-    event_log_append("WEBJOB set daily " + natural_web_hhmm + " (natural)");
-    out = "OK: daily web job set at " + natural_web_hhmm + "\nTask: " + natural_web_task +
-          unsynced_time_warning();
+// files_get - Read a file from SPIFFS
+static bool cmd_files_get(const String &input, const String &cmd, const String &cmd_lc,
+                          uint32_t intents, String &out) {
+  String filename = cmd.substring(cmd.indexOf(" ") + 1);
+  filename.trim();
+  if (filename.length() == 0) {
+    out = "ERR: usage: files_get <filename>";
+    return true;
+  }
+
+  String content, err;
+  if (!file_memory_read_file(filename, content, err)) {
+    out = "ERR: " + err;
     return true;
   }
 
-  String reminder_change_hhmm;
-  if (parse_natural_reminder_time_change(cmd, reminder_change_hhmm)) {
-    String old_hhmm;
-    String old_msg;
-    String err;
-    if (!persona_get_daily_reminder(old_hhmm, old_msg, err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-    old_hhmm.trim();
-    old_msg.trim();
-    if (old_hhmm.length() == 0 || old_msg.length() == 0) {
-      out = "No daily reminder to update. First set one with: reminder_set_daily <HH:MM> <message>";
-      return true;
-    }
-    if (!persona_set_daily_reminder(reminder_change_hhmm, old_msg, err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-    out = "OK: daily reminder updated to " + reminder_change_hhmm +
-          "\nMessage: " + reminder_message_for_user(old_msg) + unsynced_time_warning();
+  // Truncate if too long for Telegram
+  if (content.length() > 3000) {
+    out = "📄 " + filename + ":\n" + content.substring(0, 3000) + "\n\n... (truncated, use files_send or files_email to get full file)";
+  } else {
+    out = "📄 " + filename + ":\n" + content;
+  }
+  return true;
+}
+
+// files_send - Send a stored file as a Telegram document, streamed from flash
+static bool cmd_files_send(const String &input, const String &cmd, const String &cmd_lc,
+                           uint32_t intents, String &out) {
+  String filename = cmd.substring(cmd.indexOf(" ") + 1);
+  if (cmd_lc.startsWith("send file ")) {
+    filename = cmd.substring(10);
+  }
+  filename.trim();
+  if (filename.length() == 0) {
+    out = "ERR: usage: files_send <filename>";
     return true;
   }
 
-  String natural_rem_hhmm;
-  String natural_rem_msg;
-  if (parse_natural_daily_reminder(cmd, natural_rem_hhmm, natural_rem_msg, true)) {
-    String err;
-    if (!has_user_timezone()) {
-      s_pending_reminder_tz.active = true;
-      s_pending_reminder_tz.hhmm = natural_rem_hhmm;
-      s_pending_reminder_tz.message = natural_rem_msg;
-      s_pending_reminder_tz.expires_ms = millis() + kPendingReminderTzMs;
-      clear_pending_reminder_details();
-      out = "Before I set that reminder, tell me your timezone.\n"
-            "Reply: timezone_set Asia/Kolkata";
-      return true;
-    }
-    if (!persona_set_daily_reminder(natural_rem_hhmm, natural_rem_msg, err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-    event_log_append("REMINDER set daily " + natural_rem_hhmm + " (natural)");
-    out = "OK: daily reminder set at " + natural_rem_hhmm +
-          "\nMessage: " + reminder_message_for_user(natural_rem_msg) + unsynced_time_warning();
+  fs::File probe;
+  String err;
+  if (!file_memory_open_file(filename, probe, err)) {
+    out = "ERR: " + err;
     return true;
   }
+  const size_t size = probe.size();
+  probe.close();
 
-  if (cmd_lc == "soul_show" || cmd_lc == "soul") {
-    String soul, err;
-    if (!file_memory_read_soul(soul, err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-    soul.trim();
-    if (soul.length() == 0) {
-      out = "🦖 SOUL.md is empty";
-      return true;
-    }
-    if (soul.length() > 1400) {
-      soul = soul.substring(0, 1400) + "...";
-    }
-    out = "🦖 SOUL.md:\n" + soul;
+  if (!transport_telegram_send_file(filename, mime_from_filename(filename), filename)) {
+    out = "ERR: failed to send file";
     return true;
   }
+  out = "📎 Sending " + filename + " (" + String((unsigned long)size) + " bytes)";
+  return true;
+}
 
-  if (cmd_lc == "soul_clear") {
-    String err;
-    // Clear both SPIFFS SOUL.md and NVS soul
-    if (!file_memory_write_soul("", err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-    // Also clear NVS soul to remove old gamer soul
-    String nvs_err;
-    persona_clear_soul(nvs_err);  // Ignore error since NVS might not have a soul
+// files_email - Email a specific file
+static bool cmd_files_email(const String &input, const String &cmd, const String &cmd_lc,
+                            uint32_t intents, String &out) {
+  String tail = cmd.substring(cmd.indexOf(" ") + 1);
+  tail.trim();
 
-    out = "🦖 OK: Soul cleared (both SOUL.md and old storage)";
+  // Parse: files_email <filename> <email>
+  int space_idx = tail.indexOf(' ');
+  if (space_idx <= 0) {
+    out = "ERR: usage: files_email <filename> <email>";
     return true;
   }
 
-  if (cmd_lc == "soul_set" || cmd_lc.startsWith("soul_set ")) {
-    String text = cmd.length() > 8 ? cmd.substring(8) : "";
-    text.trim();
-    if (text.length() == 0) {
-      out = "ERR: usage soul_set <text>";
-      return true;
-    }
-    String err;
-    if (!file_memory_write_soul(text, err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-    out = "🦖 OK: SOUL.md updated";
+  String filename = tail.substring(0, space_idx);
+  String to_email = tail.substring(space_idx + 1);
+  filename.trim();
+  to_email.trim();
+
+  if (filename.length() == 0 || to_email.length() == 0) {
+    out = "ERR: usage: files_email <filename> <email>";
     return true;
   }
 
-  if (cmd_lc == "heartbeat_show") {
-    String hb;
-    String err;
-    if (!persona_get_heartbeat(hb, err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-    hb.trim();
-    if (hb.length() == 0) {
-      out = "Heartbeat is empty";
-      return true;
-    }
-    if (hb.length() > 1400) {
-      hb = hb.substring(0, 1400);
-    }
-    out = "HEARTBEAT:\n" + hb;
+  String content, err;
+  if (!file_memory_read_file(filename, content, err)) {
+    out = "ERR: " + err;
     return true;
   }
 
-  if (cmd_lc == "heartbeat_clear") {
-    String err;
-    if (!persona_clear_heartbeat(err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-    out = "OK: heartbeat cleared";
+  Serial.printf("[files_email] File %s read, %d bytes\n", filename.c_str(), content.length());
+
+  String subject = "File from ESP32 Bot: " + filename;
+  String email_err;
+
+  // Detect HTML files and send as html_content
+  String filename_lower = filename;
+  filename_lower.toLowerCase();
+  bool is_html = filename_lower.endsWith(".html") || filename_lower.endsWith(".htm");
+
+  bool sent;
+  if (is_html) {
+    Serial.printf("[files_email] Sending as HTML content\n");
+    sent = email_send(to_email, subject, content, "", email_err);
+  } else {
+    sent = email_send(to_email, subject, "", content, email_err);
+  }
+
+  if (sent) {
+    out = "Emailed " + filename + " (" + String(content.length()) + " bytes) to " + to_email;
+  } else {
+    out = "ERR: " + email_err;
+  }
+  return true;
+}
+
+// files_email_all - Email all files
+static bool cmd_files_email_all(const String &input, const String &cmd, const String &cmd_lc,
+                                uint32_t intents, String &out) {
+  String to_email = cmd.substring(cmd.indexOf(" ") + 1);
+  to_email.trim();
+
+  if (to_email.length() == 0) {
+    out = "ERR: usage: files_email_all <email>";
     return true;
   }
 
-  if (cmd_lc == "heartbeat_set" || cmd_lc.startsWith("heartbeat_set ")) {
-    String text = cmd.length() > 13 ? cmd.substring(13) : "";
-    text.trim();
-    if (text.length() == 0) {
-      out = "ERR: usage heartbeat_set <text>";
-      return true;
-    }
-    String err;
-    if (!persona_set_heartbeat(text, err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-    out = "OK: heartbeat updated";
+  // Get list of files
+  String list, err;
+  if (!file_memory_list_files(list, err)) {
+    out = "ERR: " + err;
     return true;
   }
 
-  if (cmd_lc == "heartbeat_run") {
-    String hb;
-    String hb_err;
-    if (!persona_get_heartbeat(hb, hb_err)) {
-      out = "ERR: " + hb_err;
-      return true;
-    }
-    hb.trim();
-    if (hb.length() == 0) {
-      out = "ERR: heartbeat is empty";
-      return true;
+  // Count files and extract names
+  int file_count = 0;
+  String files[20];  // Max 20 files
+  int idx = 0;
+  while ((idx = list.indexOf("• ", idx)) >= 0 && file_count < 20) {
+    idx += 2;  // Skip "• "
+    int space_idx = list.indexOf(" (", idx);
+    if (space_idx > idx) {
+      files[file_count++] = list.substring(idx, space_idx);
+      idx = space_idx;
+    } else {
+      break;
     }
+  }
 
-    String reply;
-    String llm_err;
-    if (!llm_generate_heartbeat(hb, reply, llm_err)) {
-      out = "ERR: " + llm_err;
-      return true;
-    }
-    if (reply.length() > 1400) {
-      reply = reply.substring(0, 1400) + "...";
-    }
-    out = "Heartbeat:\n" + reply;
+  if (file_count == 0) {
+    out = "No files to email";
     return true;
   }
 
-  if (cmd_lc == "proactive_check") {
-    // Build context for proactive decision
-    String context = build_time_context();
-
-    // Add user profile
-    String user_profile, user_err;
-    if (file_memory_read_user(user_profile, user_err)) {
-      user_profile.trim();
-      if (user_profile.length() > 0) {
-        if (user_profile.length() > 400) {
-          user_profile = user_profile.substring(user_profile.length() - 400);
-        }
-        context += "\n\nUser profile:\n" + user_profile;
-      }
+  // Read all files and create combined content
+  String all_content = "📁 All SPIFFS Files:\n\n";
+  for (int i = 0; i < file_count; i++) {
+    String content, file_err;
+    if (file_memory_read_file(files[i], content, file_err)) {
+      all_content += "\n\n======== " + files[i] + " ========\n\n";
+      all_content += content;
     }
+  }
 
-    // Add pending tasks
-    String tasks, task_err;
-    if (task_list(tasks, task_err)) {
-      tasks.trim();
-      if (tasks.length() > 0) {
-        if (tasks.length() > 300) {
-          tasks = tasks.substring(0, 300) + "...";
-        }
-        context += "\n\nPending tasks:\n" + tasks;
-      }
-    }
+  String subject = "All files from ESP32 Bot (" + String(file_count) + " files)";
+  String email_err;
+  if (email_send(to_email, subject, "", all_content, email_err)) {
+    out = "Emailed " + String(file_count) + " files to " + to_email;
+  } else {
+    out = "ERR: " + email_err;
+  }
+  return true;
+}
 
-    // Add recent memory
-    String memory, mem_err;
-    if (file_memory_read_long_term(memory, mem_err)) {
-      memory.trim();
-      if (memory.length() > 0) {
-        if (memory.length() > 300) {
-          memory = memory.substring(memory.length() - 300);
-        }
-        context += "\n\nRecent memory:\n" + memory;
+#endif
+// Model management commands
+static bool cmd_model_list(const String &input, const String &cmd, const String &cmd_lc,
+                           uint32_t intents, String &out) {
+  // Check if provider is specified
+  String provider = "";
+  if (cmd_lc.startsWith("model list ")) {
+    provider = cmd.substring(11);
+  } else if (cmd_lc.startsWith("model_list ")) {
+    provider = cmd.substring(11);
+  }
+  provider.trim();
+
+  if (provider.length() > 0) {
+    provider.toLowerCase();
+    // Fetch models from provider
+    if (provider == "openrouter" || provider == "openrouter.ai") {
+      String models, err;
+      if (llm_fetch_provider_models("openrouter", models, err)) {
+        out = models;
+      } else {
+        out = "ERR: " + err;
       }
-    }
-
-    String reply, llm_err;
-    if (!llm_generate_proactive(context, reply, llm_err)) {
-      out = "ERR: " + llm_err;
       return true;
-    }
-
-    if (reply.length() == 0) {
-      out = "🦖 (proactive: staying silent)";
+    } else {
+      out = "ERR: Model listing only supported for OpenRouter.\n"
+            "Usage: model list openrouter";
       return true;
     }
+  }
 
-    if (reply.length() > 1400) {
-      reply = reply.substring(0, 1400) + "...";
-    }
-    out = reply;
+  // No provider specified, show configured providers
+  String configured = model_config_get_configured_list();
+  out = "Configured providers:\n" + configured +
+        "\n\nUse: model list openrouter to see available models";
+  return true;
+}
+
+static bool cmd_model_status(const String &input, const String &cmd, const String &cmd_lc,
+                             uint32_t intents, String &out) {
+  out = model_config_get_status_summary();
+  return true;
+}
+
+static bool cmd_model_use(const String &input, const String &cmd, const String &cmd_lc,
+                          uint32_t intents, String &out) {
+  String provider = cmd.length() > 9 ? cmd.substring(9) : "";
+  provider.trim();
+  if (provider.length() == 0) {
+    out = "ERR: usage model use <provider>\nProviders: openai, anthropic, gemini, glm";
+    return true;
+  }
+  if (!model_config_is_provider_configured(provider)) {
+    out = "ERR: provider '" + provider + "' not configured.\n"
+          "Use: model set " + provider + " <your_api_key>";
+    return true;
+  }
+  String err;
+  if (!model_config_set_active_provider(provider, err)) {
+    out = "ERR: " + err;
     return true;
   }
+  String model = model_config_get_model(provider);
+  out = "OK: switched to " + provider + " (" + model + ")";
+  return true;
+}
 
-  if (cmd_lc == "proactive_on") {
-    out = "OK: proactive agent is enabled (runs every " + String(PROACTIVE_INTERVAL_MS / 60000) + " min)";
+static bool cmd_model_set(const String &input, const String &cmd, const String &cmd_lc,
+                          uint32_t intents, String &out) {
+  String tail = cmd.length() > 9 ? cmd.substring(9) : "";
+  tail.trim();
+  if (tail.length() == 0) {
+    out = "ERR: usage model set <provider> <api_key>\nProviders: openai, anthropic, gemini, glm";
+    return true;
+  }
+  // Find first space to separate provider and key
+  int first_space = tail.indexOf(' ');
+  if (first_space < 0) {
+    out = "ERR: usage model set <provider> <api_key>";
+    return true;
+  }
+  String provider = tail.substring(0, first_space);
+  String api_key = tail.substring(first_space + 1);
+  provider.trim();
+  api_key.trim();
+  if (api_key.length() == 0) {
+    out = "ERR: API key cannot be empty";
+    return true;
+  }
+  String err;
+  if (!model_config_set_api_key(provider, api_key, err)) {
+    out = "ERR: " + err;
     return true;
   }
+  out = "OK: API key saved for " + provider +
+        "\nUse: model use " + provider + " to activate";
+  return true;
+}
 
-  if (cmd_lc == "proactive_off") {
-    out = "OK: proactive agent disabled. Use /proactive_on to re-enable.";
+static bool cmd_model_clear(const String &input, const String &cmd, const String &cmd_lc,
+                            uint32_t intents, String &out) {
+  String provider = cmd.length() > 11 ? cmd.substring(11) : "";
+  provider.trim();
+  if (provider.length() == 0) {
+    out = "ERR: usage model clear <provider>";
+    return true;
+  }
+  String err;
+  if (!model_config_clear_provider(provider, err)) {
+    out = "ERR: " + err;
     return true;
   }
+  out = "OK: configuration cleared for " + provider;
+  return true;
+}
 
-  if (cmd_lc == "profile" || cmd_lc == "whoami" || cmd_lc == "memory_user") {
-    String user_profile, user_err;
-    if (!file_memory_read_user(user_profile, user_err)) {
-      out = "ERR: " + user_err;
-      return true;
-    }
-    user_profile.trim();
-    if (user_profile.length() == 0) {
-      out = "🦖 I don't know much about you yet! Tell me your name or interests.";
-    } else {
-      out = "👤 **User Profile (what I know about you):**\n" + user_profile;
-    }
+static bool cmd_model_select(const String &input, const String &cmd, const String &cmd_lc,
+                             uint32_t intents, String &out) {
+  String tail = cmd.length() > 12 ? cmd.substring(12) : "";
+  tail.trim();
+  if (tail.length() == 0) {
+    out = "ERR: usage model select <provider> <model_name>\n"
+          "Example: model select openrouter google/gemini-2.0-flash-exp:free";
     return true;
   }
+  int first_space = tail.indexOf(' ');
+  if (first_space < 0) {
+    out = "ERR: usage model select <provider> <model_name>\n"
+          "Example: model select openrouter google/gemini-2.0-flash-exp:free";
+    return true;
+  }
+  String provider = tail.substring(0, first_space);
+  String model_name = tail.substring(first_space + 1);
+  provider.trim();
+  model_name.trim();
+  if (model_name.length() == 0) {
+    out = "ERR: model name cannot be empty";
+    return true;
+  }
+  String err;
+  if (!model_config_set_model(provider, model_name, err)) {
+    out = "ERR: " + err;
+    return true;
+  }
+  out = "OK: model for " + provider + " set to " + model_name;
+  return true;
+}
 
-  if (cmd_lc == "cancel") {
-    if (!s_pending.active) {
-      if (s_pending_reminder_tz.active || s_pending_reminder_details.active) {
-        clear_pending_reminder_tz();
-        clear_pending_reminder_details();
-        out = "OK: pending reminder flow canceled";
-        return true;
-      }
-      out = "OK: no pending action";
-      return true;
-    }
-    clear_pending();
-    clear_pending_reminder_tz();
-    clear_pending_reminder_details();
-    out = "OK: pending action canceled";
+static bool cmd_model_failed(const String &input, const String &cmd, const String &cmd_lc,
+                             uint32_t intents, String &out) {
+  out = model_config_get_failed_status();
+  return true;
+}
+
+static bool cmd_model_reset_failed(const String &input, const String &cmd, const String &cmd_lc,
+                                   uint32_t intents, String &out) {
+  model_config_reset_all_failed_providers();
+  out = "OK: All failed providers have been reset. You can try them again.";
+  return true;
+}
+
+#if ENABLE_EMAIL
+static bool cmd_send_email(const String &input, const String &cmd, const String &cmd_lc,
+                           uint32_t intents, String &out) {
+  String remaining = cmd.length() > 10 ? cmd.substring(10) : "";
+  remaining.trim();
+
+  // Parse: send_email <to> <subject> <message>
+  int first_space = remaining.indexOf(' ');
+  if (first_space < 0) {
+    out = "ERR: usage send_email <to> <subject> <message>";
     return true;
   }
 
-  // Handle "yes" as confirmation for firmware update
-  if (cmd_lc == "yes" || cmd_lc == "yep" || cmd_lc == "yeah") {
-    if (s_pending_update.available) {
-      return tool_registry_trigger_update(out);
-    }
-    // Fall through to confirm handler if no firmware update pending
+  String to = remaining.substring(0, first_space);
+  to.trim();
+
+  String after_to = remaining.substring(first_space + 1);
+  after_to.trim();
+
+  int second_space = after_to.indexOf(' ');
+  if (second_space < 0) {
+    out = "ERR: usage send_email <to> <subject> <message>";
+    return true;
   }
 
-  if (cmd_lc == "confirm" || cmd_lc.startsWith("confirm ")) {
-    if (!s_pending.active) {
-      out = "ERR: no pending action";
-      return true;
-    }
-    if (is_expired(s_pending.expires_ms)) {
-      clear_pending();
-      out = "ERR: pending action expired";
-      return true;
-    }
+  String subject = after_to.substring(0, second_space);
+  subject.trim();
 
-    if (cmd_lc.startsWith("confirm ")) {
-      const String tail = cmd_lc.substring(8);
-      int user_id = -1;
-      if (!parse_one_int(tail, "%d", &user_id)) {
-        out = "ERR: usage confirm [id]";
-        return true;
-      }
-      if ((unsigned long)user_id != s_pending.id) {
-        out = "ERR: confirm id mismatch";
-        return true;
-      }
-    }
+  String message = after_to.substring(second_space + 1);
+  message.trim();
 
-    const int pin = s_pending.pin;
-    const int state = s_pending.state;
-    const int led_count = s_pending.led_count;
-    const PendingActionType type = s_pending.type;
-    const unsigned long id = s_pending.id;
-    if (is_safe_mode_enabled() &&
-        (type == PENDING_RELAY_SET || type == PENDING_LED_FLASH)) {
-      clear_pending();
-      out = "ERR: safe mode ON. Disable with safe_mode_off first";
-      return true;
-    }
-    clear_pending();
-    if (type == PENDING_RELAY_SET) {
-      relay_set_now(pin, state, out);
-    } else if (type == PENDING_LED_FLASH) {
-      flash_led_now(led_count, out);
-    } else {
-      out = "ERR: unknown pending action";
-      return true;
-    }
-    out += " (confirmed id=" + String(id) + ")";
+  if (to.length() == 0 || subject.length() == 0) {
+    out = "ERR: usage send_email <to> <subject> <message>";
     return true;
   }
 
-#if ENABLE_GPIO
-  const int led_flash_count = parse_led_flash_count(cmd_lc);
-  if (led_flash_count != 0) {
-    if (is_safe_mode_enabled()) {
-      out = "ERR: safe mode ON. flash_led blocked";
-      return true;
-    }
-    if (led_flash_count < 1 || led_flash_count > 20) {
-      out = "ERR: usage flash_led [1-20]";
-      return true;
-    }
+  String err;
+  String html_content = "<p>" + message + "</p>";
+  String text_content = message;
+
+  if (!email_send(to, subject, html_content, text_content, err)) {
+    out = "ERR: " + err;
+    return true;
+  }
+
+  out = "OK: Email sent to " + to;
+  return true;
+}
+
+#endif
+// WhatsApp Tools
+static bool cmd_discord_send(const String &input, const String &cmd, const String &cmd_lc,
+                             uint32_t intents, String &out) {
+  String message = cmd.length() > 13 ? cmd.substring(13) : "";
+  message.trim();
+
+  if (message.length() == 0) {
+    out = "ERR: usage discord_send <message>";
+    return true;
+  }
+
+  String err;
+  if (!discord_send_message(message, err)) {
+    out = "ERR: Discord send failed: " + err;
+    return true;
+  }
+
+  out = "OK: Message sent via Discord";
+  event_log_append("DISCORD msg");
+  return true;
+}
 
-    if (s_pending.active) {
-      out = "ERR: pending action exists (id=" + String(s_pending.id) + "). confirm/cancel first";
-      return true;
-    }
+static bool cmd_discord_send_files(const String &input, const String &cmd, const String &cmd_lc,
+                                   uint32_t intents, String &out) {
+  String topic = cmd.length() > 19 ? cmd.substring(19) : "";
+  topic = sanitize_web_topic(topic);
 
-    s_pending.active = true;
-    s_pending.id = s_next_pending_id++;
-    s_pending.type = PENDING_LED_FLASH;
-    s_pending.led_count = led_flash_count;
-    s_pending.expires_ms = millis() + ACTION_CONFIRM_TIMEOUT_MS;
+  String html, css, js, err;
+  // Generate the files
+  build_small_web_files(topic, html, css, js);
 
-    out = "CONFIRM flash_led " + String(led_flash_count) +
-          "\nRun: confirm " + String(s_pending.id) +
-          "\nOr: cancel";
+  if (!discord_send_web_files(topic, html, css, js, err)) {
+    out = "ERR: Discord send failed: " + err;
     return true;
   }
-#endif
 
-#if ENABLE_GPIO
-  if (cmd_lc.startsWith("relay_set ")) {
-    if (is_safe_mode_enabled()) {
-      out = "ERR: safe mode ON. relay_set blocked";
-      return true;
-    }
-    int pin = -1;
-    int state = -1;
-    if (parse_two_ints(cmd_lc, "relay_set %d %d", &pin, &state)) {
-      if (pin >= 0 && pin <= 39 && (state == 0 || state == 1)) {
-        if (s_pending.active) {
-          out = "ERR: pending action exists (id=" + String(s_pending.id) + "). confirm/cancel first";
-          return true;
-        }
+  out = "OK: Files generated and sent via Discord";
+  event_log_append("DISCORD files " + topic);
+  return true;
+}
 
-        s_pending.active = true;
-        s_pending.id = s_next_pending_id++;
-        s_pending.type = PENDING_RELAY_SET;
-        s_pending.pin = pin;
-        s_pending.state = state;
-        s_pending.expires_ms = millis() + ACTION_CONFIRM_TIMEOUT_MS;
-        out = "CONFIRM relay_set pin " + String(pin) + " -> " + String(state) +
-              "\nRun: confirm " + String(s_pending.id) +
-              "\nOr: cancel";
-        return true;
-      }
-    }
-    out = "ERR: usage relay_set <pin> <0|1>";
+// Web Tools
+static bool cmd_web_search(const String &input, const String &cmd, const String &cmd_lc,
+                           uint32_t intents, String &out) {
+  String query = cmd.length() > 11 ? cmd.substring(11) : "";
+  query.trim();
+  if (query.length() == 0) {
+    out = "ERR: usage web_search <query>";
     return true;
   }
+  return tool_web_search(query, out);
+}
 
-  if (cmd_lc.startsWith("sensor_read ")) {
-    int pin = -1;
-    if (parse_one_int(cmd_lc, "sensor_read %d", &pin)) {
-      if (pin >= 0 && pin <= 39) {
-        pinMode(pin, INPUT);
-        int v = digitalRead(pin);
-        out = "OK: sensor pin " + String(pin) + " = " + String(v);
-        return true;
-      }
-    }
-    out = "ERR: usage sensor_read <pin>";
+static bool cmd_weather(const String &input, const String &cmd, const String &cmd_lc,
+                        uint32_t intents, String &out) {
+  String loc = cmd.substring(cmd_lc.indexOf(' ') + 1);
+  loc.trim();
+  if (loc.length() == 0) {
+    out = "ERR: usage weather <location>";
     return true;
   }
-#endif
+  return tool_web_weather(loc, out);
+}
 
+// MinOS Bridge
+static bool cmd_minos(const String &input, const String &cmd, const String &cmd_lc,
+                      uint32_t intents, String &out) {
+  String minos_cmd = cmd.length() > 6 ? cmd.substring(6) : "help";
+  minos_cmd.trim();
+  String minos_out;
+  shell_run_once(minos_cmd, minos_out);
+  out = "🦖 MinOS Shell Output:\n" + minos_out;
+  return true;
+}
+
+static bool cmd_command_stats(const String &input, const String &cmd, const String &cmd_lc,
+                              uint32_t intents, String &out) {
+  out = s_commands.stats_text();
+  return true;
+}
+
+static const CommandSpec kCommands[] = {
+    {{"help"}, CMD_ARGS_NONE, cmd_help},
+    {{"status"}, CMD_ARGS_NONE, cmd_status},
+    {{"pc_status"}, CMD_ARGS_NONE, cmd_pc_status},
+    {{"pc_connect"}, CMD_ARGS_OPTIONAL, cmd_pc_connect},
+    {{"pc_run"}, CMD_ARGS_OPTIONAL, cmd_pc_run},
+    {{"pc_browser"}, CMD_ARGS_OPTIONAL, cmd_pc_browser},
+    {{"fresh_start", "start_fresh", "context_clear", "clear context", "reset context",
+      "start from scratch", "new chat"},
+     CMD_ARGS_NONE, cmd_fresh_start},
+    {{"health"}, CMD_ARGS_NONE, cmd_health},
+    {{"specs"}, CMD_ARGS_NONE, cmd_specs},
+    {{"usage"}, CMD_ARGS_NONE, cmd_usage},
+    {{"usage_reset"}, CMD_ARGS_NONE, cmd_usage_reset},
+    {{"security"}, CMD_ARGS_NONE, cmd_security},
+    {{"update"}, CMD_ARGS_NONE, cmd_update},
+    {{"logs"}, CMD_ARGS_NONE, cmd_logs},
+    {{"logs_clear"}, CMD_ARGS_NONE, cmd_logs_clear},
+    {{"search"}, CMD_ARGS_OPTIONAL, cmd_search},
+#if ENABLE_VOICE
+    {{"voice_start", "voice_stream"}, CMD_ARGS_NONE, cmd_voice_start},
+    {{"voice_stop"}, CMD_ARGS_NONE, cmd_voice_stop},
+    {{"voice_status"}, CMD_ARGS_NONE, cmd_voice_status},
+#endif
+    {{"time_show", "clock", "time"}, CMD_ARGS_NONE, cmd_time_show},
+    {{"safe_mode"}, CMD_ARGS_NONE, cmd_safe_mode},
+    {{"safe_mode_on"}, CMD_ARGS_NONE, cmd_safe_mode_on},
+    {{"safe_mode_off"}, CMD_ARGS_NONE, cmd_safe_mode_off},
+#if ENABLE_TASKS
+    {{"task_list"}, CMD_ARGS_NONE, cmd_task_list},
+    {{"task_clear"}, CMD_ARGS_NONE, cmd_task_clear},
+    {{"task_add"}, CMD_ARGS_OPTIONAL, cmd_task_add},
+    {{"task_done"}, CMD_ARGS_OPTIONAL, cmd_task_done},
+#endif
+#if ENABLE_EMAIL
+    {{"email_show"}, CMD_ARGS_NONE, cmd_email_show},
+    {{"email_clear"}, CMD_ARGS_NONE, cmd_email_clear},
+    {{"email_draft"}, CMD_ARGS_OPTIONAL, cmd_email_draft},
+#endif
+    {{"timezone_show"}, CMD_ARGS_NONE, cmd_timezone_show},
+    {{"timezone_clear"}, CMD_ARGS_NONE, cmd_timezone_clear},
+    {{"timezone_set"}, CMD_ARGS_OPTIONAL, cmd_timezone_set},
+    {{"reminder_set_daily", "remider_set_daily", "remainder_set_daily"},
+     CMD_ARGS_OPTIONAL, cmd_reminder_set_daily},
+    {{"reminder_show"}, CMD_ARGS_NONE, cmd_reminder_show},
+    {{"reminder_clear"}, CMD_ARGS_NONE, cmd_reminder_clear},
+    {{"reminder_run"}, CMD_ARGS_NONE, cmd_reminder_run},
+#if ENABLE_WEB_JOBS
+    {{"webjob_show"}, CMD_ARGS_NONE, cmd_webjob_show},
+#endif
+    {{"cron_add"}, CMD_ARGS_OPTIONAL, cmd_cron_add},
+    {{"cron_list", "cron_show"}, CMD_ARGS_NONE, cmd_cron_list},
+    {{"cron_remove"}, CMD_ARGS_OPTIONAL, cmd_cron_remove},
+    {{"cron_pause"}, CMD_ARGS_OPTIONAL, cmd_cron_pause},
+    {{"cron_resume"}, CMD_ARGS_OPTIONAL, cmd_cron_resume},
+    {{"cron_clear"}, CMD_ARGS_NONE, cmd_cron_clear},
+#if ENABLE_WEB_JOBS
+    {{"webjob_clear"}, CMD_ARGS_NONE, cmd_webjob_clear},
+    {{"webjob_run"}, CMD_ARGS_NONE, cmd_webjob_run},
+    {{"host_file"}, CMD_ARGS_REQUIRED, cmd_host_file},
+#if ENABLE_EMAIL
+    {{"email_files"}, CMD_ARGS_REQUIRED, cmd_email_files},
+#endif
+    {{"webjob_set_daily"}, CMD_ARGS_OPTIONAL, cmd_webjob_set_daily},
+#endif
+    {{"soul_show", "soul"}, CMD_ARGS_NONE, cmd_soul_show},
+    {{"soul_clear"}, CMD_ARGS_NONE, cmd_soul_clear},
+    {{"soul_set"}, CMD_ARGS_OPTIONAL, cmd_soul_set},
+    {{"heartbeat_show"}, CMD_ARGS_NONE, cmd_heartbeat_show},
+    {{"heartbeat_clear"}, CMD_ARGS_NONE, cmd_heartbeat_clear},
+    {{"heartbeat_set"}, CMD_ARGS_OPTIONAL, cmd_heartbeat_set},
+    {{"heartbeat_run"}, CMD_ARGS_NONE, cmd_heartbeat_run},
+    {{"auto_learn_run"}, CMD_ARGS_NONE, cmd_auto_learn_run},
+    {{"proactive_check"}, CMD_ARGS_NONE, cmd_proactive_check},
+    {{"proactive_on"}, CMD_ARGS_NONE, cmd_proactive_on},
+    {{"proactive_off"}, CMD_ARGS_NONE, cmd_proactive_off},
+    {{"profile", "whoami", "memory_user"}, CMD_ARGS_NONE, cmd_profile},
+    {{"cancel"}, CMD_ARGS_NONE, cmd_cancel},
+    {{"yes", "yep", "yeah"}, CMD_ARGS_NONE, cmd_yes},
+    {{"confirm"}, CMD_ARGS_OPTIONAL, cmd_confirm},
+#if ENABLE_GPIO
+    {{"relay_set"}, CMD_ARGS_REQUIRED, cmd_relay_set},
+    {{"sensor_read"}, CMD_ARGS_REQUIRED, cmd_sensor_read},
+#endif
 #if ENABLE_PLAN
-  if (cmd_lc == "plan" || cmd_lc.startsWith("plan ")) {
-    String task = cmd.length() > 4 ? cmd.substring(4) : "";
-    task.trim();
-    if (task.length() == 0) {
-      out = "ERR: usage plan <what to build>";
-      return true;
-    }
+    {{"plan"}, CMD_ARGS_OPTIONAL, cmd_plan},
+#endif
+    {{"memory"}, CMD_ARGS_NONE, cmd_memory},
+    {{"forget", "memory_clear"}, CMD_ARGS_NONE, cmd_forget},
+    {{"remember"}, CMD_ARGS_OPTIONAL, cmd_remember},
+    {{"file_memory", "files"}, CMD_ARGS_NONE, cmd_file_memory},
+    {{"memory_read", "read_memory"}, CMD_ARGS_NONE, cmd_memory_read},
+    {{"memory_write", "write_memory"}, CMD_ARGS_REQUIRED, cmd_memory_write},
+    {{"user_read", "read_user"}, CMD_ARGS_NONE, cmd_user_read},
+    {{"daily_note"}, CMD_ARGS_REQUIRED, cmd_daily_note},
+    {{"skill_list", "skills", "skill list"}, CMD_ARGS_NONE, cmd_skill_list},
+    {{"skill_show", "skill show"}, CMD_ARGS_REQUIRED, cmd_skill_show},
+    {{"skill_add", "skill add"}, CMD_ARGS_REQUIRED, cmd_skill_add},
+    {{"skill_remove", "skill remove", "skill_delete", "skill delete"},
+     CMD_ARGS_REQUIRED, cmd_skill_remove},
+    {{"use_skill", "use skill"}, CMD_ARGS_REQUIRED, cmd_use_skill},
+#if ENABLE_IMAGE_GEN
+    {{"generate_image"}, CMD_ARGS_OPTIONAL, cmd_generate_image},
+#endif
+#if ENABLE_EMAIL
+    {{"files_list", "files list", "list files"}, CMD_ARGS_NONE, cmd_files_list},
+    {{"files_get", "files get", "read_file"}, CMD_ARGS_REQUIRED, cmd_files_get},
+    {{"files_send", "send file"}, CMD_ARGS_REQUIRED, cmd_files_send},
+    {{"files_email", "email file"}, CMD_ARGS_REQUIRED, cmd_files_email},
+    {{"files_email_all", "email all files"}, CMD_ARGS_REQUIRED, cmd_files_email_all},
+#endif
+    {{"model list", "model_list"}, CMD_ARGS_OPTIONAL, cmd_model_list},
+    {{"model status", "model_status"}, CMD_ARGS_NONE, cmd_model_status},
+    {{"model use", "model_use"}, CMD_ARGS_REQUIRED, cmd_model_use},
+    {{"model set", "model_set"}, CMD_ARGS_REQUIRED, cmd_model_set},
+    {{"model clear", "model_clear"}, CMD_ARGS_REQUIRED, cmd_model_clear},
+    {{"model select", "model_select"}, CMD_ARGS_REQUIRED, cmd_model_select},
+    {{"model failed", "model_failed"}, CMD_ARGS_NONE, cmd_model_failed},
+    {{"model reset_failed", "model_reset_failed"}, CMD_ARGS_NONE, cmd_model_reset_failed},
+#if ENABLE_EMAIL
+    {{"send_email"}, CMD_ARGS_REQUIRED, cmd_send_email},
+#endif
+    {{"discord_send"}, CMD_ARGS_OPTIONAL, cmd_discord_send},
+    {{"discord_send_files"}, CMD_ARGS_OPTIONAL, cmd_discord_send_files},
+    {{"web_search"}, CMD_ARGS_OPTIONAL, cmd_web_search},
+    {{"weather", "check weather"}, CMD_ARGS_REQUIRED, cmd_weather},
+    {{"minos"}, CMD_ARGS_OPTIONAL, cmd_minos},
+    {{"command_stats"}, CMD_ARGS_NONE, cmd_command_stats},
+};
 
-    String plan_text;
-    String plan_error;
-    if (!llm_generate_plan(task, plan_text, plan_error)) {
-      out = "ERR: " + plan_error;
-      return true;
-    }
+static void command_table_init() {
+  if (!s_commands.build(kCommands, sizeof(kCommands) / sizeof(kCommands[0]))) {
+    Serial.println("[tools] command table unavailable, using fallback chain only");
+  }
+}
 
-    if (plan_text.length() > 1400) {
-      plan_text = plan_text.substring(0, 1400) + "...";
-    }
-    out = plan_text;
-    return true;
+// Conversation state: pending confirmations and onboarding answers.
+static bool stage_state(const String &input, const String &cmd, const String &cmd_lc,
+                        uint32_t intents, String &out) {
+  lock_pending();
+  if (s_pending.active && is_expired(s_pending.expires_ms)) {
+    clear_pending();
   }
-#endif
+  if (s_pending_reminder_tz.active && is_expired(s_pending_reminder_tz.expires_ms)) {
+    clear_pending_reminder_tz();
+  }
+  if (s_pending_reminder_details.active &&
+      is_expired(s_pending_reminder_details.expires_ms)) {
+    clear_pending_reminder_details();
+  }
+  const bool reminder_needs_tz = s_pending_reminder_tz.active;
+  unlock_pending();
 
-  if (cmd_lc == "memory") {
-    String notes;
+  String guessed_tz;
+  PendingReminderTzDraft draft;
+  if (reminder_needs_tz && extract_timezone_from_text(cmd, guessed_tz) &&
+      take_pending_reminder_tz(draft)) {
     String err;
-    if (!memory_get_notes(notes, err)) {
+    if (!persona_set_timezone(guessed_tz, err)) {
       out = "ERR: " + err;
       return true;
     }
-    notes.trim();
-    if (notes.length() == 0) {
-      out = "Memory is empty";
+    if (!persona_set_daily_reminder(draft.hhmm, draft.message, err)) {
+      out = "ERR: " + err;
       return true;
     }
-    if (notes.length() > 1400) {
-      notes = notes.substring(notes.length() - 1400);
+    if (is_webjob_message(draft.message)) {
+      event_log_append("WEBJOB set daily " + draft.hhmm);
+    } else {
+      event_log_append("REMINDER set daily " + draft.hhmm);
     }
-    out = "Memory:\n" + notes;
+    String msg_for_user = reminder_message_for_user(draft.message);
+    out = "OK: timezone set to " + guessed_tz +
+          "\nOK: daily reminder set at " + draft.hhmm +
+          "\nMessage: " + msg_for_user + unsynced_time_warning();
     return true;
   }
 
-  if (cmd_lc == "forget" || cmd_lc == "memory_clear") {
-    String err;
-    if (!memory_clear_notes(err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-    out = "OK: memory cleared";
+  if (handle_onboarding_flow(cmd, cmd_lc, out)) {
     return true;
   }
+  return false;
+}
 
-  if (cmd_lc == "remember" || cmd_lc.startsWith("remember ")) {
-    String note = cmd.length() > 8 ? cmd.substring(8) : "";
-    note.trim();
-    if (note.length() == 0) {
-      out = "ERR: usage remember <note>";
-      return true;
-    }
-    String err;
-    if (!memory_append_note(note, err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-    out = "OK: remembered";
-    return true;
-  }
+static bool stage_exact_command(const String &input, const String &cmd, const String &cmd_lc,
+                                uint32_t intents, String &out) {
+  const int row = s_commands.find_exact(cmd_lc);
+  return row >= 0 && s_commands.run(row, input, cmd, cmd_lc, intents, out);
+}
 
-  // File memory commands (SPIFFS-based)
-  if (cmd_lc == "file_memory" || cmd_lc == "files") {
-    String info, err;
-    if (!file_memory_get_info(info, err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-    out = info;
-    return true;
+static bool stage_param_command(const String &input, const String &cmd, const String &cmd_lc,
+                                uint32_t intents, String &out) {
+  const int row = s_commands.find_prefix(cmd_lc);
+  return row >= 0 && s_commands.run(row, input, cmd, cmd_lc, intents, out);
+}
+
+// Natural-language requests recognised by local parsing alone.
+static bool stage_heuristic(const String &input, const String &cmd, const String &cmd_lc,
+                            uint32_t intents, String &out) {
+#if ENABLE_WEB_JOBS
+
+  String web_files_topic;
+  if (extract_web_files_topic_from_text(cmd, web_files_topic)) {
+    return send_small_web_files(web_files_topic, out);
   }
 
-  if (cmd_lc == "memory_read" || cmd_lc == "read_memory") {
-    String content, err;
-    if (!file_memory_read_long_term(content, err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-    content.trim();
-    if (content.length() == 0) {
-      out = "📚 MEMORY.md is empty";
-      return true;
-    }
-    if (content.length() > 1400) {
-      content = "...(truncated)\n" + content.substring(content.length() - 1400);
-    }
-    out = "📚 MEMORY.md:\n" + content;
-    return true;
+  String web_query;
+  if (extract_web_query_from_text(cmd, web_query)) {
+    return run_webjob_now_task(web_query, out);
   }
+#endif
 
-  if (cmd_lc.startsWith("memory_write ") || cmd_lc.startsWith("write_memory ")) {
-    String text = cmd.substring(cmd.indexOf(" ") + 1);
-    text.trim();
-    if (text.length() == 0) {
-      out = "ERR: usage memory_write <text>";
-      return true;
-    }
-    String err;
-    if (!file_memory_append_long_term(text, err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-    out = "🦖 OK: Written to MEMORY.md";
-    return true;
+  if (is_natural_web_iteration_request(cmd_lc)) {
+    return run_natural_web_iteration(cmd, out);
   }
 
-  if (cmd_lc == "user_read" || cmd_lc == "read_user") {
-    String user, err;
-    if (!file_memory_read_user(user, err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-    user.trim();
-    if (user.length() == 0) {
-      out = "👤 USER.md is empty";
+  // HOST / SERVE / DEPLOY - publish last response as web page (always available)
+  if (cmd_lc == "host_code" || cmd_lc.startsWith("host_code ") ||
+      cmd_lc.startsWith("host ") || cmd_lc == "host" ||
+      cmd_lc.startsWith("serve ") || cmd_lc == "serve" ||
+      cmd_lc.startsWith("deploy ") || cmd_lc == "deploy" ||
+      cmd_lc.indexOf("host the") >= 0 || cmd_lc.indexOf("host this") >= 0 ||
+      cmd_lc.indexOf("host it") >= 0 || cmd_lc.indexOf("serve the") >= 0 ||
+      cmd_lc.indexOf("serve this") >= 0 || cmd_lc.indexOf("serve it") >= 0 ||
+      cmd_lc.indexOf("deploy the") >= 0 || cmd_lc.indexOf("deploy this") >= 0 ||
+      cmd_lc.indexOf("deploy it") >= 0 ||
+      (cmd_lc.indexOf("host") >= 0 && cmd_lc.indexOf("server") >= 0)) {
+    String last_resp = agent_loop_get_last_response();
+    String file_content = agent_loop_get_last_file_content();
+    String file_name = agent_loop_get_last_file_name();
+    String html_from_response;
+    const bool has_html_from_response = extract_html_from_response_text(last_resp, html_from_response);
+
+    // Priority 1: Use exact file memory if available
+    if (file_content.length() > 0) {
+      if (file_name.length() == 0) file_name = "index.html";
+
+      String file_name_lc = file_name;
+      file_name_lc.toLowerCase();
+      String content_to_host = file_content;
+      String mime = mime_from_filename(file_name);
+
+      // If the last remembered file is CSS/JS, prefer the HTML from last response.
+      if ((file_name_lc.endsWith(".js") || file_name_lc.endsWith(".css")) && has_html_from_response) {
+        file_name = "index.html";
+        content_to_host = html_from_response;
+        mime = "text/html";
+      }
+
+      // If filename is not a web asset, default to index.html for hosting.
+      if (!file_name_lc.endsWith(".html") && !file_name_lc.endsWith(".htm") &&
+          !file_name_lc.endsWith(".js") && !file_name_lc.endsWith(".css")) {
+        file_name = "index.html";
+        mime = "text/html";
+      }
+
+      web_server_publish_file(file_name, content_to_host, mime);
+      String ip = WiFi.localIP().toString();
+      String public_path = file_name;
+      if (!public_path.startsWith("/")) {
+        public_path = "/" + public_path;
+      }
+      out = "Website hosted on ESP32 (from memory)!\nAccess it at: http://" + ip + public_path;
       return true;
     }
-    if (user.length() > 1400) {
-      user = user.substring(0, 1400) + "...";
-    }
-    out = "👤 USER.md:\n" + user;
-    return true;
-  }
 
-  if (cmd_lc.startsWith("daily_note ")) {
-    String note = cmd.substring(11);
-    note.trim();
-    if (note.length() == 0) {
-      out = "ERR: usage daily_note <text>";
+    if (last_resp.length() == 0) {
+      out = "No previous response to host. Ask me to create something first!";
       return true;
     }
-    String err;
-    if (!file_memory_append_daily(note, err)) {
-      out = "ERR: " + err;
+
+    // Priority 2: Try to extract HTML from model response
+    String html_content = "";
+    extract_html_from_response_text(last_resp, html_content);
+
+    if (html_content.length() == 0) {
+      out = "Could not find HTML content in the last response. Ask me to create a website first!";
       return true;
     }
-    out = "📝 OK: Added to today's notes";
+
+    html_content.trim();
+    web_server_publish_file("index.html", html_content, "text/html");
+
+    // Get IP for the URL
+    String ip = WiFi.localIP().toString();
+    out = "Website hosted on ESP32!\nAccess it at: http://" + ip + "/index.html";
     return true;
   }
 
-  // Skill commands (lazy-loaded from SPIFFS)
-  if (cmd_lc == "skill_list" || cmd_lc == "skills" || cmd_lc == "skill list") {
-    String list, err;
-    if (!skill_list(list, err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-    out = list;
+  if (cmd_lc.indexOf("search web") >= 0 || cmd_lc.indexOf("web search") >= 0) {
+    out = "Yes. Tell me what to search.\nExample: search for cricket matches today";
     return true;
   }
 
-  if (cmd_lc.startsWith("skill_show ") || cmd_lc.startsWith("skill show ")) {
-    String name = cmd.substring(cmd.indexOf(' ', cmd.indexOf(' ') + 1) + 1);
-    if (cmd_lc.startsWith("skill_show ")) {
-      name = cmd.substring(11);
-    }
-    name.trim();
-    name.toLowerCase();
-    if (name.length() == 0) {
-      out = "ERR: usage skill_show <name>";
+  // Natural-language scheduling (without explicit command prefix)
+  String natural_web_hhmm;
+  String natural_web_task;
+  if (parse_natural_daily_webjob(cmd, natural_web_hhmm, natural_web_task)) {
+    String encoded_msg = encode_webjob_message(natural_web_task);
+    String err;
+    if (!has_user_timezone()) {
+      set_pending_reminder_tz(natural_web_hhmm, encoded_msg);
+      out = "Before I set that web job, tell me your timezone.\n"
+            "Reply: timezone_set Asia/Kolkata";
       return true;
     }
-    String content, err;
-    if (!skill_show(name, content, err)) {
+    if (!persona_set_daily_reminder(natural_web_hhmm, encoded_msg, err)) {
       out = "ERR: " + err;
       return true;
     }
-    if (content.length() > 1400) {
-      content = content.substring(0, 1400) + "...(truncated)";
-    }
-    out = "🧩 Skill: " + name + "\n\n" + content;
+    event_log_append("WEBJOB set daily " + natural_web_hhmm + " (natural)");
+    out = "OK: daily web job set at " + natural_web_hhmm + "\nTask: " + natural_web_task +
+          unsynced_time_warning();
     return true;
   }
 
-  if (cmd_lc.startsWith("skill_add ") || cmd_lc.startsWith("skill add ")) {
-    // Format: skill_add <name> <description>: <instructions>
-    String rest = cmd.substring(cmd.indexOf(' ') + 1);
-    if (cmd_lc.startsWith("skill_add ")) {
-      rest = cmd.substring(10);
-    } else {
-      rest = cmd.substring(10);
-    }
-    rest.trim();
-
-    // Parse name
-    int space = rest.indexOf(' ');
-    if (space < 0) {
-      out = "ERR: usage skill_add <name> <description>: <instructions>";
-      return true;
-    }
-    String name = rest.substring(0, space);
-    String remainder = rest.substring(space + 1);
-    remainder.trim();
-
-    // Split description and instructions at ':'
-    int colon = remainder.indexOf(':');
-    String description, instructions;
-    if (colon > 0) {
-      description = remainder.substring(0, colon);
-      instructions = remainder.substring(colon + 1);
-    } else {
-      description = remainder;
-      instructions = remainder;
-    }
-    description.trim();
-    instructions.trim();
-
+  String reminder_change_hhmm;
+  if (parse_natural_reminder_time_change(cmd, reminder_change_hhmm)) {
+    String old_hhmm;
+    String old_msg;
     String err;
-    if (!skill_add(name, description, instructions, err)) {
+    if (!persona_get_daily_reminder(old_hhmm, old_msg, err)) {
       out = "ERR: " + err;
       return true;
     }
-    out = "🧩 Skill '" + name + "' created!";
-    return true;
-  }
-
-  if (cmd_lc.startsWith("skill_remove ") || cmd_lc.startsWith("skill remove ") ||
-      cmd_lc.startsWith("skill_delete ") || cmd_lc.startsWith("skill delete ")) {
-    String name = cmd.substring(cmd.lastIndexOf(' ') + 1);
-    name.trim();
-    name.toLowerCase();
-    if (name.length() == 0) {
-      out = "ERR: usage skill_remove <name>";
+    old_hhmm.trim();
+    old_msg.trim();
+    if (old_hhmm.length() == 0 || old_msg.length() == 0) {
+      out = "No daily reminder to update. First set one with: reminder_set_daily <HH:MM> <message>";
       return true;
     }
-    String err;
-    if (!skill_remove(name, err)) {
+    if (!persona_set_daily_reminder(reminder_change_hhmm, old_msg, err)) {
       out = "ERR: " + err;
       return true;
     }
-    out = "🧩 Skill '" + name + "' removed.";
+    out = "OK: daily reminder updated to " + reminder_change_hhmm +
+          "\nMessage: " + reminder_message_for_user(old_msg) + unsynced_time_warning();
     return true;
   }
 
-  // use_skill command (explicit skill activation)
-  if (cmd_lc.startsWith("use_skill ") || cmd_lc.startsWith("use skill ")) {
-    String name = cmd.substring(cmd.indexOf(' ') + 1);
-    if (cmd_lc.startsWith("use_skill ")) {
-      name = cmd.substring(10);
-    } else {
-      name = cmd.substring(10);
-    }
-    // Might be "use_skill frontend_dev build a portfolio"
-    int space = name.indexOf(' ');
-    String extra_context = "";
-    if (space > 0) {
-      extra_context = name.substring(space + 1);
-      name = name.substring(0, space);
+  String natural_rem_hhmm;
+  String natural_rem_msg;
+  if (parse_natural_daily_reminder(cmd, natural_rem_hhmm, natural_rem_msg, true)) {
+    String err;
+    if (!has_user_timezone()) {
+      set_pending_reminder_tz(natural_rem_hhmm, natural_rem_msg);
+      out = "Before I set that reminder, tell me your timezone.\n"
+            "Reply: timezone_set Asia/Kolkata";
+      return true;
     }
-    name.trim();
-    name.toLowerCase();
-
-    String content, err;
-    if (!skill_load(name, content, err)) {
+    if (!persona_set_daily_reminder(natural_rem_hhmm, natural_rem_msg, err)) {
       out = "ERR: " + err;
       return true;
     }
-
-    // Build enhanced prompt with skill instructions
-    String prompt = "You are executing the '" + name + "' skill.\n\n"
-                    "=== SKILL INSTRUCTIONS ===\n" + content + "\n"
-                    "=== END SKILL ===\n\n";
-    if (extra_context.length() > 0) {
-      prompt += "User's specific request: " + extra_context + "\n\n";
-    }
-    prompt += "Follow the skill instructions precisely. Be thorough and detailed.";
-
-    String reply, llm_err;
-    if (llm_generate_reply(prompt, reply, llm_err)) {
-      out = "🧩 [" + name + "] " + reply;
-    } else {
-      out = "ERR: Skill execution failed: " + llm_err;
-    }
+    event_log_append("REMINDER set daily " + natural_rem_hhmm + " (natural)");
+    out = "OK: daily reminder set at " + natural_rem_hhmm +
+          "\nMessage: " + reminder_message_for_user(natural_rem_msg) + unsynced_time_warning();
     return true;
   }
 
-#if ENABLE_IMAGE_GEN
-  if (cmd_lc == "generate_image" || cmd_lc.startsWith("generate_image ")) {
-    String prompt = "";
-    if (cmd_lc.startsWith("generate_image ")) {
-      prompt = cmd.substring(14);
-      prompt.trim();
-    }
-    if (prompt.length() == 0) {
-      out = "ERR: usage generate_image <prompt>";
+#if ENABLE_GPIO
+  const int led_flash_count = parse_led_flash_count(cmd_lc);
+  if (led_flash_count != 0) {
+    if (is_safe_mode_enabled()) {
+      out = "ERR: safe mode ON. flash_led blocked";
       return true;
     }
-
-    String base64_image;
-    String llm_error;
-    if (!llm_generate_image(prompt, base64_image, llm_error)) {
-      out = "ERR: " + llm_error;
+    if (led_flash_count < 1 || led_flash_count > 20) {
+      out = "ERR: usage flash_led [1-20]";
       return true;
     }
 
-    if (!transport_telegram_send_photo_base64(base64_image, "")) {
-      out = "ERR: failed to send photo";
+    unsigned long busy_id = 0;
+    const unsigned long id = arm_pending(PENDING_LED_FLASH, -1, -1, led_flash_count, busy_id);
+    if (id == 0) {
+      out = "ERR: pending action exists (id=" + String(busy_id) + "). confirm/cancel first";
       return true;
     }
 
-    out = "Image generated and sent";
+    out = "CONFIRM flash_led " + String(led_flash_count) +
+          "\nRun: confirm " + String(id) +
+          "\nOr: cancel";
     return true;
   }
 #endif
@@ -5075,156 +5689,10 @@ bool tool_registry_execute(const String &input, String &out) {
     return true;
   }
 
-  // files_list - List all files in SPIFFS
-  if (cmd_lc == "files_list" || cmd_lc == "files list" || cmd_lc == "list files") {
-    String list, err;
-    if (!file_memory_list_files(list, err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-    out = list;
-    return true;
-  }
-
   if (is_list_projects_request(cmd_lc)) {
     return list_saved_projects(out);
   }
 
-  // files_get - Read a file from SPIFFS
-  if (cmd_lc.startsWith("files_get ") || cmd_lc.startsWith("files get ") ||
-      cmd_lc.startsWith("read_file ")) {
-    String filename = cmd.substring(cmd.indexOf(" ") + 1);
-    filename.trim();
-    if (filename.length() == 0) {
-      out = "ERR: usage: files_get <filename>";
-      return true;
-    }
-
-    String content, err;
-    if (!file_memory_read_file(filename, content, err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-
-    // Truncate if too long for Telegram
-    if (content.length() > 3000) {
-      out = "📄 " + filename + ":\n" + content.substring(0, 3000) + "\n\n... (truncated, use files_email to get full file)";
-    } else {
-      out = "📄 " + filename + ":\n" + content;
-    }
-    return true;
-  }
-
-  // files_email - Email a specific file
-  if (cmd_lc.startsWith("files_email ") || cmd_lc.startsWith("email file ")) {
-    String tail = cmd.substring(cmd.indexOf(" ") + 1);
-    tail.trim();
-
-    // Parse: files_email <filename> <email>
-    int space_idx = tail.indexOf(' ');
-    if (space_idx <= 0) {
-      out = "ERR: usage: files_email <filename> <email>";
-      return true;
-    }
-
-    String filename = tail.substring(0, space_idx);
-    String to_email = tail.substring(space_idx + 1);
-    filename.trim();
-    to_email.trim();
-
-    if (filename.length() == 0 || to_email.length() == 0) {
-      out = "ERR: usage: files_email <filename> <email>";
-      return true;
-    }
-
-    String content, err;
-    if (!file_memory_read_file(filename, content, err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-
-    Serial.printf("[files_email] File %s read, %d bytes\n", filename.c_str(), content.length());
-
-    String subject = "File from ESP32 Bot: " + filename;
-    String email_err;
-
-    // Detect HTML files and send as html_content
-    String filename_lower = filename;
-    filename_lower.toLowerCase();
-    bool is_html = filename_lower.endsWith(".html") || filename_lower.endsWith(".htm");
-
-    bool sent;
-    if (is_html) {
-      Serial.printf("[files_email] Sending as HTML content\n");
-      sent = email_send(to_email, subject, content, "", email_err);
-    } else {
-      sent = email_send(to_email, subject, "", content, email_err);
-    }
-
-    if (sent) {
-      out = "Emailed " + filename + " (" + String(content.length()) + " bytes) to " + to_email;
-    } else {
-      out = "ERR: " + email_err;
-    }
-    return true;
-  }
-
-  // files_email_all - Email all files
-  if (cmd_lc.startsWith("files_email_all ") || cmd_lc.startsWith("email all files ")) {
-    String to_email = cmd.substring(cmd.indexOf(" ") + 1);
-    to_email.trim();
-
-    if (to_email.length() == 0) {
-      out = "ERR: usage: files_email_all <email>";
-      return true;
-    }
-
-    // Get list of files
-    String list, err;
-    if (!file_memory_list_files(list, err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-
-    // Count files and extract names
-    int file_count = 0;
-    String files[20];  // Max 20 files
-    int idx = 0;
-    while ((idx = list.indexOf("• ", idx)) >= 0 && file_count < 20) {
-      idx += 2;  // Skip "• "
-      int space_idx = list.indexOf(" (", idx);
-      if (space_idx > idx) {
-        files[file_count++] = list.substring(idx, space_idx);
-        idx = space_idx;
-      } else {
-        break;
-      }
-    }
-
-    if (file_count == 0) {
-      out = "No files to email";
-      return true;
-    }
-
-    // Read all files and create combined content
-    String all_content = "📁 All SPIFFS Files:\n\n";
-    for (int i = 0; i < file_count; i++) {
-      String content, file_err;
-      if (file_memory_read_file(files[i], content, file_err)) {
-        all_content += "\n\n======== " + files[i] + " ========\n\n";
-        all_content += content;
-      }
-    }
-
-    String subject = "All files from ESP32 Bot (" + String(file_count) + " files)";
-    String email_err;
-    if (email_send(to_email, subject, "", all_content, email_err)) {
-      out = "Emailed " + String(file_count) + " files to " + to_email;
-    } else {
-      out = "ERR: " + email_err;
-    }
-    return true;
-  }
 #endif
 
 #if ENABLE_MEDIA_UNDERSTANDING
@@ -5245,11 +5713,17 @@ bool tool_registry_execute(const String &input, String &out) {
       cmd_lc.indexOf("extract text") >= 0) {
     
     // Check for document first (PDFs etc)
-    String doc_name, doc_mime, doc_b64, doc_err;
-    if (transport_telegram_get_last_document_base64(doc_name, doc_mime, doc_b64, doc_err)) {
+    String doc_name, doc_mime;
+    if (transport_telegram_last_document_info(doc_name, doc_mime)) {
+      bool is_document = true;
+      LlmMediaSource source;
+      source.mime_type = doc_mime;
+      source.open = telegram_media_open_cb;
+      source.close = telegram_media_close_cb;
+      source.ctx = &is_document;
       String reply, llm_err;
       out = "Analyzing document: " + doc_name + "...";
-      if (llm_understand_media(cmd, doc_mime, doc_b64, reply, llm_err)) {
+      if (llm_understand_media_stream(cmd, source, reply, llm_err)) {
         out = "Document Analysis (" + doc_name + "):\n" + reply;
         return true;
       }
@@ -5258,11 +5732,17 @@ bool tool_registry_execute(const String &input, String &out) {
     }
 
     // Check for photo second
-    String photo_mime, photo_b64, photo_err;
-    if (transport_telegram_get_last_photo_base64(photo_mime, photo_b64, photo_err)) {
+    String photo_mime;
+    if (transport_telegram_last_photo_info(photo_mime)) {
+      bool is_document = false;
+      LlmMediaSource source;
+      source.mime_type = photo_mime;
+      source.open = telegram_media_open_cb;
+      source.close = telegram_media_close_cb;
+      source.ctx = &is_document;
       String reply, llm_err;
       out = "Analyzing photo...";
-      if (llm_understand_media(cmd, photo_mime, photo_b64, reply, llm_err)) {
+      if (llm_understand_media_stream(cmd, source, reply, llm_err)) {
         out = "Photo Analysis:\n" + reply;
         return true;
       }
@@ -5274,281 +5754,253 @@ bool tool_registry_execute(const String &input, String &out) {
   }
 #endif
 
-  // Model management commands
-  if (cmd_lc == "model list" || cmd_lc == "model_list" ||
-      cmd_lc.startsWith("model list ") || cmd_lc.startsWith("model_list ")) {
-    // Check if provider is specified
-    String provider = "";
-    if (cmd_lc.startsWith("model list ")) {
-      provider = cmd.substring(11);
-    } else if (cmd_lc.startsWith("model_list ")) {
-      provider = cmd.substring(11);
-    }
-    provider.trim();
-
-    if (provider.length() > 0) {
-      provider.toLowerCase();
-      // Fetch models from provider
-      if (provider == "openrouter" || provider == "openrouter.ai") {
-        String models, err;
-        if (llm_fetch_provider_models("openrouter", models, err)) {
-          out = models;
-        } else {
-          out = "ERR: " + err;
-        }
+  if (cmd_lc == "time" || cmd_lc == "what time is it" || cmd_lc == "current time") {
+    return tool_web_time(out);
+  }
+
+  return false;
+}
+
+static bool llm_email_request(const String &cmd, String &out) {
+  String to, subject, body, llm_err;
+  if (llm_parse_email_request(cmd, to, subject, body, llm_err)) {
+    if (to.length() > 0) {
+      // Use default subject if LLM didn't provide one
+      if (subject.length() == 0) {
+        subject = "Message from ESP32 Bot";
+      }
+      String email_err;
+      String html_content = "<p>" + body + "</p>";
+
+      if (email_send(to, subject, html_content, body, email_err)) {
+        out = "OK: Email sent to " + to;
         return true;
       } else {
-        out = "ERR: Model listing only supported for OpenRouter.\n"
-              "Usage: model list openrouter";
+        out = "ERR: " + email_err;
         return true;
       }
     }
-
-    // No provider specified, show configured providers
-    String configured = model_config_get_configured_list();
-    out = "Configured providers:\n" + configured +
-          "\n\nUse: model list openrouter to see available models";
-    return true;
   }
+  return false;
+}
 
-  if (cmd_lc == "model status" || cmd_lc == "model_status") {
-    out = model_config_get_status_summary();
-    return true;
-  }
+static bool llm_update_request(const String &input, const String &cmd, uint32_t intents,
+                               String &out) {
+  String url;
+  bool should_update;
+  bool check_github = false;
+  String llm_err;
+  if (llm_parse_update_request(cmd, url, should_update, check_github, llm_err)) {
+    if (should_update) {
+      // If check_github is true, fetch from GitHub releases
+      if (check_github) {
+        out = "=== Checking GitHub Releases ===\n\n";
+
+        // Get GitHub repo from env (default to timiclaw project)
+        String github_repo = GITHUB_REPO;
+        if (github_repo.length() == 0) {
+          github_repo = "timiclaw/timiclaw";  // Default
+        }
 
-  if (cmd_lc.startsWith("model use ") || cmd_lc.startsWith("model_use ")) {
-    String provider = cmd.length() > 9 ? cmd.substring(9) : "";
-    provider.trim();
-    if (provider.length() == 0) {
-      out = "ERR: usage model use <provider>\nProviders: openai, anthropic, gemini, glm";
-      return true;
-    }
-    if (!model_config_is_provider_configured(provider)) {
-      out = "ERR: provider '" + provider + "' not configured.\n"
-            "Use: model set " + provider + " <your_api_key>";
-      return true;
-    }
-    String err;
-    if (!model_config_set_active_provider(provider, err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-    String model = model_config_get_model(provider);
-    out = "OK: switched to " + provider + " (" + model + ")";
-    return true;
-  }
+        out += "Repo: " + github_repo + "\n";
+        out += "Fetching latest release...\n";
+
+        // Fetch latest release from GitHub API
+        TlsSessionClient client;
+        client.setInsecure();
+        HTTPClient http;
+
+        String api_url = "https://api.github.com/repos/" + github_repo + "/releases/latest";
+        Serial.println("[update] Fetching: " + api_url);
+
+        if (http.begin(client, api_url)) {
+          int http_code = http.GET();
+
+          if (http_code == 200) {
+            String payload = http.getString();
+
+            // Parse JSON to find the firmware.bin download URL
+            // GitHub API returns: {"tag_name":"v1.0","assets":[{"name":"firmware.bin","browser_download_url":"..."}]}
+            int tag_idx = payload.indexOf("\"tag_name\":");
+            int assets_idx = payload.indexOf("\"assets\":");
+            int name_idx = payload.indexOf("\"name\":\"firmware.bin\"", assets_idx);
+            int url_idx = payload.indexOf("\"browser_download_url\":", name_idx);
+
+            if (tag_idx > 0 && assets_idx > 0 && name_idx > 0 && url_idx > 0) {
+              // Extract version tag
+              int tag_start = payload.indexOf("\"", tag_idx + 11) + 1;
+              int tag_end = payload.indexOf("\"", tag_start);
+              String version = payload.substring(tag_start, tag_end);
+
+              // Extract download URL
+              int url_start = payload.indexOf("\"", url_idx + 23) + 1;
+              int url_end = payload.indexOf("\"", url_start);
+              String download_url = payload.substring(url_start, url_end);
+
+              out += "\nLatest Release: " + version + "\n";
+              out += "Download URL: " + download_url + "\n";
+              out += "\nStarting update...\n";
+
+              Serial.println("[update] Latest: " + version + " from " + download_url);
+
+              // Perform update
+              t_httpUpdate_return ret = httpUpdate.update(client, download_url);
+
+              switch (ret) {
+                case HTTP_UPDATE_FAILED:
+                  Serial.println("[update] Failed: " + String(httpUpdate.getLastError()));
+                  out = "\nERR: Update failed\n" + httpUpdate.getLastErrorString();
+                  break;
+                case HTTP_UPDATE_NO_UPDATES:
+                  Serial.println("[update] No updates available");
+                  out = "\nERR: No updates available";
+                  break;
+                case HTTP_UPDATE_OK:
+                  Serial.println("[update] Success! Restarting...");
+                  out = "\nOK: Updated to " + version + "! Restarting...";
+                  break;
+              }
+              http.end();
+              return true;
+            } else {
+              out += "\nERR: No firmware.bin found in release assets\n";
+              out += "Please upload firmware.bin to GitHub Releases";
+              http.end();
+              return true;
+            }
+          } else {
+            out += "\nERR: GitHub API HTTP " + String(http_code) + "\n";
+            out += "Check that GITHUB_REPO is set correctly";
+            http.end();
+            return true;
+          }
+        } else {
+          out = "\nERR: Could not connect to GitHub API";
+          return true;
+        }
+      }
+      // If URL was provided, trigger update
+      else if (url.length() > 0) {
+        out = "=== Firmware Update ===\n\n";
+        out += "URL: " + url + "\n";
+        out += "Downloading and flashing...\n";
+        out += "(ESP32 will restart after update)\n";
 
-  if (cmd_lc.startsWith("model set ") || cmd_lc.startsWith("model_set ")) {
-    String tail = cmd.length() > 9 ? cmd.substring(9) : "";
-    tail.trim();
-    if (tail.length() == 0) {
-      out = "ERR: usage model set <provider> <api_key>\nProviders: openai, anthropic, gemini, glm";
-      return true;
-    }
-    // Find first space to separate provider and key
-    int first_space = tail.indexOf(' ');
-    if (first_space < 0) {
-      out = "ERR: usage model set <provider> <api_key>";
-      return true;
-    }
-    String provider = tail.substring(0, first_space);
-    String api_key = tail.substring(first_space + 1);
-    provider.trim();
-    api_key.trim();
-    if (api_key.length() == 0) {
-      out = "ERR: API key cannot be empty";
-      return true;
-    }
-    String err;
-    if (!model_config_set_api_key(provider, api_key, err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-    out = "OK: API key saved for " + provider +
-          "\nUse: model use " + provider + " to activate";
-    return true;
-  }
+        Serial.println("[update] Starting update from: " + url);
 
-  if (cmd_lc.startsWith("model clear ") || cmd_lc.startsWith("model_clear ")) {
-    String provider = cmd.length() > 11 ? cmd.substring(11) : "";
-    provider.trim();
-    if (provider.length() == 0) {
-      out = "ERR: usage model clear <provider>";
-      return true;
-    }
-    String err;
-    if (!model_config_clear_provider(provider, err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-    out = "OK: configuration cleared for " + provider;
-    return true;
-  }
+        TlsSessionClient client;
+        client.setInsecure();
 
-  if (cmd_lc.startsWith("model select ") || cmd_lc.startsWith("model_select ")) {
-    String tail = cmd.length() > 12 ? cmd.substring(12) : "";
-    tail.trim();
-    if (tail.length() == 0) {
-      out = "ERR: usage model select <provider> <model_name>\n"
-            "Example: model select openrouter google/gemini-2.0-flash-exp:free";
-      return true;
-    }
-    int first_space = tail.indexOf(' ');
-    if (first_space < 0) {
-      out = "ERR: usage model select <provider> <model_name>\n"
-            "Example: model select openrouter google/gemini-2.0-flash-exp:free";
-      return true;
-    }
-    String provider = tail.substring(0, first_space);
-    String model_name = tail.substring(first_space + 1);
-    provider.trim();
-    model_name.trim();
-    if (model_name.length() == 0) {
-      out = "ERR: model name cannot be empty";
-      return true;
-    }
-    String err;
-    if (!model_config_set_model(provider, model_name, err)) {
-      out = "ERR: " + err;
-      return true;
+        t_httpUpdate_return ret = httpUpdate.update(client, url);
+
+        switch (ret) {
+          case HTTP_UPDATE_FAILED:
+            Serial.println("[update] Failed: " + String(httpUpdate.getLastError()) + " - " + httpUpdate.getLastErrorString());
+            out = "ERR: Update failed\n" + httpUpdate.getLastErrorString();
+            break;
+          case HTTP_UPDATE_NO_UPDATES:
+            Serial.println("[update] No updates available");
+            out = "ERR: No updates available";
+            break;
+          case HTTP_UPDATE_OK:
+            Serial.println("[update] Success! Restarting...");
+            out = "OK: Update complete! Restarting...";
+            break;
+        }
+        return true;
+      } else {
+        // No URL provided, show update info (like plain /update command)
+        return cmd_update(input, "update", "update", intents, out);
+      }
     }
-    out = "OK: model for " + provider + " set to " + model_name;
-    return true;
   }
+  return false;
+}
 
-  if (cmd_lc == "model failed" || cmd_lc == "model_failed") {
-    out = model_config_get_failed_status();
-    return true;
+// Turns free text into one tool command and runs it through the local stages.
+static bool llm_route_request(const String &input, String &out) {
+  String trimmed = input;
+  trimmed.trim();
+  String routed_command;
+  String route_err;
+  if (!llm_route_tool_command(trimmed, routed_command, route_err)) {
+    return false;
   }
-
-  if (cmd_lc == "model reset_failed" || cmd_lc == "model_reset_failed") {
-    model_config_reset_all_failed_providers();
-    out = "OK: All failed providers have been reset. You can try them again.";
-    return true;
+  routed_command.trim();
+  String reason;
+  if (routed_command.length() == 0 || request_ctx_should_stop(reason)) {
+    return false;
   }
-
-#if ENABLE_EMAIL
-  if (cmd_lc.startsWith("send_email ") || cmd_lc.startsWith("send_email ")) {
-    String remaining = cmd.length() > 10 ? cmd.substring(10) : "";
-    remaining.trim();
-
-    // Parse: send_email <to> <subject> <message>
-    int first_space = remaining.indexOf(' ');
-    if (first_space < 0) {
-      out = "ERR: usage send_email <to> <subject> <message>";
-      return true;
-    }
-
-    String to = remaining.substring(0, first_space);
-    to.trim();
-
-    String after_to = remaining.substring(first_space + 1);
-    after_to.trim();
-
-    int second_space = after_to.indexOf(' ');
-    if (second_space < 0) {
-      out = "ERR: usage send_email <to> <subject> <message>";
-      return true;
-    }
-
-    String subject = after_to.substring(0, second_space);
-    subject.trim();
-
-    String message = after_to.substring(second_space + 1);
-    message.trim();
-
-    if (to.length() == 0 || subject.length() == 0) {
-      out = "ERR: usage send_email <to> <subject> <message>";
-      return true;
-    }
-
-    String err;
-    String html_content = "<p>" + message + "</p>";
-    String text_content = message;
-
-    if (!email_send(to, subject, html_content, text_content, err)) {
-      out = "ERR: " + err;
-      return true;
-    }
-
-    out = "OK: Email sent to " + to;
-    return true;
+  String routed_response;
+  if (!tool_registry_execute(routed_command, routed_response, TOOL_COST_HEURISTIC)) {
+    return false;
   }
-#endif
-
-  // WhatsApp Tools
-  if (cmd_lc.startsWith("discord_send ") || cmd_lc == "discord_send") {
-    String message = cmd.length() > 13 ? cmd.substring(13) : "";
-    message.trim();
-
-    if (message.length() == 0) {
-      out = "ERR: usage discord_send <message>";
-      return true;
-    }
-
-    String err;
-    if (!discord_send_message(message, err)) {
-      out = "ERR: Discord send failed: " + err;
-      return true;
-    }
-
-    out = "OK: Message sent via Discord";
-    event_log_append("DISCORD msg");
-    return true;
+  if (routed_response.length() > 3400 && !code_scan_contains_code(routed_response)) {
+    routed_response = routed_response.substring(0, 3400) + "...";
   }
+  event_log_append("ROUTE: " + routed_command);
+  out = routed_response;
+  return true;
+}
 
-  if (cmd_lc == "discord_send_files" || cmd_lc.startsWith("discord_send_files ")) {
-    String topic = cmd.length() > 19 ? cmd.substring(19) : "";
-    topic = sanitize_web_topic(topic);
-
-    String html, css, js, err;
-    // Generate the files
-    build_small_web_files(topic, html, css, js);
-
-    if (!discord_send_web_files(topic, html, css, js, err)) {
-      out = "ERR: Discord send failed: " + err;
-      return true;
-    }
-
-    out = "OK: Files generated and sent via Discord";
-    event_log_append("DISCORD files " + topic);
-    return true;
+// The intent bits pick one LLM classifier: email, else update, else the
+// router. Only that one runs, so the stage costs at most one round trip; if
+// it finds nothing the message goes on to chat.
+static bool stage_llm_classify(const String &input, const String &cmd, const String &cmd_lc,
+                               uint32_t intents, String &out) {
+  if (looks_like_email_request(intents) && !cmd_lc.startsWith("send_email ") &&
+      !cmd_lc.startsWith("email_")) {
+    return llm_email_request(cmd, out);
   }
-
-  // Web Tools
-  if (cmd_lc == "web_search" || cmd_lc.startsWith("web_search ")) {
-    String query = cmd.length() > 11 ? cmd.substring(11) : "";
-    query.trim();
-    if (query.length() == 0) {
-      out = "ERR: usage web_search <query>";
-      return true;
-    }
-    return tool_web_search(query, out);
+  // "update http..." is a plain command; only free text needs the model
+  if (looks_like_update_request(intents) && !cmd_lc.startsWith("update http")) {
+    return llm_update_request(input, cmd, intents, out);
   }
-
-  if (cmd_lc.startsWith("weather ") || cmd_lc.startsWith("check weather ")) {
-    String loc = cmd.substring(cmd_lc.indexOf(' ') + 1);
-    loc.trim();
-    if (loc.length() == 0) {
-      out = "ERR: usage weather <location>";
-      return true;
-    }
-    return tool_web_weather(loc, out);
+  if (should_route(input, intents)) {
+    return llm_route_request(input, out);
   }
+  return false;
+}
 
-  if (cmd_lc == "time" || cmd_lc == "what time is it" || cmd_lc == "current time") {
-    return tool_web_time(out);
-  }
+struct DispatchStage {
+  const char *name;
+  ToolCost cost;
+  CommandHandler run;  // true = handled, later stages are skipped
+};
 
-  // MinOS Bridge
-  if (cmd_lc == "minos" || cmd_lc.startsWith("minos ")) {
-    String minos_cmd = cmd.length() > 6 ? cmd.substring(6) : "help";
-    minos_cmd.trim();
-    String minos_out;
-    shell_run_once(minos_cmd, minos_out);
-    out = "🦖 MinOS Shell Output:\n" + minos_out;
-    return true;
-  }
+// Cheapest first, so a plain command never waits on a network round trip.
+static const DispatchStage kStages[] = {
+    {"state", TOOL_COST_EXACT, stage_state},
+    {"exact", TOOL_COST_EXACT, stage_exact_command},
+    {"param", TOOL_COST_PARAM, stage_param_command},
+    {"heuristic", TOOL_COST_HEURISTIC, stage_heuristic},
+    {"llm", TOOL_COST_LLM, stage_llm_classify},
+};
 
-  return false;
+bool tool_registry_execute(const String &input, String &out, ToolCost max_cost) {
+  String cmd = normalize_command(input);
+  cmd.trim();
+  String cmd_lc = cmd;
+  cmd_lc.toLowerCase();
+  const uint32_t intents = intent_classify(cmd);
+
+  const unsigned long started = millis();
+  String trace;
+  bool handled = false;
+  for (size_t i = 0; i < sizeof(kStages) / sizeof(kStages[0]) && !handled; i++) {
+    const DispatchStage &stage = kStages[i];
+    if (stage.cost > max_cost) {
+      break;
+    }
+    if (trace.length() > 0) {
+      trace += ">";
+    }
+    trace += stage.name;
+    handled = stage.run(input, cmd, cmd_lc, intents, out);
+  }
+#if TOOL_DISPATCH_TRACE
+  Serial.printf("[tools] dispatch %s: %s (%lu ms)\n", trace.c_str(), handled ? "hit" : "miss",
+                millis() - started);
+#endif
+  return handled;
 }
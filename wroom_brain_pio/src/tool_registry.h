@@ -3,8 +3,17 @@
 
 #include <Arduino.h>
 
+// Dispatch stages in order of cost. A call runs the stages up to max_cost
+// and stops at the first one that handles the input.
+enum ToolCost {
+  TOOL_COST_EXACT,      // whole input is a command name (one hash probe)
+  TOOL_COST_PARAM,      // command name followed by arguments
+  TOOL_COST_HEURISTIC,  // local natural-language parsing, no network
+  TOOL_COST_LLM,        // one LLM classification round trip
+};
+
 void tool_registry_init();
-bool tool_registry_execute(const String &input, String &out);
+bool tool_registry_execute(const String &input, String &out, ToolCost max_cost = TOOL_COST_LLM);
 
 // Auto-update check on boot (async, sends notification if update available)
 void tool_registry_check_updates_async();
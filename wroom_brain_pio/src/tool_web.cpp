@@ -2,6 +2,7 @@
 #include "brain_config.h"
 #include "llm_client.h"
 #include "web_search.h"
+#include "tls_session_cache.h"
 
 #include <Arduino.h>
 #include <HTTPClient.h>
@@ -13,7 +14,7 @@
 static String http_get(const String &url, const String &header_name = "", const String &header_val = "", int *code_out = nullptr) {
   if (WiFi.status() != WL_CONNECTED) return "";
   
-  WiFiClientSecure client;
+  TlsSessionClient client;
   client.setInsecure(); // Simplify certs
   HTTPClient http;
   
@@ -2,21 +2,73 @@
 
 #include <Arduino.h>
 #include <WiFi.h>
-#include <WiFiClientSecure.h>
 #include <HTTPClient.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <utility>
 
 #include "brain_config.h"
+#include "file_memory.h"
+#include "http_pool.h"
+#include "json_stream.h"
+#include "json_writer.h"
+#include "media_cache.h"
+#include "multipart_stream.h"
+#include "telegram_outbox.h"
+#include "tls_session_cache.h"
 
 static unsigned long s_last_poll_ms = 0;
 static long long s_last_update_id = 0;
-static const size_t kMaxMediaDownloadBytes = 120000;
-
+static portMUX_TYPE s_update_mux = portMUX_INITIALIZER_UNLOCKED;  // poll task vs webhook
+static const size_t kMaxPhotoUploadBytes = 10UL * 1024UL * 1024UL;  // sendPhoto limit
+static const uint32_t kOutboxDrainMs = 15000;
+
+// Most recent chat, photo and document. Written by whichever task dispatches
+// updates and read by the agent workers; String assignment reallocates, so
+// every access holds s_state_mutex and readers work on copies.
+struct LastMedia {
+  String file_id;
+  String unique_id;
+  String name;
+  String mime;
+};
+
+static SemaphoreHandle_t s_state_mutex = NULL;
+// Webhook updates parsed on the web server task, waiting for the poller to
+// dispatch them (TelegramUpdate* owned by the queue until received).
+static QueueHandle_t s_webhook_queue = NULL;
 static String s_last_chat_id = TELEGRAM_ALLOWED_CHAT_ID;
-static String s_last_photo_file_id = "";
-static String s_last_photo_mime = "image/jpeg";
-static String s_last_document_file_id = "";
-static String s_last_document_name = "";
-static String s_last_document_mime = "";
+static LastMedia s_last_photo;
+static LastMedia s_last_document;
+
+// The mutex is created in transport_telegram_init(), before any task that
+// dispatches updates exists; until then there is nothing to race with.
+static void state_lock() {
+  if (s_state_mutex != NULL) {
+    xSemaphoreTake(s_state_mutex, portMAX_DELAY);
+  }
+}
+
+static void state_unlock() {
+  if (s_state_mutex != NULL) {
+    xSemaphoreGive(s_state_mutex);
+  }
+}
+
+static String last_chat_id() {
+  state_lock();
+  const String chat_id = s_last_chat_id;
+  state_unlock();
+  return chat_id;
+}
+
+static LastMedia last_media(bool document) {
+  state_lock();
+  const LastMedia media = document ? s_last_document : s_last_photo;
+  state_unlock();
+  return media;
+}
 
 static String url_encode(const String &src) {
   // Keep for backward compatibility, but preserve UTF-8 characters
@@ -49,124 +101,68 @@ static String url_encode(const String &src) {
   return out;
 }
 
-static String https_get(const String &url, int *status_code) {
-  WiFiClientSecure client;
-  client.setInsecure();
+static String https_get(const String &url, int *status_code, uint16_t read_timeout_ms = 0) {
+  String body;
+  int code = -1;
+  for (int attempt = 0; attempt < 2; attempt++) {
+    HttpPoolLease lease;
+    if (!http_pool_acquire(url, lease)) {
+      code = -1;
+      break;
+    }
+
+    lease.http->setConnectTimeout(12000);
+    lease.http->setTimeout(read_timeout_ms > 0 ? read_timeout_ms : 20000);
 
-  HTTPClient https;
-  if (!https.begin(client, url)) {
-    if (status_code) {
-      *status_code = -1;
+    code = lease.http->GET();
+    body = code > 0 ? lease.http->getString() : String();
+
+    const bool retry = http_pool_should_retry(lease, code, "GET");
+    http_pool_release(lease, code > 0);
+    if (!retry) {
+      break;
     }
-    return String();
   }
 
-  const int code = https.GET();
   if (status_code) {
     *status_code = code;
   }
-
-  String body;
-  if (code > 0) {
-    body = https.getString();
-  }
-
-  https.end();
   return body;
 }
 
-static int https_post_raw(const String &url, const String &content_type, const String &body,
-                          String *response_out) {
-  WiFiClientSecure client;
-  client.setInsecure();
-
-  HTTPClient https;
-  if (!https.begin(client, url)) {
+// The body is escaped while it is sent (see json_writer.h), so message text
+// is never copied into an escaped request String.
+static int https_post_json(const String &url, JsonBody &body, String *response_out) {
+  if (!body.ok()) {
     return -1;
   }
-
-  https.setConnectTimeout(12000);
-  https.setTimeout(20000);
-  if (content_type.length() > 0) {
-    https.addHeader("Content-Type", content_type);
-  }
-
-  const int code = https.POST((uint8_t *)body.c_str(), body.length());
-  if (response_out != nullptr) {
-    if (code > 0) {
-      *response_out = https.getString();
-    } else {
-      *response_out = "";
+  int code = -1;
+  for (int attempt = 0; attempt < 2; attempt++) {
+    HttpPoolLease lease;
+    if (!http_pool_acquire(url, lease)) {
+      code = -1;
+      break;
     }
-  }
-  https.end();
-  return code;
-}
-
-static bool extract_int64_after_key(const String &body, const char *key, long long *value_out) {
-  const int k = body.indexOf(key);
-  if (k < 0) {
-    return false;
-  }
-
-  int i = k + (int)strlen(key);
-  while (i < (int)body.length() && (body[i] == ' ' || body[i] == ':')) {
-    i++;
-  }
-
-  bool neg = false;
-  if (i < (int)body.length() && body[i] == '-') {
-    neg = true;
-    i++;
-  }
-
-  long long v = 0;
-  bool any = false;
-  while (i < (int)body.length() && body[i] >= '0' && body[i] <= '9') {
-    any = true;
-    v = v * 10 + (body[i] - '0');
-    i++;
-  }
-
-  if (!any) {
-    return false;
-  }
-
-  *value_out = neg ? -v : v;
-  return true;
-}
-
-static bool extract_number_string_after_key(const String &body, const char *key, String &value_out) {
-  const int k = body.indexOf(key);
-  if (k < 0) {
-    return false;
-  }
-
-  int i = k + (int)strlen(key);
-  while (i < (int)body.length() && (body[i] == ' ' || body[i] == ':')) {
-    i++;
-  }
-  if (i >= (int)body.length()) {
-    return false;
-  }
 
-  const int start = i;
-  if (body[i] == '-') {
-    i++;
-  }
+    lease.http->setConnectTimeout(12000);
+    lease.http->setTimeout(20000);
+    lease.http->addHeader("Content-Type", "application/json");
 
-  bool any = false;
-  while (i < (int)body.length() && body[i] >= '0' && body[i] <= '9') {
-    any = true;
-    i++;
-  }
+    body.rewind();
+    code = lease.http->sendRequest("POST", &body, body.length());
+    // Always drain the body so the connection can be reused.
+    const String response = code > 0 ? lease.http->getString() : String();
+    if (response_out != nullptr) {
+      *response_out = response;
+    }
 
-  if (!any) {
-    return false;
+    const bool retry = http_pool_should_retry(lease, code, "POST");
+    http_pool_release(lease, code > 0);
+    if (!retry) {
+      break;
+    }
   }
-
-  value_out = body.substring(start, i);
-  return true;
+  return code;
 }
 
 static bool extract_escaped_string_after_key(const String &body, const char *key, String &value_out) {
@@ -227,84 +223,10 @@ static bool extract_escaped_string_after_key(const String &body, const char *key
   return false;
 }
 
-static bool extract_string_after_anchor(const String &body, const char *anchor,
-                                        const char *key, String &value_out) {
-  const int anchor_pos = body.indexOf(anchor);
-  if (anchor_pos < 0) {
-    return false;
-  }
-  return extract_escaped_string_after_key(body.substring(anchor_pos), key, value_out);
-}
-
-static bool extract_last_photo_file_id(const String &body, String &file_id_out) {
-  const int photo_pos = body.indexOf("\"photo\":[");
-  if (photo_pos < 0) {
-    return false;
-  }
-
-  const int close_pos = body.indexOf(']', photo_pos);
-  if (close_pos < 0 || close_pos <= photo_pos) {
-    return false;
-  }
-
-  String segment = body.substring(photo_pos, close_pos + 1);
-  const String key = "\"file_id\":\"";
-  int search = 0;
-  int found = -1;
-  int count = 0;
-  while (true) {
-    const int pos = segment.indexOf(key, search);
-    if (pos < 0) {
-      break;
-    }
-    found = pos;
-    search = pos + (int)key.length();
-    count++;
-    if (count >= 2) break; // Stop after finding the 2nd one (usually ~320px w/h)
-  }
-
-  if (found < 0) {
-    return false;
-  }
-
-  return extract_escaped_string_after_key(segment.substring(found), key.c_str(), file_id_out);
-}
-
-static bool extract_document_meta(const String &body, String &file_id_out,
-                                  String &name_out, String &mime_out) {
-  if (!extract_string_after_anchor(body, "\"document\"", "\"file_id\":\"", file_id_out)) {
-    return false;
-  }
-  (void)extract_string_after_anchor(body, "\"document\"", "\"file_name\":\"", name_out);
-  (void)extract_string_after_anchor(body, "\"document\"", "\"mime_type\":\"", mime_out);
-  return true;
-}
-
 static bool extract_file_path_from_getfile(const String &body, String &path_out) {
   return extract_escaped_string_after_key(body, "\"file_path\":\"", path_out);
 }
 
-static bool extract_text_field(const String &body, String &text_out) {
-  if (extract_escaped_string_after_key(body, "\"text\":\"", text_out)) {
-    return true;
-  }
-  if (extract_escaped_string_after_key(body, "\"caption\":\"", text_out)) {
-    return true;
-  }
-  return false;
-}
-
-static bool extract_chat_id(const String &body, String &chat_id_out) {
-  if (!extract_number_string_after_key(body, "\"chat\":{\"id\"", chat_id_out)) {
-    if (!extract_number_string_after_key(body, "\"chat\": {\"id\"", chat_id_out)) {
-      if (!extract_number_string_after_key(body, "\"chat\":{ \"id\"", chat_id_out)) {
-        return false;
-      }
-    }
-  }
-  return true;
-}
-
 static bool is_wifi_ready() {
   return WiFi.status() == WL_CONNECTED;
 }
@@ -329,119 +251,247 @@ static void ensure_wifi() {
   if (WiFi.status() == WL_CONNECTED) {
     Serial.print("[tg] WiFi connected, IP=");
     Serial.println(WiFi.localIP());
+    // Sessions from the previous link are not worth resuming.
+    tls_session_cache_clear();
   } else {
     Serial.println("[tg] WiFi connect timeout");
   }
 }
 
-void transport_telegram_init() {
-  ensure_wifi();
-  Serial.println("[tg] transport initialized");
-}
+// Points Telegram at our /tg/<secret> route. Updates then arrive by POST and
+// getUpdates is refused (409) until the webhook is deleted again.
+static void register_webhook() {
+  const String base = TELEGRAM_WEBHOOK_URL;
+  const String secret = TELEGRAM_WEBHOOK_SECRET;
+  if (base.length() == 0 || secret.length() == 0 || !is_wifi_ready()) {
+    return;
+  }
+  String hook = base;
+  if (hook.endsWith("/")) {
+    hook.remove(hook.length() - 1);
+  }
+  hook += "/tg/" + secret;
 
-static String json_escape_string(const String &src) {
-  String out;
-  out.reserve(src.length() * 1.2);
+  const String url = String("https://api.telegram.org/bot") + TELEGRAM_BOT_TOKEN + "/setWebhook";
+  JsonBody json;
+  json.raw("{\"url\":").str(hook).raw(",\"secret_token\":").str(secret).raw(
+      ",\"allowed_updates\":[\"message\",\"edited_message\",\"channel_post\"]}");
+  String response;
+  const int code = https_post_json(url, json, &response);
+  if (code == 200 && response.indexOf("\"ok\":true") >= 0) {
+    Serial.println("[tg] webhook registered: " + base + "/tg/***");
+  } else {
+    Serial.printf("[tg] setWebhook failed code=%d, staying on polling\n", code);
+  }
+}
 
-  for (size_t i = 0; i < src.length(); i++) {
-    const char c = src[i];
-    switch (c) {
-      case '"':  out += "\\\""; break;
-      case '\\': out += "\\\\"; break;
-      case '\n': out += "\\n"; break;
-      case '\r': out += "\\r"; break;
-      case '\t': out += "\\t"; break;
-      case '\b': out += "\\b"; break;
-      case '\f': out += "\\f"; break;
-      default:
-        // Pass UTF-8 through directly
-        out += c;
-        break;
-    }
+void transport_telegram_init() {
+  if (s_state_mutex == NULL) {
+    s_state_mutex = xSemaphoreCreateMutex();
   }
-  return out;
+  if (s_webhook_queue == NULL) {
+    s_webhook_queue = xQueueCreate(TELEGRAM_WEBHOOK_QUEUE_DEPTH, sizeof(TelegramUpdate *));
+  }
+  ensure_wifi();
+  register_webhook();
+  Serial.println("[tg] transport initialized");
 }
 
-void transport_telegram_send(const String &msg) {
+int transport_telegram_post_message(const String &chat_id, const String &text,
+                                    String *response_out) {
   if (!is_wifi_ready()) {
     ensure_wifi();
     if (!is_wifi_ready()) {
-      return;
+      return -1;
     }
   }
 
   // Use JSON POST for better unicode support
   const String url = String("https://api.telegram.org/bot") + TELEGRAM_BOT_TOKEN + "/sendMessage";
 
-  // Build JSON payload
-  String json = "{\"chat_id\":\"" + s_last_chat_id + "\",\"text\":\"";
-  json += json_escape_string(msg);
-  json += "\"}";
+  JsonBody json;
+  json.raw("{\"chat_id\":").str(chat_id).raw(",\"text\":").str(text).raw("}");
 
-  String response;
-  const int code = https_post_raw(url, "application/json", json, &response);
+  const int code = https_post_json(url, json, response_out);
 
   Serial.print("[tg] send code=");
   Serial.println(code);
+  return code;
 }
 
-bool transport_telegram_send_document(const String &filename, const String &content,
-                                      const String &mime_type, const String &caption) {
-  if (!is_wifi_ready()) {
-    ensure_wifi();
-    if (!is_wifi_ready()) {
-      return false;
+void transport_telegram_send(const String &msg) {
+  const String chat_id = last_chat_id();
+  if (telegram_outbox_send_text(chat_id, msg)) {
+    return;
+  }
+  transport_telegram_post_message(chat_id, msg, nullptr);
+}
+
+// Streams a multipart body; the body is rewound if the first attempt hit a
+// stale keep-alive connection.
+static int https_post_stream(const String &url, MultipartStream &body, String *response_out,
+                             uint16_t read_timeout_ms = 20000) {
+  int code = -1;
+  const size_t length = body.length();
+  for (int attempt = 0; attempt < 2; attempt++) {
+    if (!body.rewind()) {
+      break;
+    }
+    HttpPoolLease lease;
+    if (!http_pool_acquire(url, lease)) {
+      code = -1;
+      break;
+    }
+
+    lease.http->setConnectTimeout(12000);
+    lease.http->setTimeout(read_timeout_ms);
+    lease.http->addHeader("Content-Type", body.content_type());
+
+    code = lease.http->sendRequest("POST", &body, length);
+    const String response = code > 0 ? lease.http->getString() : String();
+    if (response_out != nullptr) {
+      *response_out = response;
+    }
+
+    const bool retry = http_pool_should_retry(lease, code, "POST");
+    http_pool_release(lease, code > 0 && !body.failed());
+    if (!retry) {
+      break;
     }
   }
+  return code;
+}
 
+static String document_name_or_default(const String &filename) {
   String safe_name = filename;
   safe_name.trim();
-  if (safe_name.length() == 0) {
-    safe_name = "file.txt";
-  }
+  return safe_name.length() > 0 ? safe_name : String("file.txt");
+}
 
+static String document_mime_or_default(const String &mime_type) {
   String safe_mime = mime_type;
   safe_mime.trim();
-  if (safe_mime.length() == 0) {
-    safe_mime = "text/plain";
+  return safe_mime.length() > 0 ? safe_mime : String("text/plain");
+}
+
+static int post_document_body(MultipartStream &body, String *response_out) {
+  if (body.overflowed()) {
+    return -1;
   }
+  const String url = String("https://api.telegram.org/bot") + TELEGRAM_BOT_TOKEN + "/sendDocument";
+  const int code = https_post_stream(url, body, response_out);
 
-  String boundary = "----esp32boundary" + String((unsigned long)millis());
-  String payload;
-  payload.reserve(content.length() + caption.length() + 512);
+  Serial.print("[tg] sendDocument code=");
+  Serial.println(code);
+  return code;
+}
 
-  payload += "--" + boundary + "\r\n";
-  payload += "Content-Disposition: form-data; name=\"chat_id\"\r\n\r\n";
-  payload += s_last_chat_id + "\r\n";
+int transport_telegram_post_document(const String &chat_id, const String &filename,
+                                     const String &content, const String &mime_type,
+                                     const String &caption, String *response_out) {
+  if (!is_wifi_ready()) {
+    ensure_wifi();
+    if (!is_wifi_ready()) {
+      return -1;
+    }
+  }
 
+  MultipartStream body;
+  body.add_field("chat_id", chat_id);
   if (caption.length() > 0) {
-    payload += "--" + boundary + "\r\n";
-    payload += "Content-Disposition: form-data; name=\"caption\"\r\n\r\n";
-    payload += caption + "\r\n";
+    body.add_field("caption", caption);
   }
+  body.add_file("document", document_name_or_default(filename), document_mime_or_default(mime_type),
+                content);
+  return post_document_body(body, response_out);
+}
 
-  payload += "--" + boundary + "\r\n";
-  payload += "Content-Disposition: form-data; name=\"document\"; filename=\"" + safe_name + "\"\r\n";
-  payload += "Content-Type: " + safe_mime + "\r\n\r\n";
-  payload += content;
-  payload += "\r\n--" + boundary + "--\r\n";
+int transport_telegram_post_document_file(const String &chat_id, fs::File &file,
+                                          const String &filename, const String &mime_type,
+                                          const String &caption, String *response_out) {
+  if (!is_wifi_ready()) {
+    ensure_wifi();
+    if (!is_wifi_ready()) {
+      return -1;
+    }
+  }
 
-  const String url = String("https://api.telegram.org/bot") + TELEGRAM_BOT_TOKEN + "/sendDocument";
-  String response;
-  const int code = https_post_raw(url, "multipart/form-data; boundary=" + boundary, payload, &response);
+  MultipartStream body;
+  body.add_field("chat_id", chat_id);
+  if (caption.length() > 0) {
+    body.add_field("caption", caption);
+  }
+  body.add_file("document", document_name_or_default(filename), document_mime_or_default(mime_type),
+                file);
+  return post_document_body(body, response_out);
+}
 
-  Serial.print("[tg] sendDocument code=");
-  Serial.println(code);
+bool transport_telegram_send_document(const String &filename, String content,
+                                      const String &mime_type, const String &caption) {
+  const String chat_id = last_chat_id();
+  if (telegram_outbox_send_document(chat_id, filename, std::move(content), mime_type, caption)) {
+    return true;
+  }
+  const int code =
+      transport_telegram_post_document(chat_id, filename, content, mime_type, caption, nullptr);
+  return code >= 200 && code < 300;
+}
+
+bool transport_telegram_send_file(const String &path, const String &mime_type,
+                                  const String &caption) {
+  const String chat_id = last_chat_id();
+  if (telegram_outbox_send_file(chat_id, path, mime_type, caption)) {
+    return true;
+  }
+  String err;
+  const int code = transport_telegram_post_file(chat_id, path, mime_type, caption, nullptr, err);
+  if (err.length() > 0) {
+    Serial.println("[tg] sendFile: " + err);
+  }
   return code >= 200 && code < 300;
 }
 
+int transport_telegram_post_file(const String &chat_id, const String &path, const String &mime_type,
+                                 const String &caption, String *response_out, String &error_out) {
+  fs::File file;
+  if (!file_memory_open_file(path, file, error_out)) {
+    return -1;
+  }
+  const int slash = path.lastIndexOf('/');
+  const String filename = slash >= 0 ? path.substring(slash + 1) : path;
+  const int code =
+      transport_telegram_post_document_file(chat_id, file, filename, mime_type, caption, response_out);
+  file.close();
+  return code;
+}
+
 // ============ STREAMING SUPPORT ============
 
+// message_id is numeric: {"ok":true,"result":{"message_id":123,...}}
 static bool extract_message_id_from_response(const String &response, String &message_id_out) {
-  return extract_escaped_string_after_key(response, "\"message_id\":\"", message_id_out);
+  const char *kKey = "\"message_id\":";
+  int pos = response.indexOf(kKey);
+  if (pos < 0) {
+    return false;
+  }
+  pos += strlen(kKey);
+  while (pos < (int)response.length() && response[pos] == ' ') {
+    pos++;
+  }
+  int end = pos;
+  while (end < (int)response.length() && response[end] >= '0' && response[end] <= '9') {
+    end++;
+  }
+  if (end == pos) {
+    return false;
+  }
+  message_id_out = response.substring(pos, end);
+  return true;
 }
 
 String transport_telegram_send_streaming_start(const String &initial_msg) {
+  telegram_outbox_wait_idle(kOutboxDrainMs);
+
   if (!is_wifi_ready()) {
     ensure_wifi();
     if (!is_wifi_ready()) {
@@ -452,12 +502,12 @@ String transport_telegram_send_streaming_start(const String &initial_msg) {
   // Send initial message
   const String url = String("https://api.telegram.org/bot") + TELEGRAM_BOT_TOKEN + "/sendMessage";
 
-  String json = "{\"chat_id\":\"" + s_last_chat_id + "\",\"text\":\"";
-  json += json_escape_string(initial_msg);
-  json += "\"}";
+  const String chat_id = last_chat_id();
+  JsonBody json;
+  json.raw("{\"chat_id\":").str(chat_id).raw(",\"text\":").str(initial_msg).raw("}");
 
   String response;
-  const int code = https_post_raw(url, "application/json", json, &response);
+  const int code = https_post_json(url, json, &response);
 
   if (code != 200) {
     Serial.println("[tg] streaming start failed");
@@ -474,184 +524,569 @@ String transport_telegram_send_streaming_start(const String &initial_msg) {
   return "";
 }
 
-bool transport_telegram_send_streaming_edit(const String &message_id, const String &new_text) {
+int transport_telegram_post_edit(const String &chat_id, const String &message_id,
+                                 const String &text, String *response_out) {
   if (!is_wifi_ready()) {
-    return false;
+    return -1;
+  }
+
+  const String url = String("https://api.telegram.org/bot") + TELEGRAM_BOT_TOKEN + "/editMessageText";
+
+  JsonBody json;
+  json.raw("{\"chat_id\":").str(chat_id).raw(",\"message_id\":").raw(message_id);
+  json.raw(",\"text\":").str(text).raw("}");
+
+  String response;
+  int code = https_post_json(url, json, &response);
+  // Re-sending identical text is rejected with 400; the message is already right.
+  if (code == 400 && response.indexOf("message is not modified") >= 0) {
+    code = 200;
   }
+  if (response_out != nullptr) {
+    *response_out = response;
+  }
+  return code;
+}
 
+bool transport_telegram_send_streaming_edit(const String &message_id, const String &new_text) {
   if (message_id.length() == 0) {
     return false;
   }
+  const String chat_id = last_chat_id();
+  if (telegram_outbox_edit_text(chat_id, message_id, new_text)) {
+    return true;
+  }
+  const int code = transport_telegram_post_edit(chat_id, message_id, new_text, nullptr);
+  return (code >= 200 && code < 300);
+}
 
-  const String url = String("https://api.telegram.org/bot") + TELEGRAM_BOT_TOKEN + "/editMessageText";
+// ============ UPDATE PARSING ============
 
-  String json = "{\"chat_id\":\"" + s_last_chat_id + "\",\"message_id\":\"" + message_id + "\",\"text\":\"";
-  json += json_escape_string(new_text);
-  json += "\"}";
+namespace {
 
-  String response;
-  const int code = https_post_raw(url, "application/json", json, &response);
+// Cap for a single captured string (text/caption). Telegram allows 4096
+// UTF-16 units, i.e. up to ~12KB of UTF-8.
+static const size_t kMaxUpdateStringBytes = 12288;
+
+enum UpdateField {
+  UF_NONE,
+  UF_UPDATE_ID,
+  UF_MESSAGE_ID,
+  UF_CHAT_ID,
+  UF_TEXT,
+  UF_CAPTION,
+  UF_PHOTO_FILE_ID,
+  UF_PHOTO_UNIQUE_ID,
+  UF_PHOTO_WIDTH,
+  UF_PHOTO_HEIGHT,
+  UF_PHOTO_SIZE,
+  UF_DOC_FILE_ID,
+  UF_DOC_UNIQUE_ID,
+  UF_DOC_NAME,
+  UF_DOC_MIME,
+  UF_DOC_SIZE,
+  UF_REPLY_ID,
+  UF_REPLY_TEXT,
+};
+
+typedef void (*update_sink_t)(const TelegramUpdate &update, void *user);
+
+struct UpdateParseCtx {
+  const char *root_key;  // "result" for getUpdates, nullptr for a bare Update object
+  int base;              // path depth of each Update object
+  TelegramUpdate update;
+  update_sink_t sink;
+  void *user;
+  int dispatched;
+};
+
+static bool key_is(const char *a, const char *b) {
+  return strcmp(a, b) == 0;
+}
 
-  return (code >= 200 && code < 300);
+static bool is_message_key(const char *k) {
+  return key_is(k, "message") || key_is(k, "edited_message") || key_is(k, "channel_post") ||
+         key_is(k, "edited_channel_post");
 }
 
-void transport_telegram_poll(incoming_cb_t cb) {
-  if (cb == nullptr) {
-    return;
+static bool at_update_root(const JsonStreamParser &p, const UpdateParseCtx &ctx) {
+  if (p.depth() != ctx.base) {
+    return false;
   }
+  return ctx.root_key == nullptr || key_is(p.key_at(0), ctx.root_key);
+}
 
-  if ((millis() - s_last_poll_ms) < TELEGRAM_POLL_MS) {
-    return;
+static UpdateField classify_field(const JsonStreamParser &p, const UpdateParseCtx &ctx) {
+  const int b = ctx.base;
+  const int rel = p.depth() - b;
+  if (rel < 1 || (ctx.root_key != nullptr && !key_is(p.key_at(0), ctx.root_key))) {
+    return UF_NONE;
+  }
+  if (rel == 1) {
+    return key_is(p.key_at(b), "update_id") ? UF_UPDATE_ID : UF_NONE;
+  }
+  if (!is_message_key(p.key_at(b))) {
+    return UF_NONE;
   }
-  s_last_poll_ms = millis();
 
-  if (!is_wifi_ready()) {
-    ensure_wifi();
-    return;
+  const char *k1 = p.key_at(b + 1);
+  if (rel == 2) {
+    if (key_is(k1, "message_id")) return UF_MESSAGE_ID;
+    if (key_is(k1, "text")) return UF_TEXT;
+    if (key_is(k1, "caption")) return UF_CAPTION;
+    return UF_NONE;
   }
 
-  const String url = String("https://api.telegram.org/bot") + TELEGRAM_BOT_TOKEN +
-                     "/getUpdates?timeout=0&limit=1&offset=" + String(s_last_update_id + 1);
+  const char *k2 = p.key_at(b + 2);
+  if (rel == 3) {
+    if (key_is(k1, "chat")) {
+      return key_is(k2, "id") ? UF_CHAT_ID : UF_NONE;
+    }
+    if (key_is(k1, "document")) {
+      if (key_is(k2, "file_id")) return UF_DOC_FILE_ID;
+      if (key_is(k2, "file_unique_id")) return UF_DOC_UNIQUE_ID;
+      if (key_is(k2, "file_name")) return UF_DOC_NAME;
+      if (key_is(k2, "mime_type")) return UF_DOC_MIME;
+      if (key_is(k2, "file_size")) return UF_DOC_SIZE;
+      return UF_NONE;
+    }
+    if (key_is(k1, "reply_to_message")) {
+      if (key_is(k2, "message_id")) return UF_REPLY_ID;
+      if (key_is(k2, "text") || key_is(k2, "caption")) return UF_REPLY_TEXT;
+    }
+    return UF_NONE;
+  }
 
-  int code = 0;
-  const String body = https_get(url, &code);
-  if (code != 200 || body.length() == 0) {
+  if (rel == 4 && key_is(k1, "photo")) {
+    const char *k3 = p.key_at(b + 3);
+    if (key_is(k3, "file_id")) return UF_PHOTO_FILE_ID;
+    if (key_is(k3, "file_unique_id")) return UF_PHOTO_UNIQUE_ID;
+    if (key_is(k3, "width")) return UF_PHOTO_WIDTH;
+    if (key_is(k3, "height")) return UF_PHOTO_HEIGHT;
+    if (key_is(k3, "file_size")) return UF_PHOTO_SIZE;
+  }
+  return UF_NONE;
+}
+
+static bool want_update_string(const JsonStreamParser &p, void *user) {
+  return classify_field(p, *(const UpdateParseCtx *)user) != UF_NONE;
+}
+
+static void on_update_event(JsonStreamParser &p, JsonStreamEvent ev, const String &value,
+                            void *user) {
+  UpdateParseCtx &ctx = *(UpdateParseCtx *)user;
+
+  if (ev == JSON_EV_OBJECT_START || ev == JSON_EV_OBJECT_END) {
+    if (!at_update_root(p, ctx)) {
+      return;
+    }
+    if (ev == JSON_EV_OBJECT_START) {
+      ctx.update = TelegramUpdate();
+    } else if (ctx.update.update_id != 0) {
+      ctx.sink(ctx.update, ctx.user);
+      ctx.dispatched++;
+    }
     return;
   }
 
-  long long update_id = 0;
-  if (!extract_int64_after_key(body, "\"update_id\"", &update_id)) {
+  if (ev != JSON_EV_STRING && ev != JSON_EV_NUMBER) {
     return;
   }
-  if (update_id <= s_last_update_id) {
+
+  TelegramUpdate &u = ctx.update;
+  const UpdateField field = classify_field(p, ctx);
+  switch (field) {
+    case UF_NONE:
+      return;
+    case UF_UPDATE_ID:
+      u.update_id = atoll(value.c_str());
+      return;
+    case UF_MESSAGE_ID:
+      u.message_id = value;
+      return;
+    case UF_CHAT_ID:
+      u.chat_id = value;
+      return;
+    case UF_TEXT:
+      u.text = value;
+      u.text_is_caption = false;
+      return;
+    case UF_CAPTION:
+      if (u.text.length() == 0) {
+        u.text = value;
+        u.text_is_caption = true;
+      }
+      return;
+    case UF_DOC_FILE_ID:
+      u.document_file_id = value;
+      return;
+    case UF_DOC_UNIQUE_ID:
+      u.document_unique_id = value;
+      return;
+    case UF_DOC_NAME:
+      u.document_name = value;
+      return;
+    case UF_DOC_MIME:
+      u.document_mime = value;
+      return;
+    case UF_DOC_SIZE:
+      u.document_size = value.toInt();
+      return;
+    case UF_REPLY_ID:
+      u.reply_to_message_id = value;
+      return;
+    case UF_REPLY_TEXT:
+      u.reply_text = value;
+      return;
+    default:
+      break;
+  }
+
+  // Photo sizes: result.N.message.photo.<i>.<field>
+  const int idx = p.index_at(ctx.base + 2);
+  if (idx < 0 || idx >= TELEGRAM_MAX_PHOTO_SIZES) {
     return;
   }
+  if (idx + 1 > u.photo_count) {
+    u.photo_count = idx + 1;
+  }
+  TelegramPhotoSize &ph = u.photos[idx];
+  switch (field) {
+    case UF_PHOTO_FILE_ID: ph.file_id = value; break;
+    case UF_PHOTO_UNIQUE_ID: ph.file_unique_id = value; break;
+    case UF_PHOTO_WIDTH: ph.width = (int)value.toInt(); break;
+    case UF_PHOTO_HEIGHT: ph.height = (int)value.toInt(); break;
+    case UF_PHOTO_SIZE: ph.file_size = value.toInt(); break;
+    default: break;
+  }
+}
+
+// Photo sizes arrive smallest first; the second one (~320px) is plenty for
+// vision models and keeps downloads small.
+static const TelegramPhotoSize *pick_photo_size(const TelegramUpdate &u) {
+  if (u.photo_count <= 0) {
+    return nullptr;
+  }
+  const int idx = u.photo_count >= 2 ? 1 : 0;
+  return u.photos[idx].file_id.length() > 0 ? &u.photos[idx] : nullptr;
+}
+
+}  // namespace
 
-  String chat_id;
-  if (!extract_chat_id(body, chat_id)) {
+// Handles a single decoded update.
+static void process_update(const TelegramUpdate &update, incoming_cb_t cb) {
+  if (update.chat_id.length() == 0) {
+    // callback_query, my_chat_member, etc. - nothing to dispatch
     return;
   }
 
-  if (chat_id != String(TELEGRAM_ALLOWED_CHAT_ID)) {
+  if (update.chat_id != String(TELEGRAM_ALLOWED_CHAT_ID)) {
     Serial.println("[tg] rejected message from non-allowlisted chat");
-    s_last_update_id = update_id;
     return;
   }
 
-  String photo_file_id;
-  if (extract_last_photo_file_id(body, photo_file_id) && photo_file_id.length() > 0) {
-    s_last_photo_file_id = photo_file_id;
-    s_last_photo_mime = "image/jpeg";
-    Serial.println("[tg] cached last photo file id");
+  const TelegramPhotoSize *photo = pick_photo_size(update);
+  state_lock();
+  if (photo != nullptr) {
+    s_last_photo.file_id = photo->file_id;
+    s_last_photo.unique_id = photo->file_unique_id;
+    s_last_photo.mime = "image/jpeg";
   }
+  if (update.document_file_id.length() > 0) {
+    s_last_document.file_id = update.document_file_id;
+    s_last_document.unique_id = update.document_unique_id;
+    s_last_document.name = update.document_name;
+    s_last_document.mime = update.document_mime;
+  }
+  s_last_chat_id = update.chat_id;
+  state_unlock();
 
-  String doc_file_id;
-  String doc_name;
-  String doc_mime;
-  if (extract_document_meta(body, doc_file_id, doc_name, doc_mime) && doc_file_id.length() > 0) {
-    s_last_document_file_id = doc_file_id;
-    s_last_document_name = doc_name;
-    s_last_document_mime = doc_mime;
+  if (photo != nullptr) {
+    Serial.println("[tg] cached last photo file id");
+  }
+  if (update.document_file_id.length() > 0) {
     Serial.println("[tg] cached last document file id");
   }
 
-  String text;
-  const bool has_text = extract_text_field(body, text);
-
-  s_last_chat_id = chat_id;
-  s_last_update_id = update_id;
-
-  if (has_text) {
-    cb(text);
-  } else if (photo_file_id.length() > 0) {
+  if (update.text.length() > 0) {
+    cb(update.text);
+  } else if (photo != nullptr) {
     // Auto-analyze: photo sent without caption
     Serial.println("[tg] auto-analyze: photo without caption");
     cb("describe this photo");
-  } else if (doc_file_id.length() > 0) {
+  } else if (update.document_file_id.length() > 0) {
     // Auto-analyze: document sent without caption
     Serial.println("[tg] auto-analyze: document without caption");
     cb("summarize this document");
   }
 }
 
-namespace {
+// Returns false for an update that was already seen (Telegram redelivers
+// webhook updates that were not acknowledged in time).
+static bool claim_update_id(long long update_id) {
+  bool fresh = false;
+  portENTER_CRITICAL(&s_update_mux);
+  if (update_id > s_last_update_id) {
+    s_last_update_id = update_id;
+    fresh = true;
+  }
+  portEXIT_CRITICAL(&s_update_mux);
+  return fresh;
+}
 
-static int base64_char_value(char c) {
-  if (c >= 'A' && c <= 'Z') return c - 'A';
-  if (c >= 'a' && c <= 'z') return c - 'a' + 26;
-  if (c >= '0' && c <= '9') return c - '0' + 52;
-  if (c == '+') return 62;
-  if (c == '/') return 63;
-  return -1;
+static void poll_update_sink(const TelegramUpdate &update, void *user) {
+  // Advance before dispatching so a rejected or unparseable update is
+  // acknowledged with the rest of the batch on the next request.
+  if (!claim_update_id(update.update_id)) {
+    return;
+  }
+  process_update(update, *(incoming_cb_t *)user);
 }
 
-static size_t base64_decode(const String &input, uint8_t *output, size_t output_size) {
-  size_t input_len = input.length();
-  size_t output_index = 0;
+// Runs queued webhook updates on the polling task, so dispatch never
+// happens on the web server's thread.
+static void drain_webhook_updates(incoming_cb_t cb) {
+  if (s_webhook_queue == NULL) {
+    return;
+  }
+  TelegramUpdate *update = nullptr;
+  while (xQueueReceive(s_webhook_queue, &update, 0) == pdTRUE) {
+    process_update(*update, cb);
+    delete update;
+  }
+}
 
-  for (size_t i = 0; i < input_len && output_index < output_size; i += 4) {
-    int values[4];
-    int valid_count = 0;
+void transport_telegram_poll(incoming_cb_t cb) {
+  if (cb == nullptr) {
+    return;
+  }
+  drain_webhook_updates(cb);
 
-    for (int j = 0; j < 4 && (i + j) < input_len; j++) {
-      char c = input[i + j];
-      if (c == '=') {
-        values[j] = 0;
-        valid_count++;
-      } else if (c == ' ' || c == '\n' || c == '\r' || c == '\t') {
-        continue;
-      } else {
-        int val = base64_char_value(c);
-        if (val < 0) continue;
-        values[j] = val;
-        valid_count++;
-      }
+  // Long polling blocks inside getUpdates, so only throttle in short-poll
+  // mode or after a failed request.
+  static unsigned long s_poll_interval_ms = TELEGRAM_POLL_MS;
+  if ((millis() - s_last_poll_ms) < s_poll_interval_ms) {
+    return;
+  }
+  s_last_poll_ms = millis();
+  s_poll_interval_ms = TELEGRAM_POLL_MS;
+
+  if (!is_wifi_ready()) {
+    ensure_wifi();
+    return;
+  }
+
+  const String url = String("https://api.telegram.org/bot") + TELEGRAM_BOT_TOKEN +
+                     "/getUpdates?timeout=" + String(TELEGRAM_LONG_POLL_S) +
+                     "&limit=" + String(TELEGRAM_POLL_BATCH_LIMIT) +
+                     "&offset=" + String(s_last_update_id + 1);
+
+  // The read timeout must outlast the server-side wait or every idle poll
+  // would be reported as a timeout.
+  const uint16_t read_timeout_ms =
+      TELEGRAM_LONG_POLL_S > 0 ? (uint16_t)((TELEGRAM_LONG_POLL_S + 10) * 1000UL) : 20000;
+
+  // The body is parsed as it streams in; updates are dispatched one by one
+  // without ever holding the whole batch in memory.
+  UpdateParseCtx ctx;
+  ctx.root_key = "result";
+  ctx.base = 2;
+  ctx.sink = poll_update_sink;
+  ctx.user = &cb;
+  ctx.dispatched = 0;
+
+  JsonStreamParser parser;
+  parser.begin(on_update_event, want_update_string, &ctx, kMaxUpdateStringBytes);
+
+  int code = -1;
+  for (int attempt = 0; attempt < 2; attempt++) {
+    HttpPoolLease lease;
+    if (!http_pool_acquire(url, lease)) {
+      break;
+    }
+    lease.http->setConnectTimeout(12000);
+    lease.http->setTimeout(read_timeout_ms);
+
+    code = lease.http->GET();
+    bool body_ok = false;
+    if (code == 200) {
+      body_ok = lease.http->writeToStream(&parser) >= 0;
+    } else if (code > 0) {
+      lease.http->getString();
+      body_ok = true;
     }
 
-    if (valid_count >= 2) {
-      if (output_index < output_size) {
-        output[output_index++] = (values[0] << 2) | ((values[1] & 0x30) >> 4);
-      }
-      if (valid_count >= 3 && output_index < output_size) {
-        output[output_index++] = ((values[1] & 0x0F) << 4) | ((values[2] & 0x3C) >> 2);
-      }
-      if (valid_count >= 4 && output_index < output_size) {
-        output[output_index++] = ((values[2] & 0x03) << 6) | values[3];
-      }
+    const bool retry = http_pool_should_retry(lease, code, "GET");
+    http_pool_release(lease, body_ok);
+    if (!retry) {
+      break;
     }
   }
 
-  return output_index;
+  if (code == 409) {
+    // A webhook is set; updates come in through the web server instead.
+    Serial.println("[tg] webhook active, polling paused");
+    s_poll_interval_ms = TELEGRAM_WEBHOOK_POLL_BACKOFF_MS;
+    return;
+  }
+  if (code != 200) {
+    Serial.printf("[tg] getUpdates failed code=%d\n", code);
+    return;
+  }
+  if (parser.failed()) {
+    Serial.println("[tg] malformed getUpdates body");
+  }
+  if (ctx.dispatched > 1) {
+    Serial.printf("[tg] processed %d updates in one batch\n", ctx.dispatched);
+  }
+  if (TELEGRAM_LONG_POLL_S > 0) {
+    s_poll_interval_ms = 0;
+  }
 }
 
-static size_t base64_decoded_size(const String &input) {
-  size_t len = input.length();
-  size_t padding = 0;
-  if (len > 0 && input[len - 1] == '=') padding++;
-  if (len > 1 && input[len - 2] == '=') padding++;
-  return (len * 3) / 4 - padding;
+static void webhook_update_sink(const TelegramUpdate &update, void *user) {
+  // Only this task enqueues, so a free slot checked here is still free below.
+  // A full queue leaves the update unclaimed for Telegram to redeliver.
+  if (s_webhook_queue == NULL || uxQueueSpacesAvailable(s_webhook_queue) == 0) {
+    *(bool *)user = false;
+    return;
+  }
+  if (!claim_update_id(update.update_id)) {
+    Serial.printf("[tg] webhook: duplicate update %lld ignored\n", update.update_id);
+    return;
+  }
+  TelegramUpdate *copy = new TelegramUpdate(update);
+  if (xQueueSend(s_webhook_queue, &copy, 0) != pdTRUE) {
+    delete copy;
+  }
 }
 
-static String base64_encode(const uint8_t *data, size_t len) {
-  static const char *alphabet =
-      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+bool transport_telegram_webhook_update(const char *body, size_t len, String &error_out) {
+  // Telegram redelivers anything not acknowledged, so a body that will
+  // never parse is logged and acknowledged rather than refused.
+  if (body == nullptr || len == 0) {
+    Serial.println("[tg] webhook: dropped empty update");
+    return true;
+  }
 
-  String out;
-  out.reserve(((len + 2) / 3) * 4);
+  bool queued = true;
+  UpdateParseCtx ctx;
+  ctx.root_key = nullptr;
+  ctx.base = 0;
+  ctx.sink = webhook_update_sink;
+  ctx.user = &queued;
+  ctx.dispatched = 0;
 
-  for (size_t i = 0; i < len; i += 3) {
-    const uint32_t b0 = data[i];
-    const uint32_t b1 = (i + 1 < len) ? data[i + 1] : 0;
-    const uint32_t b2 = (i + 2 < len) ? data[i + 2] : 0;
-    const uint32_t triple = (b0 << 16) | (b1 << 8) | b2;
+  JsonStreamParser parser;
+  parser.begin(on_update_event, want_update_string, &ctx, kMaxUpdateStringBytes);
+  parser.feed(body, len);
+  if (parser.failed() || !parser.done()) {
+    Serial.printf("[tg] webhook: dropped malformed update (%u bytes)\n", (unsigned)len);
+    return true;
+  }
+  if (!queued) {
+    error_out = "update queue full";
+    return false;
+  }
+  return true;
+}
 
-    out += alphabet[(triple >> 18) & 0x3F];
-    out += alphabet[(triple >> 12) & 0x3F];
-    out += (i + 1 < len) ? alphabet[(triple >> 6) & 0x3F] : '=';
-    out += (i + 2 < len) ? alphabet[triple & 0x3F] : '=';
+namespace {
+
+static int base64_char_value(char c) {
+  if (c >= 'A' && c <= 'Z') return c - 'A';
+  if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+  if (c >= '0' && c <= '9') return c - '0' + 52;
+  if (c == '+') return 62;
+  if (c == '/') return 63;
+  return -1;
+}
+
+// Incremental base64 decoder used as a MultipartStream generator, so an
+// upload never holds more than one socket-sized chunk of decoded bytes.
+struct Base64Source {
+  const char *data;
+  size_t len;
+  size_t in_pos;
+  size_t out_pos;
+  uint8_t pending[3];
+  int pending_len;
+  int pending_pos;
+};
+
+static void base64_source_begin(Base64Source &src, const String &input) {
+  src.data = input.c_str();
+  src.len = input.length();
+  src.in_pos = 0;
+  src.out_pos = 0;
+  src.pending_len = 0;
+  src.pending_pos = 0;
+}
+
+// Exact decoded length: whitespace and junk are skipped, '=' ends the data.
+static size_t base64_decoded_size(const String &input) {
+  size_t symbols = 0;
+  for (size_t i = 0; i < input.length(); i++) {
+    const char c = input[i];
+    if (c == '=') {
+      break;
+    }
+    if (base64_char_value(c) >= 0) {
+      symbols++;
+    }
   }
+  const size_t tail = symbols % 4;
+  return (symbols / 4) * 3 + (tail == 3 ? 2 : (tail == 2 ? 1 : 0));
+}
 
-  return out;
+static size_t base64_source_read(uint8_t *buf, size_t max_len, size_t offset, void *ctx) {
+  Base64Source &src = *(Base64Source *)ctx;
+  if (offset != src.out_pos) {
+    if (offset != 0) {
+      return 0;  // only sequential reads, or a restart after rewind()
+    }
+    src.in_pos = 0;
+    src.out_pos = 0;
+    src.pending_len = 0;
+    src.pending_pos = 0;
+  }
+
+  size_t n = 0;
+  while (n < max_len) {
+    if (src.pending_pos < src.pending_len) {
+      buf[n++] = src.pending[src.pending_pos++];
+      continue;
+    }
+
+    uint32_t acc = 0;
+    int got = 0;
+    while (got < 4 && src.in_pos < src.len) {
+      const char c = src.data[src.in_pos++];
+      if (c == '=') {
+        src.in_pos = src.len;
+        break;
+      }
+      const int val = base64_char_value(c);
+      if (val < 0) {
+        continue;
+      }
+      acc = (acc << 6) | (uint32_t)val;
+      got++;
+    }
+    if (got < 2) {
+      break;
+    }
+    for (int i = got; i < 4; i++) {
+      acc <<= 6;
+    }
+    src.pending[0] = (uint8_t)(acc >> 16);
+    src.pending[1] = (uint8_t)(acc >> 8);
+    src.pending[2] = (uint8_t)acc;
+    src.pending_len = got - 1;
+    src.pending_pos = 0;
+  }
+  src.out_pos += n;
+  return n;
 }
 
 static bool fetch_file_path_by_id(const String &file_id, String &path_out, String &error_out) {
@@ -670,110 +1105,97 @@ static bool fetch_file_path_by_id(const String &file_id, String &path_out, Strin
   return true;
 }
 
-static bool fetch_binary_file(const String &url, uint8_t **data_out, size_t *len_out,
-                              String &error_out) {
-  *data_out = nullptr;
-  *len_out = 0;
+// The one media stream currently handed out to a caller: a cached copy on
+// flash, or a download teed into the cache.
+static HttpPoolLease s_media_lease;
+static fs::File s_media_file;
+static MediaCacheTee s_media_tee;
+static bool s_media_open = false;
+static bool s_media_from_cache = false;
+static portMUX_TYPE s_media_mux = portMUX_INITIALIZER_UNLOCKED;
+
+// Workers race for the one media slot; the winner holds it from the top of
+// media_open until media_close (or until media_open fails).
+static bool claim_media_slot() {
+  portENTER_CRITICAL(&s_media_mux);
+  const bool claimed = !s_media_open;
+  s_media_open = true;
+  portEXIT_CRITICAL(&s_media_mux);
+  return claimed;
+}
 
-  WiFiClientSecure client;
-  client.setInsecure();
+static void release_media_slot() {
+  portENTER_CRITICAL(&s_media_mux);
+  s_media_open = false;
+  portEXIT_CRITICAL(&s_media_mux);
+}
 
-  HTTPClient https;
-  if (!https.begin(client, url)) {
+static bool open_media_download(const String &url, size_t *len_out, String &error_out) {
+  HttpPoolLease &lease = s_media_lease;
+  if (!http_pool_acquire(url, lease)) {
     error_out = "HTTP begin failed";
     return false;
   }
+  lease.http->setConnectTimeout(12000);
+  lease.http->setTimeout(30000);
+  int code = lease.http->GET();
+  if (http_pool_should_retry(lease, code, "GET")) {
+    http_pool_release(lease, false);
+    if (!http_pool_acquire(url, lease)) {
+      error_out = "HTTP begin failed";
+      return false;
+    }
+    lease.http->setConnectTimeout(12000);
+    lease.http->setTimeout(30000);
+    code = lease.http->GET();
+  }
 
-  https.setConnectTimeout(12000);
-  https.setTimeout(30000);
-  const int code = https.GET();
   if (code < 200 || code >= 300) {
-    https.end();
+    http_pool_release(lease, false);
     error_out = "download HTTP " + String(code);
     return false;
   }
 
-  const int total = https.getSize();
+  const int total = lease.http->getSize();
   if (total <= 0) {
-    https.end();
+    http_pool_release(lease, false);
     error_out = "Unknown file size";
     return false;
   }
-  if ((size_t)total > kMaxMediaDownloadBytes) {
-    https.end();
-    error_out = "File too large for ESP32 (" + String(total) + " bytes)";
-    return false;
-  }
-
-  uint8_t *buffer = (uint8_t *)malloc((size_t)total);
-  if (!buffer) {
-    https.end();
-    error_out = "Out of memory downloading file";
-    return false;
-  }
-
-  WiFiClient *stream = https.getStreamPtr();
-  size_t offset = 0;
-  unsigned long start_ms = millis();
-  while (https.connected() && offset < (size_t)total) {
-    size_t avail = stream->available();
-    if (avail == 0) {
-      if ((millis() - start_ms) > 15000UL) {
-        break;
-      }
-      delay(2);
-      continue;
-    }
-    const size_t to_read = ((size_t)total - offset < avail) ? ((size_t)total - offset) : avail;
-    const int read_count = stream->readBytes(buffer + offset, to_read);
-    if (read_count <= 0) {
-      break;
-    }
-    offset += (size_t)read_count;
-  }
-
-  https.end();
-
-  if (offset != (size_t)total) {
-    free(buffer);
-    error_out = "Incomplete file download";
+  if ((size_t)total > MEDIA_MAX_BYTES) {
+    http_pool_release(lease, false);
+    error_out = "File too large (" + String(total) + " bytes, limit " + String(MEDIA_MAX_BYTES) + ")";
     return false;
   }
 
-  *data_out = buffer;
-  *len_out = offset;
+  *len_out = (size_t)total;
   return true;
 }
 
-static bool telegram_file_to_base64(const String &file_id, String &base64_out, String &error_out) {
-  String file_path;
-  if (!fetch_file_path_by_id(file_id, file_path, error_out)) {
-    return false;
-  }
-
-  const String file_url = String("https://api.telegram.org/file/bot") + TELEGRAM_BOT_TOKEN +
-                          "/" + file_path;
+}  // namespace
 
-  uint8_t *data = nullptr;
-  size_t len = 0;
-  if (!fetch_binary_file(file_url, &data, &len, error_out)) {
+bool transport_telegram_last_photo_info(String &mime_out) {
+  const LastMedia photo = last_media(false);
+  if (photo.file_id.length() == 0) {
     return false;
   }
+  mime_out = photo.mime.length() > 0 ? photo.mime : String("image/jpeg");
+  return true;
+}
 
-  base64_out = base64_encode(data, len);
-  free(data);
-
-  if (base64_out.length() == 0) {
-    error_out = "Failed to base64 encode file";
+bool transport_telegram_last_document_info(String &filename_out, String &mime_out) {
+  const LastMedia document = last_media(true);
+  if (document.file_id.length() == 0) {
     return false;
   }
+  filename_out = document.name;
+  mime_out = document.mime.length() > 0 ? document.mime : String("application/octet-stream");
   return true;
 }
 
-}  // namespace
-
-bool transport_telegram_get_last_photo_base64(String &mime_out, String &base64_out,
-                                              String &error_out) {
+// media_open with the slot already claimed.
+static bool open_media_claimed(bool document, Stream **stream_out, size_t *len_out,
+                               String &error_out) {
   if (!is_wifi_ready()) {
     ensure_wifi();
     if (!is_wifi_ready()) {
@@ -782,50 +1204,72 @@ bool transport_telegram_get_last_photo_base64(String &mime_out, String &base64_o
     }
   }
 
-  if (s_last_photo_file_id.length() == 0) {
-    error_out = "No recent photo found. Send a photo first.";
+  const LastMedia media = last_media(document);
+  const String &file_id = media.file_id;
+  if (file_id.length() == 0) {
+    error_out = document ? "No recent document found. Send a document first."
+                         : "No recent photo found. Send a photo first.";
     return false;
   }
 
-  if (!telegram_file_to_base64(s_last_photo_file_id, base64_out, error_out)) {
-    return false;
+  const String &unique_id = media.unique_id;
+  if (media_cache_open(unique_id, s_media_file, len_out)) {
+    Serial.println("[tg] media served from cache");
+    s_media_from_cache = true;
+    *stream_out = &s_media_file;
+    return true;
   }
 
-  mime_out = s_last_photo_mime;
-  if (mime_out.length() == 0) {
-    mime_out = "image/jpeg";
+  String file_path;
+  if (!fetch_file_path_by_id(file_id, file_path, error_out)) {
+    return false;
   }
+  const String file_url = String("https://api.telegram.org/file/bot") + TELEGRAM_BOT_TOKEN +
+                          "/" + file_path;
+  if (!open_media_download(file_url, len_out, error_out)) {
+    return false;
+  }
+
+  s_media_from_cache = false;
+  s_media_tee.begin(s_media_lease.http->getStreamPtr(), unique_id, *len_out);
+  *stream_out = &s_media_tee;
   return true;
 }
 
-bool transport_telegram_get_last_document_base64(String &filename_out, String &mime_out,
-                                                 String &base64_out, String &error_out) {
-  if (!is_wifi_ready()) {
-    ensure_wifi();
-    if (!is_wifi_ready()) {
-      error_out = "WiFi not connected";
-      return false;
-    }
-  }
-
-  if (s_last_document_file_id.length() == 0) {
-    error_out = "No recent document found. Send a document first.";
+bool transport_telegram_media_open(bool document, Stream **stream_out, size_t *len_out,
+                                   String &error_out) {
+  *stream_out = nullptr;
+  *len_out = 0;
+  if (!claim_media_slot()) {
+    error_out = "Another media download is in progress";
     return false;
   }
-
-  if (!telegram_file_to_base64(s_last_document_file_id, base64_out, error_out)) {
+  if (!open_media_claimed(document, stream_out, len_out, error_out)) {
+    release_media_slot();
     return false;
   }
+  return true;
+}
 
-  filename_out = s_last_document_name;
-  mime_out = s_last_document_mime;
-  if (mime_out.length() == 0) {
-    mime_out = "application/octet-stream";
+// Only the holder of the slot calls this, so the flag is read unlocked.
+void transport_telegram_media_close(bool complete) {
+  if (!s_media_open) {
+    return;
   }
-  return true;
+  if (s_media_from_cache) {
+    s_media_file.close();
+  } else {
+    s_media_tee.finish(complete);
+    // A partially read body leaves the connection mid-response; don't reuse it.
+    http_pool_release(s_media_lease, complete);
+  }
+  release_media_slot();
 }
 
 bool transport_telegram_send_photo_base64(const String &base64_data, const String &caption) {
+  // Photos go out directly; let queued text land first so order is kept.
+  telegram_outbox_wait_idle(kOutboxDrainMs);
+
   if (!is_wifi_ready()) {
     ensure_wifi();
     if (!is_wifi_ready()) {
@@ -834,77 +1278,28 @@ bool transport_telegram_send_photo_base64(const String &base64_data, const Strin
   }
 
   const size_t decoded_len = base64_decoded_size(base64_data);
-  if (decoded_len > 200000) {
-    Serial.println("[tg] Image too large, skipping");
+  if (decoded_len == 0 || decoded_len > kMaxPhotoUploadBytes) {
+    Serial.println("[tg] Image empty or over Telegram's photo limit, skipping");
     return false;
   }
 
-  uint8_t *binary_data = (uint8_t *)malloc(decoded_len);
-  if (!binary_data) {
-    Serial.println("[tg] Failed to allocate memory for photo");
-    return false;
-  }
-
-  const size_t actual_len = base64_decode(base64_data, binary_data, decoded_len);
-
-  String boundary = "----esp32photoboundary" + String((unsigned long)millis());
-
-  String headers;
-  headers.reserve(512);
-  headers += "--" + boundary + "\r\n";
-  headers += "Content-Disposition: form-data; name=\"chat_id\"\r\n\r\n";
-  headers += s_last_chat_id + "\r\n";
+  // Decoded bytes are produced chunk by chunk as HTTPClient writes the body.
+  Base64Source source;
+  base64_source_begin(source, base64_data);
 
+  MultipartStream body;
+  const String chat_id = last_chat_id();
+  body.add_field("chat_id", chat_id);
   if (caption.length() > 0) {
-    headers += "--" + boundary + "\r\n";
-    headers += "Content-Disposition: form-data; name=\"caption\"\r\n\r\n";
-    headers += caption + "\r\n";
-  }
-
-  headers += "--" + boundary + "\r\n";
-  headers += "Content-Disposition: form-data; name=\"photo\"; filename=\"generated.png\"\r\n";
-  headers += "Content-Type: image/png\r\n\r\n";
-
-  String footer = "\r\n--" + boundary + "--\r\n";
-
-  const size_t total_size = headers.length() + actual_len + footer.length();
-
-  uint8_t *payload = (uint8_t *)malloc(total_size);
-  if (!payload) {
-    free(binary_data);
-    Serial.println("[tg] Failed to allocate memory for photo payload");
-    return false;
+    body.add_field("caption", caption);
   }
-
-  size_t offset = 0;
-  memcpy(payload + offset, headers.c_str(), headers.length());
-  offset += headers.length();
-  memcpy(payload + offset, binary_data, actual_len);
-  offset += actual_len;
-  memcpy(payload + offset, footer.c_str(), footer.length());
-
-  free(binary_data);
+  body.add_file("photo", "generated.png", "image/png", decoded_len, base64_source_read, &source);
 
   const String url = String("https://api.telegram.org/bot") + TELEGRAM_BOT_TOKEN + "/sendPhoto";
-  WiFiClientSecure client;
-  client.setInsecure();
-
-  HTTPClient https;
-  if (!https.begin(client, url)) {
-    free(payload);
-    return false;
-  }
-
-  https.setConnectTimeout(12000);
-  https.setTimeout(30000);
-  https.addHeader("Content-Type", "multipart/form-data; boundary=" + boundary);
-
-  const int code = https.POST(payload, total_size);
-  free(payload);
+  const int code = https_post_stream(url, body, nullptr, 30000);
 
   Serial.print("[tg] sendPhoto code=");
   Serial.println(code);
 
-  https.end();
   return code >= 200 && code < 300;
 }
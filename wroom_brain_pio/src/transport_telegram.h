@@ -2,23 +2,95 @@
 #define TRANSPORT_TELEGRAM_H
 
 #include <Arduino.h>
+#include <FS.h>
 
 typedef void (*incoming_cb_t)(const String &msg);
 
+#ifndef TELEGRAM_MAX_PHOTO_SIZES
+#define TELEGRAM_MAX_PHOTO_SIZES 4
+#endif
+
+struct TelegramPhotoSize {
+  String file_id;
+  String file_unique_id;
+  int width = 0;
+  int height = 0;
+  long file_size = 0;
+};
+
+// One update as decoded by the streaming parser. Only message-like updates
+// (message, edited_message, channel_post, edited_channel_post) are filled in.
+struct TelegramUpdate {
+  long long update_id = 0;
+  String chat_id;
+  String message_id;
+  String text;  // message text, or the caption for media
+  bool text_is_caption = false;
+
+  TelegramPhotoSize photos[TELEGRAM_MAX_PHOTO_SIZES];
+  int photo_count = 0;
+
+  String document_file_id;
+  String document_unique_id;
+  String document_name;
+  String document_mime;
+  long document_size = 0;
+
+  // Message being replied to, if any
+  String reply_to_message_id;
+  String reply_text;
+};
+
 void transport_telegram_init();
 void transport_telegram_poll(incoming_cb_t cb);
+// Parses one Update object POSTed to the webhook route and queues it; the
+// next transport_telegram_poll() call dispatches it. Updates already seen
+// (by update_id, shared with the poller) are acknowledged but not queued.
+// Empty or malformed bodies are logged and dropped. Returns false only when
+// the queue is full, so the caller should have Telegram redeliver.
+bool transport_telegram_webhook_update(const char *body, size_t len, String &error_out);
+// Queued through the outbox; send_document returns true once accepted.
 void transport_telegram_send(const String &msg);
-bool transport_telegram_send_document(const String &filename, const String &content,
+// Pass content with std::move when the caller no longer needs it.
+bool transport_telegram_send_document(const String &filename, String content,
                                       const String &mime_type, const String &caption);
+// Sends a stored file (e.g. under /projects) streamed from flash.
+bool transport_telegram_send_file(const String &path, const String &mime_type,
+                                  const String &caption);
+
+// Synchronous sends used by the outbox task. Return the HTTP status code
+// (<= 0 on connection errors) and optionally the response body.
+int transport_telegram_post_message(const String &chat_id, const String &text,
+                                    String *response_out);
+int transport_telegram_post_document(const String &chat_id, const String &filename,
+                                     const String &content, const String &mime_type,
+                                     const String &caption, String *response_out);
+int transport_telegram_post_document_file(const String &chat_id, fs::File &file,
+                                          const String &filename, const String &mime_type,
+                                          const String &caption, String *response_out);
+int transport_telegram_post_file(const String &chat_id, const String &path, const String &mime_type,
+                                 const String &caption, String *response_out, String &error_out);
 bool transport_telegram_send_document_base64(const String &filename, const String &base64_content,
                                              const String &mime_type, const String &caption);
-bool transport_telegram_get_last_photo_base64(String &mime_out, String &base64_out, String &error_out);
-bool transport_telegram_get_last_document_base64(String &filename_out, String &mime_out,
-                                                 String &base64_out, String &error_out);
+
+// Most recent photo/document received, if any
+bool transport_telegram_last_photo_info(String &mime_out);
+bool transport_telegram_last_document_info(String &filename_out, String &mime_out);
+
+// Streaming download of the most recent photo (document=false) or document.
+// The body is read straight off the socket; only one download can be open at
+// a time and it must be closed with transport_telegram_media_close().
+bool transport_telegram_media_open(bool document, Stream **stream_out, size_t *len_out,
+                                   String &error_out);
+void transport_telegram_media_close(bool complete);
 bool transport_telegram_send_photo_base64(const String &base64_data, const String &caption);
 
-// Streaming support
+// Streaming support: start sends a message right away and returns its id
+// ("" on failure); edits are queued, and a newer edit to the same message
+// supersedes one still waiting.
 String transport_telegram_send_streaming_start(const String &initial_msg);
 bool transport_telegram_send_streaming_edit(const String &message_id, const String &new_text);
+int transport_telegram_post_edit(const String &chat_id, const String &message_id,
+                                 const String &text, String *response_out);
 
 #endif
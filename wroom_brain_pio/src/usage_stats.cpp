@@ -2,6 +2,8 @@
 
 #include <Arduino.h>
 #include <Preferences.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
 #include "event_log.h"
 
 namespace {
@@ -24,10 +26,31 @@ struct UsageStats {
   uint32_t route_calls;
   uint32_t media_calls;
   uint32_t other_calls;
+  // Token counts, for the replies whose provider reported them
+  uint32_t token_replies;
+  uint32_t input_tokens;       // includes cached and cache-write tokens
+  uint32_t output_tokens;
+  uint32_t cached_tokens;      // prompt prefix read from the provider's cache
+  uint32_t cache_write_tokens;
 };
 
 static UsageStats s_stats = {};
 static bool s_loaded = false;
+// Every agent worker records calls; the mutex is created in usage_init(),
+// before the workers start.
+static SemaphoreHandle_t s_mutex = NULL;
+
+void lock_stats() {
+  if (s_mutex != NULL) {
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+  }
+}
+
+void unlock_stats() {
+  if (s_mutex != NULL) {
+    xSemaphoreGive(s_mutex);
+  }
+}
 
 void load_stats() {
   if (s_loaded) {
@@ -58,6 +81,12 @@ void load_stats() {
   s_stats.media_calls = prefs.getUInt("media", 0);
   s_stats.other_calls = prefs.getUInt("other", 0);
 
+  s_stats.token_replies = prefs.getUInt("tok_replies", 0);
+  s_stats.input_tokens = prefs.getUInt("tok_in", 0);
+  s_stats.output_tokens = prefs.getUInt("tok_out", 0);
+  s_stats.cached_tokens = prefs.getUInt("tok_cached", 0);
+  s_stats.cache_write_tokens = prefs.getUInt("tok_cwrite", 0);
+
   prefs.end();
   s_loaded = true;
 }
@@ -85,16 +114,28 @@ void save_stats() {
   prefs.putUInt("media", s_stats.media_calls);
   prefs.putUInt("other", s_stats.other_calls);
 
+  prefs.putUInt("tok_replies", s_stats.token_replies);
+  prefs.putUInt("tok_in", s_stats.input_tokens);
+  prefs.putUInt("tok_out", s_stats.output_tokens);
+  prefs.putUInt("tok_cached", s_stats.cached_tokens);
+  prefs.putUInt("tok_cwrite", s_stats.cache_write_tokens);
+
   prefs.end();
 }
 
 }  // namespace
 
 void usage_init() {
+  if (s_mutex == NULL) {
+    s_mutex = xSemaphoreCreateMutex();
+  }
+  lock_stats();
   load_stats();
+  unlock_stats();
 }
 
 void usage_record_call(const char *call_type, int http_status, const char *provider, const char *model) {
+  lock_stats();
   load_stats();
 
   s_stats.total_calls++;
@@ -138,68 +179,102 @@ void usage_record_call(const char *call_type, int http_status, const char *provi
   }
 
   save_stats();
+  unlock_stats();
+}
+
+void usage_record_tokens(uint32_t input_tokens, uint32_t output_tokens, uint32_t cached_tokens,
+                         uint32_t cache_write_tokens) {
+  lock_stats();
+  load_stats();
+  s_stats.token_replies++;
+  s_stats.input_tokens += input_tokens;
+  s_stats.output_tokens += output_tokens;
+  s_stats.cached_tokens += cached_tokens;
+  s_stats.cache_write_tokens += cache_write_tokens;
+  unlock_stats();
 }
 
 void usage_record_error(int http_status) {
+  lock_stats();
   load_stats();
   if (http_status == 429) {
     s_stats.rate_limited++;
   }
   save_stats();
+  unlock_stats();
 }
 
 void usage_get_report(String &out) {
+  lock_stats();
   load_stats();
+  const UsageStats stats = s_stats;
+  unlock_stats();
 
   out = "📊 Usage Statistics\n\n";
 
   // Call summary
   out += "Calls:\n";
-  out += "  Total: " + String(s_stats.total_calls) + "\n";
-  out += "  Success: " + String(s_stats.successful_calls) + "\n";
-  out += "  Failed: " + String(s_stats.failed_calls) + "\n";
+  out += "  Total: " + String(stats.total_calls) + "\n";
+  out += "  Success: " + String(stats.successful_calls) + "\n";
+  out += "  Failed: " + String(stats.failed_calls) + "\n";
 
-  if (s_stats.rate_limited > 0) {
-    out += "  ⚠️ Rate limited (429): " + String(s_stats.rate_limited) + "\n";
+  if (stats.rate_limited > 0) {
+    out += "  ⚠️ Rate limited (429): " + String(stats.rate_limited) + "\n";
   }
 
   // Call breakdown
   out += "\nBy type:\n";
-  if (s_stats.chat_calls > 0) {
-    out += "  Chat: " + String(s_stats.chat_calls) + "\n";
+  if (stats.chat_calls > 0) {
+    out += "  Chat: " + String(stats.chat_calls) + "\n";
   }
-  if (s_stats.image_calls > 0) {
-    out += "  Image: " + String(s_stats.image_calls) + "\n";
+  if (stats.image_calls > 0) {
+    out += "  Image: " + String(stats.image_calls) + "\n";
   }
-  if (s_stats.route_calls > 0) {
-    out += "  Route: " + String(s_stats.route_calls) + "\n";
+  if (stats.route_calls > 0) {
+    out += "  Route: " + String(stats.route_calls) + "\n";
   }
-  if (s_stats.media_calls > 0) {
-    out += "  Media: " + String(s_stats.media_calls) + "\n";
+  if (stats.media_calls > 0) {
+    out += "  Media: " + String(stats.media_calls) + "\n";
   }
-  if (s_stats.other_calls > 0) {
-    out += "  Other: " + String(s_stats.other_calls) + "\n";
+  if (stats.other_calls > 0) {
+    out += "  Other: " + String(stats.other_calls) + "\n";
+  }
+
+  // Tokens and prompt cache hit rate
+  if (stats.token_replies > 0) {
+    out += "\nTokens (" + String(stats.token_replies) + " replies):\n";
+    out += "  Input: " + String(stats.input_tokens) + "\n";
+    if (stats.cached_tokens > 0 && stats.input_tokens > 0) {
+      const int hit_pct = (int)((stats.cached_tokens * 100.0f) / stats.input_tokens);
+      out += "  Cached: " + String(stats.cached_tokens) + " (" + String(hit_pct) + "%)\n";
+    }
+    if (stats.cache_write_tokens > 0) {
+      out += "  Cache writes: " + String(stats.cache_write_tokens) + "\n";
+    }
+    out += "  Output: " + String(stats.output_tokens) + "\n";
   }
 
   // Last call info
-  if (s_stats.last_provider[0] != '\0') {
+  if (stats.last_provider[0] != '\0') {
     out += "\nLast call:\n";
-    out += "  Type: " + String(s_stats.last_call_type) + "\n";
-    out += "  Provider: " + String(s_stats.last_provider) + "\n";
-    if (s_stats.last_model[0] != '\0') {
-      out += "  Model: " + String(s_stats.last_model) + "\n";
+    out += "  Type: " + String(stats.last_call_type) + "\n";
+    out += "  Provider: " + String(stats.last_provider) + "\n";
+    if (stats.last_model[0] != '\0') {
+      out += "  Model: " + String(stats.last_model) + "\n";
     }
   }
 
   // Success rate
-  if (s_stats.total_calls > 0) {
-    float success_rate = (s_stats.successful_calls * 100.0f) / s_stats.total_calls;
+  if (stats.total_calls > 0) {
+    float success_rate = (stats.successful_calls * 100.0f) / stats.total_calls;
     out += "\nSuccess rate: " + String((int)success_rate) + "%\n";
   }
 }
 
 void usage_reset() {
+  lock_stats();
   memset(&s_stats, 0, sizeof(s_stats));
   save_stats();
+  unlock_stats();
   event_log_append("USAGE: stats reset");
 }
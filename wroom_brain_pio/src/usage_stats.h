@@ -9,6 +9,11 @@ void usage_init();
 // Record an LLM API call
 void usage_record_call(const char *call_type, int http_status, const char *provider, const char *model);
 
+// Add the token counts one LLM reply reported. Kept in RAM and saved with
+// the next usage_record_call(), so a reply costs a single NVS write.
+void usage_record_tokens(uint32_t input_tokens, uint32_t output_tokens, uint32_t cached_tokens,
+                         uint32_t cache_write_tokens);
+
 // Record an error (429, 500, etc.)
 void usage_record_error(int http_status);
 
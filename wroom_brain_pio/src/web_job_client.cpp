@@ -7,6 +7,8 @@
 #include <WiFiClientSecure.h>
 
 #include "brain_config.h"
+#include "json_writer.h"
+#include "tls_session_cache.h"
 
 namespace {
 
@@ -28,39 +30,6 @@ String trim_right_slashes(String s) {
   return s;
 }
 
-String json_escape(const String &src) {
-  String out;
-  out.reserve(src.length() + 32);
-  for (size_t i = 0; i < src.length(); i++) {
-    const char c = src[i];
-    switch (c) {
-      case '\\':
-        out += "\\\\";
-        break;
-      case '"':
-        out += "\\\"";
-        break;
-      case '\n':
-        out += "\\n";
-        break;
-      case '\r':
-        out += "\\r";
-        break;
-      case '\t':
-        out += "\\t";
-        break;
-      default:
-        if ((unsigned char)c < 0x20) {
-          out += ' ';
-        } else {
-          out += c;
-        }
-        break;
-    }
-  }
-  return out;
-}
-
 bool extract_json_string_after(const String &body, const char *needle, String &out) {
   const int key = body.indexOf(needle);
   if (key < 0) {
@@ -163,7 +132,7 @@ bool duckduckgo_instant_search(const String &query, String &reply_out, String &e
   const String url = String("https://api.duckduckgo.com/?format=json&no_html=1&skip_disambig=1&q=") +
                      url_encode(query);
 
-  WiFiClientSecure client;
+  TlsSessionClient client;
   client.setInsecure();
 
   HTTPClient https;
@@ -248,12 +217,13 @@ bool tavily_search(const String &query, String &reply_out, String &error_out) {
   const String url = trim_right_slashes(base) + "/search";
 
   const int max_results = (WEB_SEARCH_RESULTS_MAX < 1) ? 1 : WEB_SEARCH_RESULTS_MAX;
-  const String body = String("{\"api_key\":\"") + json_escape(api_key) +
-                      "\",\"query\":\"" + json_escape(query) +
-                      "\",\"search_depth\":\"basic\",\"max_results\":" + String(max_results) +
-                      ",\"include_answer\":\"basic\"}";
+  const String max_results_str = String(max_results);
+  JsonBody body;
+  body.raw("{\"api_key\":").str(api_key).raw(",\"query\":").str(query);
+  body.raw(",\"search_depth\":\"basic\",\"max_results\":").raw(max_results_str);
+  body.raw(",\"include_answer\":\"basic\"}");
 
-  WiFiClientSecure client;
+  TlsSessionClient client;
   client.setInsecure();
 
   HTTPClient https;
@@ -266,7 +236,7 @@ bool tavily_search(const String &query, String &reply_out, String &error_out) {
   https.setTimeout(WEB_SEARCH_TIMEOUT_MS);
   https.addHeader("Content-Type", "application/json");
 
-  const int code = https.POST((uint8_t *)body.c_str(), body.length());
+  const int code = https.sendRequest("POST", &body, body.length());
   String resp_body;
   if (code > 0) {
     resp_body = https.getString();
@@ -356,10 +326,11 @@ bool web_job_run(const String &task, const String &timezone, String &reply_out,
   const String url = trim_right_slashes(endpoint) + "/run_job";
   const String api_key = String(WEB_JOB_API_KEY);
 
-  String body = String("{\"task\":\"") + json_escape(task) + "\",\"timezone\":\"" +
-                json_escape(timezone) + "\",\"device\":\"esp32\"}";
+  JsonBody body;
+  body.raw("{\"task\":").str(task).raw(",\"timezone\":").str(timezone);
+  body.raw(",\"device\":\"esp32\"}");
 
-  WiFiClientSecure client;
+  TlsSessionClient client;
   client.setInsecure();
 
   HTTPClient https;
@@ -377,7 +348,7 @@ bool web_job_run(const String &task, const String &timezone, String &reply_out,
     https.addHeader("X-API-Key", api_key);
   }
 
-  int code = https.POST((uint8_t *)body.c_str(), body.length());
+  int code = https.sendRequest("POST", &body, body.length());
   String resp_body;
   if (code > 0) {
     resp_body = https.getString();
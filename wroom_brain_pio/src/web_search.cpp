@@ -1,6 +1,8 @@
 #include "web_search.h"
 
 #include "brain_config.h"
+#include "json_writer.h"
+#include "tls_session_cache.h"
 #include <WiFi.h>
 #include <WiFiClientSecure.h>
 #include <HTTPClient.h>
@@ -10,9 +12,13 @@ static const int kMaxResults = 10;
 static const int kTimeoutMs = WEB_SEARCH_TIMEOUT_MS;
 
 // HTTP POST helper
-static String http_post(const String &url, const String &json_body, int *status_code,
+static String http_post(const String &url, JsonBody &json_body, int *status_code,
                         const String &header_name = "", const String &header_value = "") {
-  WiFiClientSecure client;
+  if (!json_body.ok()) {
+    if (status_code) *status_code = -1;
+    return String();
+  }
+  TlsSessionClient client;
   client.setInsecure();
 
   HTTPClient https;
@@ -28,7 +34,8 @@ static String http_post(const String &url, const String &json_body, int *status_
     https.addHeader(header_name, header_value);
   }
 
-  const int code = https.POST((uint8_t *)json_body.c_str(), json_body.length());
+  json_body.rewind();
+  const int code = https.sendRequest("POST", &json_body, json_body.length());
   if (status_code) *status_code = code;
 
   String body;
@@ -40,24 +47,6 @@ static String http_post(const String &url, const String &json_body, int *status_
   return body;
 }
 
-// JSON escape for API calls
-static String json_escape(const String &src) {
-  String out;
-  out.reserve(src.length() * 1.2);
-  for (size_t i = 0; i < src.length(); i++) {
-    const char c = src[i];
-    switch (c) {
-      case '"':  out += "\\\""; break;
-      case '\\': out += "\\\\"; break;
-      case '\n': out += "\\n"; break;
-      case '\r': out += "\\r"; break;
-      case '\t': out += "\\t"; break;
-      default:   out += c; break;
-    }
-  }
-  return out;
-}
-
 static String resolve_serper_key() {
   String key = String(SERPER_API_KEY);
   key.trim();
@@ -96,10 +85,9 @@ static bool search_serper(const String &query, const String &api_key,
   // Build Serper API request
   String url = "https://google.serper.dev/search";
 
-  String json = "{";
-  json += "\"q\":\"" + json_escape(query) + "\",";
-  json += "\"num\":" + String(kMaxResults);
-  json += "}";
+  const String num = String(kMaxResults);
+  JsonBody json;
+  json.raw("{\"q\":").str(query).raw(",\"num\":").raw(num).raw("}");
 
   Serial.println("[search] Serper request: " + url);
 
@@ -159,11 +147,10 @@ static bool search_tavily(const String &query, const String &api_key,
   if (!url.endsWith("/")) url += "/";
   url += "search";
 
-  String json = "{";
-  json += "\"api_key\":\"" + json_escape(api_key) + "\",";
-  json += "\"query\":\"" + json_escape(query) + "\",";
-  json += "\"max_results\":" + String(kMaxResults);
-  json += "}";
+  const String max_results = String(kMaxResults);
+  JsonBody json;
+  json.raw("{\"api_key\":").str(api_key).raw(",\"query\":").str(query);
+  json.raw(",\"max_results\":").raw(max_results).raw("}");
 
   Serial.println("[search] Tavily request: " + url);
 
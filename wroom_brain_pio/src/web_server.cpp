@@ -159,6 +159,64 @@ void handle_api_chat_send(AsyncWebServerRequest *request, uint8_t *data, size_t
 }
 
 
+// POST /tg/<secret>
+// Telegram webhook delivery. The body arrives in chunks and is collected in
+// request->_tempObject (freed by the request); the update is parsed once
+// complete.
+void handle_tg_webhook_body(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
+  if (index == 0) {
+    if (total == 0 || total > TELEGRAM_WEBHOOK_MAX_BODY) {
+      return;
+    }
+    request->_tempObject = malloc(total);
+  }
+  if (request->_tempObject == nullptr || index + len > total) {
+    return;
+  }
+  memcpy((uint8_t *)request->_tempObject + index, data, len);
+}
+
+// Constant-time compare, so response timing does not leak the secret.
+bool secret_matches(const String &given, const char *expected) {
+  const size_t n = strlen(expected);
+  uint8_t diff = given.length() == n ? 0 : 1;
+  for (size_t i = 0; i < n; i++) {
+    const char c = i < given.length() ? given[i] : 0;
+    diff |= (uint8_t)(c ^ expected[i]);
+  }
+  return diff == 0;
+}
+
+void handle_tg_webhook(AsyncWebServerRequest *request) {
+  AsyncWebHeader *token = request->getHeader("X-Telegram-Bot-Api-Secret-Token");
+  if (token == nullptr || !secret_matches(token->value(), TELEGRAM_WEBHOOK_SECRET)) {
+    Serial.println("[web] webhook: bad secret token");
+    request->send(401, "text/plain", "Unauthorized");
+    return;
+  }
+  // Only a transient failure gets a non-2xx status: Telegram redelivers
+  // those, and would redeliver a permanently bad update forever.
+  const size_t length = request->contentLength();
+  if (length == 0 || length > TELEGRAM_WEBHOOK_MAX_BODY) {
+    Serial.printf("[web] webhook: dropped update of %u bytes\n", (unsigned)length);
+    request->send(200, "application/json", "{\"ok\":true}");
+    return;
+  }
+  if (request->_tempObject == nullptr) {
+    Serial.println("[web] webhook: no memory for update body");
+    request->send(503, "text/plain", "Out of memory");
+    return;
+  }
+
+  String err;
+  if (!transport_telegram_webhook_update((const char *)request->_tempObject, length, err)) {
+    Serial.println("[web] webhook: " + err);
+    request->send(503, "text/plain", err);
+    return;
+  }
+  request->send(200, "application/json", "{\"ok\":true}");
+}
+
 // Handle static file requests (Fallback)
 void handle_static_file(AsyncWebServerRequest *request) {
   String path = request->url();
@@ -205,6 +263,13 @@ void web_server_init() {
   g_server->on("/api/chat", HTTP_POST, [](AsyncWebServerRequest *request){}, NULL, handle_api_chat_send);
   g_server->on("/api/chat", HTTP_GET, handle_api_chat_history);
 
+  // Telegram webhook (the secret is part of the path and sent as a header)
+  if (strlen(TELEGRAM_WEBHOOK_SECRET) > 0) {
+    const String hook_path = String("/tg/") + TELEGRAM_WEBHOOK_SECRET;
+    g_server->on(hook_path.c_str(), HTTP_POST, handle_tg_webhook, NULL, handle_tg_webhook_body);
+    Serial.println("[web] Telegram webhook route enabled");
+  }
+
   // Static
   g_server->onNotFound(handle_static_file);
 